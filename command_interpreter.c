@@ -18,22 +18,32 @@
   along with this software. If not, see <http://www.gnu.org/licenses/>.
   ================================================================== */ 
 #include <ctype.h>
+#include <stdlib.h>
 #include "command_interpreter.h"
 #include "rgb_platform_stm8s207.h"
 #include "uart.h"
 #include "scheduler.h"
 #include "eep.h"
+#include "kv.h"
 #include "pixel.h"
-#include "i2c_bb.h"
+#include "i2c_hw.h"
 #include "i2c_ds3231_bb.h"
+#include "profiler.h"
+#include "esp8266.h"
 
 extern  task_struct task_list[]; // struct with all tasks
 extern  uint8_t     max_tasks;
 extern  Time        dt;          // Struct with time and date values, updated every sec.
 extern  bool        dst_active;  // true = Daylight Saving Time active
 
-char    rs232_inbuf[UART_BUFLEN];     // buffer for RS232 commands
-uint8_t rs232_ptr = 0;                // index in RS232 buffer
+extern  line_buf    rx1_line;    // command lines received by UART1
+extern  line_buf    esp_cmdline; // command lines received over WiFi
+
+// All command ports, see command_task()
+cmd_port cmd_ports[CMD_PORTS] = {
+    {.name = "uart1", .in = &rx1_line   , .out = NULL    , .flush = NULL     },
+    {.name = "wifi" , .in = &esp_cmdline, .out = esp_putc, .flush = esp_flush}
+};
 
 extern  char    lk1[];      // Text for top horizontal line
 extern  uint8_t lk1c[];     // Colour for every character in lk1[]
@@ -48,21 +58,25 @@ extern  uint8_t lk2c[];     // Colour for every character in lk2[]
   ---------------------------------------------------------------------------*/
 void i2c_scan(enum I2C_CH ch)
 {
-    char    s[50]; // needed for printing to serial terminal
     uint8_t x = 0;
+    uint8_t err;
     int     i;     // Leave this as an int!
     
-    sprintf(s,"I2C[%1d]: ",ch);
-    uart1_printf(s); // print to UART1
+    uart1_printf("I2C[");
+    uart1_putu(ch, 1, ' ');
+    uart1_printf("]: "); // print to UART1
     for (i = 0x02; i < 0xff; i+=2)
     {
-        if (i2c_start_bb(ch,i) == I2C_ACK)
+        // send only the address, I2C_CH0 may use the I2C peripheral
+        if (ch == I2C_CH0) err = i2c_transfer(i, NULL, 0, NULL, 0);
+        else               err = i2c_xfer_bb(ch, i, NULL, 0, NULL, 0);
+        if (err == I2C_ACK)
         {
-            sprintf(s,"0x%0x ",i);
-            uart1_printf(s); // print to UART1
+            uart1_printf("0x");
+            uart1_puthex(i, 0);
+            uart1_printf(" "); // print to UART1
             x++;
         } // if
-        i2c_stop_bb(ch);
     } // for
     if (!x) 
     {
@@ -72,43 +86,99 @@ void i2c_scan(enum I2C_CH ch)
 } // i2c_scan()
 
 /*-----------------------------------------------------------------------------
-  Purpose  : Non-blocking RS232 command-handler via the USB port
-  Variables: -
-  Returns  : [NO_ERR, ERR_CMD, ERR_NUM, ERR_I2C]
+  Purpose  : Execute a command line or a binary command for a command port. 
+             All output of the command, including an error reply, goes to 
+             the port that sent the command.
+  Variables: p  : the command port
+             b  : the payload of a BIN_CMD frame, NULL = the line in p->cmd
+             len: the number of bytes in b
+  Returns  : [NO_ERR, ERR_CMD, ERR_NUM, ERR_I2C] or ack. value for command
   ---------------------------------------------------------------------------*/
-uint8_t rs232_command_handler(void)
+static uint8_t cmd_port_run(cmd_port *p, const uint8_t *b, uint8_t len)
 {
-  char    ch;
-  static uint8_t cmd_rcvd = 0;
-  
-  if (!cmd_rcvd && uart1_kbhit())
-  {     // A new character has been received
-        ch = uart1_getc(); // get character
-	switch (ch)
-	{
-            case '\r': break;
-            case '\n': cmd_rcvd  = 1;
-                       rs232_inbuf[rs232_ptr] = '\0';
-                       rs232_ptr = 0;
-                       break;
-            default  : if (rs232_ptr < UART_BUFLEN-1)
-			    rs232_inbuf[rs232_ptr++] = ch;
-		       else 
-                       {   // buffer is full
-                           cmd_rcvd = 1;
-                           rs232_inbuf[UART_BUFLEN-1] = '\0';
-                           rs232_ptr = 0; // remove input
-                       } // else
-                       break;
-	} // switch
-  } // if
-  if (cmd_rcvd)
-  {
-      cmd_rcvd = 0;
-      return execute_single_command(rs232_inbuf);
-  } // if
-  else return NO_ERR;
-} // rs232_command_handler()
+    uint8_t  rval;
+    uint32_t t0;
+    bool     nb;
+    putc_fn  prev;
+    char     *failed = p->cmd;
+    
+    prev = uart1_redirect(p->out);
+    t0   = millis();
+    if (b) rval = execute_binary_command(b, len, p->cmd);
+    else   rval = execute_command_line(p->cmd, &failed);
+    nb   = uart1_nonblock(true); // an error reply never waits
+    switch (rval)
+    {
+        case ERR_CMD: uart1_printf("Command Error\n"); 
+                      break;
+        case ERR_NUM: uart1_printf("Number Error (");
+                      if (b) 
+                      {
+                          uart1_printf("0x");
+                          uart1_puthex(b[0], 2); // opcode
+                      } // if
+                      else uart1_printf(failed); // can be UART_BUFLEN long
+                      uart1_printf(")\n");
+                      break;
+        default     : break; // ERR_I2C: do not print anything
+    } // switch
+    uart1_nonblock(nb);
+    uart1_redirect(prev);
+    p->ticks += millis() - t0;
+    p->n_cmd++;
+    if ((rval >= ERR_CMD) && (rval <= ERR_I2C)) p->n_err++;
+    if (p->flush) p->flush();
+    return rval;
+} // cmd_port_run()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : Non-blocking command-handler for one command port. An ISR
+             assembles the lines, a complete line is executed here.
+  Variables: p: the command port
+  Returns  : [NO_ERR, ERR_CMD, ERR_NUM, ERR_I2C] or ack. value for command
+  ---------------------------------------------------------------------------*/
+uint8_t cmd_port_handler(cmd_port *p)
+{
+    if (!line_get(p->in, p->cmd)) return NO_ERR;
+    return cmd_port_run(p, NULL, 0);
+} // cmd_port_handler()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : Execute a binary command (BIN_CMD frame) for a command port.
+  Variables: p  : the command port that sent the frame
+             b  : the payload of the frame: opcode and arguments
+             len: the number of bytes in b
+  Returns  : [NO_ERR, ERR_CMD, ERR_NUM, ERR_I2C] or ack. value for command
+  ---------------------------------------------------------------------------*/
+uint8_t cmd_port_binary(cmd_port *p, const uint8_t *b, uint8_t len)
+{
+    return cmd_port_run(p, b, len);
+} // cmd_port_binary()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : Print the statistics of a command port: commands executed,
+             errors and the mean execution time in ticks.
+  Variables: p: the command port
+  Returns  : -
+  ---------------------------------------------------------------------------*/
+void cmd_port_stats(cmd_port *p)
+{
+    uart1_printf(p->name);
+    uart1_printf(": ");
+    uart1_putu(p->n_cmd, 0, ' ');
+    uart1_printf(" cmd, ");
+    uart1_putu(p->n_err, 0, ' ');
+    uart1_printf(" err, ");
+    uart1_putu(p->ticks, 0, ' ');
+    uart1_printf(" ticks");
+    if (p->n_cmd)
+    {
+        uart1_printf(", ");
+        uart1_putu(p->ticks / p->n_cmd, 0, ' ');
+        uart1_printf(" ticks/cmd");
+    } // if
+    uart1_printf("\n");
+} // cmd_port_stats()
 
 /*-----------------------------------------------------------------------------
   Purpose  : list all tasks and send result to the UART or ETH
@@ -118,23 +188,79 @@ uint8_t rs232_command_handler(void)
 void list_all_tasks(void)
 {
     uint8_t index = 0;
-    char    s[50];
     
     //uart1_printf("Task-Name,T(ms),Stat,T(ms),M(ms)\n");
+    // Then: lateness, max. lateness, max. jitter (all in ticks) and missed periods
     //go through the active tasks
     if(task_list[index].Period != 0)
     {
         while ((index < MAX_TASKS) && (task_list[index].Period != 0))
         {
-            sprintf(s,"%s,%d,%x,%d,%d\n", task_list[index].Name, 
-                    task_list[index].Period  , task_list[index].Status, 
-                    task_list[index].Duration, task_list[index].Duration_Max);
-            uart1_printf(s);
+            uart1_printf(task_list[index].Name);
+            uart1_putc(',');
+            uart1_putu(task_list[index].Period, 0, ' ');
+            uart1_putc(',');
+            uart1_puthex(task_list[index].Status, 0);
+            uart1_putc(',');
+            uart1_putu(task_list[index].Duration, 0, ' ');
+            uart1_putc(',');
+            uart1_putu(task_list[index].Duration_Max, 0, ' ');
+            uart1_putc(',');
+            uart1_putu(task_list[index].Late, 0, ' ');
+            uart1_putc(',');
+            uart1_putu(task_list[index].Late_Max, 0, ' ');
+            uart1_putc(',');
+            uart1_putu(task_list[index].Jitter_Max, 0, ' ');
+            uart1_putc(',');
+            uart1_putu(task_list[index].Missed, 0, ' ');
+            uart1_printf("\n");
             index++;
         } // while
     } // if
 } // list_all_tasks()
 
+/*-----------------------------------------------------------------------------
+  Purpose  : list the profiler statistics of all ISRs and tasks as CSV and
+             send result to the UART. Times are in clock-cycles (24 MHz),
+             b0..b23 is the log2 histogram: bk counts 2^k <= cycles < 2^(k+1).
+  Variables: -
+ Returns   : -
+  ---------------------------------------------------------------------------*/
+void list_profiler(void)
+{
+    const char *isr_name[PROF_TASK0] = {"tim2","uart1_rx","uart1_tx","uart3_rx","uart3_tx"};
+    prof_struct p;
+    uint8_t     i, k;
+    
+    uart1_printf("name,n,min,mean,max");
+    for (k = 0; k < PROF_BINS; k++)
+    {
+        uart1_printf(",b");
+        uart1_putu(k, 0, ' ');
+    } // for k
+    uart1_printf("\n");
+    for (i = 0; i < PROF_SLOTS; i++)
+    {
+        if (!prof_get(i,&p)) continue; // no measurements
+        if (i < PROF_TASK0) uart1_printf(isr_name[i]);
+        else                uart1_printf(task_list[i - PROF_TASK0].Name);
+        uart1_putc(',');
+        uart1_putu(p.cnt, 0, ' ');
+        uart1_putc(',');
+        uart1_putu(p.min, 0, ' ');
+        uart1_putc(',');
+        uart1_putu(p.sum / p.cnt, 0, ' ');
+        uart1_putc(',');
+        uart1_putu(p.max, 0, ' ');
+        for (k = 0; k < PROF_BINS; k++)
+        {
+            uart1_putc(',');
+            uart1_putu(p.hist[k], 0, ' ');
+        } // for k
+        uart1_printf("\n");
+    } // for i
+} // list_profiler()
+
 /*-----------------------------------------------------------------------------
   Purpose  : This routine reads the time and date from the DS3231 RTC and 
              prints this info to the uart.
@@ -143,115 +269,426 @@ void list_all_tasks(void)
   ---------------------------------------------------------------------------*/
 void print_date_and_time(void)
 {
-    char s2[40]; // Used for printing to UART
-    uart1_printf("DS3231: ");
-    sprintf(s2," %d-%d-%d, %d:%d.%d",
-               dt.day , dt.mon, dt.year,
-               dt.hour, dt.min, dt.sec);
-    uart1_printf(s2);
-    sprintf(s2," dow:%d, dst:%d\n",
-               dt.dow, dst_active);
-    uart1_printf(s2);
+    uart1_printf("DS3231:  ");
+    uart1_putu(dt.day, 0, ' ');
+    uart1_putc('-');
+    uart1_putu(dt.mon, 0, ' ');
+    uart1_putc('-');
+    uart1_putu(dt.year, 0, ' ');
+    uart1_printf(", ");
+    uart1_putu(dt.hour, 0, ' ');
+    uart1_putc(':');
+    uart1_putu(dt.min, 0, ' ');
+    uart1_putc('.');
+    uart1_putu(dt.sec, 0, ' ');
+    uart1_printf(" dow:");
+    uart1_putu(dt.dow, 0, ' ');
+    uart1_printf(", dst:");
+    uart1_putu(dst_active, 0, ' ');
+    uart1_printf("\n");
 } // print_date_and_time()
 
 /*-----------------------------------------------------------------------------
-  Purpose: interpret commands which are received via the USB serial terminal:
+  Purpose  : This routine prints a baud-rate of a UART and the error of
+             the actual baud-rate, e.g. "UART1: 115200 Baud, err +0.16 %".
+  Variables: uart: [1,3]
+             baud: the baud-rate
+  Returns  : -
+  ---------------------------------------------------------------------------*/
+void print_baud(uint8_t uart, uint32_t baud)
+{
+    int16_t err = uart_baud_err(baud);
+    
+    uart1_printf("UART");
+    uart1_putu(uart, 0, ' ');
+    uart1_printf(": ");
+    uart1_putu(baud, 0, ' ');
+    if (err == BAUD_INVALID)
+    {
+        uart1_printf(" Baud, not possible\n");
+        return;
+    } // if
+    uart1_printf(" Baud, err ");
+    uart1_putc((err < 0) ? '-' : '+');
+    if (err < 0) err = -err;
+    uart1_putu(err / 100, 0, ' ');
+    uart1_putc('.');
+    uart1_putu(err % 100, 2, '0');
+    uart1_printf(" %\n");
+} // print_baud()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : Baud-rate commands B0, B1 and B2, see cmd_table[]
+  Variables: num: the command number
+             a  : the arguments
+  Returns  : NO_ERR or ERR_NUM
+  ---------------------------------------------------------------------------*/
+static uint8_t cmd_baud(uint8_t num, cmd_arg *a)
+{
+    switch (num)
+    {
+        case 0: // UART1, this reply is sent with the old baud-rate
+            print_baud(1, a->n);
+            if (!uart1_set_baud(a->n)) return ERR_NUM;
+            kv_write32(KV_BAUD1, a->n);
+            break;
+        case 1: // UART3
+            print_baud(3, a->n);
+            if (!uart3_set_baud(a->n)) return ERR_NUM;
+            kv_write32(KV_BAUD3, a->n);
+            break;
+        default: // Show baud-rates
+            print_baud(1, uart_get_baud(1));
+            print_baud(3, uart_get_baud(3));
+            break;
+    } // switch
+    return NO_ERR;
+} // cmd_baud()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : Date and time commands D0, D1 and D2, see cmd_table[]
+  Variables: num: the command number
+             a  : the arguments
+  Returns  : NO_ERR or ERR_NUM
+  ---------------------------------------------------------------------------*/
+static uint8_t cmd_date(uint8_t num, cmd_arg *a)
+{
+    switch (num)
+    {
+        case 0: // Set Date
+            uart1_printf("Date: ");
+            uart1_putu(a->v[0], 0, ' ');
+            uart1_putc('-');
+            uart1_putu(a->v[1], 0, ' ');
+            uart1_putc('-');
+            uart1_putu(a->v[2], 0, ' ');
+            uart1_printf("\n");
+            ds3231_setdate(a->v[0], a->v[1], a->v[2]); // write to DS3231 IC
+            break;
+        case 1: // Set Time
+            uart1_printf("Time: ");
+            uart1_putu(a->v[0], 0, ' ');
+            uart1_putc(':');
+            uart1_putu(a->v[1], 0, ' ');
+            uart1_putc(':');
+            uart1_putu(a->v[2], 0, ' ');
+            uart1_printf("\n");
+            ds3231_settime(a->v[0], a->v[1], a->v[2]); // write to DS3231 IC
+            break;
+        default: // Get Date & Time
+            print_date_and_time(); 
+            break;
+    } // switch
+    return NO_ERR;
+} // cmd_date()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : ESP8266 commands E0, E1 and E2, see cmd_table[]
+  Variables: num: the command number
+             a  : the arguments
+  Returns  : NO_ERR or ERR_NUM
+  ---------------------------------------------------------------------------*/
+static uint8_t cmd_esp(uint8_t num, cmd_arg *a)
+{
+    switch (num)
+    {
+        case 0 : // AT-command, e.g. E0 AT+CWJAP_DEF="ssid","pwd"
+                 if (!esp_raw(a->s)) return ERR_NUM;
+                 break;
+        case 1 : esp_stats();
+                 break;
+        default: esp_start();
+                 break;
+    } // switch
+    return NO_ERR;
+} // cmd_esp()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : System commands S0..S9, see cmd_table[]
+  Variables: num: the command number
+             a  : the arguments
+  Returns  : NO_ERR
+  ---------------------------------------------------------------------------*/
+static uint8_t cmd_system(uint8_t num, cmd_arg *a)
+{
+    uint16_t y;
+    uint8_t  i;
+    
+    switch (num)
+    {
+        case 0: // Ebrew revision
+            print_revision_nr(); // print revision number
+            break;
+        case 1: // EEPROM write statistics
+            eep_stats();
+            kv_stats();
+            break;
+        case 2: // List all I2C devices
+            i2c_scan(I2C_CH0);
+#if I2C_HW
+            i2c_hw_stats();
+#endif
+            break;
+        case 3: // List all tasks
+            list_all_tasks(); 
+            break;	
+        case 4: // List profiler statistics
+            list_profiler(); 
+            break;	
+        case 5: // CPU load
+            y = cpu_load();
+            uart1_printf("Load: ");
+            uart1_putu(y / 10, 0, ' ');
+            uart1_putc('.');
+            uart1_putu(y % 10, 0, ' ');
+            uart1_printf(" %\n");
+            break;	
+        case 6: // Reset statistics
+            reset_task_stats();
+            prof_reset();
+            break;	
+        case 7: // UART1 receive statistics
+            uart1_stats();
+            break;	
+        case 8: // Stream statistics
+            stream_stats();
+            break;	
+        default: // Command port statistics
+            for (i = 0; i < CMD_PORTS; i++) cmd_port_stats(&cmd_ports[i]);
+            break;	
+    } // switch
+    return NO_ERR;
+} // cmd_system()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : Text commands T0 and T1 for the lichtkrant, see cmd_table[]
+  Variables: num: the command number
+             a  : the arguments
+  Returns  : NO_ERR
+  ---------------------------------------------------------------------------*/
+static uint8_t cmd_text(uint8_t num, cmd_arg *a)
+{
+    if (num == 0)
+    {   // Text for top-level row
+        strcpy(lk1, a->s);
+        kv_write_string(KV_TEXT1, lk1);
+        color_text_input(lk1,lk1c);
+        kv_write(KV_COL1, lk1c, strlen(lk1));
+    } // if
+    else
+    {   // Text for bottom-level row
+        strcpy(lk2, a->s);
+        kv_write_string(KV_TEXT2, lk2);
+        color_text_input(lk2,lk2c);
+        kv_write(KV_COL2, lk2c, strlen(lk2));
+    } // else
+    return NO_ERR;
+} // cmd_text()
+
+/*-----------------------------------------------------------------------------
+  All commands. A text command is a letter, a number and (after one space)
+  the argument, e.g. "B0 115200". Several commands can be given in one line,
+  separated by CMD_SEP: "D0 17-10-2026;D1 12:30:00". An ARG_TEXT argument
+  takes the rest of the line, so it must be the last command of a line.
+  A BIN_CMD frame holds the opcode and the arguments in binary form.
+   - B0 x         : Set baud-rate of UART1 to x (9600..921600), stored in EEPROM
+     B1 x         : Set baud-rate of UART3 to x (9600..921600), stored in EEPROM
+     B2           : Show baud-rates and baud-rate errors of UART1 and UART3
+   - D0 dd-mm-yyyy: Set date of the DS3231
+     D1 hh:mm:ss  : Set time of the DS3231
+     D2           : Show date and time
+   - E0 x         : Send AT-command x to the ESP8266, responses are printed
+     E1           : ESP8266 status
+     E2           : Restart (initialise) the ESP8266
    - S0           : Ebrew hardware revision number (also disables delayed-start)
+     S1           : EEPROM write and kv store statistics
      S2           : List all connected I2C devices  
      S3           : List all tasks
- 
+     S4           : List profiler statistics (CSV, clock-cycles)
+     S5           : CPU load over the last 2 seconds
+     S6           : Reset task and profiler statistics
+     S7           : UART1 receive statistics
+     S8           : Binary frame (stream) statistics
+     S9           : Command port statistics (UART1, WiFi)
+   - T0 x         : Text x for the top row of the lichtkrant, stored in EEPROM
+     T1 x         : Text x for the bottom row of the lichtkrant, stored in EEPROM
+  ---------------------------------------------------------------------------*/
+const cmd_entry cmd_table[] = {
+    {'b', 0, 0x10, ARG_NUM , cmd_baud  },
+    {'b', 1, 0x11, ARG_NUM , cmd_baud  },
+    {'b', 2, 0x12, ARG_NONE, cmd_baud  },
+    {'d', 0, 0x20, ARG_DATE, cmd_date  },
+    {'d', 1, 0x21, ARG_DATE, cmd_date  },
+    {'d', 2, 0x22, ARG_NONE, cmd_date  },
+    {'e', 0, 0x30, ARG_TEXT, cmd_esp   },
+    {'e', 1, 0x31, ARG_NONE, cmd_esp   },
+    {'e', 2, 0x32, ARG_NONE, cmd_esp   },
+    {'s', 0, 0x40, ARG_NONE, cmd_system},
+    {'s', 1, 0x41, ARG_NONE, cmd_system},
+    {'s', 2, 0x42, ARG_NONE, cmd_system},
+    {'s', 3, 0x43, ARG_NONE, cmd_system},
+    {'s', 4, 0x44, ARG_NONE, cmd_system},
+    {'s', 5, 0x45, ARG_NONE, cmd_system},
+    {'s', 6, 0x46, ARG_NONE, cmd_system},
+    {'s', 7, 0x47, ARG_NONE, cmd_system},
+    {'s', 8, 0x48, ARG_NONE, cmd_system},
+    {'s', 9, 0x49, ARG_NONE, cmd_system},
+    {'t', 0, 0x50, ARG_TEXT, cmd_text  },
+    {'t', 1, 0x51, ARG_TEXT, cmd_text  }
+};
+#define CMD_ENTRIES (sizeof(cmd_table) / sizeof(cmd_entry))
+
+/*-----------------------------------------------------------------------------
+  Purpose  : Find a text command in cmd_table[]
+  Variables: s  : the command, e.g. "B0 115200"
+             arg: pointer to the argument in s is returned here
+             err: ERR_CMD (unknown letter) or ERR_NUM (unknown number) is
+                  returned here when the command is not found
+  Returns  : the table entry, NULL if not found
+  ---------------------------------------------------------------------------*/
+static const cmd_entry *find_command(char *s, char **arg, uint8_t *err)
+{
+    const cmd_entry *e;
+    char            c   = tolower(s[0]);
+    uint8_t         num = atoi(&s[1]); // convert number in command (until space is found)
+    
+    *err = ERR_CMD;
+    for (e = cmd_table; e < &cmd_table[CMD_ENTRIES]; e++)
+    {
+        if (e->letter == c)
+        {
+            *err = ERR_NUM;
+            if (e->num == num) break;
+        } // if
+    } // for e
+    if (e == &cmd_table[CMD_ENTRIES]) return NULL;
+    s++;
+    while (isdigit(*s)) s++;
+    if (*s == ' ') s++; // one space between command and argument
+    *arg = s;
+    return e;
+} // find_command()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : Interpret one text command, see cmd_table[] for all commands
   Variables: 
-          s: the string that contains the command from RS232 serial port 0
+          s: the string that contains the command, without CMD_SEP
   Returns  : [NO_ERR, ERR_CMD, ERR_NUM, ERR_I2C] or ack. value for command
   ---------------------------------------------------------------------------*/
 uint8_t execute_single_command(char *s)
 {
-   uint8_t  num  = atoi(&s[1]); // convert number in command (until space is found)
-   uint8_t  rval = NO_ERR;
-   char     s2[40]; // Used for printing to RS232 port
-   char     *s1;
-   uint8_t  d,m,h,sec;
-   uint16_t y;
+   const cmd_entry *e;
+   cmd_arg  a;
+   char     *p;
+   uint8_t  i, rval;
    const char sep[] = ":-.";
    
-   switch (tolower(s[0]))
+   if ((e = find_command(s, &p, &rval)) == NULL)
    {
-        case 'd': // Set Date, 1 = Get Date
-		 switch (num)
-		 {
-                    case 0: // Set Date
-			    s1 = strtok(&s[3],sep);
-                            d  = atoi(s1);
-                            s1 = strtok(NULL ,sep);
-                            m  = atoi(s1);
-                            s1 = strtok(NULL ,sep);
-                            y  = atoi(s1);
-                            sprintf(s2,"Date: %d-%d-%d\n",d,m,y);
-                            uart1_printf(s2);
-                            ds3231_setdate(d,m,y); // write to DS3231 IC
-                            break;
-                    case 1: // Set Time
-                            s1      = strtok(&s[3],sep);
-                            h       = atoi(s1);
-                            s1      = strtok(NULL ,sep);
-                            m       = atoi(s1);
-                            s1      = strtok(NULL ,sep);
-                            sec     = atoi(s1);
-                            sprintf(s2,"Time: %d:%d:%d\n",h,m,sec);
-                            uart1_printf(s2);
-                            ds3231_settime(h,m,sec); // write to DS3231 IC
-                            break;
-                    case 2: // Get Date & Time
-                            print_date_and_time(); 
-                            break;
-                   default: break;
-                 } // switch
-                 break;
+       if (rval == ERR_CMD)
+       {
+           uart1_printf("ERR.CMD["); // s can be UART_BUFLEN long
+           uart1_printf(s);
+           uart1_printf("]\n");
+       } // if
+       return rval;
+   } // if
+   switch (e->args)
+   {
+       case ARG_NUM : if (!isdigit(*p)) return ERR_NUM;
+                      a.n = atol(p);
+                      break;
+       case ARG_DATE: for (i = 0; i < 3; i++)
+                      {
+                          if (!isdigit(*p)) return ERR_NUM;
+                          a.v[i] = atoi(p);
+                          while (isdigit(*p)) p++;
+                          if ((i < 2) && (!*p || !strchr(sep, *p++))) return ERR_NUM;
+                      } // for i
+                      break;
+       case ARG_TEXT: a.s = p;
+                      break;
+       default      : break; // ARG_NONE
+   } // switch
+   rval = e->handler(e->num, &a);
+   return (rval == NO_ERR) ? CMD_ACK + e->num : rval;
+} // execute_single_command()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : Interpret a line with one or more commands, separated by CMD_SEP.
+             The commands are executed in order, until one returns an error.
+             An ARG_TEXT command takes the rest of the line.
+  Variables: s     : the line, it is modified (CMD_SEP is replaced by '\0')
+             failed: the command that returned an error is returned here
+  Returns  : the result of the last command executed, 
+             [NO_ERR, ERR_CMD, ERR_NUM, ERR_I2C] or ack. value for command
+  ---------------------------------------------------------------------------*/
+uint8_t execute_command_line(char *s, char **failed)
+{
+    const cmd_entry *e;
+    char    *next, *arg;
+    uint8_t rval = NO_ERR;
+    
+    while (*s)
+    {
+        while (*s == ' ') s++; // "S5; S3" is allowed
+        e    = find_command(s, &arg, &rval);
+        next = NULL;
+        if (!e || (e->args != ARG_TEXT))
+        {   // the command ends at CMD_SEP
+            next = strchr(s, CMD_SEP);
+            if (next) *next++ = '\0';
+        } // if
+        if (*s)
+        {
+            *failed = s;
+            rval    = execute_single_command(s);
+            if ((rval >= ERR_CMD) && (rval <= ERR_I2C)) break;
+        } // if
+        if (!next) break;
+        s = next;
+    } // while
+    return rval;
+} // execute_command_line()
 
-        case 's': // System commands
-               rval = 67 + num;
-               switch (num)
-               {
-                   case 0: // Ebrew revision
-                       print_revision_nr(); // print revision number
+/*-----------------------------------------------------------------------------
+  Purpose  : Interpret a binary command, the payload of a BIN_CMD frame: 
+             the opcode from cmd_table[] and the arguments:
+             ARG_NONE: -, ARG_NUM: 4 bytes, ARG_DATE: 3 x 2 bytes (MSB first)
+             ARG_TEXT: the remaining bytes, no '\0'.
+  Variables: b  : the payload
+             len: the number of bytes in b [1..UART_BUFLEN]
+             txt: buffer of UART_BUFLEN bytes for an ARG_TEXT argument
+  Returns  : [NO_ERR, ERR_CMD, ERR_NUM, ERR_I2C] or ack. value for command
+  ---------------------------------------------------------------------------*/
+uint8_t execute_binary_command(const uint8_t *b, uint8_t len, char *txt)
+{
+    const cmd_entry *e;
+    cmd_arg  a;
+    uint8_t  i, rval;
+    
+    for (e = cmd_table; e < &cmd_table[CMD_ENTRIES]; e++)
+    {
+        if (e->opcode == b[0]) break;
+    } // for e
+    if (e == &cmd_table[CMD_ENTRIES]) return ERR_CMD;
+    switch (e->args)
+    {
+        case ARG_NUM : if (len != 5) return ERR_NUM;
+                       a.n = ((uint32_t)b[1] << 24) | ((uint32_t)b[2] << 16) |
+                             ((uint16_t)b[3] << 8)  | b[4];
                        break;
-                   case 2: // List all I2C devices
-                       i2c_scan(I2C_CH0);
+        case ARG_DATE: if (len != 7) return ERR_NUM;
+                       for (i = 0; i < 3; i++) a.v[i] = ((uint16_t)b[2*i+1] << 8) | b[2*i+2];
                        break;
-                   case 3: // List all tasks
-                       list_all_tasks(); 
-                       break;	
-                   default: rval = ERR_NUM;
-                   break;
-               } // switch
-               break;
-               
-	   case 't': // Text input for lichtkrant
-               rval = 67 + num;
-               switch (num)
-               {
-                   case 0: // Text for top-level row
-                       strcpy(lk1,&s[3]);
-                       eep_write_string(EEP_TEXT1,lk1);
-                       color_text_input(lk1,lk1c);
-                       eep_write_string(EEP_COL1,(char *)lk1c);
+        case ARG_TEXT: if (len > UART_BUFLEN) return ERR_NUM;
+                       memcpy(txt, &b[1], len - 1);
+                       txt[len - 1] = '\0';
+                       a.s = txt;
                        break;
-                   case 1: // Text for bottom-level row
-                       strcpy(lk2,&s[3]);
-                       eep_write_string(EEP_TEXT2,lk2);
-                       color_text_input(lk2,lk2c);
-                       eep_write_string(EEP_COL2,(char *)lk2c);
+        default      : if (len != 1) return ERR_NUM; // ARG_NONE
                        break;
-                   default: rval = ERR_NUM;
-                   break;
-               } // switch
-               break;
-               
-	   default: 
-               rval = ERR_CMD;
-               sprintf(s2,"ERR.CMD[%s]\n",s);
-               uart1_printf(s2);
-               break;
-   } // switch
-   return rval;	
-} // execute_single_command()
\ No newline at end of file
+    } // switch
+    rval = e->handler(e->num, &a);
+    return (rval == NO_ERR) ? CMD_ACK + e->num : rval;
+} // execute_binary_command()
\ No newline at end of file
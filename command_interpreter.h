@@ -22,10 +22,58 @@
 #include "stm8_hw_init.h"
 #include "scheduler.h"
 #include "i2c_bb.h"
+#include "uart.h"
+
+#define CMD_PORTS (2) /* UART1 and WiFi (ESP8266 on UART3), see cmd_ports[] */
+#define CMD_SEP   (';') /* separates the commands in one line */
+#define CMD_ACK   (67)  /* a command returns CMD_ACK + its number when ok */
+
+// Argument types of a command, see cmd_table[]. Text / binary format:
+#define ARG_NONE  (0) /* no argument */
+#define ARG_NUM   (1) /* a number / 4 bytes, MSB first */
+#define ARG_DATE  (2) /* 3 numbers separated by ':', '-' or '.' / 3 x 2 bytes, MSB first */
+#define ARG_TEXT  (3) /* rest of the line, may contain CMD_SEP / the remaining bytes */
+
+// The arguments of a command, filled in by the parser
+typedef struct _cmd_arg
+{
+    uint32_t n;    // ARG_NUM
+    uint16_t v[3]; // ARG_DATE
+    char     *s;   // ARG_TEXT
+} cmd_arg;
+
+// An entry of the command table
+typedef struct _cmd_entry
+{
+    char    letter;  // first character of the command, lower-case
+    uint8_t num;     // number after the letter
+    uint8_t opcode;  // first payload byte of a BIN_CMD frame
+    uint8_t args;    // [ARG_NONE, ARG_NUM, ARG_DATE, ARG_TEXT]
+    uint8_t (*handler)(uint8_t num, cmd_arg *a); // returns NO_ERR or ERR_NUM
+} cmd_entry;
+
+// A command port: where command lines come from and where the replies go
+typedef struct _cmd_port
+{
+    const char *name;             // shown by the S9 command
+    line_buf   *in;               // command lines, filled by an ISR
+    putc_fn    out;               // reply sink, NULL = UART1
+    void       (*flush)(void);    // called after every command, may be NULL
+    char       cmd[UART_BUFLEN];  // the command being executed
+    uint16_t   n_cmd;             // commands executed
+    uint16_t   n_err;             // commands that returned an error
+    uint32_t   ticks;             // time spent executing commands, in ticks
+} cmd_port;
       
 void    i2c_scan(enum I2C_CH ch);
-uint8_t rs232_command_handler(void);
+uint8_t cmd_port_handler(cmd_port *p);
+uint8_t cmd_port_binary(cmd_port *p, const uint8_t *b, uint8_t len);
+void    cmd_port_stats(cmd_port *p);
 void    list_all_tasks(void);
+void    list_profiler(void);
+void    print_baud(uint8_t uart, uint32_t baud);
 uint8_t execute_single_command(char *s);
+uint8_t execute_command_line(char *s, char **failed);
+uint8_t execute_binary_command(const uint8_t *b, uint8_t len, char *txt);
 
 #endif
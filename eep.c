@@ -18,7 +18,200 @@
   You should have received a copy of the GNU General Public License
   along with this software.  If not, see <http://www.gnu.org/licenses/>.
   ================================================================== */ 
+#include <string.h>
 #include "eep.h"
+#include "uart.h"
+
+uint8_t  eep_buf[EEP_BLOCK];  // new contents of one block, see eep_start()
+uint16_t eep_bytes   = 0;     // bytes changed in the EEPROM
+uint16_t eep_prog[3] = {0};   // program cycles: byte, word and block programming
+uint16_t eep_skip    = 0;     // blocks not programmed, nothing changed
+
+eep_span eep_q[EEP_QLEN];     // write queue, see eep_write_block()
+uint8_t  eep_qbuf[EEP_QBUF];  // bytes of the spans in eep_q[]
+uint8_t  eep_qwr   = 0;       // free-running write index for eep_q[]
+uint8_t  eep_qrd   = 0;       // free-running read index for eep_q[]
+uint16_t eep_qin   = 0;       // index in eep_qbuf[] for the next span
+uint16_t eep_qused = 0;       // bytes in the queue, incl. the ones programmed now
+uint8_t  eep_n     = 0;       // bytes of the oldest span in the program cycle
+bool     eep_busy  = false;   // true = a program cycle is running
+
+/*-----------------------------------------------------------------------------
+  Purpose  : This function starts a program cycle of the STM8 EEPROM, it does
+             not wait until it is done (see eep_ready()). The EEPROM must be 
+             unlocked. The STM8S207 has read-while-write, so the program
+             continues to run from Flash, also with block programming.
+  Variables: dst : address in the EEPROM, aligned to the size of mode
+             src : the bytes to write
+             len : 1 (byte), EEP_WORD or EEP_BLOCK bytes
+             mode: [EEP_PRG_BYTE, EEP_PRG_WORD, EEP_PRG_BLOCK]
+  Returns  : -
+  ---------------------------------------------------------------------------*/
+static void eep_program(uint8_t *dst, const uint8_t *src, uint8_t len, uint8_t mode)
+{
+    FLASH_CR2  = mode;
+    FLASH_NCR2 = (uint8_t)~mode;
+    while (len--) *dst++ = *src++; // the last byte starts programming
+    eep_busy = true;
+} // eep_program()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : This function removes bytes from the oldest span in the queue.
+  Variables: n: the number of bytes, max. the length of the span
+  Returns  : -
+  ---------------------------------------------------------------------------*/
+static void eep_pop(uint8_t n)
+{
+    eep_span *e = &eep_q[eep_qrd & (EEP_QLEN - 1)];
+    
+    e->addr   += n;
+    e->ofs     = (e->ofs + n) & (EEP_QBUF - 1);
+    e->len    -= n;
+    eep_qused -= n;
+    if (!e->len) eep_qrd++; // span is done
+} // eep_pop()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : This function checks if a program cycle has ended. When it has,
+             the programmed bytes are removed from the queue.
+  Variables: wait: true = wait until the program cycle has ended
+  Returns  : true = no program cycle is running
+  ---------------------------------------------------------------------------*/
+static bool eep_ready(bool wait)
+{
+    if (eep_busy)
+    {   // EEP_WR_PG_DIS: write to a write-protected address
+        while (!(FLASH_IAPSR & (EEP_EOP | EEP_WR_PG_DIS)))
+        {
+            if (!wait) return false;
+        } // while
+        eep_busy = false;
+        eep_pop(eep_n);
+    } // if
+    return true;
+} // eep_ready()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : This function starts programming the part of the oldest span in
+             the queue that is within one block, with as few program cycles
+             (each takes about 6 msec.) as possible. The block is compared
+             with the new contents: an unchanged block is skipped, a single
+             changed byte or word is written with byte or word programming
+             and more changes with one block programming. A span from 
+             eep_write_words() is written one changed word per program cycle.
+  Variables: -
+  Returns  : -
+  ---------------------------------------------------------------------------*/
+static void eep_start(void)
+{
+    uint8_t  *eep = (uint8_t *)EEP_BASE_ADDR; // EEPROM base address.
+    eep_span *e   = &eep_q[eep_qrd & (EEP_QLEN - 1)];
+    uint16_t blk  = e->addr & ~(EEP_BLOCK - 1); // start of the block
+    uint8_t  i, j, start, first, last, words, bytes, w, wb = 0;
+    
+    start = first = e->addr - blk;
+    last  = (first + e->len < EEP_BLOCK) ? first + e->len : EEP_BLOCK; // excl.
+    eep_n = last - first;
+    memcpy(eep_buf, &eep[blk], EEP_BLOCK);  // current contents
+    for (i = first; i < last; i++)
+    {
+        eep_buf[i] = eep_qbuf[(e->ofs + i - first) & (EEP_QBUF - 1)];
+    } // for i
+    words = bytes = 0;
+    for (i = first & ~(EEP_WORD - 1); i < last; i += EEP_WORD)
+    {   // count the changed words and bytes
+        w = bytes;
+        for (j = i; j < i + EEP_WORD; j++)
+        {
+            if (eep_buf[j] != eep[blk + j]) bytes++;
+        } // for j
+        if (bytes != w) 
+        {
+            if (!words++) 
+            {   // first changed word
+                first = i; 
+                wb    = bytes;
+            } // if
+            else if (e->mode == EEP_PRG_WORD) 
+            {   // only the first changed word in this program cycle
+                eep_n = i - start;
+                bytes = wb;
+                break;
+            } // else if
+        } // if
+    } // for i
+    eep_bytes += bytes;
+    if (!words) 
+    {   // nothing to program
+        eep_skip++;
+        eep_pop(eep_n);
+        return;
+    } // if
+    if (!FLASH_IAPSR_DUL)
+    {
+        FLASH_DUKR = 0xAE;      // unlock EEPROM
+        FLASH_DUKR = 0x56;
+        while (!FLASH_IAPSR_DUL) ; // wait until EEPROM is unlocked
+    } // if
+    if ((words > 1) && (e->mode == EEP_PRG_BLOCK))
+    {   // one program cycle for the whole block
+        eep_program(&eep[blk], eep_buf, EEP_BLOCK, EEP_PRG_BLOCK);
+        eep_prog[2]++;
+    } // if
+    else if (bytes > 1)
+    {
+        eep_program(&eep[blk + first], &eep_buf[first], EEP_WORD, EEP_PRG_WORD);
+        eep_prog[1]++;
+    } // else if
+    else
+    {   // one byte
+        while (eep_buf[first] == eep[blk + first]) first++;
+        eep_program(&eep[blk + first], &eep_buf[first], 1, EEP_PRG_BYTE);
+        eep_prog[0]++;
+    } // else
+} // eep_start()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : This task programs the queued writes into the STM8 EEPROM. Every
+             call either waits for nothing or starts one program cycle (one
+             byte, word or block), the end of a program cycle is checked in 
+             the next call. The EEPROM is write-protected again when the 
+             queue is empty.
+  Variables: -
+  Returns  : -
+  ---------------------------------------------------------------------------*/
+void eep_task(void)
+{
+    if (!eep_ready(false)) return; // program cycle still running
+    while (!eep_busy && (eep_qrd != eep_qwr)) eep_start(); // skips unchanged blocks
+    if (!eep_busy && FLASH_IAPSR_DUL) FLASH_IAPSR_DUL = 0; // write-protect EEPROM again
+} // eep_task()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : This function programs all queued writes into the STM8 EEPROM
+             and returns when they are done.
+  Variables: -
+  Returns  : -
+  ---------------------------------------------------------------------------*/
+void eep_flush(void)
+{
+    while (eep_qused)
+    {
+        eep_ready(true); // wait for the running program cycle
+        eep_task();
+    } // while
+} // eep_flush()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : This function returns the number of bytes in the write queue,
+             that are not yet (completely) programmed into the EEPROM.
+  Variables: -
+  Returns  : the number of bytes
+  ---------------------------------------------------------------------------*/
+uint16_t eep_pending(void)
+{
+    return eep_qused;
+} // eep_pending()
 
 /*-----------------------------------------------------------------------------
   Purpose  : This function reads a (8-bit) value from the STM8 EEPROM.
@@ -28,12 +221,19 @@
   ---------------------------------------------------------------------------*/
 uint8_t eep_read8(uint16_t eep_address)
 {
-    uint8_t data;
+    uint8_t  i = eep_qwr;
+    eep_span *e;
     
-    char    *address = (char *)EEP_BASE_ADDR; // EEPROM base address.
-    address += eep_address;                   // add offset
-    data     = *address;                      // read byte
-    return data;
+    while (i != eep_qrd)
+    {   // the newest queued byte for this address is the actual value
+        e = &eep_q[--i & (EEP_QLEN - 1)];
+        if ((uint16_t)(eep_address - e->addr) < e->len)
+        {
+            return eep_qbuf[(e->ofs + eep_address - e->addr) & (EEP_QBUF - 1)];
+        } // if
+    } // while
+    eep_ready(true); // the EEPROM cannot be read during a program cycle
+    return *((uint8_t *)EEP_BASE_ADDR + eep_address);
 } // eep_read8()
 
 /*-----------------------------------------------------------------------------
@@ -46,14 +246,84 @@ uint16_t eep_read16(uint16_t eep_address)
 {
     uint16_t data;
     
-    char    *address = (char *)EEP_BASE_ADDR; // EEPROM base address.
-    address += eep_address;                   // add offset
-    data     = *address++;                    // read MSB first
-    data   <<= 8;                             // SHL 8
-    data    |= *address;                      // read LSB
-    return data;                              // Return result
+    data   = eep_read8(eep_address);     // read MSB first
+    data <<= 8;                          // SHL 8
+    data  |= eep_read8(eep_address + 1); // read LSB
+    return data;                         // Return result
 } // eep_read16()
 
+/*-----------------------------------------------------------------------------
+  Purpose  : This function copies a number of bytes into the write queue. 
+             They are programmed later by eep_task(), reads return the 
+             queued bytes until then. Only when the queue is full, this 
+             function waits for a program cycle.
+  Variables: eep_address: the index number within the EEPROM.
+             p          : the bytes to write
+             len        : the number of bytes to write
+             mode       : EEP_PRG_BLOCK: any programming mode
+                          EEP_PRG_WORD : byte or word programming only
+  Returns  : -
+  ---------------------------------------------------------------------------*/
+static void eep_queue(uint16_t eep_address, const uint8_t *p, uint16_t len, uint8_t mode)
+{
+    eep_span *e;
+    uint8_t  i, n;
+    
+    while (len)
+    {
+        n = (len < EEP_BLOCK) ? len : EEP_BLOCK;
+        while (((uint8_t)(eep_qwr - eep_qrd) >= EEP_QLEN) || (eep_qused + n > EEP_QBUF))
+        {   // queue is full, program the oldest span now
+            eep_ready(true);
+            eep_task();
+        } // while
+        e       = &eep_q[eep_qwr & (EEP_QLEN - 1)];
+        e->addr = eep_address;
+        e->ofs  = eep_qin;
+        e->len  = n;
+        e->mode = mode;
+        for (i = 0; i < n; i++)
+        {
+            eep_qbuf[eep_qin] = *p++;
+            eep_qin = (eep_qin + 1) & (EEP_QBUF - 1);
+        } // for i
+        eep_qused   += n;
+        eep_qwr++;   // span is ready for eep_task()
+        eep_address += n;
+        len         -= n;
+    } // while
+} // eep_queue()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : This function writes a number of bytes to the STM8 EEPROM. The
+             write is queued, see eep_queue(), and programmed with as few
+             program cycles as possible.
+  Variables: eep_address: the index number within the EEPROM.
+             p          : the bytes to write
+             len        : the number of bytes to write
+  Returns  : -
+  ---------------------------------------------------------------------------*/
+void eep_write_block(uint16_t eep_address, const uint8_t *p, uint16_t len)
+{
+    eep_queue(eep_address, p, len, EEP_PRG_BLOCK);
+} // eep_write_block()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : This function writes a number of bytes to the STM8 EEPROM, one
+             changed word per program cycle. A program cycle erases and 
+             writes all bytes it covers, block programming would also risk
+             the other bytes in the block when the power fails. With this
+             function, a power failure only affects the word being written.
+  Variables: eep_address: the index number within the EEPROM.
+             p          : the bytes to write
+             len        : the number of bytes to write
+  Returns  : -
+  ---------------------------------------------------------------------------*/
+void eep_write_words(uint16_t eep_address, const uint8_t *p, uint16_t len)
+{
+    eep_queue(eep_address, p, len, EEP_PRG_WORD);
+} // eep_write_words()
+
 /*-----------------------------------------------------------------------------
   Purpose  : This function writes a (8-bit) value to the STM8 EEPROM.
   Variables: eep_address: the index number within the EEPROM. An index number
@@ -63,17 +333,7 @@ uint16_t eep_read16(uint16_t eep_address)
   ---------------------------------------------------------------------------*/
 void eep_write8(uint16_t eep_address,uint8_t data)
 {
-    char *address = (char *)EEP_BASE_ADDR; //  EEPROM base address.
-
-    // Avoid unnecessary EEPROM writes
-    if (data == eep_read8(eep_address)) return;
-
-    address += eep_address; // add offset
-    FLASH_DUKR = 0xAE;      // unlock EEPROM
-    FLASH_DUKR = 0x56;
-    while (!FLASH_IAPSR_DUL) ; // wait until EEPROM is unlocked
-    *address   = (uint8_t)(data & 0xFF); // write it
-    FLASH_IAPSR_DUL = 0;    // write-protect EEPROM again
+    eep_write_block(eep_address, &data, 1); // unchanged bytes are skipped
 } // eep_write8()
 
 /*-----------------------------------------------------------------------------
@@ -85,41 +345,60 @@ void eep_write8(uint16_t eep_address,uint8_t data)
   ---------------------------------------------------------------------------*/
 void eep_write16(uint16_t eep_address,uint16_t data)
 {
-    char *address = (char *)EEP_BASE_ADDR; //  EEPROM base address.
+    uint8_t b[2];
+    
+    b[0] = (uint8_t)(data >> 8); // MSB first
+    b[1] = (uint8_t)data;
+    eep_write_block(eep_address, b, 2);
+} // eep_write16()
 
-    // Avoid unnecessary EEPROM writes
-    if (data == eep_read16(eep_address)) return;
+/*-----------------------------------------------------------------------------
+  Purpose  : This function reads a (32-bit) value from the STM8 EEPROM.
+  Variables: eep_address: the index number within the EEPROM.
+  Returns  : the (32-bit value), MSB first
+  ---------------------------------------------------------------------------*/
+uint32_t eep_read32(uint16_t eep_address)
+{
+    uint32_t data = eep_read16(eep_address); // read MSW first
+    
+    return (data << 16) | eep_read16(eep_address + 2);
+} // eep_read32()
 
-    address += eep_address; // add offset
-    FLASH_DUKR = 0xAE;      // unlock EEPROM
-    FLASH_DUKR = 0x56;
-    while (!FLASH_IAPSR_DUL) ; // wait until EEPROM is unlocked
-    *address++ = (uint8_t)((data >> 8) & 0xFF); // write MSB
-    *address   = (uint8_t)(data & 0xFF);        // write LSB
-    FLASH_IAPSR_DUL = 0;    // write-protect EEPROM again
-} // eep_write16()
+/*-----------------------------------------------------------------------------
+  Purpose  : This function writes a (32-bit) value to the STM8 EEPROM.
+  Variables: eep_address: the index number within the EEPROM.
+             data       : 32-bit value to write to the EEPROM
+  Returns  : -
+  ---------------------------------------------------------------------------*/
+void eep_write32(uint16_t eep_address, uint32_t data)
+{
+    uint8_t b[4];
+    
+    b[0] = (uint8_t)(data >> 24); // MSB first
+    b[1] = (uint8_t)(data >> 16);
+    b[2] = (uint8_t)(data >> 8);
+    b[3] = (uint8_t)data;
+    eep_write_block(eep_address, b, 4); // one program cycle at most
+} // eep_write32()
 
 /*-----------------------------------------------------------------------------
-  Purpose  : This function writes a string to the STM8 EEPROM.
+  Purpose  : This function writes a string to the STM8 EEPROM. A string is
+             max. EEP_STRLEN-1 characters, longer strings are cut off.
   Variables: eep_address: the index number within the EEPROM.
              s          : string to write to eeprom
   Returns  : -
   ---------------------------------------------------------------------------*/
 void eep_write_string(uint16_t eep_address, char *s)
 {
-    uint8_t i = 0;
-    char *address = (char *)EEP_BASE_ADDR; //  EEPROM base address.
-
-    address += eep_address; // add offset
-    FLASH_DUKR = 0xAE;      // unlock EEPROM
-    FLASH_DUKR = 0x56;
-    while (!FLASH_IAPSR_DUL) ; // wait until EEPROM is unlocked
-    while ((s[i] != '\0') && (i < 0x80))
-    {
-        *address++ = (uint8_t)(s[i++]); // write it
-    } // while
-    *address = '\0';        // terminate string in eeprom
-    FLASH_IAPSR_DUL = 0;    // write-protect EEPROM again
+    uint8_t len = 0;
+    
+    while ((s[len] != '\0') && (len < EEP_STRLEN - 1)) len++;
+    if (s[len] == '\0') eep_write_block(eep_address, (uint8_t *)s, len + 1);
+    else
+    {   // cut off
+        eep_write_block(eep_address, (uint8_t *)s, len);
+        eep_write8(eep_address + len, '\0'); // terminate string in eeprom
+    } // else
 } // eep_write_string()
 
 /*-----------------------------------------------------------------------------
@@ -131,10 +410,31 @@ void eep_write_string(uint16_t eep_address, char *s)
 void eep_read_string(uint16_t eep_address, char *s)
 {
     uint8_t i = 0;
-    char *address = (char *)EEP_BASE_ADDR; //  EEPROM base address.
 
-    address += eep_address; // add offset
-    while (((s[i] = *address++) != '\0') && (i < 0x80)) i++;
+    while (((s[i] = eep_read8(eep_address + i)) != '\0') && (i < 0x80)) i++;
 } // eep_read_string()
 
-
+/*-----------------------------------------------------------------------------
+  Purpose  : This function prints the EEPROM write statistics: the bytes that
+             changed, the program cycles per programming mode, the blocks
+             that were not programmed because nothing changed and the bytes
+             that are still in the write queue.
+  Variables: -
+  Returns  : -
+  ---------------------------------------------------------------------------*/
+void eep_stats(void)
+{
+    uart1_printf("EEP: ");
+    uart1_putu(eep_bytes, 0, ' ');
+    uart1_printf(" bytes changed, ");
+    uart1_putu(eep_prog[0], 0, ' ');
+    uart1_printf(" byte, ");
+    uart1_putu(eep_prog[1], 0, ' ');
+    uart1_printf(" word, ");
+    uart1_putu(eep_prog[2], 0, ' ');
+    uart1_printf(" block prog., ");
+    uart1_putu(eep_skip, 0, ' ');
+    uart1_printf(" blocks unchanged, ");
+    uart1_putu(eep_qused, 0, ' ');
+    uart1_printf(" bytes pending\n");
+} // eep_stats()
@@ -21,15 +21,41 @@
   ================================================================== */ 
 #include "stm8_hw_init.h"
 
-// EEPROM base address within STM8 uC
+// EEPROM base address within STM8 uC, the host tests use a model
+#ifndef EEP_BASE_ADDR
 #define EEP_BASE_ADDR (0x4000)
+#endif
+#define EEP_BLOCK     (128)  /* block size of the data EEPROM (high-density STM8S) */
+#define EEP_WORD      (4)    /* word size for word programming */
+#define EEP_STRLEN    (0x80) /* max. string length incl. '\0', see eep_write_string() */
+#define EEP_QLEN      (8)    /* spans in the write queue, power of 2 */
+#define EEP_QBUF      (256)  /* bytes in the write queue, power of 2 */
+
+// Programming modes: values for FLASH_CR2, FLASH_NCR2 gets the inverse
+#define EEP_PRG_BYTE  (0x00) /* byte programming */
+#define EEP_PRG_WORD  (0x40) /* WPRG: word programming, 4 bytes */
+#define EEP_PRG_BLOCK (0x01) /* PRG : standard block programming, EEP_BLOCK bytes */
+#define EEP_EOP       (0x04) /* FLASH_IAPSR: end of programming */
+#define EEP_WR_PG_DIS (0x01) /* FLASH_IAPSR: write to a protected address */
 
+// Fixed layout of older versions, copied into the kv store by kv_init()
 #define EEP_TEXT1          (0x0000) /* Text-string top-row */
 #define EEP_TEXT2          (0x0080) /* Text-string bottom-row */
 #define EEP_COL1           (0x0100) /* Colors for text-string top-row */
 #define EEP_COL2           (0x0180) /* Colors for text-string bottom-row */
 #define EEP_DST_ACTIVE     (0x0200) /* 1 = DST is Active */
+#define EEP_BAUD1          (0x0202) /* 32-bit baud-rate UART1, 0 = default */
+#define EEP_BAUD3          (0x0206) /* 32-bit baud-rate UART3, 0 = default */
       
+// A span of bytes in the write queue, the bytes are in eep_qbuf[]
+typedef struct _eep_span
+{
+    uint16_t addr; // index number within the EEPROM
+    uint16_t ofs;  // index of the first byte in eep_qbuf[]
+    uint8_t  len;  // number of bytes, max. EEP_BLOCK
+    uint8_t  mode; // EEP_PRG_BLOCK: any mode, EEP_PRG_WORD: no block programming
+} eep_span;
+
 #define NO_INIT            (0xFF)
 #define USE_ETH            (0x00)
 #define USE_USB            (0xFF)
@@ -39,7 +65,15 @@ uint8_t  eep_read8(uint16_t eep_address);
 uint16_t eep_read16(uint16_t eep_address);
 void     eep_write8(uint16_t eep_address, uint8_t data);
 void     eep_write16(uint16_t eep_address, uint16_t data);
+uint32_t eep_read32(uint16_t eep_address);
+void     eep_write32(uint16_t eep_address, uint32_t data);
+void     eep_write_block(uint16_t eep_address, const uint8_t *p, uint16_t len);
+void     eep_write_words(uint16_t eep_address, const uint8_t *p, uint16_t len);
 void     eep_write_string(uint16_t eep_address,char *s);
 void     eep_read_string(uint16_t eep_address,char *s);
+void     eep_task(void);
+void     eep_flush(void);
+uint16_t eep_pending(void);
+void     eep_stats(void);
 
 #endif
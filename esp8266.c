@@ -0,0 +1,489 @@
+/*==================================================================
+  File Name: esp8266.c
+  Author   : Emile
+  ------------------------------------------------------------------
+  Purpose  : This files contains a non-blocking driver for an ESP8266
+             WiFi module with AT-firmware on UART3. AT-commands are put
+             in a queue and sent one at a time by esp_task(), which
+             matches the response lines and handles timeouts.
+             The UART3 RX ISR calls esp_rx() for every byte: it splits
+             the input into response lines and forwards the payload of
+             "+IPD" messages to esp_cmdline, the WiFi command port, and
+             binary frames to the UART1 frame receiver. Command replies
+             are collected by esp_putc() and sent with AT+CIPSEND.
+             The ESP8266 is set up as a TCP server on port ESP_PORT.
+             Connect it once to an access-point with the E0 command, e.g.
+             E0 AT+CWJAP_DEF="ssid","password", the ESP8266 stores this.
+  ------------------------------------------------------------------
+  This file is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+ 
+  This software is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+ 
+  You should have received a copy of the GNU General Public License
+  along with this software.  If not, see <http://www.gnu.org/licenses/>.
+  ================================================================== */ 
+#include <string.h>
+#include "esp8266.h"
+#include "uart.h"
+#include "delay.h"
+#include "scheduler.h"
+
+#define ESP_QMASK        (ESP_QLEN - 1)
+#define ESP_LMASK        (ESP_LINES - 1)
+#define ESP_LINES_FULL   ((uint8_t)(esp_wr - esp_rd) >= ESP_LINES)
+#define ESP_TICKS(ms)    ((uint32_t)(ms) * TICKS_PER_SEC / 1000)
+#define ESP_REACHED(t)   ((int32_t)(millis() - (t)) >= 0)
+
+// Receive states of esp_rx()
+#define ESP_RX_LINE (0) /* assembling a response line */
+#define ESP_RX_IPD  (1) /* "+IPD," received, parsing "<id>,<len>:" */
+#define ESP_RX_DATA (2) /* forwarding <len> payload bytes to UART1 */
+
+typedef struct _esp_entry
+{
+    const char *cmd;   // AT-command, "\r\n" is added when it is sent
+    const char *ok;    // response line that ends the command without error
+    uint16_t   tmo;    // response timeout in msec.
+    uint8_t    flags;  // [ESP_F_INIT, ESP_F_ECHO, ESP_F_SEND]
+} esp_entry;
+
+// Init. sequence, started by esp_start()
+const esp_entry esp_init_list[] = {
+    {"AT+RST"                , "ready", 5000   , ESP_F_INIT}, // clean start
+    {"ATE0"                  , "OK"   , ESP_TMO, ESP_F_INIT}, // no echo
+    {"AT+CWMODE_CUR=1"       , "OK"   , ESP_TMO, ESP_F_INIT}, // station mode
+    {"AT+CIPMUX=1"           , "OK"   , ESP_TMO, ESP_F_INIT}, // needed for a server
+    {"AT+CIPSERVER=1," ESP_PORT, "OK" , ESP_TMO, ESP_F_INIT}
+};
+
+// Written by esp_rx() in the UART3 RX ISR
+char     esp_line[ESP_LINES][ESP_BUFLEN]; // ring of response lines
+volatile uint8_t esp_wr = 0;        // free-running count of lines written by the ISR
+volatile uint8_t esp_rd = 0;        // free-running count of lines read by esp_task()
+uint8_t  esp_pos       = 0;        // number of chars in the current line
+uint8_t  esp_rx_state  = ESP_RX_LINE;
+uint8_t  esp_ipd_match = 0;        // number of chars of "+IPD," matched
+uint16_t esp_ipd_num;              // number being parsed in "<id>,<len>:"
+uint16_t esp_ipd_len;              // payload bytes still to forward
+uint8_t  esp_ipd_id    = 0;        // connection id of the last +IPD message
+line_buf esp_cmdline;              // command lines received over WiFi
+uint16_t esp_lost      = 0;        // lines lost, both line buffers were full
+uint16_t esp_ipd       = 0;        // +IPD messages received
+uint32_t esp_ipd_bytes = 0;        // payload bytes forwarded to UART1
+
+// Used by esp_task()
+esp_entry esp_q[ESP_QLEN];         // AT-command queue
+uint8_t  esp_qwr       = 0;        // free-running write offset in esp_q[]
+uint8_t  esp_qrd       = 0;        // free-running read offset in esp_q[]
+bool     esp_busy      = false;    // true = esp_q[esp_qrd] sent, waiting for response
+uint32_t esp_deadline;             // millis() at which the command times out
+uint8_t  esp_state     = ESP_OFF;  // [ESP_OFF, ESP_INIT, ESP_READY]
+uint32_t esp_retry_at  = 0;        // millis() at which esp_start() is called again
+uint8_t  esp_conn      = 0;        // bit i set: TCP connection i is open
+bool     esp_ip        = false;    // true = connected to an access-point
+bool     esp_raw_busy  = false;    // true = esp_rawbuf[] is in the queue
+bool     esp_send_busy = false;    // true = AT+CIPSEND is in the queue
+char     esp_rawbuf[ESP_BUFLEN];   // AT-command of the E0 command
+char     esp_sendbuf[20];          // AT+CIPSEND=<id>,<len>
+uint8_t  esp_tx[ESP_TXLEN];        // command replies, filled by esp_putc()
+uint8_t  esp_txn       = 0;        // number of bytes in esp_tx[]
+uint8_t  esp_tx_chunk  = 0;        // bytes of esp_tx[] in the pending AT+CIPSEND
+uint8_t  esp_tx_pos    = 0;        // bytes of the chunk written to UART3
+bool     esp_tx_out    = false;    // true = '>' received, the chunk is being written
+uint16_t esp_tx_drop   = 0;        // reply bytes dropped, esp_tx[] was full
+uint16_t esp_tmo_cnt   = 0;        // commands that timed out
+uint16_t esp_err_cnt   = 0;        // commands that returned an error
+
+/*------------------------------------------------------------------
+  Purpose  : This function ends the current response line. Called 
+             from esp_rx().
+  Variables: -
+  Returns  : -
+  ------------------------------------------------------------------*/
+static inline void esp_line_done(void)
+{
+    if (ESP_LINES_FULL)
+    {   // all line buffers are full
+        esp_lost++;
+    } // if
+    else
+    {
+        esp_line[esp_wr & ESP_LMASK][(esp_pos < ESP_BUFLEN) ? esp_pos : ESP_BUFLEN-1] = '\0';
+        esp_wr++; // continue in the next buffer
+        post_event(EV_ESP);
+    } // else
+    esp_pos       = 0;
+    esp_ipd_match = 0;
+} // esp_line_done()
+
+/*------------------------------------------------------------------
+  Purpose  : This function is called by the UART3 RX ISR for every byte
+             received from the ESP8266. Response lines are assembled in
+             esp_line[], '\r' is ignored. The '>' prompt of AT+CIPSEND
+             has no '\n' and is a line by itself. The payload of a 
+             "+IPD,<id>,<len>:" message goes to uart1_rx_byte().
+  Variables: ch: the byte received
+  Returns  : -
+  ------------------------------------------------------------------*/
+void esp_rx(uint8_t ch)
+{
+    switch (esp_rx_state)
+    {
+        case ESP_RX_DATA: if (!uart1_frame_rx(ch, esp_cmdline.pos == 0, SRC_WIFI))
+                          {   // text: a command for the WiFi command port
+                              line_rx(&esp_cmdline, ch);
+                          } // if
+                          esp_ipd_bytes++;
+                          if (--esp_ipd_len == 0) esp_rx_state = ESP_RX_LINE;
+                          break;
+        case ESP_RX_IPD : if ((ch >= '0') && (ch <= '9'))
+                          {
+                              esp_ipd_num = esp_ipd_num * 10 + (ch - '0');
+                          } // if
+                          else if (ch == ',')
+                          {   // <id> done
+                              esp_ipd_id  = esp_ipd_num;
+                              esp_ipd_num = 0;
+                          } // else if
+                          else if ((ch == ':') && esp_ipd_num)
+                          {   // <len> done, payload follows
+                              esp_ipd_len  = esp_ipd_num;
+                              esp_rx_state = ESP_RX_DATA;
+                              esp_ipd++;
+                          } // else if
+                          else esp_rx_state = ESP_RX_LINE; // not a valid +IPD
+                          break;
+        default         : // ESP_RX_LINE
+                          if (ch == '\n')
+                          {
+                              if (esp_pos) esp_line_done(); // skip empty lines
+                          } // if
+                          else if ((ch == '\r') || ((ch == ' ') && !esp_pos)) ;
+                          else if ((ch == '>') && !esp_pos)
+                          {   // prompt of AT+CIPSEND
+                              esp_pos = 1;
+                              if (!ESP_LINES_FULL) esp_line[esp_wr & ESP_LMASK][0] = ch;
+                              esp_line_done();
+                          } // else if
+                          else
+                          {
+                              if ((esp_pos < ESP_BUFLEN - 1) && !ESP_LINES_FULL)
+                              {
+                                  esp_line[esp_wr & ESP_LMASK][esp_pos] = ch;
+                              } // if
+                              if ((esp_ipd_match == esp_pos) && (esp_pos < 5) && 
+                                  (ch == "+IPD,"[esp_pos])) esp_ipd_match++;
+                              if (esp_pos < 0xFF) esp_pos++;
+                              if (esp_ipd_match == 5)
+                              {   // "+IPD," is not a response line
+                                  esp_rx_state  = ESP_RX_IPD;
+                                  esp_ipd_num   = 0;
+                                  esp_ipd_match = 0;
+                                  esp_pos       = 0;
+                              } // if
+                          } // else
+                          break;
+    } // switch
+} // esp_rx()
+
+/*------------------------------------------------------------------
+  Purpose  : This function adds an AT-command to the queue.
+  Variables: cmd  : the AT-command, without "\r\n". Not copied, it must
+                    stay valid until the command is finished.
+             ok   : the response line that ends the command, e.g. "OK"
+             tmo  : response timeout in msec.
+             flags: [ESP_F_INIT, ESP_F_ECHO, ESP_F_SEND]
+  Returns  : false if the queue is full
+  ------------------------------------------------------------------*/
+bool esp_cmd(const char *cmd, const char *ok, uint16_t tmo, uint8_t flags)
+{
+    esp_entry *e;
+    
+    if ((uint8_t)(esp_qwr - esp_qrd) >= ESP_QLEN) return false;
+    e        = &esp_q[esp_qwr & ESP_QMASK];
+    e->cmd   = cmd;
+    e->ok    = ok;
+    e->tmo   = tmo;
+    e->flags = flags;
+    esp_qwr++;
+    return true;
+} // esp_cmd()
+
+/*------------------------------------------------------------------
+  Purpose  : This function (re)starts the ESP8266: the queue is 
+             emptied and the init. sequence is put in the queue.
+  Variables: -
+  Returns  : -
+  ------------------------------------------------------------------*/
+void esp_start(void)
+{
+    uint8_t i;
+    
+    esp_qrd       = esp_qwr; // empty queue
+    esp_busy      = false;
+    esp_raw_busy  = false;
+    esp_send_busy = false;
+    esp_tx_out    = false;
+    esp_txn       = 0;
+    esp_conn      = 0;
+    esp_ip        = false;
+    esp_state     = ESP_INIT;
+    for (i = 0; i < sizeof(esp_init_list) / sizeof(esp_entry); i++)
+    {
+        esp_cmd(esp_init_list[i].cmd, esp_init_list[i].ok, 
+                esp_init_list[i].tmo, esp_init_list[i].flags);
+    } // for i
+} // esp_start()
+
+/*------------------------------------------------------------------
+  Purpose  : This function finishes the command at the head of the
+             queue. A failed init. command stops the ESP8266, it is
+             started again after ESP_RETRY msec.
+  Variables: ok: true = expected response received
+  Returns  : -
+  ------------------------------------------------------------------*/
+static void esp_done(bool ok)
+{
+    esp_entry *e = &esp_q[esp_qrd & ESP_QMASK];
+    
+    esp_busy   = false;
+    esp_tx_out = false;
+    esp_qrd++;
+    if (e->flags & ESP_F_ECHO) esp_raw_busy  = false;
+    if (e->flags & ESP_F_SEND)
+    {   // remove the bytes sent from esp_tx[], or all bytes after an error
+        if (ok) memmove(esp_tx, &esp_tx[esp_tx_chunk], esp_txn - esp_tx_chunk);
+        esp_txn      -= ok ? esp_tx_chunk : esp_txn;
+        esp_send_busy = false;
+    } // if
+    if (!ok && (e->flags & ESP_F_INIT))
+    {   // init. failed, try again later
+        esp_qrd       = esp_qwr; // empty queue
+        esp_raw_busy  = false;
+        esp_send_busy = false;
+        esp_txn       = 0;
+        esp_state     = ESP_OFF;
+        esp_retry_at  = millis() + ESP_TICKS(ESP_RETRY);
+    } // if
+    else if ((esp_state == ESP_INIT) && ((esp_qrd == esp_qwr) || 
+             !(esp_q[esp_qrd & ESP_QMASK].flags & ESP_F_INIT)))
+    {   // last init. command is done
+        esp_state = ESP_READY;
+    } // else if
+} // esp_done()
+
+/*------------------------------------------------------------------
+  Purpose  : This function handles one response line of the ESP8266:
+             it is matched against the command that is waiting for a
+             response, other lines are unsolicited messages.
+  Variables: s: the response line
+  Returns  : -
+  ------------------------------------------------------------------*/
+static void esp_line_handler(char *s)
+{
+    esp_entry *e = &esp_q[esp_qrd & ESP_QMASK];
+    
+    if (esp_busy)
+    {
+        if (e->flags & ESP_F_ECHO)
+        {   // response to an E0 command
+            uart1_printf(s);
+            uart1_printf("\n");
+        } // if
+        if (!strcmp(s, e->ok))
+        {
+            esp_done(true);
+            return;
+        } // if
+        if (!strcmp(s, "ERROR") || !strcmp(s, "FAIL") || !strcmp(s, "SEND FAIL"))
+        {
+            esp_err_cnt++;
+            esp_done(false);
+            return;
+        } // if
+        if ((e->flags & ESP_F_SEND) && !strcmp(s, ">"))
+        {   // ESP8266 is ready for the data, esp_task() writes it
+            esp_tx_out   = true;
+            esp_tx_pos   = 0;
+            esp_deadline = millis() + ESP_TICKS(e->tmo);
+            return;
+        } // if
+    } // if
+    if (!strcmp(s, "WIFI GOT IP"))          esp_ip = true;
+    else if (!strcmp(s, "WIFI DISCONNECT")) esp_ip = false;
+    else if ((s[0] >= '0') && (s[0] <= '4') && (s[1] == ','))
+    {   // "<id>,CONNECT" or "<id>,CLOSED"
+        if      (!strcmp(&s[2], "CONNECT")) esp_conn |=  (1 << (s[0] - '0'));
+        else if (!strcmp(&s[2], "CLOSED"))  esp_conn &= ~(1 << (s[0] - '0'));
+    } // else if
+    else if (!strcmp(s, "ready") && (esp_state == ESP_READY))
+    {   // ESP8266 was reset, initialise it again
+        esp_state    = ESP_OFF;
+        esp_retry_at = millis();
+    } // else if
+} // esp_line_handler()
+
+/*------------------------------------------------------------------
+  Purpose  : This function queues an AT+CIPSEND for all bytes in esp_tx[].
+             The bytes are written when the ESP8266 sends the '>' prompt.
+  Variables: id: the connection id [0..4]
+  Returns  : -
+  ------------------------------------------------------------------*/
+static void esp_queue_send(uint8_t id)
+{
+    uint8_t i = 11;
+    
+    esp_tx_chunk = esp_txn;
+    strcpy(esp_sendbuf, "AT+CIPSEND=");
+    esp_sendbuf[i++] = '0' + id;
+    esp_sendbuf[i++] = ',';
+    if (esp_tx_chunk >= 100) esp_sendbuf[i++] = '0' + esp_tx_chunk / 100;
+    if (esp_tx_chunk >= 10)  esp_sendbuf[i++] = '0' + (esp_tx_chunk / 10) % 10;
+    esp_sendbuf[i++] = '0' + esp_tx_chunk % 10;
+    esp_sendbuf[i]   = '\0';
+    esp_send_busy = esp_cmd(esp_sendbuf, "SEND OK", ESP_TMO, ESP_F_SEND);
+} // esp_queue_send()
+
+/*------------------------------------------------------------------
+  Purpose  : This is the ESP8266 task. It is made ready by EV_ESP (a
+             response line is received) and runs on its period for the
+             timeouts. It never waits for the ESP8266.
+  Variables: -
+  Returns  : -
+  ------------------------------------------------------------------*/
+void esp_task(void)
+{
+    esp_entry *e;
+    
+    while (esp_rd != esp_wr)
+    {   // handle all received lines, esp_rd++ gives the buffer back to esp_rx()
+        esp_line_handler(esp_line[esp_rd & ESP_LMASK]);
+        esp_rd++;
+    } // while
+    if (esp_tx_out)
+    {   // write the AT+CIPSEND data as far as the UART3 transmit ring has room,
+        // waiting for a full ring would stall the other tasks
+        while ((esp_tx_pos < esp_tx_chunk) && uart3_tx_room()) uart3_putc(esp_tx[esp_tx_pos++]);
+        if (esp_tx_pos < esp_tx_chunk) esp_flush(); // run again at the next pass
+        else                           esp_tx_out = false;
+    } // if
+    if (esp_busy && ESP_REACHED(esp_deadline))
+    {   // no response in time
+        esp_tmo_cnt++;
+        if (esp_q[esp_qrd & ESP_QMASK].flags & ESP_F_ECHO) uart1_printf("ESP timeout\n");
+        esp_done(false);
+    } // if
+    if ((esp_state == ESP_OFF) && ESP_REACHED(esp_retry_at))
+    {
+        esp_start();
+    } // if
+    if ((esp_state == ESP_READY) && esp_txn && !esp_send_busy)
+    {   // command reply waiting, send it to the connection of the last +IPD
+        if ((esp_ipd_id <= 4) && (esp_conn & (1 << esp_ipd_id))) esp_queue_send(esp_ipd_id);
+        else esp_txn = 0; // connection is closed
+    } // if
+    if (!esp_busy && (esp_qrd != esp_qwr))
+    {   // send next command
+        e = &esp_q[esp_qrd & ESP_QMASK];
+        uart3_printf(e->cmd);
+        uart3_printf("\n"); // sent as "\r\n"
+        esp_busy     = true;
+        esp_deadline = millis() + ESP_TICKS(e->tmo);
+    } // if
+} // esp_task()
+
+/*------------------------------------------------------------------
+  Purpose  : This function queues an AT-command from the E0 command,
+             its response lines are printed to UART1.
+  Variables: cmd: the AT-command, it is copied
+  Returns  : false if a previous E0 command is not finished yet or
+             the queue is full
+  ------------------------------------------------------------------*/
+bool esp_raw(const char *cmd)
+{
+    if (esp_raw_busy) return false;
+    strncpy(esp_rawbuf, cmd, ESP_BUFLEN - 1);
+    esp_rawbuf[ESP_BUFLEN - 1] = '\0';
+    esp_raw_busy = esp_cmd(esp_rawbuf, "OK", ESP_TMO_JOIN, ESP_F_ECHO);
+    return esp_raw_busy;
+} // esp_raw()
+
+/*------------------------------------------------------------------
+  Purpose  : This function adds one byte to the reply for the WiFi
+             command port. esp_task() sends it to the connection of the
+             last +IPD message. This is the output sink of the WiFi
+             command port, see uart1_redirect().
+  Variables: ch: the byte to send
+  Returns  : 1 if the byte was added, 0 if it was dropped
+  ------------------------------------------------------------------*/
+uint8_t esp_putc(uint8_t ch)
+{
+    if ((esp_state != ESP_READY) || (esp_txn >= ESP_TXLEN))
+    {
+        esp_tx_drop++;
+        return 0;
+    } // if
+    esp_tx[esp_txn++] = ch;
+    return 1;
+} // esp_putc()
+
+/*------------------------------------------------------------------
+  Purpose  : This function makes esp_task() ready, so a reply in esp_tx[]
+             is sent now instead of at the next period.
+  Variables: -
+  Returns  : -
+  ------------------------------------------------------------------*/
+__monitor void esp_flush(void)
+{
+    post_event(EV_ESP);
+} // esp_flush()
+
+/*------------------------------------------------------------------
+  Purpose  : This function initialises the driver, call it before the
+             UART3 interrupts are enabled. esp_task() starts the ESP8266.
+  Variables: -
+  Returns  : -
+  ------------------------------------------------------------------*/
+void esp_init(void)
+{
+    line_init(&esp_cmdline, EV_WIFI_LINE);
+    esp_state    = ESP_OFF;
+    esp_retry_at = millis(); // start at the first run of esp_task()
+} // esp_init()
+
+/*------------------------------------------------------------------
+  Purpose  : This function prints the status of the ESP8266 driver.
+  Variables: -
+  Returns  : -
+  ------------------------------------------------------------------*/
+void esp_stats(void)
+{
+    const char *st[3] = {"off","init","ready"};
+    
+    uart1_printf("ESP: ");
+    uart1_printf(st[esp_state]);
+    uart1_printf(esp_ip ? ", ip" : ", no ip");
+    uart1_printf(", conn 0x");
+    uart1_puthex(esp_conn, 2);
+    uart1_printf(", ");
+    uart1_putu(esp_ipd, 0, ' ');
+    uart1_printf(" ipd (");
+    uart1_putu(esp_ipd_bytes, 0, ' ');
+    uart1_printf(" bytes), ");
+    uart1_putu(esp_lost, 0, ' ');
+    uart1_printf(" lost, ");
+    uart1_putu(esp_cmdline.lost, 0, ' ');
+    uart1_printf(" cmd lost, ");
+    uart1_putu(esp_tx_drop, 0, ' ');
+    uart1_printf(" tx dropped\n     ");
+    uart1_putu(esp_tmo_cnt, 0, ' ');
+    uart1_printf(" tmo, ");
+    uart1_putu(esp_err_cnt, 0, ' ');
+    uart1_printf(" err\n");
+} // esp_stats()
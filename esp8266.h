@@ -0,0 +1,54 @@
+#ifndef _ESP8266_H
+#define _ESP8266_H
+/*==================================================================
+  File Name: esp8266.h
+  Author   : Emile
+  ------------------------------------------------------------------
+  Purpose  : This is the header-file for esp8266.c
+  ------------------------------------------------------------------
+  This file is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+ 
+  This software is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+ 
+  You should have received a copy of the GNU General Public License
+  along with this software.  If not, see <http://www.gnu.org/licenses/>.
+  ================================================================== */ 
+#include <stdint.h>
+#include <stdbool.h>
+
+#define ESP_BUFLEN    (64)    /* max. length of a response line, incl. '\0' */
+#define ESP_QLEN      (8)     /* entries in the AT-command queue, power of 2 */
+#define ESP_LINES     (4)     /* response lines buffered for esp_task(), power of 2 */
+#define ESP_TXLEN     (200)   /* max. reply of a WiFi command, in bytes (< 256) */
+#define ESP_PORT      "23"    /* TCP server port for commands and frames */
+#define ESP_TMO       (2000)  /* default response timeout in msec. */
+#define ESP_TMO_JOIN  (20000) /* response timeout for E0 commands (CWJAP) */
+#define ESP_RETRY     (10000) /* msec. before a failed ESP8266 is initialised again */
+
+// States of the ESP8266 driver, see esp_state
+#define ESP_OFF       (0) /* not initialised, waiting ESP_RETRY */
+#define ESP_INIT      (1) /* init. commands are in the queue */
+#define ESP_READY     (2) /* TCP server is running */
+
+// Flags for esp_cmd()
+#define ESP_F_INIT    (0x01) /* part of the init. sequence, a failure restarts it */
+#define ESP_F_ECHO    (0x02) /* print the response lines to UART1 */
+#define ESP_F_SEND    (0x04) /* AT+CIPSEND: send esp_tx[] after '>' */
+
+void    esp_rx(uint8_t ch); // called from the UART3 RX ISR
+void    esp_init(void);
+void    esp_task(void);
+void    esp_start(void);
+bool    esp_cmd(const char *cmd, const char *ok, uint16_t tmo, uint8_t flags);
+bool    esp_raw(const char *cmd);
+uint8_t esp_putc(uint8_t ch);
+__monitor void esp_flush(void);
+void    esp_stats(void);
+
+#endif
@@ -5,8 +5,9 @@
   Purpose  : This file contains the bit-banging I2C functions 
              for the STM8 uC. It is needed for every I2C device
              connected to the STM8 uC. The I2C hardware unit inside
-             the STM8 is not used, since this is too complicated and
-             could cause bus lock-ups.
+             the STM8 is used by i2c_hw.c instead (see I2C_HW).
+             Transactions on I2C_CH0 run in i2c_bb_task(), a few bits
+             per call, so that other tasks keep running.
   ------------------------------------------------------------------
   This file is free software: you can redistribute it and/or modify
   it under the terms of the GNU General Public License as published by
@@ -22,6 +23,28 @@
   along with this software. If not, see <http://www.gnu.org/licenses/>.
   ================================================================== */ 
 #include "i2c_bb.h"
+#include "scheduler.h"
+
+// States of the transaction engine, see i2c_bb_step()
+#define BB_IDLE  (0) /* no transaction */
+#define BB_START (1) /* (repeated) start condition */
+#define BB_WRITE (2) /* write i2c_bb_byte, 1 bit per step, then the ACK */
+#define BB_READ  (3) /* read i2c_bb_byte, 1 bit per step, then the (N)ACK */
+#define BB_STOP  (4) /* stop condition */
+
+#define I2C_BB_QMASK (I2C_BB_QLEN - 1)
+
+i2c_xfer * volatile i2c_bb_q[I2C_BB_QLEN]; // transactions to run
+volatile uint8_t i2c_bb_qwr = 0;  // free-running write index for i2c_bb_q[]
+volatile uint8_t i2c_bb_qrd = 0;  // free-running read index for i2c_bb_q[]
+i2c_xfer *i2c_bb_cur = NULL;      // running transaction, NULL = idle
+uint8_t  i2c_bb_state = BB_IDLE;  // BB_IDLE .. BB_STOP
+uint8_t  i2c_bb_dir;              // I2C_WRITE or I2C_READ phase of i2c_bb_cur
+uint8_t  i2c_bb_pos;              // bytes written or read in this phase
+uint8_t  i2c_bb_byte;             // byte that is shifted in or out
+uint8_t  i2c_bb_bit;              // bit of i2c_bb_byte, 0 = the ACK bit
+bool     i2c_bb_adr;              // i2c_bb_byte is the address
+uint8_t  i2c_bb_err;              // I2C_ACK or I2C_NACK
     
 /*-----------------------------------------------------------------------------
   Purpose  : This function resets the I2C-bus after a lock-up. See also:
@@ -199,6 +222,218 @@ uint8_t i2c_read_bb(enum I2C_CH ch, uint8_t ack)
     return result;
 } // i2c_read_bb()
 
+/*-----------------------------------------------------------------------------
+  Purpose  : This function runs a complete I2C transaction: write wlen bytes,
+             then read rlen bytes after a repeated start. It is the same as
+             i2c_hw_xfer(), so that i2c_transfer() can use either one.
+             On I2C_CH0 it waits for the transactions queued before it, 
+             since i2c_bb_task() uses the same bus.
+  Variables: ch  : I2C channel number [I2C_CH0,I2C_CH1,I2C_CH2]
+             addr: I2C address of the device, bit 0 (R/W) is not used
+             wbuf: bytes to write
+             wlen: number of bytes to write
+             rbuf: bytes read
+             rlen: number of bytes to read, the last one gets a NACK
+  Returns  : [I2C_ACK, I2C_NACK]
+  ---------------------------------------------------------------------------*/
+uint8_t i2c_xfer_bb(enum I2C_CH ch, uint8_t addr, const uint8_t *wbuf, uint8_t wlen, uint8_t *rbuf, uint8_t rlen)
+{
+    i2c_xfer x;
+    uint8_t  err;
+    uint8_t  i;
+    
+    if (ch == I2C_CH0)
+    {   // run it with the transaction engine, without yielding
+        x.addr = addr;
+        x.wbuf = wbuf;
+        x.wlen = wlen;
+        x.rbuf = rbuf;
+        x.rlen = rlen;
+        x.done = NULL;
+        while (!i2c_bb_submit(&x)) i2c_bb_step(); // queue is full
+        while (x.status == I2C_BUSY) i2c_bb_step();
+        return x.status;
+    } // if
+    addr &= 0xFE;
+    if (wlen || !rlen)
+    {
+        err = i2c_start_bb(ch, addr | I2C_WRITE);
+        for (i = 0; (i < wlen) && (err == I2C_ACK); i++)
+            err = i2c_write_bb(ch, wbuf[i]);
+        if (rlen && (err == I2C_ACK)) 
+            err = i2c_rep_start_bb(ch, addr | I2C_READ);
+    } // if
+    else err = i2c_start_bb(ch, addr | I2C_READ);
+    if (err == I2C_ACK)
+    {
+        for (i = 0; i < rlen; i++)
+            rbuf[i] = i2c_read_bb(ch, (i == rlen - 1) ? I2C_NACK : I2C_ACK);
+    } // if
+    i2c_stop_bb(ch);
+    return (err == I2C_ACK) ? I2C_ACK : I2C_NACK;
+} // i2c_xfer_bb()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : This function adds a transaction for I2C_CH0 to the queue of 
+             i2c_bb_task(). x must remain valid until x->status is no longer
+             I2C_BUSY. x->done (if not NULL) is called by i2c_bb_task() at 
+             the end of the transaction.
+  Variables: x: the transaction
+  Returns  : false = queue is full, try again later
+  ---------------------------------------------------------------------------*/
+__monitor bool i2c_bb_submit(i2c_xfer *x)
+{
+    if ((uint8_t)(i2c_bb_qwr - i2c_bb_qrd) >= I2C_BB_QLEN) return false;
+    x->status = I2C_BUSY;
+    i2c_bb_q[i2c_bb_qwr++ & I2C_BB_QMASK] = x;
+    post_event(EV_I2C); // start i2c_bb_task()
+    return true;
+} // i2c_bb_submit()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : This function prepares the next byte of the running transaction,
+             after the ACK of the previous one. 
+  Variables: -
+  Returns  : -
+  ---------------------------------------------------------------------------*/
+static void i2c_bb_next(void)
+{
+    i2c_xfer *x = i2c_bb_cur;
+    
+    i2c_bb_bit = 0x80;
+    if (i2c_bb_dir == I2C_READ)
+    {
+        i2c_bb_state = (i2c_bb_pos < x->rlen) ? BB_READ : BB_STOP;
+    } // if
+    else if (i2c_bb_pos < x->wlen)
+    {
+        i2c_bb_byte  = x->wbuf[i2c_bb_pos++];
+        i2c_bb_state = BB_WRITE;
+    } // else if
+    else if (x->rlen)
+    {   // repeated start for the read phase
+        i2c_bb_dir   = I2C_READ;
+        i2c_bb_state = BB_START;
+    } // else if
+    else i2c_bb_state = BB_STOP;
+    i2c_bb_adr = false;
+} // i2c_bb_next()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : This function runs one step of the I2C_CH0 transactions: a 
+             start condition, one bit, an ACK bit or a stop condition. The
+             pin levels and delays are the same as in i2c_start_bb(), 
+             i2c_write_bb(), i2c_read_bb() and i2c_stop_bb(). SCL stays low
+             between steps, which slaves see as a slow master.
+  Variables: -
+  Returns  : false = no transaction to run
+  ---------------------------------------------------------------------------*/
+bool i2c_bb_step(void)
+{
+    i2c_xfer *x = i2c_bb_cur;
+    
+    switch (i2c_bb_state)
+    {
+        case BB_IDLE:
+             if (i2c_bb_qrd == i2c_bb_qwr) return false;
+             x = i2c_bb_cur = i2c_bb_q[i2c_bb_qrd++ & I2C_BB_QMASK];
+             i2c_bb_dir = (x->wlen || !x->rlen) ? I2C_WRITE : I2C_READ;
+             i2c_bb_err = I2C_ACK;
+             // no break, start condition: SDA = 1 after i2c_stop_bb()
+        case BB_START:
+             if (i2c_bb_dir == I2C_READ && x->wlen)
+             {   // repeated start: SCL = 0, SDA = 0
+                 sda_1(I2C_CH0);
+                 i2c_delay_5usec(1);
+             } // if
+             scl_1(I2C_CH0);
+             sda_0(I2C_CH0);
+             i2c_delay_5usec(1);
+             scl_0(I2C_CH0);
+             i2c_bb_byte  = (x->addr & 0xFE) | i2c_bb_dir;
+             i2c_bb_bit   = 0x80;
+             i2c_bb_pos   = 0;
+             i2c_bb_adr   = true;
+             i2c_bb_state = BB_WRITE;
+             break;
+        case BB_WRITE:
+             if (i2c_bb_bit)
+             {
+                 if (i2c_bb_byte & i2c_bb_bit) sda_1(I2C_CH0);
+                 else                          sda_0(I2C_CH0);
+                 scl_1(I2C_CH0);
+                 scl_0(I2C_CH0);
+                 i2c_bb_bit >>= 1;
+             } // if
+             else
+             {   // ACK from the slave
+                 sda_in(I2C_CH0);
+                 i2c_delay_5usec(1);
+                 scl_1(I2C_CH0);
+                 if (sda_read(I2C_CH0)) i2c_bb_err = I2C_NACK;
+                 scl_0(I2C_CH0);
+                 sda_out(I2C_CH0);
+                 sda_0(I2C_CH0);
+                 if (i2c_bb_err == I2C_NACK) i2c_bb_state = BB_STOP;
+                 else                        i2c_bb_next();
+             } // else
+             break;
+        case BB_READ:
+             if (i2c_bb_bit == 0x80) sda_in(I2C_CH0); // SCL = 0
+             if (i2c_bb_bit)
+             {
+                 i2c_bb_byte <<= 1;
+                 scl_1(I2C_CH0);
+                 if (sda_read(I2C_CH0)) i2c_bb_byte |= 0x01;
+                 scl_0(I2C_CH0);
+                 i2c_bb_bit >>= 1;
+             } // if
+             else
+             {   // ACK from the master, NACK after the last byte
+                 sda_out(I2C_CH0);
+                 x->rbuf[i2c_bb_pos++] = i2c_bb_byte;
+                 if (i2c_bb_pos < x->rlen) sda_0(I2C_CH0);
+                 else                      sda_1(I2C_CH0);
+                 scl_1(I2C_CH0);
+                 scl_0(I2C_CH0);
+                 sda_0(I2C_CH0);
+                 i2c_bb_next();
+             } // else
+             break;
+        default: // BB_STOP: SCL = 0, SDA = 0
+             scl_1(I2C_CH0);
+             sda_1(I2C_CH0);
+             i2c_delay_5usec(1);
+             i2c_bb_cur   = NULL;
+             i2c_bb_state = BB_IDLE;
+             x->status    = i2c_bb_err;
+             if (x->done) x->done(x);
+             break;
+    } // switch
+    return true;
+} // i2c_bb_step()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : This is the task for the transactions queued by i2c_bb_submit().
+             It runs I2C_BB_BITS steps of i2c_bb_step() per call (about 
+             15 usec. per step), so the CPU is never held for a complete 
+             transaction. It runs on EV_I2C and posts EV_I2C again as long
+             as a transaction is running, so it runs once every 
+             dispatch_tasks() pass until the queue is empty.
+  Variables: -
+  Returns  : -
+  ---------------------------------------------------------------------------*/
+void i2c_bb_task(void)
+{
+    uint8_t i;
+    
+    for (i = 0; i < I2C_BB_BITS; i++)
+    {
+        if (!i2c_bb_step()) return; // queue is empty
+    } // for i
+    post_event(EV_I2C); // continue in the next pass
+} // i2c_bb_task()
+
 int16_t lm92_read(enum I2C_CH ch, uint8_t *err)
 /*------------------------------------------------------------------
   Purpose  : This function reads the LM92 13-bit Temp. Sensor and
@@ -32,6 +32,9 @@
 #define I2C_WRITE   (0)
 #define I2C_READ    (1)
 #define I2C_RETRIES (3)
+#define I2C_BUSY    (3)   /* i2c_xfer.status: queued or running */
+#define I2C_BB_QLEN (4)   /* transactions in the i2c_bb_task() queue, power of 2 */
+#define I2C_BB_BITS (3)   /* bits (clock pulses) per i2c_bb_task() call */
 
 enum I2C_CH
 {
@@ -40,6 +43,21 @@ enum I2C_CH
     I2C_CH2 = 2  /* I2C channel 2, not used */
 }; // enum
 
+// An I2C transaction: write wlen bytes, then read rlen bytes after a
+// repeated start. wlen == 0: read only, rlen == 0: write only, both 0:
+// only the address is sent (to see if a device is there). Used by
+// i2c_bb_submit() (I2C_CH0) and by i2c_hw_submit() in i2c_hw.c.
+typedef struct _i2c_xfer
+{
+    uint8_t        addr;  // I2C address, bit 0 (R/W) is not used
+    const uint8_t *wbuf;  // bytes to write
+    uint8_t        wlen;  // number of bytes to write
+    uint8_t       *rbuf;  // bytes read
+    uint8_t        rlen;  // number of bytes to read
+    void (*done)(struct _i2c_xfer *x); // called at the end, may be NULL
+    volatile uint8_t status; // I2C_BUSY, then I2C_ACK, I2C_NACK or I2C_ERROR
+} i2c_xfer;
+
 //-----------------------------------------------------------------
 // The LM92 sign bit is normally bit 12. The value read from the
 // LM92 is SHL3. Therefore the sign bit is at bit 15
@@ -124,10 +142,12 @@ enum I2C_CH
 
 /*-----------------------------------------------------------------------------
   Purpose  : This function creates a 5 usec delay (approximately) without
-             using a timer or an interrupt.
+             using a timer or an interrupt. A host test may replace it by 
+             defining i2c_delay_5usec() as a macro.
   Variables: --
   Returns  : -
   ---------------------------------------------------------------------------*/
+#ifndef i2c_delay_5usec
 static inline void i2c_delay_5usec(uint16_t x)
 {
     uint16_t j;
@@ -138,6 +158,7 @@ static inline void i2c_delay_5usec(uint16_t x)
         for (i = 0; i < 120; i++) ; // 120 * 41.7 nsec (24 MHz) = 5 usec.
     } // for j
 } // i2c_delay_5usec()
+#endif
 
 /*-----------------------------------------------------------------------------
   Purpose  : Sets the SCL line to input
@@ -305,6 +326,10 @@ uint8_t i2c_rep_start_bb(enum I2C_CH ch, uint8_t addr); // Issues a repeated sta
 void    i2c_stop_bb(enum I2C_CH ch);                    // Terminates the data transfer and releases the I2C bus
 uint8_t i2c_write_bb(enum I2C_CH ch, uint8_t data);     // Send one byte to I2C device, returns ACK or NAK
 uint8_t i2c_read_bb(enum I2C_CH ch, uint8_t ack);       // Read one byte from I2C device and calls i2c_stop_bb()
+uint8_t i2c_xfer_bb(enum I2C_CH ch, uint8_t addr, const uint8_t *wbuf, uint8_t wlen, uint8_t *rbuf, uint8_t rlen); // write, then read after a repeated start
+__monitor bool i2c_bb_submit(i2c_xfer *x);              // Queue a transaction for i2c_bb_task()
+bool    i2c_bb_step(void);                              // Runs 1 bit of the queued transactions
+void    i2c_bb_task(void);                              // Runs I2C_BB_BITS bits of the queued transactions
 
 int16_t lm92_read(enum I2C_CH ch, uint8_t *err);
 bool    ds2482_reset(enum I2C_CH ch, uint8_t addr);
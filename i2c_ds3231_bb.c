@@ -4,9 +4,9 @@
   ------------------------------------------------------------------
   Purpose : This files contains the DS3231 related functions.
             The DS3231 is a Real-Time Clock (RTC).
-            It uses I2C bit-banging instead of the I2C module inside
-            the STM8, because it is just too complex and very difficult
-            to get fault-free under all circumstances.
+            It uses i2c_transfer(): the interrupt-driven I2C module
+            inside the STM8 (i2c_hw.c) or I2C bit-banging (i2c_bb.c),
+            see I2C_HW in i2c_hw.h.
   ------------------------------------------------------------------
   This file is free software: you can redistribute it and/or modify
   it under the terms of the GNU General Public License as published by
@@ -22,36 +22,21 @@
   along with this file. If not, see <http://www.gnu.org/licenses/>.
   ==================================================================
 */ 
-#include "i2c_bb.h"
+#include "i2c_hw.h"
 #include "i2c_ds3231_bb.h"
 
 bool ds3231_read_register(uint8_t reg, uint8_t *value)
-{
-    bool err;
-
-    err = (i2c_start_bb(I2C_CH0,DS3231_ADR | I2C_WRITE) != I2C_ACK); // generate I2C start + output address to I2C bus
-    if (!err) 
-    { 
-        i2c_write_bb(I2C_CH0,reg);      // write register address to read from
-        i2c_rep_start_bb(I2C_CH0,DS3231_ADR | I2C_READ);
-        *value = i2c_read_bb(I2C_CH0,I2C_NACK); // Read register + issue NACK
-    } // if
-    i2c_stop_bb(I2C_CH0);          // i2c_stop() condition
-    return err;
+{   // write register address to read from, then read register + issue NACK
+    return (i2c_transfer(DS3231_ADR, &reg, 1, value, 1) != I2C_ACK);
 } // ds3231_read_register()
  
 bool ds3231_write_register(uint8_t reg, uint8_t value)
 {
-    bool err;
+    uint8_t buf[2];
 
-    err = (i2c_start_bb(I2C_CH0,DS3231_ADR | I2C_WRITE) != I2C_ACK); // generate I2C start + output address to I2C bus
-    if (!err) 
-    {
-        i2c_write_bb(I2C_CH0,reg);   // write register address to write to
-        i2c_write_bb(I2C_CH0,value); // write value into register
-    } // if
-    i2c_stop_bb(I2C_CH0);       // close I2C bus
-    return err;
+    buf[0] = reg;   // register address to write to
+    buf[1] = value; // value for this register
+    return (i2c_transfer(DS3231_ADR, buf, 2, NULL, 0) != I2C_ACK);
 } // ds3231_write_register()
 
 uint8_t	ds3231_decode(uint8_t value)
@@ -85,36 +70,61 @@ uint8_t ds3231_encode(uint8_t value)
     return encoded;
 } // ds3231_encode()
 
+// Converts the 7 time registers, starting at REG_SEC
+static void ds3231_time(Time *p, uint8_t *buf)
+{
+    p->sec  = ds3231_decode(buf[0]);  // SECONDS register
+    p->min  = ds3231_decode(buf[1]);  // MINUTES register
+    p->hour = ds3231_decodeH(buf[2]); // HOURS register
+    p->dow  = buf[3];                 // DOW register
+    p->day  = ds3231_decode(buf[4]);  // DAY register
+    p->mon  = ds3231_decode(buf[5]);  // MONTH register
+    p->year = 2000 + ds3231_decodeY(buf[6]); // YEAR register
+} // ds3231_time()
+
 bool ds3231_gettime(Time *p)
 {
+    uint8_t reg = REG_SEC; // seconds register is first register to read
+    uint8_t buf[7];
     bool    err;
-    uint8_t buf;
 
-    err = (i2c_start_bb(I2C_CH0,DS3231_ADR | I2C_WRITE) != I2C_ACK); // generate I2C start + output address to I2C bus
-    if (!err) 
-    {
-        i2c_write_bb(I2C_CH0,REG_SEC); // seconds register is first register to read
-        i2c_rep_start_bb(I2C_CH0,DS3231_ADR | I2C_READ);
-        
-        buf     = i2c_read_bb(I2C_CH0,I2C_ACK);  // Read SECONDS register
-        p->sec  = ds3231_decode(buf);     
-        buf     = i2c_read_bb(I2C_CH0,I2C_ACK);  // Read MINUTES register
-        p->min  = ds3231_decode(buf);     
-        buf     = i2c_read_bb(I2C_CH0,I2C_ACK);  // Read HOURS register
-        p->hour = ds3231_decodeH(buf);    
-        buf     = i2c_read_bb(I2C_CH0,I2C_ACK);  // Read DOW register
-        p->dow  = buf;    
-        buf     = i2c_read_bb(I2C_CH0,I2C_ACK);  // Read DAY register
-        p->day  = ds3231_decode(buf);
-        buf     = i2c_read_bb(I2C_CH0,I2C_ACK);  // Read MONTH register
-        p->mon  = ds3231_decode(buf);
-        buf     = i2c_read_bb(I2C_CH0,I2C_NACK); // Read YEAR register
-        p->year = 2000 + ds3231_decodeY(buf); 
-    } // if
-    i2c_stop_bb(I2C_CH0);
+    err = (i2c_transfer(DS3231_ADR, &reg, 1, buf, 7) != I2C_ACK);
+    if (!err) ds3231_time(p, buf);
     return err;
 } // ds3231_gettime()
 
+// Runs the transfer x of a _nb function: the first call submits it, the
+// next calls return true once it is done. busy belongs to x.
+static bool ds3231_xfer_nb(i2c_xfer *x, bool *busy)
+{
+    if (!*busy)
+    {   // start the transfer, run by the I2C ISR or by i2c_bb_task()
+        *busy = i2c_submit(x);
+        return false;
+    } // if
+#if I2C_HW
+    i2c_hw_poll(); // timeout check
+#endif
+    if (x->status == I2C_BUSY) return false;
+    *busy = false;
+    return true;
+} // ds3231_xfer_nb()
+
+// Same as ds3231_gettime(), but it does not wait for the I2C transfer.
+// Call it until it returns true, e.g. with PT_WAIT_UNTIL(). p is only
+// updated when the DS3231 replied.
+bool ds3231_gettime_nb(Time *p)
+{
+    static const uint8_t reg = REG_SEC;
+    static uint8_t  buf[7];
+    static i2c_xfer x = {DS3231_ADR, &reg, 1, buf, 7, NULL, I2C_ACK};
+    static bool     busy = false;
+    
+    if (!ds3231_xfer_nb(&x, &busy)) return false;
+    if (x.status == I2C_ACK) ds3231_time(p, buf);
+    return true;
+} // ds3231_gettime_nb()
+
 void ds3231_settime(uint8_t hour, uint8_t min, uint8_t sec)
 {
     if ((hour < 24) && (min < 60) && (sec < 60))
@@ -125,6 +135,26 @@ void ds3231_settime(uint8_t hour, uint8_t min, uint8_t sec)
     } // if	
 } // ds3231_settime()
 
+// Same as ds3231_settime(), but it does not wait for the I2C transfer:
+// seconds, minutes and hours are written in one transfer. Call it with
+// the same time until it returns true, e.g. with PT_WAIT_UNTIL().
+bool ds3231_settime_nb(uint8_t hour, uint8_t min, uint8_t sec)
+{
+    static uint8_t  buf[4];
+    static i2c_xfer x = {DS3231_ADR, buf, 4, NULL, 0, NULL, I2C_ACK};
+    static bool     busy = false;
+    
+    if (!busy)
+    {   // the time to write, REG_SEC is the first register
+        if ((hour >= 24) || (min >= 60) || (sec >= 60)) return true;
+        buf[0] = REG_SEC;
+        buf[1] = ds3231_encode(sec);
+        buf[2] = ds3231_encode(min);
+        buf[3] = ds3231_encode(hour);
+    } // if
+    return ds3231_xfer_nb(&x, &busy);
+} // ds3231_settime_nb()
+
 // 1=Monday, 2=Tuesday, 3=Wednesday, 4=Thursday, 5=Friday, 6=Saturday, 7=Sunday
 uint8_t ds3231_calc_dow(uint8_t date, uint8_t mon, uint16_t year)
 {
@@ -160,23 +190,45 @@ void ds3231_setdow(uint8_t dow)
             ds3231_write_register(REG_DOW, dow);
 } // ds3231_setdow() 
 
-// Returns the Temperature in a Q8.2 format
-int16_t ds3231_gettemp(void)
+// Converts the 2 temperature registers to Q8.2, starting at REG_TEMPM
+static int16_t ds3231_temp(uint8_t msb, uint8_t lsb)
 {
-	bool err;
-	uint8_t msb,lsb;
 	int16_t retv;
 	
-	err    = ds3231_read_register(REG_TEMPM, &msb);
 	retv   = msb;
 	retv <<= 2; // SHL 2
-	if (!err) err = ds3231_read_register(REG_TEMPL, &lsb);
 	retv  |= (lsb >> 6);
 	if (retv & 0x0200)
 	{   // sign-bit is set
             retv &= ~0x0200; // clear sign bit
             retv = -retv;    // 2-complement
 	} // if
-	if (!err) return retv;
+	return retv;
+} // ds3231_temp()
+
+// Returns the Temperature in a Q8.2 format
+int16_t ds3231_gettemp(void)
+{
+	bool err;
+	uint8_t msb,lsb;
+	
+	err    = ds3231_read_register(REG_TEMPM, &msb);
+	if (!err) err = ds3231_read_register(REG_TEMPL, &lsb);
+	if (!err) return ds3231_temp(msb, lsb);
 	else      return 0;
 } // ds3231_gettemp()
+
+// Same as ds3231_gettemp(), but it does not wait for the I2C transfer:
+// both registers are read in one transfer. Call it until it returns true,
+// e.g. with PT_WAIT_UNTIL(). t is only updated when the DS3231 replied.
+bool ds3231_gettemp_nb(int16_t *t)
+{
+    static const uint8_t reg = REG_TEMPM;
+    static uint8_t  buf[2];
+    static i2c_xfer x = {DS3231_ADR, &reg, 1, buf, 2, NULL, I2C_ACK};
+    static bool     busy = false;
+    
+    if (!ds3231_xfer_nb(&x, &busy)) return false;
+    if (x.status == I2C_ACK) *t = ds3231_temp(buf[0], buf[1]);
+    return true;
+} // ds3231_gettemp_nb()
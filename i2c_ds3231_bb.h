@@ -68,10 +68,13 @@ typedef struct _Time
 
 // Function prototypes for DS3231
 bool    ds3231_gettime(Time *p);
+bool    ds3231_gettime_nb(Time *p);
 void    ds3231_settime(uint8_t hour, uint8_t min, uint8_t sec);
+bool    ds3231_settime_nb(uint8_t hour, uint8_t min, uint8_t sec);
 uint8_t ds3231_calc_dow(uint8_t date, uint8_t mon, uint16_t year);
 void    ds3231_setdate(uint8_t date, uint8_t mon, uint16_t year);
 void    ds3231_setdow(uint8_t dow);
 int16_t ds3231_gettemp(void);
+bool    ds3231_gettemp_nb(int16_t *t);
 
 #endif
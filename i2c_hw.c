@@ -0,0 +1,434 @@
+/*==================================================================
+  File Name: i2c_hw.c
+  Author   : Emile
+  ------------------------------------------------------------------
+  Purpose  : This file contains the interrupt-driven I2C master for
+             the I2C peripheral of the STM8 uC (PE1 = SCL, PE2 = SDA).
+             Transactions are queued with i2c_hw_submit() and run by
+             the I2C ISR, the CPU only handles an interrupt per byte.
+             Reading follows the STM8 reference manual (RM0016): the
+             NACK and STOP for the last byte are set while the clock
+             is stretched (BTF), so they are never too late.
+  ------------------------------------------------------------------
+  This file is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+ 
+  This software is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+ 
+  You should have received a copy of the GNU General Public License
+  along with this software.  If not, see <http://www.gnu.org/licenses/>.
+  ================================================================== */ 
+#include "i2c_hw.h"
+#include "scheduler.h"
+#include "delay.h"
+#include "uart.h"
+
+// I2C register bits
+#define I2C_PE       (0x01) /* CR1  : peripheral enable */
+#define I2C_START    (0x01) /* CR2  : (repeated) start generation */
+#define I2C_STOP     (0x02) /* CR2  : stop generation */
+#define I2C_ACKEN    (0x04) /* CR2  : acknowledge received bytes */
+#define I2C_POS      (0x08) /* CR2  : ACK/NACK applies to the next byte */
+#define I2C_SWRST    (0x80) /* CR2  : software reset */
+#define I2C_ADDCONF  (0x40) /* OARH : must be 1 */
+#define I2C_FS       (0x80) /* CCRH : fast mode */
+#define I2C_SB       (0x01) /* SR1  : start condition sent */
+#define I2C_ADDR     (0x02) /* SR1  : address sent and acknowledged */
+#define I2C_BTF      (0x04) /* SR1  : byte transfer finished, clock stretched */
+#define I2C_RXNE     (0x40) /* SR1  : DR holds a received byte */
+#define I2C_TXE      (0x80) /* SR1  : DR is empty */
+#define I2C_BERR     (0x01) /* SR2  : misplaced start or stop */
+#define I2C_ARLO     (0x02) /* SR2  : arbitration lost */
+#define I2C_AF       (0x04) /* SR2  : no acknowledge */
+#define I2C_OVR      (0x08) /* SR2  : overrun */
+#define I2C_ITERREN  (0x01) /* ITR  : error interrupts */
+#define I2C_ITEVTEN  (0x02) /* ITR  : event interrupts */
+#define I2C_ITBUFEN  (0x04) /* ITR  : TXE and RXNE interrupts */
+
+#define I2C_QMASK    (I2C_QLEN - 1)
+#define I2C_STOP_MAX (250)  /* max. loops waiting for a stop condition */
+
+i2c_xfer * volatile i2c_q[I2C_QLEN]; // transactions to run
+volatile uint8_t i2c_qwr  = 0;       // free-running write index for i2c_q[]
+volatile uint8_t i2c_qrd  = 0;       // free-running read index for i2c_q[]
+i2c_xfer * volatile i2c_cur = NULL;  // running transaction, NULL = idle
+uint8_t  i2c_dir;                    // I2C_WRITE or I2C_READ phase of i2c_cur
+uint8_t  i2c_pos;                    // bytes written or read in this phase
+bool     i2c_sb;                     // true = waiting for the (repeated) start
+volatile uint8_t i2c_seq  = 0;       // incremented for every transaction
+uint16_t i2c_n[4];                   // transactions: ACK, NACK, error, timeout
+
+/*-----------------------------------------------------------------------------
+  Purpose  : This function prepares the read phase of the running
+             transaction: ACK is set for all but the last byte. For two 
+             bytes, POS moves the NACK to the second byte (RM0016).
+  Variables: -
+  Returns  : -
+  ---------------------------------------------------------------------------*/
+static void i2c_read_phase(void)
+{
+    i2c_dir = I2C_READ;
+    i2c_pos = 0;
+    if      (i2c_cur->rlen == 2) I2C_CR2 |= I2C_ACKEN | I2C_POS;
+    else if (i2c_cur->rlen >  2) I2C_CR2 |= I2C_ACKEN;
+} // i2c_read_phase()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : This function starts the next transaction in the queue. Called
+             by the I2C ISR and by i2c_hw_submit() (interrupts disabled).
+  Variables: -
+  Returns  : -
+  ---------------------------------------------------------------------------*/
+static void i2c_next(void)
+{
+    uint8_t i = 0;
+    
+    I2C_CR2 &= ~(I2C_ACKEN | I2C_POS);
+    if (i2c_qrd == i2c_qwr)
+    {   // queue is empty
+        i2c_cur = NULL;
+        I2C_ITR = 0;
+        return;
+    } // if
+    i2c_cur = i2c_q[i2c_qrd++ & I2C_QMASK];
+    i2c_seq++;
+    if (i2c_cur->wlen || !i2c_cur->rlen)
+    {
+        i2c_dir = I2C_WRITE;
+        i2c_pos = 0;
+    } // if
+    else i2c_read_phase();
+    while ((I2C_CR2 & I2C_STOP) && (i++ < I2C_STOP_MAX)) ; // previous stop, a few usec.
+    i2c_sb   = true;
+    I2C_ITR  = I2C_ITEVTEN | I2C_ITERREN;
+    I2C_CR2 |= I2C_START;
+} // i2c_next()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : This function ends the running transaction, calls its callback 
+             and starts the next one.
+  Variables: status: [I2C_ACK, I2C_NACK, I2C_ERROR]
+  Returns  : -
+  ---------------------------------------------------------------------------*/
+static void i2c_done(uint8_t status)
+{
+    i2c_xfer *x = i2c_cur;
+    
+    i2c_n[status]++;
+    x->status = status;
+    if (x->done) x->done(x);
+    i2c_next();
+} // i2c_done()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : This is the I2C interrupt routine, for events and errors. It
+             runs the transaction in i2c_cur, one step per interrupt.
+  Variables: -
+  Returns  : -
+  ---------------------------------------------------------------------------*/
+#pragma vector = I2C_vector
+__interrupt void I2C_IRQHandler(void)
+{
+    i2c_xfer *x = i2c_cur;
+    uint8_t  sr1, sr2, n;
+    
+    sr1 = I2C_SR1;
+    sr2 = I2C_SR2;
+    if (!x)
+    {   // should not happen
+        I2C_ITR = 0;
+        return;
+    } // if
+    if (sr2 & (I2C_BERR | I2C_ARLO | I2C_AF | I2C_OVR))
+    {   // AF: the address or a written byte was not acknowledged
+        I2C_SR2 = 0;
+        if (!(sr2 & I2C_ARLO)) I2C_CR2 |= I2C_STOP; // ARLO: no longer the master
+        i2c_done((sr2 & I2C_AF) ? I2C_NACK : I2C_ERROR);
+    } // if
+    else if (sr1 & I2C_SB)
+    {   // start condition sent, writing DR clears SB
+        i2c_sb = false;
+        I2C_DR = (x->addr & 0xFE) | i2c_dir;
+    } // else if
+    else if (i2c_sb)
+    {   // BTF of the last written byte stays set until the repeated start
+    } // else if
+    else if (sr1 & I2C_ADDR)
+    {   // address acknowledged, reading SR3 clears ADDR
+        if (i2c_dir == I2C_WRITE)
+        {
+            (void)I2C_SR3;
+            if (x->wlen) I2C_ITR |= I2C_ITBUFEN; // TXE for the first byte
+            else
+            {   // address only: the device is there
+                I2C_CR2 |= I2C_STOP;
+                i2c_done(I2C_ACK);
+            } // else
+        } // if
+        else if (x->rlen == 1)
+        {   // NACK (ACK is 0) and STOP for the one byte, RXNE when it is in
+            (void)I2C_SR3;
+            I2C_CR2 |= I2C_STOP;
+            I2C_ITR |= I2C_ITBUFEN;
+        } // else if
+        else if (x->rlen == 2)
+        {   // POS: the NACK is for the 2nd byte, then wait for BTF
+            (void)I2C_SR3;
+            I2C_CR2 &= ~I2C_ACKEN;
+        } // else if
+        else
+        {   // RXNE until 3 bytes are left, then BTF
+            (void)I2C_SR3;
+            if (x->rlen > 3) I2C_ITR |= I2C_ITBUFEN;
+        } // else
+    } // else if
+    else if (i2c_dir == I2C_WRITE)
+    {
+        if (i2c_pos < x->wlen)
+        {
+            if (sr1 & I2C_TXE)
+            {
+                I2C_DR = x->wbuf[i2c_pos++];
+                if (i2c_pos == x->wlen) I2C_ITR &= ~I2C_ITBUFEN; // wait for BTF
+            } // if
+        } // if
+        else if (sr1 & I2C_BTF)
+        {   // last byte is sent
+            if (x->rlen)
+            {   // repeated start for the read phase
+                i2c_read_phase();
+                i2c_sb   = true;
+                I2C_CR2 |= I2C_START;
+            } // if
+            else 
+            {
+                I2C_CR2 |= I2C_STOP;
+                i2c_done(I2C_ACK);
+            } // else
+        } // else if
+    } // else if
+    else
+    {   // read phase, n bytes are not read yet
+        n = x->rlen - i2c_pos;
+        if (n > 3)
+        {
+            if (sr1 & I2C_RXNE)
+            {
+                x->rbuf[i2c_pos++] = I2C_DR;
+                if (n == 4) I2C_ITR &= ~I2C_ITBUFEN; // BTF for the last 3 bytes
+            } // if
+        } // if
+        else if (n == 3)
+        {   // BTF: byte N-2 in DR, N-1 in the shift register, SCL is low
+            if (sr1 & I2C_BTF)
+            {
+                I2C_CR2 &= ~I2C_ACKEN;           // NACK for byte N
+                x->rbuf[i2c_pos++] = I2C_DR;
+            } // if
+        } // else if
+        else if (n == 2)
+        {   // BTF: byte N-1 in DR, N in the shift register, SCL is low
+            if (sr1 & I2C_BTF)
+            {
+                I2C_CR2 |= I2C_STOP;
+                x->rbuf[i2c_pos++] = I2C_DR;
+                x->rbuf[i2c_pos++] = I2C_DR;
+                i2c_done(I2C_ACK);
+            } // if
+        } // else if
+        else if (sr1 & I2C_RXNE)
+        {   // the one byte of a 1-byte read
+            x->rbuf[i2c_pos++] = I2C_DR;
+            i2c_done(I2C_ACK);
+        } // else if
+    } // else
+} // I2C_IRQHandler()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : This function initializes the I2C peripheral as master. A slave
+             that holds SDA low is first released by i2c_reset_bus().
+  Variables: clk  : which clock is active: HSI (0xE1), HSE (0xB4) or LSI (0xD2)
+             speed: [I2C_100KHZ, I2C_400KHZ]
+  Returns  : -
+  ---------------------------------------------------------------------------*/
+void i2c_hw_init(uint8_t clk, uint8_t speed)
+{
+    uint32_t f   = FMASTER(clk);
+    uint8_t  mhz = (uint8_t)(f / 1000000UL);
+    uint16_t ccr;
+    
+    i2c_reset_bus(I2C_CH0); // with bit-banging
+    scl_in(I2C_CH0);        // release the pins for the I2C peripheral
+    sda_in(I2C_CH0);
+    I2C_CR1   = 0;          // PE = 0 while the clock is set
+    I2C_CR2   = I2C_SWRST;
+    I2C_CR2   = 0;
+    I2C_FREQR = mhz;        // peripheral clock in MHz
+    if (speed == I2C_400KHZ)
+    {   // Tlow = 2 * Thigh = 2 * CCR / fMASTER, rounded up
+        ccr        = (uint16_t)((f + 3 * 400000UL - 1) / (3 * 400000UL));
+        I2C_CCRH   = I2C_FS | (uint8_t)(ccr >> 8);
+        I2C_TRISER = (uint8_t)(mhz * 3 / 10 + 1); // max. 300 nsec.
+    } // if
+    else
+    {   // Tlow = Thigh = CCR / fMASTER, rounded up
+        ccr        = (uint16_t)((f + 2 * 100000UL - 1) / (2 * 100000UL));
+        I2C_CCRH   = (uint8_t)(ccr >> 8);
+        I2C_TRISER = mhz + 1;                     // max. 1000 nsec.
+    } // else
+    I2C_CCRL  = (uint8_t)ccr;
+    I2C_OARH  = I2C_ADDCONF; // 7-bit addressing
+    I2C_ITR   = 0;
+    I2C_CR1   = I2C_PE;
+    i2c_cur   = NULL;
+    i2c_qrd   = i2c_qwr = 0;
+} // i2c_hw_init()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : This function adds a transaction to the queue. It is started 
+             at once when the I2C bus is idle. x must remain valid until
+             x->status is no longer I2C_BUSY. x->done (if not NULL) is 
+             called from the I2C ISR at the end of the transaction.
+  Variables: x: the transaction
+  Returns  : false = queue is full, try again later
+  ---------------------------------------------------------------------------*/
+__monitor bool i2c_hw_submit(i2c_xfer *x)
+{
+    if ((uint8_t)(i2c_qwr - i2c_qrd) >= I2C_QLEN) return false;
+    x->status = I2C_BUSY;
+    i2c_q[i2c_qwr++ & I2C_QMASK] = x;
+    if (!i2c_cur) i2c_next();
+    return true;
+} // i2c_hw_submit()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : This function stops the I2C ISR for the running transaction.
+             i2c_cur stays set, so i2c_hw_submit() only queues until
+             i2c_hw_restart() is called.
+  Variables: seq: i2c_seq of the transaction to abort
+  Returns  : false = the transaction ended just now
+  ---------------------------------------------------------------------------*/
+static __monitor bool i2c_hw_stop(uint8_t seq)
+{
+    if (!i2c_cur || (i2c_seq != seq)) return false;
+    I2C_ITR = 0;
+    return true;
+} // i2c_hw_stop()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : This function ends the stopped transaction as a timeout and
+             starts the next one in the queue.
+  Variables: -
+  Returns  : -
+  ---------------------------------------------------------------------------*/
+static __monitor void i2c_hw_restart(void)
+{
+    i2c_n[I2C_ERROR]--; // counted as a timeout
+    i2c_n[3]++;
+    i2c_done(I2C_ERROR);
+} // i2c_hw_restart()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : This function aborts the running transaction: the I2C peripheral
+             is reset, the bus is cleared and the next transaction is started.
+             Only i2c_hw_stop() and i2c_hw_restart() disable interrupts, the
+             bus reset (2 msec. or more) runs with the interrupt state of
+             the caller, so the row scan and the UARTs keep running.
+  Variables: seq: i2c_seq of the transaction to abort
+  Returns  : -
+  ---------------------------------------------------------------------------*/
+static void i2c_hw_abort(uint8_t seq)
+{
+    uint8_t ccrh, ccrl, triser;
+    
+    if (!i2c_hw_stop(seq)) return;
+    ccrh   = I2C_CCRH; // keep the speed settings
+    ccrl   = I2C_CCRL;
+    triser = I2C_TRISER;
+    I2C_CR1 = 0;
+    i2c_reset_bus(I2C_CH0);
+    scl_in(I2C_CH0);
+    sda_in(I2C_CH0);
+    I2C_CR2    = I2C_SWRST;
+    I2C_CR2    = 0;
+    I2C_CCRH   = ccrh;
+    I2C_CCRL   = ccrl;
+    I2C_TRISER = triser;
+    I2C_OARH   = I2C_ADDCONF;
+    I2C_CR1    = I2C_PE;
+    i2c_hw_restart();
+} // i2c_hw_abort()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : This function aborts the running transaction when it takes more 
+             than I2C_TMO msec. (bus lock-up), see i2c_hw_abort(). Call it
+             while waiting for a transaction.
+  Variables: -
+  Returns  : -
+  ---------------------------------------------------------------------------*/
+void i2c_hw_poll(void)
+{
+    static uint8_t  seq;
+    static uint32_t t0;
+    
+    if (!i2c_cur) return;
+    if (seq != i2c_seq)
+    {   // a new transaction is running
+        seq = i2c_seq;
+        t0  = millis();
+    } // if
+    else if (millis() - t0 >= (uint32_t)I2C_TMO * TICKS_PER_SEC / 1000)
+    {
+        i2c_hw_abort(seq);
+    } // else if
+} // i2c_hw_poll()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : This function runs a transaction and waits until it is done.
+             This is the same as i2c_xfer_bb(), but the I2C peripheral 
+             shifts the bits.
+  Variables: addr: I2C address of the device, bit 0 (R/W) is not used
+             wbuf: bytes to write
+             wlen: number of bytes to write
+             rbuf: bytes read, after a repeated start
+             rlen: number of bytes to read
+  Returns  : [I2C_ACK, I2C_NACK, I2C_ERROR]
+  ---------------------------------------------------------------------------*/
+uint8_t i2c_hw_xfer(uint8_t addr, const uint8_t *wbuf, uint8_t wlen, uint8_t *rbuf, uint8_t rlen)
+{
+    i2c_xfer x;
+    
+    x.addr = addr;
+    x.wbuf = wbuf;
+    x.wlen = wlen;
+    x.rbuf = rbuf;
+    x.rlen = rlen;
+    x.done = NULL;
+    while (!i2c_hw_submit(&x)) i2c_hw_poll(); // queue is full
+    while (x.status == I2C_BUSY) i2c_hw_poll();
+    return x.status;
+} // i2c_hw_xfer()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : This function prints the number of I2C transactions: acknowledged,
+             not acknowledged, bus errors and timeouts.
+  Variables: -
+  Returns  : -
+  ---------------------------------------------------------------------------*/
+void i2c_hw_stats(void)
+{
+    uart1_printf("I2C: ");
+    uart1_putu(i2c_n[I2C_ACK], 0, ' ');
+    uart1_printf(" ok, ");
+    uart1_putu(i2c_n[I2C_NACK], 0, ' ');
+    uart1_printf(" nack, ");
+    uart1_putu(i2c_n[I2C_ERROR], 0, ' ');
+    uart1_printf(" error, ");
+    uart1_putu(i2c_n[3], 0, ' ');
+    uart1_printf(" timeout\n");
+} // i2c_hw_stats()
@@ -0,0 +1,56 @@
+#ifndef _I2C_HW_H
+#define _I2C_HW_H
+/*==================================================================
+  File Name: i2c_hw.h
+  Author   : Emile
+  ------------------------------------------------------------------
+  Purpose  : This is the header-file for i2c_hw.c
+  ------------------------------------------------------------------
+  This file is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+ 
+  This software is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+ 
+  You should have received a copy of the GNU General Public License
+  along with this software.  If not, see <http://www.gnu.org/licenses/>.
+  ================================================================== */ 
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "i2c_bb.h"
+
+//---------------------------------------------------------------
+// I2C_HW: 1 = i2c_transfer() uses the I2C peripheral on PE1/PE2 
+//             (i2c_hw.c), interrupt-driven, 
+//         0 = i2c_transfer() uses bit-banging on I2C_CH0 (i2c_bb.c).
+//---------------------------------------------------------------
+#ifndef I2C_HW
+#define I2C_HW       (1)
+#endif
+
+#define I2C_100KHZ   (0)    /* standard mode, see i2c_hw_init() */
+#define I2C_400KHZ   (1)    /* fast mode, fMASTER must be >= 4 MHz */
+#define I2C_QLEN     (4)    /* transactions in the queue, power of 2 */
+#define I2C_TMO      (25)   /* msec. before a transaction is aborted */
+
+// i2c_xfer (see i2c_bb.h) for both drivers, i2c_submit() returns at once
+#if I2C_HW
+#define i2c_transfer(a,w,wl,r,rl) i2c_hw_xfer(a,w,wl,r,rl)
+#define i2c_submit(x)             i2c_hw_submit(x)
+#else
+#define i2c_transfer(a,w,wl,r,rl) i2c_xfer_bb(I2C_CH0,a,w,wl,r,rl)
+#define i2c_submit(x)             i2c_bb_submit(x)
+#endif
+
+void    i2c_hw_init(uint8_t clk, uint8_t speed);
+__monitor bool i2c_hw_submit(i2c_xfer *x);
+uint8_t i2c_hw_xfer(uint8_t addr, const uint8_t *wbuf, uint8_t wlen, uint8_t *rbuf, uint8_t rlen);
+void    i2c_hw_poll(void);
+void    i2c_hw_stats(void);
+
+#endif
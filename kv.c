@@ -0,0 +1,385 @@
+/*==================================================================
+  File Name: kv.c
+  Author   : Emile
+  ------------------------------------------------------------------
+  Purpose  : This files contains the configuration store: a log of
+             key/value records in the STM8 data EEPROM, see kv.h.
+  ------------------------------------------------------------------
+  This file is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+ 
+  This software is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+ 
+  You should have received a copy of the GNU General Public License
+  along with this software.  If not, see <http://www.gnu.org/licenses/>.
+  ================================================================== */ 
+#include <string.h>
+#include "kv.h"
+#include "eep.h"
+#include "uart.h"
+
+// Length of a record with len data bytes, a multiple of EEP_WORD
+#define KV_SIZE(len) (((len) + 4 + EEP_WORD - 1) & ~(EEP_WORD - 1))
+
+#if KV_HDR + 4 * KV_SIZE(KV_MAXLEN) + KV_SIZE(1) + 2 * KV_SIZE(4) > KV_SECSIZE
+#error "KV_SECSIZE too small: the newest record of every key must fit in a sector"
+#endif
+
+uint16_t kv_idx[KV_KEYS];   // EEPROM index of the newest record per key, 0 = none
+uint16_t kv_sec   = 0;      // EEPROM index of the active sector
+uint16_t kv_seq   = 0;      // sequence number of the active sector
+uint16_t kv_end   = 0;      // EEPROM index for the next record
+uint16_t kv_moves = 0;      // sectors filled up since power-up
+uint16_t kv_bad   = 0;      // records with a crc error, see kv_init()
+uint8_t  kv_rec[KV_RECLEN]; // record (or header) to write
+
+/*-----------------------------------------------------------------------------
+  Purpose  : This function checks the crc of a record or sector header.
+  Variables: a: EEPROM index of the record or header
+             n: number of bytes before the crc
+  Returns  : true = crc is correct
+  ---------------------------------------------------------------------------*/
+static bool kv_crc_ok(uint16_t a, uint8_t n)
+{
+    uint16_t crc = 0xFFFF;
+    uint8_t  i;
+    
+    for (i = 0; i < n; i++) crc = crc16_ccitt(crc, eep_read8(a + i));
+    return (crc == eep_read16(a + n));
+} // kv_crc_ok()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : This function builds a record in kv_rec[] and appends it to the
+             active sector. It is written one word per program cycle, so a
+             power failure can not damage the other records.
+  Variables: key: the key of the record
+             len: the number of data bytes, already in kv_rec[2..]
+  Returns  : -
+  ---------------------------------------------------------------------------*/
+static void kv_append(uint8_t key, uint8_t len)
+{
+    uint16_t crc = 0xFFFF;
+    uint8_t  i, n = KV_SIZE(len);
+    
+    kv_rec[0] = key;
+    kv_rec[1] = len;
+    for (i = 0; i < len + 2; i++) crc = crc16_ccitt(crc, kv_rec[i]);
+    kv_rec[i++] = (uint8_t)(crc >> 8);
+    kv_rec[i++] = (uint8_t)crc;
+    while (i < n) kv_rec[i++] = 0x00; // up to the next word
+    eep_write_words(kv_end, kv_rec, n);
+    kv_idx[key] = kv_end;
+    kv_end     += n;
+} // kv_append()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : This function writes the header of the active sector. Until
+             its last word is written, the previous sector is the active 
+             sector after a power-up.
+  Variables: -
+  Returns  : -
+  ---------------------------------------------------------------------------*/
+static void kv_commit(void)
+{
+    uint16_t crc = 0xFFFF;
+    uint8_t  i;
+    
+    kv_rec[0] = 'K';
+    kv_rec[1] = 'V';
+    kv_rec[2] = (uint8_t)(kv_seq >> 8);
+    kv_rec[3] = (uint8_t)kv_seq;
+    for (i = 0; i < 4; i++) crc = crc16_ccitt(crc, kv_rec[i]);
+    kv_rec[4] = (uint8_t)(crc >> 8);
+    kv_rec[5] = (uint8_t)crc;
+    kv_rec[6] = kv_rec[7] = 0x00;
+    eep_write_words(kv_sec, kv_rec, KV_HDR);
+} // kv_commit()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : This function starts a new sector: the next one (round-robin)
+             is erased and the newest record of every key is copied to it.
+             The header of the new sector is written by kv_commit(), after
+             the record that did not fit in the old sector.
+  Variables: skip: key of the record that did not fit, it is not copied
+  Returns  : -
+  ---------------------------------------------------------------------------*/
+static void kv_move(uint8_t skip)
+{
+    uint16_t sec = kv_sec + KV_SECSIZE;
+    uint16_t pos;
+    uint8_t  key, i, n;
+    
+    if (sec >= KV_SECTORS * KV_SECSIZE) sec = 0; // round-robin
+    memset(kv_rec, 0x00, KV_RECLEN);
+    eep_write_words(sec, kv_rec, KV_HDR); // old header first
+    for (pos = sec + KV_HDR; pos < sec + KV_SECSIZE; pos += n)
+    {   // erase the rest of the sector, no records in it yet
+        n = (sec + KV_SECSIZE - pos < KV_RECLEN) ? sec + KV_SECSIZE - pos : KV_RECLEN;
+        eep_write_block(pos, kv_rec, n);
+    } // for pos
+    pos = sec + KV_HDR;
+    for (key = KV_FREE + 1; key < KV_KEYS; key++)
+    {
+        if ((key == skip) || !kv_idx[key]) continue;
+        n = KV_SIZE(eep_read8(kv_idx[key] + 1));
+        for (i = 0; i < n; i++) kv_rec[i] = eep_read8(kv_idx[key] + i);
+        eep_write_block(pos, kv_rec, n);
+        kv_idx[key] = pos;
+        pos += n;
+    } // for key
+    kv_idx[skip] = 0;
+    kv_sec = sec;
+    kv_end = pos;
+    kv_seq++;
+} // kv_move()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : This function copies a text-string from the fixed EEPROM layout
+             of older versions into kv_rec[2..].
+  Variables: eep_address: the index number within the EEPROM.
+  Returns  : the length of the string, max. KV_MAXLEN
+  ---------------------------------------------------------------------------*/
+static uint8_t kv_old_string(uint16_t eep_address)
+{
+    uint8_t len = 0;
+    
+    while ((len < KV_MAXLEN) && ((kv_rec[2 + len] = eep_read8(eep_address + len)) != '\0')) len++;
+    return len;
+} // kv_old_string()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : This function starts the store in an EEPROM without a valid 
+             sector. The values in the fixed EEPROM layout of older versions
+             (EEP_TEXT1 .. EEP_BAUD3) are copied into the last sector, which
+             is not used by that layout.
+  Variables: -
+  Returns  : -
+  ---------------------------------------------------------------------------*/
+static void kv_format(void)
+{
+    uint32_t baud;
+    uint8_t  len;
+    
+    kv_sec = (KV_SECTORS - 2) * KV_SECSIZE; // kv_move() takes the next one
+    kv_seq = 0;
+    memset(kv_idx, 0, sizeof(kv_idx));
+    kv_move(KV_FREE);
+    if ((len = kv_old_string(EEP_TEXT1)) > 0) kv_append(KV_TEXT1, len);
+    if ((len = kv_old_string(EEP_TEXT2)) > 0) kv_append(KV_TEXT2, len);
+    if ((len = kv_old_string(EEP_COL1))  > 0) kv_append(KV_COL1 , len);
+    if ((len = kv_old_string(EEP_COL2))  > 0) kv_append(KV_COL2 , len);
+    if ((kv_rec[2] = eep_read8(EEP_DST_ACTIVE)) != 0x00) kv_append(KV_DST, 1);
+    if ((baud = eep_read32(EEP_BAUD1)) != 0) kv_write32(KV_BAUD1, baud);
+    if ((baud = eep_read32(EEP_BAUD3)) != 0) kv_write32(KV_BAUD3, baud);
+    kv_commit();
+} // kv_format()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : This function finds the active sector (valid header with the
+             highest sequence number) and builds the index of the newest
+             record of every key. Records with a crc error were being
+             written when the power failed, they are skipped.
+             Should be called upon initialization.
+  Variables: -
+  Returns  : -
+  ---------------------------------------------------------------------------*/
+void kv_init(void)
+{
+    uint16_t sec, seq, end;
+    uint8_t  key, len;
+    bool     found = false;
+    
+    for (sec = 0; sec < KV_SECTORS * KV_SECSIZE; sec += KV_SECSIZE)
+    {
+        if ((eep_read8(sec) == 'K') && (eep_read8(sec + 1) == 'V') && kv_crc_ok(sec, 4))
+        {
+            seq = eep_read16(sec + 2);
+            if (!found || ((int16_t)(seq - kv_seq) > 0))
+            {   // newest sector so far
+                kv_sec = sec;
+                kv_seq = seq;
+                found  = true;
+            } // if
+        } // if
+    } // for sec
+    kv_bad = kv_moves = 0;
+    if (!found) 
+    {
+        kv_format();
+        return;
+    } // if
+    memset(kv_idx, 0, sizeof(kv_idx));
+    kv_end = kv_sec + KV_HDR;
+    end    = kv_sec + KV_SECSIZE;
+    while (kv_end + 4 <= end)
+    {
+        key = eep_read8(kv_end);
+        len = eep_read8(kv_end + 1);
+        if ((key == KV_FREE) || (key >= KV_KEYS) || (len > KV_MAXLEN) ||
+            (kv_end + KV_SIZE(len) > end)) break; // end of the log
+        if (kv_crc_ok(kv_end, len + 2)) kv_idx[key] = kv_end;
+        else                            kv_bad++;
+        kv_end += KV_SIZE(len);
+    } // while
+} // kv_init()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : This function reads the value of a key.
+  Variables: key: the key to read
+             p  : the value is copied to p
+             max: the max. number of bytes to copy
+  Returns  : the length of the value, 0 if the key has no value
+  ---------------------------------------------------------------------------*/
+uint8_t kv_read(uint8_t key, uint8_t *p, uint8_t max)
+{
+    uint16_t a;
+    uint8_t  i, len;
+    
+    if ((key >= KV_KEYS) || !kv_idx[key]) return 0;
+    a   = kv_idx[key];
+    len = eep_read8(a + 1);
+    if (len > max) len = max;
+    for (i = 0; i < len; i++) p[i] = eep_read8(a + 2 + i);
+    return len;
+} // kv_read()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : This function writes a new value for a key. A record is added
+             to the active sector, nothing is written when the value did not
+             change. When the active sector is full, the next sector is 
+             started, see kv_move().
+  Variables: key: the key to write
+             p  : the new value
+             len: the number of bytes, max. KV_MAXLEN
+  Returns  : false = invalid key or length
+  ---------------------------------------------------------------------------*/
+bool kv_write(uint8_t key, const uint8_t *p, uint8_t len)
+{
+    uint16_t a;
+    uint8_t  i = 0;
+    bool     full;
+    
+    if ((key == KV_FREE) || (key >= KV_KEYS) || (len > KV_MAXLEN)) return false;
+    a = kv_idx[key];
+    if (a && (eep_read8(a + 1) == len))
+    {   // compare with the current value
+        while ((i < len) && (eep_read8(a + 2 + i) == p[i])) i++;
+        if (i == len) return true; // no change
+    } // if
+    full = (kv_end + KV_SIZE(len) > kv_sec + KV_SECSIZE);
+    if (full) kv_move(key);
+    memcpy(&kv_rec[2], p, len);
+    kv_append(key, len);
+    if (full)
+    {
+        kv_commit(); // the new sector is now the active one
+        kv_moves++;
+    } // if
+    return true;
+} // kv_write()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : This function reads an 8-bit value.
+  Variables: key: the key to read
+  Returns  : the value, 0 if the key has no value
+  ---------------------------------------------------------------------------*/
+uint8_t kv_read8(uint8_t key)
+{
+    uint8_t data = 0;
+    
+    kv_read(key, &data, 1);
+    return data;
+} // kv_read8()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : This function writes an 8-bit value.
+  Variables: key : the key to write
+             data: the new value
+  Returns  : -
+  ---------------------------------------------------------------------------*/
+void kv_write8(uint8_t key, uint8_t data)
+{
+    kv_write(key, &data, 1);
+} // kv_write8()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : This function reads a 32-bit value, stored MSB first.
+  Variables: key: the key to read
+  Returns  : the value, 0 if the key has no (valid) value
+  ---------------------------------------------------------------------------*/
+uint32_t kv_read32(uint8_t key)
+{
+    uint8_t b[4];
+    
+    if (kv_read(key, b, 4) < 4) return 0;
+    return ((uint32_t)b[0] << 24) | ((uint32_t)b[1] << 16) | ((uint16_t)b[2] << 8) | b[3];
+} // kv_read32()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : This function writes a 32-bit value, MSB first.
+  Variables: key : the key to write
+             data: the new value
+  Returns  : -
+  ---------------------------------------------------------------------------*/
+void kv_write32(uint8_t key, uint32_t data)
+{
+    uint8_t b[4];
+    
+    b[0] = (uint8_t)(data >> 24); // MSB first
+    b[1] = (uint8_t)(data >> 16);
+    b[2] = (uint8_t)(data >> 8);
+    b[3] = (uint8_t)data;
+    kv_write(key, b, 4);
+} // kv_write32()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : This function reads a text-string.
+  Variables: key: the key to read
+             s  : the string, max. KV_MAXLEN characters and a '\0'
+  Returns  : -
+  ---------------------------------------------------------------------------*/
+void kv_read_string(uint8_t key, char *s)
+{
+    s[kv_read(key, (uint8_t *)s, KV_MAXLEN)] = '\0';
+} // kv_read_string()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : This function writes a text-string, without the '\0'. A string
+             is max. KV_MAXLEN characters, longer strings are cut off.
+  Variables: key: the key to write
+             s  : the string
+  Returns  : -
+  ---------------------------------------------------------------------------*/
+void kv_write_string(uint8_t key, const char *s)
+{
+    size_t len = strlen(s);
+    
+    kv_write(key, (const uint8_t *)s, (len > KV_MAXLEN) ? KV_MAXLEN : (uint8_t)len);
+} // kv_write_string()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : This function prints the state of the configuration store: the
+             active sector, its sequence number, the bytes in use, the number
+             of times a sector was full and the records with a crc error.
+  Variables: -
+  Returns  : -
+  ---------------------------------------------------------------------------*/
+void kv_stats(void)
+{
+    uart1_printf("KV: sector ");
+    uart1_putu(kv_sec / KV_SECSIZE, 0, ' ');
+    uart1_printf(", seq ");
+    uart1_putu(kv_seq, 0, ' ');
+    uart1_printf(", ");
+    uart1_putu(kv_end - kv_sec, 0, ' ');
+    uart1_printf(" bytes used, ");
+    uart1_putu(kv_moves, 0, ' ');
+    uart1_printf(" sectors full, ");
+    uart1_putu(kv_bad, 0, ' ');
+    uart1_printf(" bad records\n");
+} // kv_stats()
@@ -0,0 +1,67 @@
+#ifndef _KV_H
+#define _KV_H
+/*==================================================================
+  File Name: kv.h
+  Author   : Emile
+  ------------------------------------------------------------------
+  Purpose  : This is the header-file for kv.c
+  ------------------------------------------------------------------
+  This file is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+ 
+  This software is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+ 
+  You should have received a copy of the GNU General Public License
+  along with this software.  If not, see <http://www.gnu.org/licenses/>.
+  ================================================================== */ 
+#include <stdint.h>
+#include <stdbool.h>
+
+//----------------------------------------------------------------------
+// The configuration is a log of records in the data EEPROM, divided in
+// KV_SECTORS sectors of KV_SECSIZE bytes. Only one sector is active, a 
+// new value is appended to it as a record:
+//   key len data[len] crc_hi crc_lo [0..3 zero bytes]
+// crc is CRC-16/CCITT over key, len and data. A record starts at a word
+// boundary (EEP_WORD), so appending a record never programs the words 
+// of another record. The newest record of a key holds its value. The 
+// erased EEPROM reads 0x00, key KV_FREE is the end of the log.
+// A sector starts with a header: 'K' 'V' seq_hi seq_lo crc_hi crc_lo 0 0
+// When the active sector is full, the newest record of every key is
+// copied to the next sector (round-robin), which gets seq+1. Its header
+// is written last: until then, the old sector is still the active one.
+//----------------------------------------------------------------------
+#define KV_SECTORS (3)   /* number of sectors */
+#define KV_SECSIZE (512) /* bytes per sector, a multiple of EEP_BLOCK */
+#define KV_HDR     (8)   /* bytes of the sector header */
+#define KV_MAXLEN  (99)  /* max. length of a value: a text without '\0' */
+#define KV_RECLEN  (KV_MAXLEN + 7) /* max. record length, incl. zero bytes */
+
+// Keys, every key has one value of 0..KV_MAXLEN bytes
+#define KV_FREE    (0)   /* erased EEPROM, not a key */
+#define KV_TEXT1   (1)   /* Text-string top-row */
+#define KV_TEXT2   (2)   /* Text-string bottom-row */
+#define KV_COL1    (3)   /* Colors for text-string top-row */
+#define KV_COL2    (4)   /* Colors for text-string bottom-row */
+#define KV_DST     (5)   /* 1 = DST is Active */
+#define KV_BAUD1   (6)   /* 32-bit baud-rate UART1, 0 = default */
+#define KV_BAUD3   (7)   /* 32-bit baud-rate UART3, 0 = default */
+#define KV_KEYS    (8)   /* number of keys, incl. KV_FREE */
+
+void     kv_init(void);
+uint8_t  kv_read(uint8_t key, uint8_t *p, uint8_t max);
+bool     kv_write(uint8_t key, const uint8_t *p, uint8_t len);
+uint8_t  kv_read8(uint8_t key);
+void     kv_write8(uint8_t key, uint8_t data);
+uint32_t kv_read32(uint8_t key);
+void     kv_write32(uint8_t key, uint32_t data);
+void     kv_read_string(uint8_t key, char *s);
+void     kv_write_string(uint8_t key, const char *s);
+void     kv_stats(void);
+
+#endif
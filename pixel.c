@@ -20,6 +20,15 @@
 #include <stdlib.h>
 #include "pixel.h"
 #include "tetris.h"
+#include "uart.h"
+
+// decode_frame(): byte i of an image plane is byte (i ^ BYTE_SWAP) of the
+// row words. The STM8 is big-endian, the host tests run little-endian.
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define BYTE_SWAP (1)
+#else
+#define BYTE_SWAP (0)
+#endif
 
 extern uint16_t rgb_bufr[]; // Buffered version of the red leds
 extern uint16_t rgb_bufg[]; // Buffered version of the green leds
@@ -29,6 +38,20 @@ extern uint16_t fieldg[]; // Tetris playfield green leds
 extern uint16_t fieldb[]; // Tetris playfield blue leds
 extern uint8_t  atascii[128][8]; // Atari XL Font
 extern uint8_t  font3x5[][5];    // Small font for score
+#if ROW_STREAM
+extern uint8_t  row_stream[2][MAX_Y][SIZE_X]; // PC_ODR bytes for every row
+#else
+extern uint16_t frame_bufr[2][BCM_PLANES][MAX_Y]; // Front and back buffer red leds
+extern uint16_t frame_bufg[2][BCM_PLANES][MAX_Y]; // Front and back buffer green leds
+extern uint16_t frame_bufb[2][BCM_PLANES][MAX_Y]; // Front and back buffer blue leds
+#endif
+#if BCM_PLANES > 1
+extern uint16_t bcm_bufr[BCM_PLANES][MAX_Y]; // Bit-planes red leds
+extern uint16_t bcm_bufg[BCM_PLANES][MAX_Y]; // Bit-planes green leds
+extern uint16_t bcm_bufb[BCM_PLANES][MAX_Y]; // Bit-planes blue leds
+#endif
+extern uint8_t  front_buf; // Index of the buffer shown by the TIM2 ISR
+extern bool     swap_req;  // true = swap buffers at next frame
 
 /*-------------------------------------------------------------------------
  Purpose   : This function clears an entire screen.
@@ -49,7 +72,14 @@ void clearScreen(bool screen)
         for (uint8_t i = 0; i < MAX_Y; i++)
         {
             rgb_bufr[i] = rgb_bufg[i] = rgb_bufb[i] = BLACK;
+#if BCM_PLANES > 1
+            for (uint8_t k = 0; k < BCM_PLANES; k++)
+            {
+                bcm_bufr[k][i] = bcm_bufg[k][i] = bcm_bufb[k][i] = BLACK;
+            } // for k
+#endif
         } // for i
+        mark_all_rows_dirty();
     } // if
 } // clearScreen()
 
@@ -93,10 +123,98 @@ void setPixel(bool screen, int8_t x, int8_t y, uint8_t col)
             if ((col & BLUE)  ==  BLUE)   
                  rgb_bufb[y]  |=  bt;
             else rgb_bufb[y]  &= ~bt;
+#if BCM_PLANES > 1
+            for (uint8_t k = 0; k < BCM_PLANES; k++)
+            {   // remove a 12-bit colour set by setPixel12()
+                bcm_bufr[k][y] &= ~bt;
+                bcm_bufg[k][y] &= ~bt;
+                bcm_bufb[k][y] &= ~bt;
+            } // for k
+#endif
+            mark_row_dirty(y);
         } // if        
     } // else
 } // setPixel()
 
+/*-------------------------------------------------------------------------
+ Purpose   : This function sets a 12-bit colour of a pixel in a screen.
+             With BCM_PLANES > 1, the upper BCM_PLANES bits of every colour
+             are written into the bit-planes. Otherwise, and for the Tetris
+             playfield, a colour is on when its MSB is set.
+  Variables: screen: [FIELD,SCREEN], Tetris playfield or main-screen
+             x     : the x position of the pixel in the playfield
+  	     y     : the y position of the pixel in the playfield
+  	     col12 : the 12-bit colour 0xRGB, see RGB12()
+  Returns  : -
+  -------------------------------------------------------------------------*/
+void setPixel12(bool screen, int8_t x, int8_t y, uint16_t col12)
+{
+#if BCM_PLANES > 1
+    uint16_t bt;
+    uint8_t  r, g, b;
+    
+    if ((screen == SCREEN) && (x >= 0) && (y >= 0) && (x < SIZE_X) && (y < MAX_Y))
+    {
+        bt = (1<<x);
+        rgb_bufr[y] &= ~bt; // no full-intensity colour
+        rgb_bufg[y] &= ~bt;
+        rgb_bufb[y] &= ~bt;
+        r = (uint8_t)(col12 >> (12 - BCM_PLANES)) & BCM_MASK;
+        g = (uint8_t)(col12 >> ( 8 - BCM_PLANES)) & BCM_MASK;
+        b = (uint8_t)(col12 >> ( 4 - BCM_PLANES)) & BCM_MASK;
+        for (uint8_t k = 0; k < BCM_PLANES; k++)
+        {   // bit k of every colour goes into plane k
+            if (r & 0x01) bcm_bufr[k][y] |=  bt;
+            else          bcm_bufr[k][y] &= ~bt;
+            if (g & 0x01) bcm_bufg[k][y] |=  bt;
+            else          bcm_bufg[k][y] &= ~bt;
+            if (b & 0x01) bcm_bufb[k][y] |=  bt;
+            else          bcm_bufb[k][y] &= ~bt;
+            r >>= 1; g >>= 1; b >>= 1;
+        } // for k
+        mark_row_dirty(y);
+        return;
+    } // if
+#endif
+    uint8_t col = BLACK;
+    
+    if (col12 & 0x0800) col |= RED;
+    if (col12 & 0x0080) col |= GREEN;
+    if (col12 & 0x0008) col |= BLUE;
+    setPixel(screen, x, y, col);
+} // setPixel12()
+
+/*-------------------------------------------------------------------------
+ Purpose   : This function returns the 12-bit colour of a pixel in a screen.
+             A pixel set with setPixel() returns 0xF for every colour set.
+  Variables: screen: [FIELD,SCREEN], Tetris playfield or main-screen
+             x  : the x position of the pixel in the playfield
+  	     y  : the y position of the pixel in the playfield
+  Returns  : the 12-bit colour 0xRGB of the pixel
+  -------------------------------------------------------------------------*/
+uint16_t getPixel12(bool screen, int8_t x, int8_t y)
+{
+    uint8_t col = getPixel(screen, x, y);
+    uint8_t r   = (col & RED)   ? 0x0F : 0x00;
+    uint8_t g   = (col & GREEN) ? 0x0F : 0x00;
+    uint8_t b   = (col & BLUE)  ? 0x0F : 0x00;
+#if BCM_PLANES > 1
+    uint16_t bt;
+    
+    if ((screen == SCREEN) && (x >= 0) && (y >= 0) && (x < SIZE_X) && (y < MAX_Y))
+    {
+        bt = (1<<x);
+        for (int8_t k = BCM_PLANES-1; k >= 0; k--)
+        {   // plane k is bit k of the upper BCM_PLANES bits
+            if (bcm_bufr[k][y] & bt) r |= (1 << (4 - BCM_PLANES + k));
+            if (bcm_bufg[k][y] & bt) g |= (1 << (4 - BCM_PLANES + k));
+            if (bcm_bufb[k][y] & bt) b |= (1 << (4 - BCM_PLANES + k));
+        } // for k
+    } // if
+#endif
+    return RGB12(r,g,b);
+} // getPixel12()
+
 /*-------------------------------------------------------------------------
  Purpose   : This function returns the color of a pixel in a screen.
   Variables: screen: [FIELD,SCREEN], Tetris playfield or main-screen
@@ -267,3 +385,162 @@ void drawLine(bool screen, int8_t x0, int8_t y0, int8_t x1, int8_t y1, uint8_t c
         } // if
     } // for
 } // drawLine()
+
+#if ROW_STREAM
+/*-------------------------------------------------------------------------
+ Purpose   : This function converts all rows that were changed since this
+             buffer was last encoded into the row_stream[buf] table. Every 
+             entry of this table is a ready-made PC_ODR byte for one column: 
+             the SDIN bits are inverted (a LED is on when its bit is 0) and 
+             SHCP and STCP are 0. The TIM2 ISR then only has to write this 
+             byte to PC_ODR and clock the shift-registers. Only PC_MATRIX
+             bits are set here, the ISR adds the other PC_ODR bits.
+  Variables: buf: [0,1] the row_stream buffer to encode, never the front one
+  Returns  : -
+  -------------------------------------------------------------------------*/
+void encode_dirty_rows(uint8_t buf)
+{
+    uint16_t r, g, b;
+    uint8_t  x, y, byte;
+    uint8_t  mask = (1 << buf);
+    uint8_t  *p;
+    
+    for (y = 0; y < MAX_Y; y++)
+    {
+        if (rows_dirty[y] & mask)
+        {
+            rows_dirty[y] &= ~mask; // other buffer still needs this row
+            r = rgb_bufr[y];
+            g = rgb_bufg[y];
+            b = rgb_bufb[y];
+            p = row_stream[buf][y];
+            for (x = 0; x < SIZE_X; x++)
+            {   // bit 0 is the first column to send to the shift-registers
+                byte = 0x00;
+                if (!(r & 0x0001)) byte |= SDIN_R;
+                if (!(g & 0x0001)) byte |= SDIN_G;
+                if (!(b & 0x0001)) byte |= SDIN_B;
+                *p++ = byte;
+                r >>= 1; g >>= 1; b >>= 1;
+            } // for x
+        } // if
+    } // for y
+} // encode_dirty_rows()
+#endif
+
+/*-------------------------------------------------------------------------
+ Purpose   : This function copies the drawing buffer rgb_bufr/g/b into the 
+             back buffer and asks the TIM2 ISR to show it. The ISR swaps 
+             front and back buffer when current_row wraps to 0, so a frame
+             is never shown half-drawn. rgb_bufr/g/b itself is not changed, 
+             tasks that only update part of the screen can continue drawing.
+  Variables: -
+  Returns  : true: frame is queued for display
+             false: previous frame not shown yet, try again next frame
+  -------------------------------------------------------------------------*/
+bool present(void)
+{
+    uint8_t back;
+    
+    if (swap_req) return false; // back buffer is still waiting for the ISR
+    back = front_buf ^ 0x01;
+#if ROW_STREAM
+    encode_dirty_rows(back);
+#else
+    for (uint8_t k = 0; k < BCM_PLANES; k++)
+    {
+        for (uint8_t i = 0; i < MAX_Y; i++)
+        {   // full-intensity colours are on in every plane
+#if BCM_PLANES > 1
+            frame_bufr[back][k][i] = rgb_bufr[i] | bcm_bufr[k][i];
+            frame_bufg[back][k][i] = rgb_bufg[i] | bcm_bufg[k][i];
+            frame_bufb[back][k][i] = rgb_bufb[i] | bcm_bufb[k][i];
+#else
+            frame_bufr[back][k][i] = rgb_bufr[i];
+            frame_bufg[back][k][i] = rgb_bufg[i];
+            frame_bufb[back][k][i] = rgb_bufb[i];
+#endif
+        } // for i
+    } // for k
+#endif
+    swap_req = true; // swap at the next frame
+    return true;
+} // present()
+
+/*-------------------------------------------------------------------------
+ Purpose   : This function decodes a binary frame received by UART1 into
+             rgb_bufr/g/b, see uart.h for the frame types. Only the rows
+             that are changed by the frame are marked dirty.
+  Variables: type: [BIN_FRAME, BIN_ROWS, BIN_XRLE]
+             p   : the payload of the frame
+             len : the payload length
+  Returns  : true: frame decoded; false: frame is invalid, the screen may
+             be partly updated.
+  -------------------------------------------------------------------------*/
+bool decode_frame(uint8_t type, const uint8_t *p, uint8_t len)
+{
+    // The STM8 is big-endian: byte 2y of a plane is the MSB of row y
+    uint8_t  *plane[3] = {(uint8_t *)rgb_bufr, (uint8_t *)rgb_bufg, (uint8_t *)rgb_bufb};
+    uint8_t  i, k, c, y;
+    uint16_t pos = 0; // byte index in the image, 0..BIN_FRAME_LEN
+    
+    switch (type)
+    {
+        case BIN_FRAME: for (k = 0; k < 3; k++)
+                        {
+#if BYTE_SWAP
+                            for (i = 0; i < 2 * MAX_Y; i++) plane[k][i ^ 1] = p[k * 2 * MAX_Y + i];
+#else
+                            memcpy(plane[k], p + k * 2 * MAX_Y, 2 * MAX_Y);
+#endif
+                        } // for k
+                        mark_all_rows_dirty();
+                        return true;
+        case BIN_ROWS : for (i = 0; i < len; i += BIN_ROW_SIZE)
+                        {
+                            y = p[i];
+                            if (y >= MAX_Y) return false;
+                            rgb_bufr[y] = ((uint16_t)p[i+1] << 8) | p[i+2];
+                            rgb_bufg[y] = ((uint16_t)p[i+3] << 8) | p[i+4];
+                            rgb_bufb[y] = ((uint16_t)p[i+5] << 8) | p[i+6];
+                            mark_row_dirty(y);
+                        } // for i
+                        return true;
+        case BIN_XRLE : i = 0;
+                        while (i < len)
+                        {
+                            c = p[i++];
+                            if (c & 0x80)
+                            {   // skip unchanged bytes
+                                pos += (c & 0x7F) + 1;
+                                continue;
+                            } // if
+                            if ((i + c + 1 > len) || (pos + c + 1 > BIN_FRAME_LEN)) return false;
+                            for (k = 0; k <= c; k++, pos++)
+                            {   // XOR c+1 bytes into the image
+                                y = pos % (2 * MAX_Y);
+                                plane[pos / (2 * MAX_Y)][y ^ BYTE_SWAP] ^= p[i++];
+                                mark_row_dirty(y >> 1);
+                            } // for k
+                        } // while
+                        return (pos <= BIN_FRAME_LEN);
+        default       : return false;
+    } // switch
+} // decode_frame()
+
+/*-------------------------------------------------------------------------
+ Purpose   : This function fills both front and back buffer with the 
+             contents of rgb_bufr/g/b. Call it once, before the TIM2 
+             interrupt is enabled.
+  Variables: -
+  Returns  : -
+  -------------------------------------------------------------------------*/
+void init_frame_buffers(void)
+{
+    mark_all_rows_dirty();
+    present();          // fill back buffer
+    front_buf ^= 0x01;  // show it
+    swap_req   = false;
+    present();          // fill other buffer
+    swap_req   = false;
+} // init_frame_buffers()
@@ -20,6 +20,7 @@
   along with this software.  If not, see <http://www.gnu.org/licenses/>.
   ================================================================== */ 
 #include <stdint.h>
+#include <string.h>
 #include "stm8_hw_init.h"
 
 // List of directions
@@ -42,11 +43,34 @@
 #define CYAN    (BLUE | GREEN)
 #define WHITE   (BLUE | GREEN | RED)
 
+//----------------------------------------------------------------------
+// 12-bit colours for setPixel12() and getPixel12(): 0xRGB, 4 bits each. 
+// Only the upper BCM_PLANES bits of every colour are displayed.
+//----------------------------------------------------------------------
+#define RGB12(r,g,b) ((uint16_t)((((r) & 0x0F) << 8) | (((g) & 0x0F) << 4) | ((b) & 0x0F)))
+#define BCM_MASK     ((1 << BCM_PLANES) - 1)
+
+#if ROW_STREAM
+extern uint8_t rows_dirty[]; // bit n set = row must be encoded again in row_stream[n]
+
+// Every function that changes rgb_bufr/g/b[y] should mark row y as dirty
+#define mark_row_dirty(y)     (rows_dirty[y] = 0x03)
+#define mark_all_rows_dirty() (memset(rows_dirty,0x03,MAX_Y))
+#else
+#define mark_row_dirty(y)
+#define mark_all_rows_dirty()
+#endif
+
 void    clearScreen(bool screen);
 void    setPixel(bool screen, int8_t x, int8_t y, uint8_t col);
 uint8_t getPixel(bool screen, int8_t x, int8_t y);
+void     setPixel12(bool screen, int8_t x, int8_t y, uint16_t col12);
+uint16_t getPixel12(bool screen, int8_t x, int8_t y);
 void    printChar(bool screen, int8_t x, int8_t y, uint8_t ch, uint8_t col, bool hv);
 void    printSmallChar(bool screen, int8_t x, int8_t y, uint8_t ch, uint8_t col, bool hv);
 void    drawLine(bool screen, int8_t x0, int8_t y0, int8_t x1, int8_t y1, uint8_t col);
+void    init_frame_buffers(void);
+bool    present(void);
+bool    decode_frame(uint8_t type, const uint8_t *p, uint8_t len);
 
 #endif
\ No newline at end of file
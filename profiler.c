@@ -0,0 +1,193 @@
+/*==================================================================
+  File Name: profiler.c
+  Author   : Emile
+  ------------------------------------------------------------------
+  Purpose  : This files contains a cycle-accurate profiler for the
+             interrupt routines and the scheduler tasks. For every
+             slot the min., max., mean and a log2 histogram of the
+             number of clock-cycles is kept.
+  ------------------------------------------------------------------
+  This file is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+ 
+  This software is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+ 
+  You should have received a copy of the GNU General Public License
+  along with this software.  If not, see <http://www.gnu.org/licenses/>.
+  ================================================================== */ 
+#include <string.h>
+#include "profiler.h"
+#ifdef PROF_TIM3
+#include "stm8_hw_init.h"
+#endif
+
+prof_struct prof[PROF_SLOTS]; // statistics for every ISR and task
+uint32_t    prof_ovh = 0;     // cycles needed by PROF_START() + PROF_STOP()
+
+volatile bool idle_sleep = false;        // true = CPU is in WFI, cleared by IDLE_WAKEUP()
+volatile uint32_t idle_wake;             // PROF_CLOCK() at wake-up, set by IDLE_WAKEUP()
+uint32_t    load_start;                  // PROF_CLOCK() at start of window
+uint32_t    load_idle;                   // idle cycles in current window
+uint32_t    load_win_idle[LOAD_WINDOWS]; // idle cycles of previous windows
+uint32_t    load_win_len[LOAD_WINDOWS];  // length of previous windows
+uint8_t     load_idx = 0;                // index in load_win_idle[]
+
+#ifdef PROF_TIM3
+uint16_t    prof_ovf = 0;     // upper 16 bits of the TIM3 cycle counter
+
+/*-----------------------------------------------------------------------------
+  Purpose  : TIM3 overflow interrupt, every 65536 clock-cycles (2.7 msec.
+             at 24 MHz). It extends the TIM3 counter to 32 bits.
+  Variables: -
+  Returns  : -
+  ---------------------------------------------------------------------------*/
+#pragma vector = TIM3_OVR_UIF_vector
+__interrupt void TIM3_UPD_OVF_IRQHandler(void)
+{
+    IDLE_WAKEUP(); // before prof_ovf++, PROF_CLOCK() adds the pending overflow
+    prof_ovf++;
+    TIM3_SR1_UIF = 0; // Reset the interrupt
+} // TIM3_UPD_OVF_IRQHandler()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : This function returns the 32-bit cycle counter. An overflow
+             that is pending but not yet handled by the TIM3 ISR (e.g. when
+             called from another ISR) is added here.
+  Variables: -
+  Returns  : the number of clock-cycles since prof_init()
+  ---------------------------------------------------------------------------*/
+__monitor uint32_t prof_clock(void)
+{
+    uint16_t hi = prof_ovf;
+    uint8_t  h  = TIM3_CNTRH; // reading CNTRH latches CNTRL
+    uint8_t  l  = TIM3_CNTRL;
+    
+    if (TIM3_SR1_UIF && !(h & 0x80)) hi++; // counter wrapped, ISR not run yet
+    return ((uint32_t)hi << 16) | ((uint16_t)h << 8) | l;
+} // prof_clock()
+#endif
+
+/*-----------------------------------------------------------------------------
+  Purpose  : This function starts TIM3 as a free-running counter at fMASTER
+             and measures the overhead of PROF_START() and PROF_STOP().
+             Should be called before interrupts are enabled.
+  Variables: -
+  Returns  : -
+  ---------------------------------------------------------------------------*/
+void prof_init(void)
+{
+    uint32_t t;
+    
+#ifdef PROF_TIM3
+    TIM3_PSCR    = 0x00; // Prescaler = 1, count clock-cycles
+    TIM3_ARRH    = 0xFF; // Count to 0xFFFF
+    TIM3_ARRL    = 0xFF;
+    TIM3_IER_UIE = 1;    // Enable TIM3 overflow interrupt
+    TIM3_CR1_CEN = 1;    // Start TIM3
+#endif
+    prof_ovh = 0;
+    t        = PROF_CLOCK();
+    prof_ovh = PROF_CLOCK() - t;
+    prof_reset();
+    load_start = PROF_CLOCK();
+} // prof_init()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : This function clears all profiler statistics.
+  Variables: -
+  Returns  : -
+  ---------------------------------------------------------------------------*/
+__monitor void prof_reset(void)
+{
+    memset(prof,0x00,sizeof(prof));
+} // prof_reset()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : This function adds one measurement to a profiler slot.
+             Called by PROF_STOP(), also from within interrupt routines.
+  Variables: id    : index in prof[], see PROF_TIM2 .. PROF_TASK0
+             cycles: the measured number of clock-cycles
+  Returns  : -
+  ---------------------------------------------------------------------------*/
+void prof_add(uint8_t id, uint32_t cycles)
+{
+    prof_struct *p;
+    uint8_t      bin = 0;
+    
+    if (id >= PROF_SLOTS) return;
+    p = &prof[id];
+    if (cycles > prof_ovh) cycles -= prof_ovh;
+    else                   cycles  = 0;
+    if (!p->cnt || (cycles < p->min)) p->min = cycles;
+    if (cycles > p->max)              p->max = cycles;
+    if ((p->cnt == UINT16_MAX) || (p->sum > UINT32_MAX - cycles))
+    {   // halve both, the mean stays the same
+        p->sum >>= 1;
+        p->cnt >>= 1;
+    } // if
+    p->sum += cycles;
+    p->cnt++;
+    while ((cycles >>= 1) && (bin < PROF_BINS-1)) bin++;
+    if (p->hist[bin] < UINT16_MAX) p->hist[bin]++;
+} // prof_add()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : This function returns a consistent copy of a profiler slot.
+  Variables: id: index in prof[], see PROF_TIM2 .. PROF_TASK0
+             p : pointer to the copy
+  Returns  : true = slot contains measurements
+  ---------------------------------------------------------------------------*/
+__monitor bool prof_get(uint8_t id, prof_struct *p)
+{
+    if (id >= PROF_SLOTS) return false;
+    memcpy(p,&prof[id],sizeof(prof_struct));
+    return (p->cnt > 0);
+} // prof_get()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : This function adds idle cycles to the current load window and
+             starts a new window after LOAD_WIN_CYCLES. It is called by
+             dispatch_tasks() every time, also when the CPU did not sleep.
+  Variables: cycles: number of idle cycles (0 = CPU did not sleep)
+  Returns  : -
+  ---------------------------------------------------------------------------*/
+void load_add_idle(uint32_t cycles)
+{
+    uint32_t now = PROF_CLOCK();
+    
+    load_idle += cycles;
+    if (now - load_start >= LOAD_WIN_CYCLES)
+    {   // window is complete
+        load_win_idle[load_idx] = load_idle;
+        load_win_len[load_idx]  = now - load_start;
+        if (++load_idx >= LOAD_WINDOWS) load_idx = 0;
+        load_idle  = 0;
+        load_start = now;
+    } // if
+} // load_add_idle()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : This function returns the CPU load over the last LOAD_WINDOWS
+             windows (2 sec.). Only complete windows are used.
+  Variables: -
+  Returns  : CPU load in 0.1 % (0..1000)
+  ---------------------------------------------------------------------------*/
+uint16_t cpu_load(void)
+{
+    uint32_t idle = 0;
+    uint32_t len  = 0;
+    
+    for (uint8_t i = 0; i < LOAD_WINDOWS; i++)
+    {
+        idle += load_win_idle[i];
+        len  += load_win_len[i];
+    } // for i
+    len /= 1000; // idle * 1000 would overflow
+    if (!len || (idle / len > 1000)) return 0;
+    return (uint16_t)(1000 - idle / len);
+} // cpu_load()
@@ -0,0 +1,95 @@
+#ifndef _PROFILER_H
+#define _PROFILER_H
+/*==================================================================
+  File Name: profiler.h
+  Author   : Emile
+  ------------------------------------------------------------------
+  Purpose  : This is the header-file for profiler.c
+  ------------------------------------------------------------------
+  This file is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+ 
+  This software is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+ 
+  You should have received a copy of the GNU General Public License
+  along with this software.  If not, see <http://www.gnu.org/licenses/>.
+  ================================================================== */ 
+#include <stdint.h>
+#include <stdbool.h>
+#include "scheduler.h"
+
+//---------------------------------------------------------------
+// PROFILER: 1 = measure the ISRs and tasks in clock-cycles,
+//           0 = PROF_START() and PROF_STOP() generate no code.
+//---------------------------------------------------------------
+#define PROFILER      (1)
+
+//---------------------------------------------------------------
+// PROF_CLOCK() returns a free-running 32-bit cycle counter. On the
+// STM8 this is TIM3 (fMASTER, no prescaler) extended with an
+// overflow counter. A host build defines PROF_CLOCK() itself,
+// e.g. -DPROF_CLOCK()=host_cycles(), and then TIM3 is not used.
+//---------------------------------------------------------------
+#ifndef PROF_CLOCK
+#define PROF_TIM3     (1)
+#define PROF_CLOCK()  prof_clock()
+#endif
+
+// Indices in prof[]
+#define PROF_TIM2     (0) /* TIM2 display + scheduler ISR */
+#define PROF_UART1_RX (1)
+#define PROF_UART1_TX (2)
+#define PROF_UART3_RX (3)
+#define PROF_UART3_TX (4)
+#define PROF_TASK0    (5) /* task_list[i] uses prof[PROF_TASK0 + i] */
+#define PROF_SLOTS    (PROF_TASK0 + MAX_TASKS)
+
+#define PROF_BINS     (24) /* bin k: 2^k <= cycles < 2^(k+1), bin 0: 0..1 */
+
+typedef struct _prof_struct
+{
+    uint32_t min;             // Min. measured cycles
+    uint32_t max;             // Max. measured cycles
+    uint32_t sum;             // Sum of cycles, halved together with cnt
+    uint16_t cnt;             // Number of measurements in sum
+    uint16_t hist[PROF_BINS]; // log2 histogram of cycles
+} prof_struct;
+
+//---------------------------------------------------------------
+// CPU load: dispatch_tasks() sleeps (WFI) when there is nothing to
+// do. The idle cycles are summed per window of LOAD_WIN_CYCLES and
+// the load is averaged over the last LOAD_WINDOWS windows.
+//---------------------------------------------------------------
+#define LOAD_WIN_CYCLES (6000000UL) /* 250 msec. at 24 MHz */
+#define LOAD_WINDOWS    (8)         /* load is averaged over 2 sec. */
+
+extern volatile bool     idle_sleep; // true = CPU is in WFI, set by dispatch_tasks()
+extern volatile uint32_t idle_wake;  // PROF_CLOCK() at wake-up
+
+// Every ISR that can end a WFI starts with this, so that the time of the
+// ISR itself is not counted as idle time.
+#define IDLE_WAKEUP()   if (idle_sleep) { idle_wake = PROF_CLOCK(); idle_sleep = false; }
+
+#if PROFILER
+#define PROF_START(t)    uint32_t t = PROF_CLOCK()
+#define PROF_STOP(id,t)  prof_add(id, PROF_CLOCK() - (t))
+#else
+#define PROF_START(t)
+#define PROF_STOP(id,t)
+#endif
+
+#ifdef PROF_TIM3
+__monitor uint32_t prof_clock(void);
+#endif
+void     prof_init(void);
+__monitor void prof_reset(void);
+void     prof_add(uint8_t id, uint32_t cycles);
+__monitor bool prof_get(uint8_t id, prof_struct *p);
+void     load_add_idle(uint32_t cycles);
+uint16_t cpu_load(void);
+#endif
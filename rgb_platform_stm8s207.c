@@ -21,14 +21,22 @@
 #include "pixel.h"
 #include "tetris.h"
 #include "eep.h"
-#include "i2c_bb.h"
+#include "kv.h"
+#include "i2c_hw.h"
 #include "i2c_ds3231_bb.h"
+#include "profiler.h"
+#include "esp8266.h"
 
 char   *revision_nr = "0.32";   // RGB Platform SW revision number
 extern uint8_t atascii[128][8]; // Atari XL Font
-extern char rs232_inbuf[];
+extern cmd_port cmd_ports[];   // command ports, see command_interpreter.c
 bool   dst_active = false; // true = Daylight Saving Time active
 Time   dt;                 // Struct with time and date values, updated every sec.
+task_handle disp_task = TASK_NONE; // display task, stopped while streaming
+task_handle strm_task = TASK_NONE; // stream_task()
+uint16_t strm_frames[3] = {0};     // frames decoded, per type BIN_FRAME..BIN_XRLE
+uint16_t strm_err       = 0;       // frames that could not be decoded
+uint32_t strm_bytes     = 0;       // bytes received for all decoded frames
 
 //-------------------------------------------------------------------------
 // Array which holds the Red, Green & Blue bits for every RGB-LED.
@@ -40,6 +48,31 @@ Time   dt;                 // Struct with time and date values, updated every se
 uint16_t rgb_bufr[MAX_Y] = {0}; // The actual status of the red leds
 uint16_t rgb_bufg[MAX_Y] = {0}; // The actual status of the green leds
 uint16_t rgb_bufb[MAX_Y] = {0}; // The actual status of the blue leds
+//-------------------------------------------------------------------------
+// rgb_bufr/g/b is only a drawing buffer, the TIM2 ISR shows one of the two
+// frame buffers below. present() copies rgb_bufr/g/b into the back buffer.
+//-------------------------------------------------------------------------
+#if ROW_STREAM
+//-------------------------------------------------------------------------
+// Pre-encoded version of rgb_bufr/g/b, this is what the TIM2 ISR sends.
+// row_stream[n][y][x] is the PC_ODR byte for column x of row y.
+//-------------------------------------------------------------------------
+uint8_t  row_stream[2][MAX_Y][SIZE_X]; // PC_ODR bytes for every row
+uint8_t  rows_dirty[MAX_Y];            // bit n set = row_stream[n] is not up to date
+#else
+uint16_t frame_bufr[2][BCM_PLANES][MAX_Y]; // Front and back buffer red leds
+uint16_t frame_bufg[2][BCM_PLANES][MAX_Y]; // Front and back buffer green leds
+uint16_t frame_bufb[2][BCM_PLANES][MAX_Y]; // Front and back buffer blue leds
+#endif
+#if BCM_PLANES > 1
+//-------------------------------------------------------------------------
+// Bit-planes for 12-bit colours set with setPixel12(). Plane k is shown
+// for 2^k time units. A bit set in rgb_bufr/g/b is shown at full intensity.
+//-------------------------------------------------------------------------
+uint16_t bcm_bufr[BCM_PLANES][MAX_Y]; // Bit-planes red leds
+uint16_t bcm_bufg[BCM_PLANES][MAX_Y]; // Bit-planes green leds
+uint16_t bcm_bufb[BCM_PLANES][MAX_Y]; // Bit-planes blue leds
+#endif
 
 //-------------------------------------------------------------------------
 // Global variables for lichtkrant() function
@@ -77,6 +110,7 @@ void lichtkrant(void)
     lichtkrant1();             // top row
     if (lk2run) lichtkrant2(); // bottom row
     lk2run = !lk2run;          // twice as slow as top row
+    present();                 // show at next frame
     BG_LEDb = 0;               // Stop time-measurement
 } // lichtkrant()
 
@@ -143,6 +177,7 @@ void lichtkrant1(void)
                  rgb_bufb[cy] &= 0x00FF; // clear bits 15-08
                  rgb_bufb[cy] |= (rgb_bufb[cy-1] & 0xFF00);
             } // for cy
+            mark_all_rows_dirty();
             chi = (uint8_t)lk1[cur_row1_idx]; // get new character
             col = lk1c[cur_row1_idx];
             for (bit = 0; bit < 8; bit++)
@@ -213,6 +248,7 @@ void lichtkrant2(void)
                  rgb_bufb[cy] &= 0xFF00; // clear bits 07-00
                  rgb_bufb[cy] |= (rgb_bufb[cy-1] & 0x00FF);
             } // for cy
+            mark_all_rows_dirty();
             chi = (uint8_t)lk2[cur_row2_idx]; // get new character
             col = lk2c[cur_row2_idx];         // get color of new character
             for (bit = 0; bit < 8; bit++)
@@ -315,6 +351,8 @@ void test_playfield(void)
             cntr = RED;
             break;
    } // switch
+   mark_all_rows_dirty();
+   present();   // show at next frame
    BG_LEDb = 0; // Stop time-measurement
 } // test_playfield()
 
@@ -352,12 +390,14 @@ Purpose  : This task is called every minute by pattern_task(). It checks
            for a change from summer- to wintertime and vice-versa.
            To start DST: Find the last Sunday in March  : @2 AM advance clock to 3 AM.
            To stop DST : Find the last Sunday in October: @3 AM set clock back to 2 AM (only once!).
-Variables: p: pointer to time-struct
-Returns  : -
+           It does not write to the DS3231 itself: clock_task() does that
+           without waiting, and then sets KV_DST to dst_active.
+Variables: p: pointer to time-struct, the time to write to the DS3231
+Returns  : true = p->hour, p->min and p->sec must be written to the DS3231
 ------------------------------------------------------------------------*/
-void check_and_set_summertime(void)
+bool check_and_set_summertime(Time *p)
 {
-    uint8_t        hr,day,lsun03,lsun10,dst_eep;
+    uint8_t        day,lsun03,lsun10,dst_eep;
     static uint8_t advance_time = 0;
     static uint8_t revert_time  = 0;
     
@@ -376,11 +416,12 @@ void check_and_set_summertime(void)
                 else if (dt.hour < 2)     dst_active = false;
                 break;
         case 1: // Now advance time, do this only once
-             ds3231_settime(3,0,dt.sec); // Set time to 3:00, leave secs the same
+             p->hour = 3;      // Set time to 3:00, leave secs the same
+             p->min  = 0;
+             p->sec  = dt.sec;
              advance_time = 2;
              dst_active   = true;
-             eep_write8(EEP_DST_ACTIVE,0x01); // set DST in eeprom
-             break;
+             return true; // and set DST in eeprom
         case 2: 
              if (dt.min > 0) advance_time = 0; // At 3:01:00 back to normal
              dst_active = true;
@@ -402,11 +443,12 @@ void check_and_set_summertime(void)
         else if (dt.hour < 3)     dst_active = true;
         break;
         case 1: // Now revert time, do this only once
-            ds3231_settime(2,0,dt.sec); // Set time back to 2:00, leave secs the same
+            p->hour = 2;      // Set time back to 2:00, leave secs the same
+            p->min  = 0;
+            p->sec  = dt.sec;
             revert_time = 2;
             dst_active  = false;
-            eep_write8(EEP_DST_ACTIVE,0x00); // reset DST in eeprom
-            break;
+            return true; // and reset DST in eeprom
         case 2: // make sure we passed 3 AM in order to prevent multiple reverts
             if (dt.hour > 3) revert_time = 0; // at 4:00:00 back to normal
             dst_active = false;
@@ -421,21 +463,127 @@ void check_and_set_summertime(void)
     // summer- or winter-time, the eeprom value differs from the actual 
     // dst_active value. If so, set the actual sommer- and winter-time.
     //------------------------------------------------------------------------
-    dst_eep = eep_read8(EEP_DST_ACTIVE);
+    dst_eep = kv_read8(KV_DST);
     if (dst_active && !dst_eep)
     {   // It is summer-time, but clock has not been advanced yet
-        hr = (dt.hour >= 23) ? 0 : dt.hour + 1;
-        ds3231_settime(hr,dt.min,dt.sec); // Set summer-time to 1 hour later
-        eep_write8(EEP_DST_ACTIVE,0x01); // set DST in eeprom
+        p->hour = (dt.hour >= 23) ? 0 : dt.hour + 1; // Set summer-time to 1 hour later
     } // if
     else if (!dst_active && dst_eep)
     {   // It is winter-time, but clock has not been moved back yet
-        hr = (dt.hour > 0) ? dt.hour - 1 : 23;
-        ds3231_settime(hr,dt.min,dt.sec); // Set summer-time to 1 hour earlier
-        eep_write8(EEP_DST_ACTIVE,0x00); // set DST in eeprom
+        p->hour = (dt.hour > 0) ? dt.hour - 1 : 23;  // Set summer-time to 1 hour earlier
     } // if
+    else return false;
+    p->min = dt.min;
+    p->sec = dt.sec;
+    return true; // and set DST in eeprom
 } // check_and_set_summertime()
 
+/*-----------------------------------------------------------------------------
+  Purpose  : This task runs the command handler for every command port. It
+             is made ready by EV_UART1_LINE and EV_WIFI_LINE, posted when a 
+             complete line is received. All received lines are handled, the
+             reply goes to the port that sent the command. Error reports are
+             written in non-blocking mode: when the TX ring is full they are
+             cut off instead of stalling the display tasks.
+  Variables: -
+  Returns  : -
+  ---------------------------------------------------------------------------*/
+void command_task(void)
+{
+    uint8_t i;
+    
+    for (i = 0; i < CMD_PORTS; i++)
+    {
+        while (line_ready(cmd_ports[i].in)) cmd_port_handler(&cmd_ports[i]);
+    } // for i
+} // command_task()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : This task shows the binary frames received by UART1. It is made
+             ready by EV_UART1_FRAME. The first frame stops the display task, 
+             it is started again when no frame was received for 
+             STREAM_TIMEOUT frames. While streaming, the task also runs on 
+             every EV_FRAME, to show a frame that had to wait for a swap.
+             Frames are decoded into rgb_bufr/g/b by decode_frame().
+             BIN_CMD frames are commands, they do not touch the screen.
+  Variables: -
+  Returns  : -
+  ---------------------------------------------------------------------------*/
+void stream_task(void)
+{
+    static bool     active  = false;
+    static bool     decoded = false; // frame in uart1_getframe() is decoded
+    static uint16_t last;  // frame_cnt when the last frame was shown
+    uint8_t         *p, type, len, src;
+    
+    while ((p = uart1_getframe(&type, &len, &src)) != NULL)
+    {
+        if (type == BIN_CMD)
+        {   // binary command, the reply goes to the port that sent it
+            cmd_port_binary(&cmd_ports[src], p, len);
+            uart1_frame_free();
+            continue;
+        } // if
+        if (!active)
+        {   // take over the screen from the display task
+            disable_task_h(disp_task);
+            set_task_events_h(strm_task, EV_UART1_FRAME | EV_FRAME);
+            clearScreen(SCREEN);
+            active = true;
+        } // if
+        if (!decoded)
+        {   // a delta frame must be decoded only once
+            if (decode_frame(type, p, len))
+            {
+                strm_frames[type - BIN_FRAME]++;
+                strm_bytes += len + 6; // + sync, type, len and crc
+            } // if
+            else strm_err++;
+            decoded = true;
+        } // if
+        if (!present()) return; // previous frame not shown yet, retry next frame
+        uart1_frame_free();
+        decoded = false;
+        last    = get_frame_cnt();
+    } // while
+    if (active && ((uint16_t)(get_frame_cnt() - last) > STREAM_TIMEOUT))
+    {   // stream has stopped, give the screen back
+        set_task_events_h(strm_task, EV_UART1_FRAME);
+        enable_task_h(disp_task, false);
+        active = false;
+    } // if
+} // stream_task()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : This routine prints the statistics of stream_task(): the number
+             of frames per type, the average number of bytes per frame and
+             the size compared to sending every frame as a BIN_FRAME.
+  Variables: -
+  Returns  : -
+  ---------------------------------------------------------------------------*/
+void stream_stats(void)
+{
+    uint16_t n = strm_frames[0] + strm_frames[1] + strm_frames[2];
+    
+    uart1_printf("Stream: ");
+    uart1_putu(strm_frames[0], 0, ' ');
+    uart1_printf(" full, ");
+    uart1_putu(strm_frames[1], 0, ' ');
+    uart1_printf(" rows, ");
+    uart1_putu(strm_frames[2], 0, ' ');
+    uart1_printf(" xrle, ");
+    uart1_putu(strm_err, 0, ' ');
+    uart1_printf(" err\n");
+    if (n)
+    {
+        uart1_printf("Bytes/frame: ");
+        uart1_putu(strm_bytes / n, 0, ' ');
+        uart1_printf(", size: ");
+        uart1_putu(strm_bytes * 100 / ((uint32_t)n * (BIN_FRAME_LEN + 6)), 0, ' ');
+        uart1_printf(" % of full frames\n");
+    } // if
+} // stream_stats()
+
 /*-----------------------------------------------------------------------------
   Purpose  : This routine reads the date and time info from the DS3231 RTC and
              stores this info into the global variables seconds, minutes and
@@ -448,16 +596,22 @@ void check_and_set_summertime(void)
   ---------------------------------------------------------------------------*/
 void clock_task(void)
 {
-    static bool one = true;
-    
+    static bool    one = true;
+    static int16_t temp;
+    static Time    st; // time to write to the DS3231
     char s[25];
     
-    ds3231_gettime(&dt);
-    check_and_set_summertime();
+    PT_BEGIN();
+    PT_WAIT_UNTIL(ds3231_gettime_nb(&dt)); // other tasks run during the I2C transfers
+    if (check_and_set_summertime(&st))
+    {   // first the DS3231, then the DST flag in eeprom
+        PT_WAIT_UNTIL(ds3231_settime_nb(st.hour, st.min, st.sec));
+        kv_write8(KV_DST, dst_active ? 0x01 : 0x00);
+    } // if
+    PT_WAIT_UNTIL(ds3231_gettemp_nb(&temp));
     sprintf(lk2,"Het is nu %s %d %s %d %02d:%02d:%02d %s ",dows[dt.dow&0x07],
                dt.day , months[dt.mon], dt.year,
                dt.hour, dt.min, dt.sec, dst_active ? "Zomertijd" : "Wintertijd");
-    uint16_t temp = ds3231_gettemp();
     sprintf(s," %d.",temp>>2);
     strcat(lk2,s);
     sprintf(s,"%d%cC ",25*(temp & 0x03),31); // character 31 is 
@@ -470,6 +624,7 @@ void clock_task(void)
         lk_status |= LK2;
         color_text_input(lk2,lk2c);
     } // if
+    PT_END();
 } // clock_task()
 
 /*------------------------------------------------------------------
@@ -479,56 +634,73 @@ void clock_task(void)
   ------------------------------------------------------------------*/
 int main(void)
 {
-    char    s[35];     // Needed for uart_printf() and sprintf()
     uint8_t clk;       // which clock is active
     uint8_t dip_sw;    // status of dip-switches
+    task_handle h;     // handle of a task
     
     __disable_interrupt();
     clk = initialise_system_clock(HSE); // Set system-clock to 24 MHz
-    uart1_init(clk);                    // UART1 init. to 115200,8,N,1
-    uart3_init(clk);                    // UART3 init. to 115200,8,N,1
+    uart1_init(clk);                    // UART1 init. to UART1_BAUD,8,N,1
+    uart3_init(clk);                    // UART3 init. to UART3_BAUD,8,N,1
+    esp_init();                         // ESP8266 on UART3, started by esp_task()
+    kv_init();                          // configuration store in EEPROM
+    uart1_set_baud(kv_read32(KV_BAUD1)); // baud-rates set with B0/B1 command,
+    uart3_set_baud(kv_read32(KV_BAUD3)); // ignored when not (yet) valid
     setup_timers(clk,FREQ_4KHZ);        // Set Timer 2 for interrupt frequency
+    prof_init();                        // Start TIM3 as cycle counter
     setup_gpio_ports();                 // Init. needed output-ports
+#if I2C_HW
+    i2c_hw_init(clk, I2C_400KHZ);       // Init. I2C peripheral (I2C bus 0)
+#else
     i2c_init_bb(I2C_CH0);               // Init. I2C bus 0 for bit-banging
+#endif
     dip_sw = read_dip_switches();       // Read dip-switches
     
     // Initialize all the tasks for the RGB Platform
     scheduler_init(); // init. task-scheduler
+#if !I2C_HW
+    h = add_task(i2c_bb_task, "i2c", 0, 1);      // I2C transactions, I2C_BB_BITS per run
+    set_task_events_h(h, EV_I2C);                // only while a transaction is queued
+#endif
     switch (dip_sw)
     {
-        case 1 : add_task(tetrisMain    , "tetris", 150,   50); break; // Tetris game
-        case 15: add_task(test_playfield, "test"  , 175, 2000); break; // Test
-       default : add_task(lichtkrant    , "lkrant", 100,   50);        // Lichtkrant
-                 add_task(clock_task    , "rtc"   ,  75,20000);        // read date & time from DS3231
-                 run_now_task("rtc");  // run task now, so date/time are initialized
+        // Display tasks count frames (FRAMES_PER_SEC), 6 frames is 48 msec.
+        case 1 : disp_task = add_frame_task(tetrisMain, "tetris", 19, 6); // Tetris game
+                 h = add_task(tetrisInputs, "stick" ,   0, 1000);        // Joystick
+                 set_task_events_h(h, EV_STICK); // run on every joystick change
+                 break;
+        case 15: disp_task = add_frame_task(test_playfield, "test", 22, 250); break; // Test
+       default : disp_task = add_frame_task(lichtkrant, "lkrant", 12, 6);    // Lichtkrant
+                 h = add_task(clock_task, "rtc"   ,  75,20000);        // read date & time from DS3231
+                 run_now_task_h(h);    // read date & time in the first dispatch pass
                  break;
     } // switch
+    h = add_task(command_task, "cmd", 0, 1000);  // Commands from UART1 and WiFi
+    set_task_events_h(h, EV_UART1_LINE | EV_WIFI_LINE); // run on every received line
+    strm_task = add_frame_task(stream_task, "stream", 0, FRAMES_PER_SEC);
+    set_task_events_h(strm_task, EV_UART1_FRAME); // binary frames from UART1
+    h = add_task(esp_task, "esp", 100, 100);     // ESP8266 on UART3
+    set_task_events_h(h, EV_ESP | EV_PERIOD);   // response lines and timeouts
+    add_task(eep_task, "eep", 0, 20);            // EEPROM writes, 1 program cycle per run
+    init_frame_buffers(); // all leds off before the TIM2 ISR starts
     __enable_interrupt(); // set global interrupt enable, start task-scheduler
 	
     print_revision_nr();  // print revision nr to UART 1
-    sprintf(s,"\nCLK: 0x%X ",clk);
-    uart1_printf(s);
+    uart1_printf("\nCLK: 0x");
+    uart1_puthex(clk, 0);
+    uart1_putc(' ');
     if      (clk == HSI) uart1_printf("HSI\n");
     else if (clk == LSI) uart1_printf("LSI\n");
     else if (clk == HSE) uart1_printf("HSE\n");
-    sprintf(s,"DIP-SW: 0x%X\n",dip_sw);
-    uart1_printf(s); // print status of dip-switches
+    uart1_printf("DIP-SW: 0x");
+    uart1_puthex(dip_sw, 0);
+    uart1_printf("\n"); // print status of dip-switches
     set_buzzer(FREQ_4KHZ,1);
-    eep_read_string(EEP_TEXT1,lk1);         // read top-row of lichtkrant
-    eep_read_string(EEP_COL1,(char*)lk1c);  // read colors of top-row
+    kv_read_string(KV_TEXT1,lk1);           // read top-row of lichtkrant
+    kv_read(KV_COL1,lk1c,KV_MAXLEN);        // read colors of top-row
     
     while (true)
     {   // main loop
-        dispatch_tasks(); // run the task-scheduler
-        switch (rs232_command_handler()) // run command handler continuously
-        {
-            case ERR_CMD: uart1_printf("Command Error\n"); 
-                          break;
-            case ERR_NUM: sprintf(s,"Number Error (%s)\n",rs232_inbuf);
-                          uart1_printf(s);  
-                          break;
-            case ERR_I2C: break; // do not print anything 
-            default     : break;
-        } // switch
+        dispatch_tasks(); // run the task-scheduler, sleeps when idle
     } // while()
 } // main()
\ No newline at end of file
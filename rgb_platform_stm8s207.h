@@ -30,17 +30,23 @@
 #include <string.h>
 #include "delay.h"         /* for delay_msec() */
 #include "i2c_bb.h"
+#include "i2c_ds3231_bb.h" /* for Time */
 #include "uart.h"
 #include "command_interpreter.h"
 #include "scheduler.h"
 
+#define STREAM_TIMEOUT (2 * FRAMES_PER_SEC) /* frames without a binary frame before the display task resumes */
+
 void    lichtkrant(void);
 void    lichtkrant1(void);
 void    lichtkrant2(void);
 void    color_text_input(char *s, uint8_t *scol);
 void    test_playfield(void);
+void    command_task(void);
+void    stream_task(void);
+void    stream_stats(void);
 void    print_revision_nr(void);
 uint8_t read_dip_switches(void);
-void    check_and_set_summertime(void);
+bool    check_and_set_summertime(Time *p);
 
 #endif /* _RGB_PLATFORM_STM8S207_H_ */
\ No newline at end of file
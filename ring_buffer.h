@@ -5,6 +5,12 @@
   Purpose  : This is the header-file that defines all functions and
              structures for working with ring-buffers. These ring-buffers
 	     are primarily used for UART ISR driven communication.
+             The size is a compile-time power of two, so wrapping is
+             done with a mask. The read and write offsets run freely
+             from 0 to 255: write_offset - read_offset is the number
+             of bytes in the buffer, all RING_SIZE bytes can be used.
+             There is one writer and one reader (an ISR and the main
+             program), so no locking is needed for the offsets.
   ------------------------------------------------------------------
   This file is free software: you can redistribute it and/or modify
   it under the terms of the GNU General Public License as published by
@@ -23,45 +29,42 @@
 #define RING_BUFFER_H
 
 #include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#define RING_SIZE (32)            /* Size of every ring buffer, power of 2 */
+#define RING_MASK (RING_SIZE - 1) /* Mask for the read and write offsets */
+#if (RING_SIZE & RING_MASK) || (RING_SIZE > 128)
+#error "RING_SIZE must be a power of 2 and <= 128"
+#endif
 
 struct ring_buffer 
 {
-    volatile uint8_t write_offset;
-    volatile uint8_t read_offset;
-    uint8_t          size;
-    uint8_t          *buffer;
+    volatile uint8_t write_offset; // free-running, only changed by the writer
+    volatile uint8_t read_offset;  // free-running, only changed by the reader
+    uint8_t          high_water;   // max. number of bytes in the buffer
+    uint8_t          buffer[RING_SIZE];
 }; /* ring_buffer */
 
 /*-----------------------------------------------------------------------------
-  Purpose  : Get the next offset in a ring buffer.
-  Variables: cur_offset: the current offset in the ring buffer
-             max_offset: the highest allowed offset in the ring buffer
-  Returns  : next offset or 0 if we are wrapping
-  ---------------------------------------------------------------------------*/
-static inline uint8_t get_next(uint8_t cur_offset, uint8_t max_offset)
-{
-   return ((cur_offset == max_offset-1) ? 0 : cur_offset + 1);
-} /* get_next() */
-
-/*-----------------------------------------------------------------------------
-  Purpose  : Get the next write offset in a ring buffer
+  Purpose  : Get the number of bytes in a ring buffer.
   Variables: ring: pointer to a struct of type ring_buffer
-  Returns  : the next write offset in the ring buffer
+  Returns  : 0..RING_SIZE
   ---------------------------------------------------------------------------*/
-static inline uint8_t ring_buffer_get_next_write(const struct ring_buffer *ring)
+static inline uint8_t ring_buffer_used(const struct ring_buffer *ring)
 {
-    return get_next(ring->write_offset, ring->size);
-} /* ring_buffer_get_next_write() */
+    return (uint8_t)(ring->write_offset - ring->read_offset);
+} /* ring_buffer_used() */
 
 /*-----------------------------------------------------------------------------
-  Purpose  : Get the next read offset in a ring buffer
+  Purpose  : Get the number of free bytes in a ring buffer.
   Variables: ring: pointer to a struct of type ring_buffer
-  Returns  : the next read offset in the ring buffer
+  Returns  : 0..RING_SIZE
   ---------------------------------------------------------------------------*/
-static inline uint8_t ring_buffer_get_next_read(const struct ring_buffer *ring)
+static inline uint8_t ring_buffer_free(const struct ring_buffer *ring)
 {
-    return get_next(ring->read_offset, ring->size);
-} /* ring_buffer_get_next_read() */
+    return RING_SIZE - ring_buffer_used(ring);
+} /* ring_buffer_free() */
 
 /*-----------------------------------------------------------------------------
   Purpose  : Function for checking if the ring buffer is full.
@@ -70,7 +73,7 @@ static inline uint8_t ring_buffer_get_next_read(const struct ring_buffer *ring)
   ---------------------------------------------------------------------------*/
 static inline bool ring_buffer_is_full(const struct ring_buffer *ring)
 {
-    return (ring->read_offset == ring_buffer_get_next_write(ring));
+    return (ring_buffer_used(ring) == RING_SIZE);
 } /* ring_buffer_is_full() */
 
 /*-----------------------------------------------------------------------------
@@ -84,20 +87,27 @@ static inline bool ring_buffer_is_empty(const struct ring_buffer *ring)
     return (r == ring->write_offset);
 } /* ring_buffer_is_empty() */
 
+/*-----------------------------------------------------------------------------
+  Purpose  : Get the high-water mark of a ring buffer: the maximum number
+             of bytes that were in the buffer since ring_buffer_init().
+  Variables: ring: pointer to a struct of type ring_buffer
+  Returns  : 0..RING_SIZE
+  ---------------------------------------------------------------------------*/
+static inline uint8_t ring_buffer_high_water(const struct ring_buffer *ring)
+{
+    return ring->high_water;
+} /* ring_buffer_high_water() */
+
 /*-----------------------------------------------------------------------------
   Purpose  : Function for initializing a ring buffer
-  Variables: buffer: pointer to the buffer to use as a ring buffer
-             size  : the size of the ring buffer
-  Returns  : struct containing the ring buffer
+  Variables: ring: pointer to a struct of type ring_buffer
+  Returns  : -
   ---------------------------------------------------------------------------*/
-static inline struct ring_buffer ring_buffer_init(uint8_t *buffer, uint8_t size)
+static inline void ring_buffer_init(struct ring_buffer *ring)
 {
-    struct ring_buffer ring;
-    ring.write_offset = 0;
-    ring.read_offset  = 0;
-    ring.size         = size;
-    ring.buffer       = buffer;
-    return ring;
+    ring->write_offset = 0;
+    ring->read_offset  = 0;
+    ring->high_water   = 0;
 } /* ring_buffer_init() */
 
 /*-----------------------------------------------------------------------------
@@ -109,15 +119,15 @@ static inline struct ring_buffer ring_buffer_init(uint8_t *buffer, uint8_t size)
   ---------------------------------------------------------------------------*/
 static inline uint8_t ring_buffer_get(struct ring_buffer *ring)
 {
-    //Assert(!ring_buffer_is_empty(ring));
-    uint8_t data = ring->buffer[ring->read_offset];
-    ring->read_offset = ring_buffer_get_next_read(ring);
+    uint8_t r    = ring->read_offset;
+    uint8_t data = ring->buffer[r & RING_MASK];
+    ring->read_offset = r + 1;
     return data;
 } /* ring_buffer_get() */
 
 /*-----------------------------------------------------------------------------
   Purpose  : Function for putting a data byte in the ring buffer. 
-             Make sure buffer is not full (using ring_buffer_is_full) 
+             Make sure buffer is not full (using ring_buffer_is_full)
              before calling this function.
   Variables: ring: pointer to a struct of type ring_buffer
              data: the byte to put into the buffer
@@ -125,9 +135,64 @@ static inline uint8_t ring_buffer_get(struct ring_buffer *ring)
   ---------------------------------------------------------------------------*/
 static inline void ring_buffer_put(struct ring_buffer *ring, uint8_t data)
 {
-    //Assert(!ring_buffer_is_full(ring));   
-    ring->buffer[ring->write_offset] = data;
-    ring->write_offset = ring_buffer_get_next_write(ring);
+    uint8_t w = ring->write_offset;
+    uint8_t n;
+    
+    ring->buffer[w & RING_MASK] = data;
+    ring->write_offset = ++w; // publish the byte after it is written
+    n = (uint8_t)(w - ring->read_offset);
+    if (n > ring->high_water) ring->high_water = n;
 } /* ring_buffer_put() */
 
+/*-----------------------------------------------------------------------------
+  Purpose  : Function for putting a block of bytes in the ring buffer. The
+             block is copied in at most two contiguous spans (before and 
+             after the wrap-around) and then published in one go.
+  Variables: ring: pointer to a struct of type ring_buffer
+             src : the bytes to put into the buffer
+             len : the number of bytes in src
+  Returns  : the number of bytes copied, less than len if the buffer is full
+  ---------------------------------------------------------------------------*/
+static inline uint8_t ring_buffer_put_block(struct ring_buffer *ring, 
+                                            const uint8_t *src, uint8_t len)
+{
+    uint8_t w    = ring->write_offset;
+    uint8_t room = RING_SIZE - (uint8_t)(w - ring->read_offset);
+    uint8_t span;
+    
+    if (len > room) len = room;
+    span = RING_SIZE - (w & RING_MASK); // contiguous bytes until the wrap
+    if (span > len) span = len;
+    memcpy(&ring->buffer[w & RING_MASK], src, span);
+    memcpy(ring->buffer, src + span, len - span);
+    ring->write_offset = w + len;
+    room = RING_SIZE - room + len;      // bytes in the buffer now
+    if (room > ring->high_water) ring->high_water = room;
+    return len;
+} /* ring_buffer_put_block() */
+
+/*-----------------------------------------------------------------------------
+  Purpose  : Function for getting a block of bytes from the ring buffer, in
+             at most two contiguous spans.
+  Variables: ring: pointer to a struct of type ring_buffer
+             dst : destination for the bytes read
+             len : the max. number of bytes to read
+  Returns  : the number of bytes copied, less than len if the buffer is empty
+  ---------------------------------------------------------------------------*/
+static inline uint8_t ring_buffer_get_block(struct ring_buffer *ring, 
+                                            uint8_t *dst, uint8_t len)
+{
+    uint8_t r    = ring->read_offset;
+    uint8_t used = (uint8_t)(ring->write_offset - r);
+    uint8_t span;
+    
+    if (len > used) len = used;
+    span = RING_SIZE - (r & RING_MASK); // contiguous bytes until the wrap
+    if (span > len) span = len;
+    memcpy(dst, &ring->buffer[r & RING_MASK], span);
+    memcpy(dst + span, ring->buffer, len - span);
+    ring->read_offset = r + len;
+    return len;
+} /* ring_buffer_get_block() */
+
 #endif /* RING_BUFFER_H */
@@ -19,12 +19,40 @@
   along with this software.  If not, see <http://www.gnu.org/licenses/>.
   ================================================================== */ 
 #include "scheduler.h"
+#include "profiler.h"
+#include "stm8_hw_init.h"
       
 extern uint32_t millis(void);
 
 task_struct task_list[MAX_TASKS]; // struct with all tasks
 uint8_t     max_tasks = 0;
 
+#define CLK_TICK  (0) /* index in sched_clk[] for add_task() tasks */
+#define CLK_FRAME (1) /* index in sched_clk[] for add_frame_task() tasks */
+#define TASK_CLK(i) ((task_list[i].Status & TASK_FRAME) ? CLK_FRAME : CLK_TICK)
+#define REACHED(now,t) ((int32_t)((now) - (t)) >= 0) /* wrap-around safe */
+#define TICKS_PER_FRAME (MAX_Y) /* scheduler_isr() is called once per row */
+
+uint8_t  sched_order[MAX_TASKS]; // task indices, highest priority first
+uint8_t  sched_current = TASK_NONE; // index of the running task
+
+// dispatch_tasks() uses a bit-mask of tasks, bit i = task i
+#if MAX_TASKS > 32
+#error "MAX_TASKS > 32 does not fit in a task_mask"
+#elif MAX_TASKS > 8
+typedef uint32_t task_mask;
+#else
+typedef uint8_t  task_mask;
+#endif
+
+uint32_t sched_clk[2];           // Tick and frame counters
+#if SCHED_DEADLINE
+uint32_t sched_next[2];          // Earliest deadline for both counters
+uint32_t sched_frame_tick;       // Tick at which a frame deadline was reached
+volatile bool sched_pending = false; // true = a deadline is reached or changed
+#endif
+volatile uint8_t sched_events = 0; // events posted by ISRs, see post_event()
+
 /*-----------------------------------------------------------------------------
   Purpose  : Initialization function for scheduler. Should be called before 
 	           calling any other scheduler function.
@@ -34,8 +62,87 @@ uint8_t     max_tasks = 0;
 void scheduler_init(void)
 {
     memset(task_list,0x00,sizeof(task_list)); // clear task_list array
+    // called before interrupts are enabled
+    sched_clk[CLK_TICK]   = sched_clk[CLK_FRAME]  = 0;
+#if SCHED_DEADLINE
+    sched_next[CLK_TICK]  = sched_next[CLK_FRAME] = UINT32_MAX >> 1;
+    sched_pending         = false;
+#endif
 } // scheduler_init()
 
+/*-----------------------------------------------------------------------------
+  Purpose  : Read a scheduler counter. The 32-bit counter is changed by an
+             ISR, so it is read with interrupts disabled.
+  Variables: clk: [CLK_TICK, CLK_FRAME]
+  Returns  : the counter value
+  ---------------------------------------------------------------------------*/
+static __monitor uint32_t sched_now(uint8_t clk)
+{
+    return sched_clk[clk];
+} // sched_now()
+
+#if SCHED_DEADLINE
+
+/*-----------------------------------------------------------------------------
+  Purpose  : Read the tick at which the last frame deadline was reached.
+  Variables: -
+  Returns  : the release time of frame tasks in ticks
+  ---------------------------------------------------------------------------*/
+static __monitor uint32_t sched_frame_release(void)
+{
+    return sched_frame_tick;
+} // sched_frame_release()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : Set the earliest deadlines, which are compared by the ISRs.
+             A deadline that has already passed is seen at the next tick.
+  Variables: next: the earliest deadline for CLK_TICK and CLK_FRAME
+  Returns  : -
+  ---------------------------------------------------------------------------*/
+static __monitor void sched_set_next(uint32_t *next)
+{
+    sched_next[CLK_TICK]  = next[CLK_TICK];
+    sched_next[CLK_FRAME] = next[CLK_FRAME];
+} // sched_set_next()
+#endif
+
+#if !SCHED_DEADLINE
+/*-----------------------------------------------------------------------------
+  Purpose  : Decrement the delay or counter of a task. On time-out, the ready
+             flag is set. Used by scheduler_isr() and scheduler_frame_isr().
+  Variables: index: index of the task in task_list[]
+  Returns  : -
+  ---------------------------------------------------------------------------*/
+static inline void task_tick(uint8_t index)
+{
+    // First go through the initial delay
+    if(task_list[index].Delay > 0)
+    {
+        task_list[index].Delay--;
+    } // if
+    else
+    {   // Now we decrement the actual period counter 
+        task_list[index].Counter--;
+        if(task_list[index].Counter == 0)
+        {
+            if (task_list[index].Events & EV_PERIOD)
+            {   // not for a task that only runs on events
+                if (task_list[index].Status & TASK_READY)
+                {   // expired again before the task could run
+                    task_list[index].Missed++;
+                } // if
+                else
+                {   // Set the flag and remember the release time
+                    task_list[index].Status |= TASK_READY;
+                    task_list[index].Release = sched_clk[CLK_TICK];
+                } // else
+            } // if
+            task_list[index].Counter = task_list[index].Period; // reset the counter
+        } // if
+    } // else
+} // task_tick()
+#endif
+
 /*-----------------------------------------------------------------------------
   Purpose  : Run-time function for scheduler. Should be called from within
              an ISR. This function goes through the task-list and decrements
@@ -45,218 +152,746 @@ void scheduler_init(void)
   ---------------------------------------------------------------------------*/
 void scheduler_isr(void)
 {
+#if SCHED_DEADLINE
+    if (REACHED(++sched_clk[CLK_TICK], sched_next[CLK_TICK])) sched_pending = true;
+#else
     uint8_t index = 0; // index in task_list struct
     
+    sched_clk[CLK_TICK]++;
     while ((index < MAX_TASKS) && task_list[index].pFunction)
     {
-        // First go through the initial delay
-        if(task_list[index].Delay > 0)
+        if (!(task_list[index].Status & TASK_FRAME)) task_tick(index);
+        index++;
+    } // while
+#endif
+} // scheduler_isr()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : Run-time function for frame tasks. Should be called from within
+             the display ISR, every time a complete frame has been shown.
+             Only tasks added with add_frame_task() are decremented here.
+  Variables: task_list[] structure
+  Returns  : -
+  ---------------------------------------------------------------------------*/
+void scheduler_frame_isr(void)
+{
+#if SCHED_DEADLINE
+    if (REACHED(++sched_clk[CLK_FRAME], sched_next[CLK_FRAME]))
+    {   // not reached again until sched_update() sets the next deadline,
+        // so the release time stays the first frame, also during a long task
+        sched_frame_tick       = sched_clk[CLK_TICK]; // release time of frame tasks
+        sched_next[CLK_FRAME] += UINT32_MAX >> 1;
+        sched_pending          = true;
+    } // if
+#else
+    uint8_t index = 0; // index in task_list struct
+    
+    sched_clk[CLK_FRAME]++;
+    while ((index < MAX_TASKS) && task_list[index].pFunction)
+    {
+        if (task_list[index].Status & TASK_FRAME) task_tick(index);
+        index++;
+    } // while
+#endif
+} // scheduler_frame_isr()
+
+#if SCHED_DEADLINE
+/*-----------------------------------------------------------------------------
+  Purpose  : Set the ready flag of every enabled task whose deadline has been
+             reached and give it its next deadline. The next deadline is one
+             period after the previous one, so there is no drift. Periods
+             that are missed completely are skipped.
+             Then the earliest deadline of the remaining tasks is set.
+  Variables: task_list[] structure
+  Returns  : -
+  ---------------------------------------------------------------------------*/
+static void sched_update(void)
+{
+    uint8_t  index = 0;
+    uint8_t  clk;
+    uint32_t now[2];
+    uint32_t next[2];
+    uint32_t frame_tick;
+    
+    sched_pending   = false; // a deadline reached from now on sets it again
+    now[CLK_TICK]   = sched_now(CLK_TICK);
+    now[CLK_FRAME]  = sched_now(CLK_FRAME);
+    frame_tick      = sched_frame_release();
+    next[CLK_TICK]  = now[CLK_TICK]  + (UINT32_MAX >> 1);
+    next[CLK_FRAME] = now[CLK_FRAME] + (UINT32_MAX >> 1);
+    while ((index < MAX_TASKS) && task_list[index].pFunction)
+    {
+        if ((task_list[index].Status & TASK_ENABLED) && (task_list[index].Events & EV_PERIOD))
         {
-            task_list[index].Delay--;
-        } // if
-        else
-        {   // Now we decrement the actual period counter 
-            task_list[index].Counter--;
-            if(task_list[index].Counter == 0)
+            clk = TASK_CLK(index);
+            if (REACHED(now[clk], task_list[index].Deadline))
             {
-                // Set the flag and reset the counter;
-                task_list[index].Status |= TASK_READY;
+                if (task_list[index].Status & TASK_READY)
+                {   // still busy, e.g. a coroutine that has not finished
+                    task_list[index].Missed++;
+                } // if
+                else
+                {
+                    task_list[index].Status |= TASK_READY;
+                    if (clk == CLK_TICK)
+                         task_list[index].Release = task_list[index].Deadline;
+                    else task_list[index].Release = frame_tick;
+                } // else
+                task_list[index].Deadline += task_list[index].Period;
+                while (REACHED(now[clk], task_list[index].Deadline))
+                {   // a complete period is missed
+                    task_list[index].Deadline += task_list[index].Period;
+                    task_list[index].Missed++;
+                } // while
             } // if
-        } // else
+            if ((int32_t)(task_list[index].Deadline - next[clk]) < 0)
+            {
+                next[clk] = task_list[index].Deadline;
+            } // if
+        } // if
         index++;
     } // while
-} // scheduler_isr()
+    sched_set_next(next);
+} // sched_update()
+#endif
 
 /*-----------------------------------------------------------------------------
-  Purpose  : Run all tasks for which the ready flag is set. Should be called 
-             from within the main() function, not from an interrupt routine!
+  Purpose  : Check if a task can run: it is enabled, ready and not sleeping
+             in PT_SLEEP_MS(). A sleeping task is woken up here.
+  Variables: index: index of the task in task_list[]
+             now  : the current tick
+  Returns  : true = task can run
+  ---------------------------------------------------------------------------*/
+static bool task_runnable(uint8_t index, uint32_t now)
+{
+    if ((task_list[index].Status & (TASK_READY | TASK_ENABLED)) != (TASK_READY | TASK_ENABLED))
+        return false;
+    if (task_list[index].Status & TASK_SLEEP)
+    {
+        if (!REACHED(now, task_list[index].Pt_Wake)) return false;
+        task_list[index].Status &= ~TASK_SLEEP; // sleep time is over
+    } // if
+    return true;
+} // task_runnable()
+
+#if IDLE_WFI
+/*-----------------------------------------------------------------------------
+  Purpose  : Check if there is work for dispatch_tasks().
   Variables: task_list[] structure
+  Returns  : true = a task is ready, a deadline is reached or an event posted
+  ---------------------------------------------------------------------------*/
+static bool work_to_do(void)
+{
+    uint8_t  index = 0;
+    uint32_t now   = sched_now(CLK_TICK);
+    
+#if SCHED_DEADLINE
+    if (sched_pending) return true;
+#endif
+    if (sched_events)  return true;
+    while ((index < MAX_TASKS) && task_list[index].pFunction)
+    {
+        if (task_runnable(index, now))
+            return true;
+        index++;
+    } // while
+    return false;
+} // work_to_do()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : Put the CPU to sleep (WFI) when there is nothing to do and add
+             the idle time to the CPU load. The check is done with interrupts
+             disabled, WFI enables them again, so an interrupt that arrives
+             after the check still wakes up the CPU.
+  Variables: -
   Returns  : -
   ---------------------------------------------------------------------------*/
-void dispatch_tasks(void)
+static void cpu_idle(void)
+{
+    uint32_t t;
+    uint32_t idle = 0;
+    
+    __disable_interrupt();
+    if (work_to_do())
+    {
+        __enable_interrupt();
+    } // if
+    else
+    {
+        t          = PROF_CLOCK();
+        idle_sleep = true;
+        __wait_for_interrupt(); // the ISR that wakes us sets idle_wake
+        if (idle_sleep)
+        {   // woken by an ISR without IDLE_WAKEUP()
+            idle_sleep = false;
+            idle_wake  = PROF_CLOCK();
+        } // if
+        idle = idle_wake - t;
+    } // else
+    load_add_idle(idle);
+} // cpu_idle()
+#endif
+
+/*-----------------------------------------------------------------------------
+  Purpose  : Update the lateness and jitter of a task that is about to start.
+             Lateness is the time from release (ready flag set) to start,
+             jitter is the difference between the time between two starts
+             and the period. All times are in ticks.
+  Variables: index: index of the task in task_list[]
+  Returns  : -
+  ---------------------------------------------------------------------------*/
+static void task_stats(uint8_t index)
+{
+    task_struct *p     = &task_list[index];
+    uint32_t     start = sched_now(CLK_TICK);
+    uint32_t     late  = start - p->Release;
+    uint32_t     period, jit;
+    
+    p->Late = (late > UINT16_MAX) ? UINT16_MAX : (uint16_t)late;
+    if (p->Late > p->Late_Max) p->Late_Max = p->Late;
+    if (p->Status & TASK_RUN)
+    {   // a previous start is known
+        if (p->Status & TASK_FRAME)
+             period = (uint32_t)p->Period * TICKS_PER_FRAME;
+        else period = p->Period;
+        jit = start - p->Last_Start;
+        jit = (jit > period) ? jit - period : period - jit;
+        if (jit > UINT16_MAX)  jit = UINT16_MAX;
+        if (jit > p->Jitter_Max) p->Jitter_Max = (uint16_t)jit;
+    } // if
+    p->Last_Start = start;
+    p->Status    |= TASK_RUN;
+} // task_stats()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : Clear the duration, lateness, jitter and missed-period
+             statistics of all tasks.
+  Variables: task_list[] structure
+  Returns  : -
+  ---------------------------------------------------------------------------*/
+void reset_task_stats(void)
 {
     uint8_t index = 0;
-    uint32_t time1; // Measured #clock-ticks of 50 usec. (TMR1 frequency)
-    uint32_t time2;
     
-    //go through the active tasks
     while ((index < MAX_TASKS) && task_list[index].pFunction)
     {
-        if((task_list[index].Status & (TASK_READY | TASK_ENABLED)) == (TASK_READY | TASK_ENABLED))
+        task_list[index].Duration_Max = 0;
+        task_list[index].Late_Max     = 0;
+        task_list[index].Jitter_Max   = 0;
+        task_list[index].Missed       = 0;
+        task_list[index].Status      &= ~TASK_RUN; // no jitter for next start
+        index++;
+    } // while
+} // reset_task_stats()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : Post one or more events. Can be called from an ISR and from
+             a task: it only sets bits, the tasks are made ready by
+             dispatch_tasks(). The read-modify-write of sched_events is
+             __monitor, so an ISR that posts in between is not lost.
+  Variables: ev: [EV_UART1_LINE, EV_STICK, EV_FRAME]
+  Returns  : -
+  ---------------------------------------------------------------------------*/
+__monitor void post_event(uint8_t ev)
+{
+    sched_events |= ev;
+} // post_event()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : Read and clear the posted events.
+  Variables: -
+  Returns  : the events posted since the previous call
+  ---------------------------------------------------------------------------*/
+static __monitor uint8_t take_events(void)
+{
+    uint8_t ev = sched_events;
+    
+    sched_events = 0;
+    return ev;
+} // take_events()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : Make every enabled task that waits for a posted event ready,
+             without waiting for its next period.
+  Variables: task_list[] structure
+  Returns  : -
+  ---------------------------------------------------------------------------*/
+static void wake_tasks(void)
+{
+    uint8_t  index = 0;
+    uint8_t  ev    = take_events();
+    uint32_t now   = sched_now(CLK_TICK);
+    
+    while ((index < MAX_TASKS) && task_list[index].pFunction)
+    {
+        if ((task_list[index].Status & TASK_ENABLED) && (task_list[index].Events & ev) &&
+           !(task_list[index].Status & TASK_READY))
         {
-            time1 = millis(); // Read msec. timer
-            task_list[index].Counter  = task_list[index].Period; // reset counter
-            task_list[index].pFunction(); // run the task
-            task_list[index].Status  &= ~TASK_READY; // reset the task when finished
-            time2 = millis(); // read msec. timer
-            if (time2 < time1) time2 += UINT32_MAX - time1; // overflows every 49.7 days, unlikely
-            else               time2 -= time1; 
-            task_list[index].Duration  = (uint16_t)time2; // time difference in milliseconds
-            if (time2 > task_list[index].Duration_Max)
-            {
-                task_list[index].Duration_Max = time2;
-            } // if
+            task_list[index].Status |= TASK_READY;
+            task_list[index].Release = now;
         } // if
         index++;
     } // while
-    // go to sleep till next tick!
+} // wake_tasks()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : Return the sort key of a task, a lower key is a higher priority.
+             Tasks with a priority set by set_task_priority_h() come first,
+             the other tasks are ordered by period (deadline-monotonic).
+  Variables: index: index of the task in task_list[]
+  Returns  : the sort key
+  ---------------------------------------------------------------------------*/
+static uint32_t prio_key(uint8_t index)
+{
+    if (task_list[index].Prio != PRIO_AUTO) return task_list[index].Prio;
+    if (task_list[index].Status & TASK_FRAME)
+         return PRIO_AUTO + 1 + (uint32_t)task_list[index].Period * TICKS_PER_FRAME;
+    else return PRIO_AUTO + 1 + task_list[index].Period;
+} // prio_key()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : Sort sched_order[] on priority. Called when a task is added or
+             when its priority or period is changed, not by dispatch_tasks().
+  Variables: task_list[] structure
+  Returns  : -
+  ---------------------------------------------------------------------------*/
+static void sched_sort(void)
+{
+    uint8_t i, j, t;
+    
+    for (i = 0; i < max_tasks; i++) sched_order[i] = i;
+    for (i = 1; i < max_tasks; i++)
+    {   // insertion sort, equal keys keep their table order
+        t = sched_order[i];
+        for (j = i; (j > 0) && (prio_key(sched_order[j-1]) > prio_key(t)); j--)
+        {
+            sched_order[j] = sched_order[j-1];
+        } // for j
+        sched_order[j] = t;
+    } // for i
+} // sched_sort()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : Find the ready task with the highest priority.
+  Variables: ran: bit i is set if task i already ran in this dispatch pass,
+                  a coroutine that yields stays ready but runs once per pass.
+  Returns  : index of the task, TASK_NONE if no task is ready
+  ---------------------------------------------------------------------------*/
+static uint8_t next_ready(task_mask ran)
+{
+    uint8_t  i, index;
+    uint32_t now = sched_now(CLK_TICK);
+    
+    for (i = 0; i < max_tasks; i++)
+    {
+        index = sched_order[i];
+        if (!(ran & ((task_mask)1 << index)) && task_runnable(index, now))
+            return index;
+    } // for i
+    return TASK_NONE;
+} // next_ready()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : Run a task and measure its duration. A coroutine task that
+             returns from PT_YIELD(), PT_WAIT_UNTIL() or PT_SLEEP_MS() stays
+             ready, it is resumed in the next dispatch pass.
+  Variables: index: index of the task in task_list[]
+  Returns  : -
+  ---------------------------------------------------------------------------*/
+static void run_task(uint8_t index)
+{
+    uint32_t time1; // Measured #clock-ticks of 50 usec. (TMR1 frequency)
+    uint32_t time2;
+    
+    time1 = millis(); // Read msec. timer
+    if (!task_list[index].Pt_Line)
+    {   // a new run, not a coroutine that is resumed
+        task_stats(index);
+        task_list[index].Counter  = task_list[index].Period; // reset counter
+    } // if
+    sched_current = index;
+    PROF_START(t0);
+    task_list[index].pFunction(); // run the task
+    PROF_STOP(PROF_TASK0 + index,t0);
+    sched_current = TASK_NONE;
+    if (!task_list[index].Pt_Line)
+    {   // reset the task when finished
+        task_list[index].Status &= ~TASK_READY;
+    } // if
+    time2 = millis(); // read msec. timer
+    if (time2 < time1) time2 += UINT32_MAX - time1; // overflows every 49.7 days, unlikely
+    else               time2 -= time1; 
+    task_list[index].Duration  = (uint16_t)time2; // time difference in milliseconds
+    if (time2 > task_list[index].Duration_Max)
+    {
+        task_list[index].Duration_Max = time2;
+    } // if
+} // run_task()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : Run all tasks for which the ready flag is set. Should be called 
+             from within the main() function, not from an interrupt routine!
+             After every task, the ready task with the highest priority is
+             run next, so a task released while a slow task was running goes
+             before lower-priority tasks that were already waiting. Every
+             call runs at most max_tasks tasks, so main() keeps running.
+  Variables: task_list[] structure
+  Returns  : -
+  ---------------------------------------------------------------------------*/
+void dispatch_tasks(void)
+{
+    uint8_t   n, index;
+    task_mask ran = 0; // bit i: task i has run in this pass
+    
+    for (n = 0; n < max_tasks; n++)
+    {
+#if SCHED_DEADLINE
+        if (sched_pending) sched_update();
+#endif
+        if (sched_events) wake_tasks();
+        index = next_ready(ran);
+        if (index == TASK_NONE) break;
+        run_task(index);
+        ran |= ((task_mask)1 << index);
+    } // for n
+#if IDLE_WFI
+    cpu_idle(); // go to sleep till next tick!
+#endif
 } // dispatch_tasks()
 
+/*-----------------------------------------------------------------------------
+  Purpose  : Add a function to the task-list struct. Used by add_task() and
+             add_frame_task().
+  Variables: task_ptr: pointer to function
+             Name    : name of the task, should be a string constant
+             temp1   : initial delay in ticks or frames
+             temp2   : period between two calls in ticks or frames
+             frame   : TASK_FRAME if counted in frames, 0 otherwise
+  Returns  : handle of the task, TASK_NONE if task_list[] is full
+  ---------------------------------------------------------------------------*/
+static task_handle add_task_list(void (*task_ptr)(), const char *Name, uint16_t temp1, uint16_t temp2, uint8_t frame)
+{
+    uint8_t  index = 0;
+    
+    if (max_tasks >= MAX_TASKS) return TASK_NONE;
+    //go through the active tasks
+    while ((index < MAX_TASKS) && task_list[index].Period) index++;
+    if (index >= MAX_TASKS) return TASK_NONE;
+    
+    task_list[index].pFunction    = task_ptr;       // Pointer to Function
+    task_list[index].Period       = temp2;          // Period in msec.
+    task_list[index].Counter      = temp2;	    // Countdown timer
+    task_list[index].Delay        = temp1;          // Initial delay before start
+    task_list[index].Status      |= TASK_ENABLED | frame; // Enable task by default
+    task_list[index].Status      &= ~TASK_READY;    // Task not ready to run
+    task_list[index].Duration     = 0;              // Actual Task Duration
+    task_list[index].Duration_Max = 0;              // Max. Task Duration
+    task_list[index].Name         = Name;           // Name of Task, not copied
+    task_list[index].Prio         = PRIO_AUTO;      // Ordered by period
+    task_list[index].Events       = EV_PERIOD;      // Run on period only
+#if SCHED_DEADLINE
+    // first run after delay + period, the same as with Delay and Counter
+    task_list[index].Deadline     = sched_now(frame ? CLK_FRAME : CLK_TICK) + temp1 + temp2;
+    sched_pending = true; // recalculate earliest deadline
+#endif
+    max_tasks++; // increase number of tasks
+    sched_sort();
+    return index;
+} // add_task_list()
+
 /*-----------------------------------------------------------------------------
   Purpose  : Add a function to the task-list struct. Should be called upon
   		     initialization.
   Variables: task_ptr: pointer to function
+             Name    : name of the task, should be a string constant
              delay   : initial delay in msec.
              period  : period between two calls in msec.
-  Returns  : [NO_ERR, ERR_MAX_TASKS]
+  Returns  : handle of the task, TASK_NONE if task_list[] is full
   ---------------------------------------------------------------------------*/
-uint8_t add_task(void (*task_ptr)(), char *Name, uint16_t delay, uint16_t period)
+task_handle add_task(void (*task_ptr)(), const char *Name, uint16_t delay, uint16_t period)
 {
-    uint8_t  index = 0;
     uint16_t temp1 = (uint16_t)(delay  * TICKS_PER_SEC / 1000);
     uint16_t temp2 = (uint16_t)(period * TICKS_PER_SEC / 1000);
     
-    if (max_tasks >= MAX_TASKS) return ERR_MAX_TASKS;
-    //go through the active tasks
-    while ((index < MAX_TASKS) && task_list[index].Period) index++;
-    if (index >= MAX_TASKS) return ERR_MAX_TASKS;
+    return add_task_list(task_ptr, Name, temp1, temp2, 0);
+} // add_task()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : Add a function to the task-list struct that runs in step with
+             the display. Its counters are decremented once per displayed
+             frame by scheduler_frame_isr(), so a task that draws and calls
+             present() runs exactly once every 'period' frames.
+  Variables: task_ptr: pointer to function
+             Name    : name of the task, should be a string constant
+             delay   : initial delay in frames.
+             period  : period between two calls in frames.
+  Returns  : handle of the task, TASK_NONE if task_list[] is full
+  ---------------------------------------------------------------------------*/
+task_handle add_frame_task(void (*task_ptr)(), const char *Name, uint16_t delay, uint16_t period)
+{
+    return add_task_list(task_ptr, Name, delay, period, TASK_FRAME);
+} // add_frame_task()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : Add all tasks from a task table. The table is a const array, so
+             it is stored in flash together with the task names.
+  Variables: tbl: pointer to the first entry of the task table
+             n  : number of entries in the table
+  Returns  : [NO_ERR, ERR_MAX_TASKS]
+  ---------------------------------------------------------------------------*/
+uint8_t add_task_table(const task_def *tbl, uint8_t n)
+{
+    task_handle h;
     
-    if (task_list[index].Period == 0)
+    while (n--)
     {
-        task_list[index].pFunction    = task_ptr;       // Pointer to Function
-        task_list[index].Period       = temp2;          // Period in msec.
-        task_list[index].Counter      = temp2;	        // Countdown timer
-        task_list[index].Delay        = temp1;          // Initial delay before start
-        task_list[index].Status      |= TASK_ENABLED;   // Enable task by default
-        task_list[index].Status      &= ~TASK_READY;    // Task not ready to run
-        task_list[index].Duration     = 0;              // Actual Task Duration
-        task_list[index].Duration_Max = 0;              // Max. Task Duration
-        strncpy(task_list[index].Name, Name, NAME_LEN); // Name of Task
-        max_tasks++; // increase number of tasks
-    } // if
+        if (tbl->Flags & TASK_FRAME)
+             h = add_frame_task(tbl->pFunction, tbl->Name, tbl->Delay, tbl->Period);
+        else h = add_task(tbl->pFunction, tbl->Name, tbl->Delay, tbl->Period);
+        if (h == TASK_NONE) return ERR_MAX_TASKS;
+        tbl++;
+    } // while
     return NO_ERR;
-} // add_task()
+} // add_task_table()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : Find a task by its name. Only needed for the serial console,
+             all other code should use the handle returned by add_task().
+  Variables: Name: Name of task to find
+  Returns  : handle of the task, TASK_NONE if not found
+  ---------------------------------------------------------------------------*/
+task_handle find_task(const char *Name)
+{
+    uint8_t index = 0;
+    
+    while ((index < MAX_TASKS) && (task_list[index].Period != 0))
+    {
+        if (!strcmp(task_list[index].Name,Name)) return index;
+        index++;
+    } // while
+    return TASK_NONE;
+} // find_task()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : Convert the result of find_task() into an error code.
+  Variables: h: handle returned by find_task()
+  Returns  : error [NO_ERR, ERR_NAME, ERR_EMPTY]
+  ---------------------------------------------------------------------------*/
+static uint8_t name_err(task_handle h)
+{
+    if (task_list[0].Period == 0) return ERR_EMPTY;
+    else if (h == TASK_NONE)      return ERR_NAME;
+    else                          return NO_ERR;
+} // name_err()
 
 /*-----------------------------------------------------------------------------
   Purpose  : Enable a task.
-  Variables: Name: Name of task to enable
+  Variables: h: handle of the task to enable
              exclusive: DISABLE_OTHER_TASKS: enable only this task, 
                                              other tasks are disabled. 
                         THIS_TASK_ONLY: enable this task, other tasks are not changed.
-  Returns  : error [NO_ERR, ERR_NAME, ERR_EMPTY]
+  Returns  : error [NO_ERR, ERR_NAME]
   ---------------------------------------------------------------------------*/
-uint8_t enable_task(char *Name, bool exclusive)
+uint8_t enable_task_h(task_handle h, bool exclusive)
 {
     uint8_t index = 0;
-    bool    found = false;
     
-    //go through the active tasks
-    if (task_list[index].Period != 0)
-    {
-        while ((index < MAX_TASKS) && (task_list[index].Period != 0) && (!found || exclusive))
+    if ((h >= MAX_TASKS) || !task_list[h].Period) return ERR_NAME;
+    if (exclusive)
+    {   // other tasks should be disabled
+        while ((index < MAX_TASKS) && (task_list[index].Period != 0))
         {
-            if (!strcmp(task_list[index].Name,Name))
-            {   // task is found
-                task_list[index].Status |= TASK_ENABLED;
-                found = true;
-            } // if
-            else if (exclusive)
-            {   // other task, should be disabled
-                task_list[index].Status &= ~TASK_ENABLED;
-            } // else if
+            if (index != h) task_list[index].Status &= ~TASK_ENABLED;
             index++;
         } // while
     } // if
-    else return ERR_EMPTY;
-    if (!found)
-         return ERR_NAME;
-    else return NO_ERR;	
+#if SCHED_DEADLINE
+    if (!(task_list[h].Status & TASK_ENABLED))
+    {   // restart one period from now
+        task_list[h].Deadline = sched_now(TASK_CLK(h)) + task_list[h].Period;
+        sched_pending = true; // recalculate earliest deadline
+    } // if
+#endif
+    task_list[h].Status |= TASK_ENABLED;
+    return NO_ERR;
+} // enable_task_h()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : Enable a task.
+  Variables: Name: Name of task to enable
+             exclusive: see enable_task_h()
+  Returns  : error [NO_ERR, ERR_NAME, ERR_EMPTY]
+  ---------------------------------------------------------------------------*/
+uint8_t enable_task(const char *Name, bool exclusive)
+{
+    task_handle h = find_task(Name);
+    
+    if (h == TASK_NONE) return name_err(h);
+    return enable_task_h(h, exclusive);
 } // enable_task()
 
+/*-----------------------------------------------------------------------------
+  Purpose  : Disable a task.
+  Variables: h: handle of the task to disable
+  Returns  : error [NO_ERR, ERR_NAME]
+  ---------------------------------------------------------------------------*/
+uint8_t disable_task_h(task_handle h)
+{
+    if ((h >= MAX_TASKS) || !task_list[h].Period) return ERR_NAME;
+    task_list[h].Status &= ~TASK_ENABLED;
+    return NO_ERR;
+} // disable_task_h()
+
 /*-----------------------------------------------------------------------------
   Purpose  : Disable a task.
   Variables: Name: Name of task to disable
   Returns  : error [NO_ERR, ERR_NAME, ERR_EMPTY]
   ---------------------------------------------------------------------------*/
-uint8_t disable_task(char *Name)
+uint8_t disable_task(const char *Name)
 {
-    uint8_t index = 0;
-    bool    found = false;
+    task_handle h = find_task(Name);
     
-    //go through the active tasks
-    if (task_list[index].Period != 0)
-    {
-        while ((index < MAX_TASKS) && (task_list[index].Period != 0) && !found)
-        {
-            if (!strcmp(task_list[index].Name,Name))
-            {
-                task_list[index].Status &= ~TASK_ENABLED;
-                found = true;
-            } // if
-            index++;
-        } // while
-    } // if
-    else return ERR_EMPTY;
-    if (!found)
-        return ERR_NAME;
-    else return NO_ERR;	
+    if (h == TASK_NONE) return name_err(h);
+    return disable_task_h(h);
 } // disable_task()
 
 /*-----------------------------------------------------------------------------
   Purpose  : Set the time-period (msec.) of a task.
-  Variables: Period: the time in milliseconds
+  Variables: h     : handle of the task
+             Period: the time in milliseconds (in frames for a frame task)
+  Returns  : error [NO_ERR, ERR_NAME]
+  ---------------------------------------------------------------------------*/
+uint8_t set_task_time_period_h(task_handle h, uint16_t Period)
+{
+    if ((h >= MAX_TASKS) || !task_list[h].Period) return ERR_NAME;
+    if (task_list[h].Status & TASK_FRAME)
+         task_list[h].Period = Period;
+    else task_list[h].Period = (uint16_t)(Period * TICKS_PER_SEC / 1000);
+#if SCHED_DEADLINE
+    task_list[h].Deadline = sched_now(TASK_CLK(h)) + task_list[h].Period;
+    sched_pending = true; // recalculate earliest deadline
+#endif
+    sched_sort(); // period may change the order
+    return NO_ERR;
+} // set_task_time_period_h()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : Set the events that make a task ready.
+  Variables: h     : handle of the task
+             events: any of EV_UART1_LINE, EV_STICK, EV_FRAME. Add EV_PERIOD
+                     to run the task on its period as well.
+  Returns  : error [NO_ERR, ERR_NAME]
+  ---------------------------------------------------------------------------*/
+uint8_t set_task_events_h(task_handle h, uint8_t events)
+{
+    if ((h >= MAX_TASKS) || !task_list[h].Period) return ERR_NAME;
+    task_list[h].Events = events;
+#if SCHED_DEADLINE
+    task_list[h].Deadline = sched_now(TASK_CLK(h)) + task_list[h].Period;
+    sched_pending = true; // recalculate earliest deadline
+#endif
+    return NO_ERR;
+} // set_task_events_h()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : Set the priority of a task.
+  Variables: h   : handle of the task
+             prio: 0 is the highest priority. Tasks with a priority always
+                   go before tasks with PRIO_AUTO, which are ordered by
+                   period: the shortest period goes first.
+  Returns  : error [NO_ERR, ERR_NAME]
+  ---------------------------------------------------------------------------*/
+uint8_t set_task_priority_h(task_handle h, uint8_t prio)
+{
+    if ((h >= MAX_TASKS) || !task_list[h].Period) return ERR_NAME;
+    task_list[h].Prio = prio;
+    sched_sort();
+    return NO_ERR;
+} // set_task_priority_h()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : Set the time-period (msec.) of a task.
+  Variables: Period: the time in milliseconds (in frames for a frame task)
              Name  : the name of the task to set the time for
   Returns  : error [NO_ERR, ERR_NAME, ERR_EMPTY]
   ---------------------------------------------------------------------------*/
-uint8_t set_task_time_period(uint16_t Period, char *Name)
+uint8_t set_task_time_period(uint16_t Period, const char *Name)
 {
-    uint8_t index = 0;
-    bool    found = false;
+    task_handle h = find_task(Name);
     
-    //go through the active tasks
-    if(task_list[index].Period != 0)
-    {
-        while ((index < MAX_TASKS) && (task_list[index].Period != 0) && !found)
-        {
-            if (!strcmp(task_list[index].Name,Name))
-            {
-                task_list[index].Period = (uint16_t)(Period * TICKS_PER_SEC / 1000);
-                found = true;
-            } // if
-            index++;
-        } // while
-    } // if
-    else return ERR_EMPTY;
-    if (!found)
-        return ERR_NAME;
-    else return NO_ERR;	
+    if (h == TASK_NONE) return name_err(h);
+    return set_task_time_period_h(h, Period);
 } // set_task_time_period()
 
+/*-----------------------------------------------------------------------------
+  Purpose  : Set the task to run immediately. The task is made ready and is
+             run by the next dispatch_tasks() pass, like any other task, so
+             this never waits for the task itself. A coroutine task that
+             sleeps in PT_SLEEP_MS() is woken up.
+  Variables: h: handle of the task
+  Returns  : error [NO_ERR, ERR_NAME]
+  ---------------------------------------------------------------------------*/
+uint8_t run_now_task_h(task_handle h)
+{
+    if ((h >= MAX_TASKS) || !task_list[h].Period) return ERR_NAME;
+    if (!(task_list[h].Status & TASK_READY))
+    {   // not already waiting to run or running as a coroutine
+        task_list[h].Status |= TASK_READY;
+        task_list[h].Release = sched_now(CLK_TICK);
+    } // if
+    task_list[h].Status &= ~TASK_SLEEP;
+    return NO_ERR;
+} // run_now_task_h()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : Return the resume point of the running coroutine task.
+             Used by PT_BEGIN(), do not call this directly.
+  Variables: -
+  Returns  : the line of the last PT_ macro, 0 = start of the task or
+             the task function is not called by the scheduler
+  ---------------------------------------------------------------------------*/
+uint16_t pt_resume(void)
+{
+    if (sched_current >= max_tasks) return 0;
+    return task_list[sched_current].Pt_Line;
+} // pt_resume()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : Save the resume point of the running coroutine task.
+             Used by the PT_ macros, do not call this directly. Ignored
+             when the task function is not called by the scheduler.
+  Variables: line: the line to resume at, 0 = the task is finished
+  Returns  : -
+  ---------------------------------------------------------------------------*/
+void pt_save(uint16_t line)
+{
+    if (sched_current >= max_tasks) return;
+    task_list[sched_current].Pt_Line = line;
+} // pt_save()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : Let the running coroutine task sleep. Other tasks run and the
+             CPU may go to sleep in the meantime. Used by PT_SLEEP_MS().
+  Variables: ms: the sleep time in milliseconds
+  Returns  : -
+  ---------------------------------------------------------------------------*/
+void pt_sleep(uint16_t ms)
+{
+    if (sched_current >= max_tasks) return;
+    task_list[sched_current].Pt_Wake = sched_now(CLK_TICK) + 
+                                       (uint32_t)ms * TICKS_PER_SEC / 1000;
+    task_list[sched_current].Status |= TASK_SLEEP;
+} // pt_sleep()
+
 /*-----------------------------------------------------------------------------
   Purpose  : Set the task to run immediately
   Variables: Name  : the name of the task
   Returns  : error [NO_ERR, ERR_NAME, ERR_EMPTY]
   ---------------------------------------------------------------------------*/
-uint8_t run_now_task(char *Name)
+uint8_t run_now_task(const char *Name)
 {
-    uint8_t index = 0;
-    bool    found = false;
+    task_handle h = find_task(Name);
     
-    //go through the active tasks
-    if(task_list[index].Period != 0)
-    {
-        while ((index < MAX_TASKS) && (task_list[index].Period != 0) && !found)
-        {
-            if (!strcmp(task_list[index].Name,Name))
-            {
-                task_list[index].pFunction(); // run the task
-                found = true;
-            } // if
-            index++;
-        } // while
-    } // if
-    else return ERR_EMPTY;
-    if (!found)
-        return ERR_NAME;
-    else return NO_ERR;	
+    if (h == TASK_NONE) return name_err(h);
+    return run_now_task_h(h);
 } // run_now_task()
@@ -24,13 +24,35 @@
 #include <string.h>
 #include <stdio.h>
 
-#define MAX_TASKS	  (3)
+#ifndef MAX_TASKS
+#define MAX_TASKS	  (7) /* at most 32, the host test uses 32 */
+#endif
 #define MAX_MSEC      (60000)
 #define TICKS_PER_SEC (4000L)
-#define NAME_LEN         (12) 
+
+//---------------------------------------------------------------
+// SCHED_DEADLINE: 1 = every task has an absolute deadline, the ISR
+//                     only compares the tick counter with the
+//                     earliest deadline (O(1) per tick).
+//                 0 = the ISR decrements Delay and Counter of every
+//                     task (O(MAX_TASKS) per tick).
+//---------------------------------------------------------------
+#ifndef SCHED_DEADLINE
+#define SCHED_DEADLINE (1)
+#endif
+
+//---------------------------------------------------------------
+// IDLE_WFI: 1 = dispatch_tasks() executes WFI when no task is ready
+//               and no event is posted, the idle time is used for
+//               the CPU load (see cpu_load()).
+//---------------------------------------------------------------
+#define IDLE_WFI       (1)
 
 #define TASK_READY    (0x01)
 #define TASK_ENABLED  (0x02)
+#define TASK_FRAME    (0x04) /* Delay and Period are in display frames */
+#define TASK_RUN      (0x08) /* Task has started since the last stats reset */
+#define TASK_SLEEP    (0x10) /* Coroutine task waits in PT_SLEEP_MS() */
 
 #define NO_ERR        (0x00)
 #define ERR_CMD	      (0x01)
@@ -40,28 +62,102 @@
 #define ERR_EMPTY     (0x05)
 #define ERR_MAX_TASKS (0x06)
 
+#define TASK_NONE     (0xFF) /* invalid task handle */
+#define PRIO_AUTO     (0xFF) /* priority from period (deadline-monotonic) */
+
+// Events posted by ISRs with post_event(), see set_task_events_h()
+#define EV_UART1_LINE (0x01) /* UART1 received a '\n' */
+#define EV_STICK      (0x02) /* joystick changed (debounced) */
+#define EV_FRAME      (0x04) /* a frame has been shown */
+#define EV_UART1_FRAME (0x08) /* UART1 received a binary frame, see uart.h */
+#define EV_ESP        (0x10) /* ESP8266 response line received, see esp8266.h */
+#define EV_WIFI_LINE  (0x20) /* command line received over WiFi, see esp8266.h */
+#define EV_I2C        (0x40) /* I2C transaction queued or running, see i2c_bb.c */
+#define EV_PERIOD     (0x80) /* not an event: task also runs on its period */
+
 #define DISABLE_OTHER_TASKS (true)
 #define THIS_TASK_ONLY      (false)
       
 typedef struct _task_struct
 {
     void     (* pFunction)(void); // Function pointer
-    char     Name[NAME_LEN];      // Task name
+    const char *Name;             // Task name, a string constant in flash
     uint16_t Period;              // Period between 2 calls in msec.
     uint16_t Delay;               // Initial delay before Counter starts in msec.
     uint16_t Counter;             // Running counter, is init. from Period
     uint8_t  Status;              // bit 1: 1=enabled ; bit 0: 1=ready to run
     uint16_t Duration;            // Measured task-duration in clock-ticks
     uint16_t Duration_Max;        // Max. measured task-duration
+    uint32_t Release;             // Tick at which the ready flag was set
+    uint32_t Last_Start;          // Tick of the previous start
+    uint16_t Late;                // Ticks from release to start, last run
+    uint16_t Late_Max;            // Max. ticks from release to start
+    uint16_t Jitter_Max;          // Max. |start-to-start time - Period| in ticks
+    uint16_t Missed;              // Number of periods that did not run
+    uint8_t  Prio;                // 0 = highest, PRIO_AUTO = order by period
+    uint8_t  Events;              // Events that make the task ready + EV_PERIOD
+    uint16_t Pt_Line;             // Coroutine resume point, 0 = not started
+    uint32_t Pt_Wake;             // Tick at which PT_SLEEP_MS() ends
+#if SCHED_DEADLINE
+    uint32_t Deadline;            // Tick (frame for TASK_FRAME) of next run
+#endif
 } task_struct;
 
+typedef uint8_t task_handle;      // index in task_list[]
+
+// Entry for a task table in flash, see add_task_table()
+typedef struct _task_def
+{
+    void     (* pFunction)(void); // Function pointer
+    const char *Name;             // Task name
+    uint16_t Delay;               // Initial delay in msec. (frames for TASK_FRAME)
+    uint16_t Period;              // Period in msec. (frames for TASK_FRAME)
+    uint8_t  Flags;               // 0 or TASK_FRAME
+} task_def;
+
 void    scheduler_init(void); // clear task_list struct
 void    scheduler_isr(void);  // run-time function for scheduler
+void    scheduler_frame_isr(void); // run-time function for frame tasks
 void    dispatch_tasks(void); // run all tasks that are ready
-uint8_t add_task(void (*task_ptr)(), char *Name, uint16_t delay, uint16_t period);
-uint8_t set_task_time_period(uint16_t Period, char *Name);
-uint8_t enable_task(char *Name, bool exclusive);
-uint8_t disable_task(char *Name);
-uint8_t run_now_task(char *Name);
+task_handle add_task(void (*task_ptr)(), const char *Name, uint16_t delay, uint16_t period);
+task_handle add_frame_task(void (*task_ptr)(), const char *Name, uint16_t delay, uint16_t period);
+uint8_t add_task_table(const task_def *tbl, uint8_t n);
+void    reset_task_stats(void);
+task_handle find_task(const char *Name); // for the serial console only
+
+// Handle-based control functions, a single index into task_list[]
+uint8_t set_task_time_period_h(task_handle h, uint16_t Period);
+uint8_t enable_task_h(task_handle h, bool exclusive);
+uint8_t disable_task_h(task_handle h);
+uint8_t run_now_task_h(task_handle h);
+uint8_t set_task_priority_h(task_handle h, uint8_t prio);
+uint8_t set_task_events_h(task_handle h, uint8_t events);
+__monitor void post_event(uint8_t ev); // from an ISR or a task
+
+//---------------------------------------------------------------
+// Stackless coroutines (protothreads) for long-running tasks.
+// A task function starts with PT_BEGIN() and ends with PT_END().
+// PT_YIELD(), PT_WAIT_UNTIL() and PT_SLEEP_MS() return to
+// dispatch_tasks(), the task is resumed after the macro in a later
+// dispatch pass. Local variables are lost at these points, use
+// static variables for values that are needed afterwards. A switch
+// statement must not contain one of these macros and there can be
+// only one of these macros on a line (__LINE__ is the resume point).
+//---------------------------------------------------------------
+#define PT_BEGIN()        switch (pt_resume()) { case 0:
+#define PT_YIELD()        do { pt_save(__LINE__); return; case __LINE__:; } while (0)
+#define PT_WAIT_UNTIL(c)  do { pt_save(__LINE__); case __LINE__: if (!(c)) return; } while (0)
+#define PT_SLEEP_MS(ms)   do { pt_sleep(ms); pt_save(__LINE__); return; case __LINE__:; } while (0)
+#define PT_END()          } pt_save(0)
+
+uint16_t pt_resume(void);
+void     pt_save(uint16_t line);
+void     pt_sleep(uint16_t ms);
+
+// Name-based control functions, these use find_task()
+uint8_t set_task_time_period(uint16_t Period, const char *Name);
+uint8_t enable_task(const char *Name, bool exclusive);
+uint8_t disable_task(const char *Name);
+uint8_t run_now_task(const char *Name);
 
 #endif
@@ -21,13 +21,28 @@
 #include "stm8_hw_init.h"
 #include "scheduler.h"
 #include "pixel.h"
+#include "profiler.h"
 
 extern uint32_t t2_millis;  // needed for delay_msec()
-extern uint16_t rgb_bufr[]; // The actual status of the red leds
-extern uint16_t rgb_bufg[]; // The actual status of the green leds
-extern uint16_t rgb_bufb[]; // The actual status of the blue leds
+#if ROW_STREAM
+extern uint8_t  row_stream[2][MAX_Y][SIZE_X]; // PC_ODR bytes for every row
+#else
+extern uint16_t frame_bufr[2][BCM_PLANES][MAX_Y]; // Front and back buffer red leds
+extern uint16_t frame_bufg[2][BCM_PLANES][MAX_Y]; // Front and back buffer green leds
+extern uint16_t frame_bufb[2][BCM_PLANES][MAX_Y]; // Front and back buffer blue leds
+#endif
 
-uint8_t current_row = 0;         // Index which row in the hardware is enabled
+uint8_t  current_row = 0;        // Index which row in the hardware is enabled
+#if BCM_PLANES > 1
+uint8_t  bcm_plane   = 0;        // Index of bit-plane being shown
+uint16_t bcm_arr[BCM_PLANES];    // TIM2 reload value for every bit-plane
+#endif
+uint8_t  front_buf   = 0;        // Index of the buffer shown by the TIM2 ISR
+bool     swap_req    = false;    // true = swap buffers at next frame
+uint16_t frame_cnt   = 0;        // Number of displayed frames
+uint8_t  stick_raw;              // Last joystick sample
+uint8_t  stick_stable;           // Debounced joystick value
+uint8_t  stick_cnt   = 0;        // Number of equal joystick samples
 
 //------------------------------------------------
 // Buzzer variables
@@ -108,34 +123,117 @@ void set_buzzer(uint8_t freq, uint8_t nrbeeps)
     bz_on      = true;
 } // set_buzzer()
 
+/*------------------------------------------------------------------
+  Purpose  : This function selects the next row to display. When 
+             current_row wraps to 0, a pending buffer swap is done
+             and frame tasks are released. Called from the TIM2 ISR.
+  Variables: -
+  Returns  : -
+  ------------------------------------------------------------------*/
+static inline void next_row(void)
+{
+    if (++current_row >= MAX_Y)
+    {   // cycle through rows, enable one at a time
+        current_row = 0;
+        if (swap_req)
+        {   // a new frame is ready in the back buffer
+            front_buf ^= 0x01;
+            swap_req   = false;
+        } // if
+        frame_cnt++;           // a complete frame has been displayed
+        scheduler_frame_isr(); // release tasks that run once per frame
+        post_event(EV_FRAME);
+    } // if
+} // next_row()
+
+/*------------------------------------------------------------------
+  Purpose  : This function samples the joystick every tick. PORTF has
+             no interrupt capability (NOTE 1), so a change is found here
+             and posted as EV_STICK after STICK_DEBOUNCE equal samples.
+             Called from the TIM2 ISR.
+  Variables: -
+  Returns  : -
+  ------------------------------------------------------------------*/
+static inline void stick_isr(void)
+{
+    uint8_t stick = PF_IDR & STICK_ALL;
+    
+    if (stick != stick_raw)
+    {   // input changed, restart debounce
+        stick_raw = stick;
+        stick_cnt = 0;
+    } // if
+    else if ((stick_cnt < STICK_DEBOUNCE) && (++stick_cnt == STICK_DEBOUNCE) && 
+             (stick_raw != stick_stable))
+    {   // stable for STICK_DEBOUNCE ticks
+        stick_stable = stick_raw;
+        post_event(EV_STICK);
+    } // else if
+} // stick_isr()
+
+/*-----------------------------------------------------------------------------
+  Purpose  : This function returns the debounced joystick inputs.
+  Variables: -
+  Returns  : PF_IDR & STICK_ALL, debounced
+  ---------------------------------------------------------------------------*/
+uint8_t get_stick(void)
+{
+    return stick_stable;
+} // get_stick()
+
 /*------------------------------------------------------------------
   Purpose  : This is the Timer-interrupt routine for the Timer 2 
-             Overflow handler which runs every msec. (f=1 kHz). 
-             It is used by the task-scheduler.
+             Overflow handler which runs at 4 kHz (see setup_timers()).
+             Every interrupt sends one row to the shift-registers and 
+             selects it, it also gives the tick for the task-scheduler,
+             the buzzer and the joystick.
+             With BCM_PLANES > 1 it runs BCM_PLANES times per row,
+             the scheduler is then only called once per row.
   Variables: -
   Returns  : -
   ------------------------------------------------------------------*/
 #pragma vector = TIM2_OVR_UIF_vector
 __interrupt void TIM2_UPD_OVF_IRQHandler(void)
 {
+    IDLE_WAKEUP();     // end of idle time
+    PROF_START(t0);    // cycles of this ISR
     IRQ_LEDb = 1;      // Start Time-measurement
+#if BCM_PLANES == 1
     t2_millis++;       // update millisecond counter
     scheduler_isr();   // call the ISR routine for the task-scheduler
     buzzer_isr();      // buzzer ISR routine
+    stick_isr();       // joystick sampling
+#endif
     
     ROWENAb = 0;
+#if ROW_STREAM
+    uint8_t *p    = row_stream[front_buf][current_row]; // start with column 0
+    uint8_t  keep = PC_ODR & ~PC_MATRIX; // PC0, PC6 and PC7 are not ours
+    for (uint8_t i = 0; i < SIZE_X; i++)
+    {   // SDIN bits are already inverted, SHCP and STCP are 0 in every byte
+        PC_ODR = keep | *p++; // set R, G and B data bits (and SHCP = 0)
+        SHCPb  = 1;    // set clock for shift-register
+    } // for i
+    SHCPb = 0;         // set clock to 0 again
+#else
+#if BCM_PLANES > 1
+    uint8_t  plane   = bcm_plane;
+#else
+    uint8_t  plane   = 0;
+#endif
     uint16_t colmask = 0x0001; // start with bit 0 to send to shift-register
     for (uint8_t i = 0; i < SIZE_X; i++)
     {   // shift color bits to hardware shift-registers
         // A LED in hardware is enabled when the bit is 0, bits are inverted here.
-        SDIN_Rb   = (rgb_bufr[current_row] & colmask) ? 0 : 1;
-        SDIN_Gb   = (rgb_bufg[current_row] & colmask) ? 0 : 1;
-        SDIN_Bb   = (rgb_bufb[current_row] & colmask) ? 0 : 1;
+        SDIN_Rb   = (frame_bufr[front_buf][plane][current_row] & colmask) ? 0 : 1;
+        SDIN_Gb   = (frame_bufg[front_buf][plane][current_row] & colmask) ? 0 : 1;
+        SDIN_Bb   = (frame_bufb[front_buf][plane][current_row] & colmask) ? 0 : 1;
         SHCPb     = 1; // set clock for shift-register;
         colmask <<= 1; // select next bit
         SHCPb     = 0; // set clock to 0 again
     } // for i
-    
+#endif
+
     // Now clock bits from shift-registers to output-registers
     STCPb = 1; // set clock to 1
     //---------------------------------------------------------------
@@ -143,14 +241,41 @@ __interrupt void TIM2_UPD_OVF_IRQHandler(void)
     //---------------------------------------------------------------
     PB_ODR = 0x80 | (current_row & 0x7F); // ROWENA=1 + Set PCB nr and ROW nr
     STCPb  = 0; // set clock to 0 again
-    if (++current_row >= MAX_Y)
-    {   // cycle through rows, enable one at a time
-        current_row = 0;
+#if BCM_PLANES > 1
+    // ARPE is 0, so the new reload value is used for the running period:
+    // the plane that was just latched is shown for 2^bcm_plane time units.
+    TIM2_ARRH = (uint8_t)(bcm_arr[bcm_plane] >> 8);
+    TIM2_ARRL = (uint8_t)(bcm_arr[bcm_plane] & 0xFF);
+    if (++bcm_plane >= BCM_PLANES)
+    {   // All planes of this row are shown. The scheduler is called here, 
+        // during the longest plane, so it does not delay the short planes.
+        bcm_plane = 0;
+        t2_millis++;       // update millisecond counter
+        scheduler_isr();   // call the ISR routine for the task-scheduler
+        buzzer_isr();      // buzzer ISR routine
+        stick_isr();       // joystick sampling
+        next_row();
     } // if
+#else
+    next_row();
+#endif
     IRQ_LEDb     = 0; // Stop Time-measurement
     TIM2_SR1_UIF = 0; // Reset the interrupt otherwise it will fire again straight away.
+    PROF_STOP(PROF_TIM2,t0);
 } // TIM2_UPD_OVF_IRQHandler()
 
+/*-----------------------------------------------------------------------------
+  Purpose  : This function returns the number of frames displayed since
+             power-up. It is incremented by the TIM2 ISR when current_row
+             wraps to 0, so it changes FRAMES_PER_SEC times a second.
+  Variables: -
+  Returns  : the frame counter
+  ---------------------------------------------------------------------------*/
+__monitor uint16_t get_frame_cnt(void)
+{
+    return frame_cnt;
+} // get_frame_cnt()
+
 /*-----------------------------------------------------------------------------
   Purpose  : This routine initialises the system clock to run at 24 MHz.
              It uses the external HSE oscillator. 
@@ -239,6 +364,22 @@ void setup_timers(uint8_t clk, uint8_t freq)
             TIM2_ARRL    = 0xE8;  //  Low  byte for 16 MHz -> 1 kHz
         } // else
     } // else
+#if BCM_PLANES > 1
+    //----------------------------------------------------------
+    // Binary Code Modulation: TIM2 runs at fMASTER and the row
+    // period is divided into (2^BCM_PLANES - 1) time units, 
+    // bit-plane k lasts 2^k units. 24 MHz, 4 kHz: row = 6000.
+    //----------------------------------------------------------
+    uint32_t row  = ((clk == HSE) ? 24000000UL : 16000000UL) / (1000UL << freq);
+    uint16_t unit = (uint16_t)(row / ((1 << BCM_PLANES) - 1));
+    for (uint8_t k = 0; k < BCM_PLANES; k++)
+    {
+        bcm_arr[k] = (unit << k) - 1;
+    } // for k
+    TIM2_PSCR    = 0x00;  //  Prescaler = 1
+    TIM2_ARRH    = (uint8_t)(bcm_arr[0] >> 8);
+    TIM2_ARRL    = (uint8_t)(bcm_arr[0] & 0xFF);
+#endif
     TIM2_IER_UIE = 1;     //  Enable the update interrupts
     TIM2_CR1_CEN = 1;     //  Finally enable the timer
 } // setup_timers()
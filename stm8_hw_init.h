@@ -78,6 +78,39 @@
 #define MAX_Y        (NR_OF_BOARDS * SIZE_Y)
 #define MAX_CHAR_Y   (MAX_Y>>3)
 
+//---------------------------------------------------------------
+// ROW_STREAM: 1 = TIM2 ISR sends pre-encoded PC_ODR bytes, which
+//                 are made by present() from the changed rows.
+//             0 = TIM2 ISR tests the frame_buf bits for every column.
+// ROW_STREAM and BCM_PLANES may be set on the command-line (test/Makefile).
+//---------------------------------------------------------------
+#ifndef ROW_STREAM
+#define ROW_STREAM   (1)
+#endif
+
+//---------------------------------------------------------------
+// BCM_PLANES: number of bit-planes per colour (Binary Code Modulation)
+//   1  : a LED is on or off (8 colours), one TIM2 interrupt per row.
+//   2-4: every row is shown BCM_PLANES times, plane k for 2^k time
+//        units, giving 2^(3*BCM_PLANES) colours. The TIM2 reload is
+//        changed for every plane, the row period stays the same.
+// The shortest plane must last longer than the TIM2 ISR itself,
+// at 4 kHz 3 planes is the practical maximum.
+//---------------------------------------------------------------
+#ifndef BCM_PLANES
+#define BCM_PLANES   (1)
+#endif
+#if (BCM_PLANES > 1) && ROW_STREAM
+#error "BCM_PLANES > 1 needs ROW_STREAM = 0"
+#endif
+
+//---------------------------------------------------------------
+// Tasks draw into rgb_bufr/g/b and call present() when a frame is
+// complete. The TIM2 ISR shows one of two front buffers and swaps
+// them when current_row wraps to 0. A frame is MAX_Y interrupts.
+//---------------------------------------------------------------
+#define FRAMES_PER_SEC (4000/MAX_Y) /* with setup_timers(clk,FREQ_4KHZ) */
+
 //-----------------------------
 // PORT A defines
 //-----------------------------
@@ -108,6 +141,11 @@
 #define SDIN_R      (0x08) /* PC3 */
 #define SDIN_G      (0x04) /* PC2 */       
 #define SDIN_B      (0x02) /* PC1 */       
+#define PC_MATRIX   (SHCP | STCP | SDIN_R | SDIN_G | SDIN_B)
+// The TIM2 ISR writes the whole PC_ODR byte for every column (ROW_STREAM).
+// It keeps the PC0, PC6 and PC7 bits (PC_ODR & ~PC_MATRIX) as it found them
+// at the start of the row, so these pins may only be changed by code that
+// cannot interrupt the TIM2 ISR.
 
 // use these defines to directly control the output-pins
 #define SHCPb       (PC_ODR_ODR5) /* clock for HC595 shift-registers */
@@ -143,6 +181,7 @@
 #define STICK_RIGHT (0x10) /* PF4 */
 #define STICK_OK    (0x08) /* PF3 */
 #define STICK_ALL   (STICK_UP | STICK_DOWN | STICK_LEFT | STICK_RIGHT | STICK_OK)
+#define STICK_DEBOUNCE (20) /* ticks (5 msec.) before a change is accepted */
        
 //-----------------------------
 // PORT G defines
@@ -177,6 +216,8 @@
 #define HSI (0xE1) /* internal 16 MHz oscillator */
 #define LSI (0xD2) /* internal 128 kHz oscillator */
 #define HSE (0xB4) /* external 24 MHz oscillator */
+// Master clock frequency in Hz for the result of initialise_system_clock()
+#define FMASTER(clk) (((clk) == HSE) ? 24000000UL : (((clk) == HSI) ? 16000000UL : 128000UL))
 
 // Function prototypes
 void     buzzer(void);
@@ -184,4 +225,6 @@ void     set_buzzer(uint8_t freq, uint8_t nrbeeps);
 uint8_t  initialise_system_clock(uint8_t clk);
 void     setup_timers(uint8_t clk, uint8_t freq);
 void     setup_gpio_ports(void);
+uint16_t get_frame_cnt(void);
+uint8_t  get_stick(void);
 #endif // _STM8_HW_INIT_H
\ No newline at end of file
@@ -0,0 +1,172 @@
+#ifndef _BIN_FRAME_H
+#define _BIN_FRAME_H
+/*==================================================================
+  File Name: bin_frame.h
+  Author   : Emile
+  ------------------------------------------------------------------
+  Purpose  : Sender side of the binary frames on UART1 (see uart.h),
+             used by the host tests and by send_frames.c. An image is
+             the payload of a BIN_FRAME: red, green and blue plane, 
+             2 bytes per row, MSB first. The encoders make a BIN_ROWS
+             or BIN_XRLE payload from an image and the previous image.
+  ------------------------------------------------------------------
+  This file is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+ 
+  This software is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+ 
+  You should have received a copy of the GNU General Public License
+  along with this software.  If not, see <http://www.gnu.org/licenses/>.
+  ================================================================== */ 
+#include <stdint.h>
+#include <string.h>
+#include "uart.h"
+
+/*------------------------------------------------------------------
+  Purpose  : This function makes a binary frame: sync, type, len, 
+             payload and CRC-16/CCITT over type, len and payload.
+  Variables: out : the frame, at least len + 6 bytes
+             type: [BIN_FRAME, BIN_ROWS, BIN_XRLE, BIN_CMD]
+             p   : the payload
+             len : the payload length
+  Returns  : the number of bytes in out
+  ------------------------------------------------------------------*/
+static uint16_t bin_frame(uint8_t *out, uint8_t type, const uint8_t *p, uint8_t len)
+{
+    uint16_t crc = crc16_ccitt(crc16_ccitt(0xFFFF, type), len);
+    uint16_t n   = 0;
+    
+    out[n++] = BIN_SYNC1;
+    out[n++] = BIN_SYNC2;
+    out[n++] = type;
+    out[n++] = len;
+    for (uint8_t i = 0; i < len; i++)
+    {
+        crc      = crc16_ccitt(crc, p[i]);
+        out[n++] = p[i];
+    } // for i
+    out[n++] = (uint8_t)(crc >> 8);
+    out[n++] = (uint8_t)(crc & 0xFF);
+    return n;
+} // bin_frame()
+
+/*------------------------------------------------------------------
+  Purpose  : This function makes an image from the row words of the
+             red, green and blue leds, e.g. rgb_bufr/g/b.
+  Variables: img    : the image, BIN_FRAME_LEN bytes
+             r, g, b: MAX_Y row words per colour
+  Returns  : -
+  ------------------------------------------------------------------*/
+static void bin_image(uint8_t *img, const uint16_t *r, const uint16_t *g, const uint16_t *b)
+{
+    const uint16_t *plane[3] = {r, g, b};
+    
+    for (uint8_t k = 0; k < 3; k++)
+    {
+        for (uint8_t y = 0; y < MAX_Y; y++)
+        {
+            *img++ = (uint8_t)(plane[k][y] >> 8);
+            *img++ = (uint8_t)(plane[k][y] & 0xFF);
+        } // for y
+    } // for k
+} // bin_image()
+
+/*------------------------------------------------------------------
+  Purpose  : This function makes a BIN_ROWS payload: every row that is
+             changed, as row index and the red, green and blue word.
+  Variables: out : the payload, at least BIN_ROWS_LEN bytes
+             img : the new image
+             prev: the previous image
+  Returns  : the payload length, 0 if nothing changed
+  ------------------------------------------------------------------*/
+static uint8_t bin_enc_rows(uint8_t *out, const uint8_t *img, const uint8_t *prev)
+{
+    uint8_t n = 0, k, i;
+    
+    for (uint8_t y = 0; y < MAX_Y; y++)
+    {
+        for (k = 0; k < 6; k++)
+        {   // MSB and LSB of every plane
+            i = (k >> 1) * 2 * MAX_Y + 2 * y + (k & 1);
+            if (img[i] != prev[i]) break;
+        } // for k
+        if (k == 6) continue; // row not changed
+        out[n++] = y;
+        for (k = 0; k < 6; k++) out[n++] = img[(k >> 1) * 2 * MAX_Y + 2 * y + (k & 1)];
+    } // for y
+    return n;
+} // bin_enc_rows()
+
+/*------------------------------------------------------------------
+  Purpose  : This function makes a BIN_XRLE payload: the XOR of the new
+             and the previous image, run-length coded. A single unchanged
+             byte between changed bytes is sent as a 0 (1 byte instead
+             of a skip and a new control byte), trailing unchanged bytes
+             are not sent.
+  Variables: out : the payload, at least 2 * BIN_FRAME_LEN bytes
+             img : the new image
+             prev: the previous image
+  Returns  : the payload length, a BIN_XRLE frame can only be sent
+             when it is 1..BIN_FRAME_LEN
+  ------------------------------------------------------------------*/
+static uint16_t bin_enc_xrle(uint8_t *out, const uint8_t *img, const uint8_t *prev)
+{
+    uint16_t i = 0, j, end = BIN_FRAME_LEN, n = 0;
+    
+    while ((end > 0) && (img[end-1] == prev[end-1])) end--; // trailing bytes
+    while (i < end)
+    {
+        j = i;
+        if (img[i] == prev[i])
+        {   // skip at most 128 unchanged bytes
+            while ((j < end) && (j - i < 128) && (img[j] == prev[j])) j++;
+            out[n++] = 0x80 | (j - i - 1);
+        } // if
+        else
+        {   // at most 128 bytes to XOR, with single unchanged bytes
+            while ((j < end) && (j - i < 128) && ((img[j] != prev[j]) || 
+                   ((j + 1 < end) && (j + 1 - i < 128) && (img[j+1] != prev[j+1])))) j++;
+            out[n++] = j - i - 1;
+            for (uint16_t k = i; k < j; k++) out[n++] = img[k] ^ prev[k];
+        } // else
+        i = j;
+    } // while
+    return n;
+} // bin_enc_xrle()
+
+/*------------------------------------------------------------------
+  Purpose  : This function makes the smallest payload for an image: 
+             BIN_FRAME, BIN_ROWS or BIN_XRLE.
+  Variables: out : the payload, at least 2 * BIN_FRAME_LEN bytes
+             type: returns the frame type
+             img : the new image
+             prev: the previous image, as shown by the panel
+  Returns  : the payload length
+  ------------------------------------------------------------------*/
+static uint8_t bin_enc_best(uint8_t *out, uint8_t *type, const uint8_t *img, const uint8_t *prev)
+{
+    uint8_t  rows[BIN_ROWS_LEN];
+    uint8_t  nr = bin_enc_rows(rows, img, prev);
+    uint16_t nx = bin_enc_xrle(out, img, prev);
+    
+    if ((nx > 0) && (nx <= BIN_FRAME_LEN) && (nx <= nr))
+    {   // BIN_XRLE is already in out[]
+        *type = BIN_XRLE;
+        return (uint8_t)nx;
+    } // if
+    if (nr < BIN_FRAME_LEN)
+    {   // also when nothing changed: an empty BIN_ROWS frame
+        *type = BIN_ROWS;
+        memcpy(out, rows, nr);
+        return nr;
+    } // if
+    *type = BIN_FRAME;
+    memcpy(out, img, BIN_FRAME_LEN);
+    return BIN_FRAME_LEN;
+} // bin_enc_best()
+#endif
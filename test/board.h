@@ -0,0 +1,133 @@
+#ifndef _BOARD_H
+#define _BOARD_H
+/*==================================================================
+  File Name: board.h
+  Author   : Emile
+  ------------------------------------------------------------------
+  Purpose  : Model of the board for the tests that link the whole
+             firmware (FW in the Makefile, without delay.c). Time only
+             advances in board_tick(): it runs the TIM2 ISR and moves
+             the bytes of UART1 and UART3 that fit in one tick at the
+             baud-rate through their ISRs. UART1 output is collected in
+             u1_out[], UART3 is connected to a file descriptor, e.g. a
+             pseudo-terminal. millis() and delay_msec() of delay.c are
+             replaced: delay_msec() runs the board while it waits, and
+             millis() calls board_hook (if set), so that a test can run
+             the board while the firmware polls.
+  ------------------------------------------------------------------
+  This file is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+ 
+  This software is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+ 
+  You should have received a copy of the GNU General Public License
+  along with this software.  If not, see <http://www.gnu.org/licenses/>.
+  ================================================================== */ 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../stm8_hw_init.h"
+#include "../scheduler.h"
+#include "../uart.h"
+#include "../ring_buffer.h"
+
+#define U1_OUTLEN (1 << 16) /* bytes of UART1 output that are kept */
+
+__interrupt void TIM2_UPD_OVF_IRQHandler(void);
+__interrupt void UART1_TX_IRQHandler(void);
+__interrupt void UART1_RX_IRQHandler(void);
+__interrupt void UART3_TX_IRQHandler(void);
+__interrupt void UART3_RX_IRQHandler(void);
+extern struct ring_buffer ring_buffer_out1, ring_buffer_out3;
+extern uint32_t baud1, baud3;
+
+uint32_t t2_millis = 0;        // ticks, as in delay.c
+char     u1_out[U1_OUTLEN];    // UART1 output, '\0' terminated
+uint32_t u1_outn = 0;          // bytes in u1_out[]
+const char *u1_in = NULL;      // input for UART1, NULL = none
+int      u3_fd   = -1;         // UART3 is connected to this file descriptor
+uint32_t u3_tx   = 0, u3_rx = 0; // bytes sent and received by UART3
+static double u1_credit = 0.0, u3_credit = 0.0; // bytes that the UARTs may move
+void     (*board_hook)(void) = NULL; // called by millis(), NULL = none
+
+/*------------------------------------------------------------------
+  Purpose  : This function sends one byte with the TX ISR of a UART.
+  Variables: isr : the TX ISR
+             rb  : the transmit ring of the UART
+             tien: the TIEN bit of the UART
+             dr  : the data register of the UART
+  Returns  : the byte sent, -1 if nothing was sent
+  ------------------------------------------------------------------*/
+static int board_tx(void (*isr)(void), struct ring_buffer *rb, 
+                    volatile unsigned char *tien, volatile unsigned char *dr)
+{
+    bool empty;
+    
+    if (!*tien) return -1; // transmit interrupt off
+    empty = ring_buffer_is_empty(rb);
+    isr();
+    return empty ? -1 : *dr;
+} // board_tx()
+
+/*------------------------------------------------------------------
+  Purpose  : This function runs the board for one tick (250 usec.).
+  Variables: -
+  Returns  : -
+  ------------------------------------------------------------------*/
+void board_tick(void)
+{
+    uint8_t b;
+    int     ch;
+    
+    TIM2_UPD_OVF_IRQHandler();
+    for (u1_credit += baud1 / 10.0 / TICKS_PER_SEC; u1_credit >= 1.0; u1_credit -= 1.0)
+    {   // UART1 sends and receives one byte
+        ch = board_tx(UART1_TX_IRQHandler, &ring_buffer_out1, &UART1_CR2_TIEN, &UART1_DR);
+        if ((ch >= 0) && (u1_outn < U1_OUTLEN - 1)) u1_out[u1_outn++] = ch;
+        if (u1_in && *u1_in)
+        {
+            UART1_DR = *u1_in++;
+            UART1_RX_IRQHandler();
+        } // if
+    } // for
+    for (u3_credit += baud3 / 10.0 / TICKS_PER_SEC; u3_credit >= 1.0; u3_credit -= 1.0)
+    {   // UART3 sends and receives one byte
+        ch = board_tx(UART3_TX_IRQHandler, &ring_buffer_out3, &UART3_CR2_TIEN, &UART3_DR);
+        if ((ch >= 0) && (u3_fd >= 0))
+        {
+            b = ch;
+            if (write(u3_fd, &b, 1) == 1) u3_tx++;
+        } // if
+        if ((u3_fd >= 0) && (read(u3_fd, &b, 1) == 1))
+        {
+            UART3_DR = b;
+            UART3_RX_IRQHandler();
+            u3_rx++;
+        } // if
+    } // for
+    u1_out[u1_outn] = '\0';
+} // board_tick()
+
+__monitor uint32_t millis(void)
+{
+    if (board_hook) board_hook();
+    return t2_millis;
+} // millis()
+
+/*------------------------------------------------------------------
+  Purpose  : As delay.c: wait until millis() has advanced by ms, the 
+             board runs meanwhile.
+  ------------------------------------------------------------------*/
+void delay_msec(uint16_t ms)
+{
+    uint32_t start = millis();
+    
+    while ((millis() - start) < ms) board_tick();
+} // delay_msec()
+#endif
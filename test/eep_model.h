@@ -0,0 +1,183 @@
+#ifndef _EEP_MODEL_H
+#define _EEP_MODEL_H
+/*==================================================================
+  File Name: eep_model.h
+  Author   : Emile
+  ------------------------------------------------------------------
+  Purpose  : Model of the STM8S207 data EEPROM for the tests of eep.c
+             and kv.c. Include it before eep.c: the EEPROM is em_mem[]
+             and the FLASH registers are functions of the model.
+             - FLASH_DUKR  : the keys 0xAE, 0x56 unlock the EEPROM
+             - FLASH_CR2   : a write starts a program cycle, the bytes
+                             that changed must be within one byte,
+                             word or block, as set in FLASH_CR2
+             - FLASH_IAPSR : every read takes EM_POLL usec., EOP is set
+                             EM_PROG usec. after the start of a cycle
+             Time (em_now) only advances when FLASH_IAPSR is read or
+             when the test advances it. Every program cycle is counted
+             per mode, with the bytes it programs, and per word in 
+             em_wear[]. A cycle that does not change anything or breaks 
+             a rule is counted in em_err.
+             Power failure: in cycle em_cut, only the first em_cut_n 
+             bytes are programmed, the other bytes of the word or block
+             are erased (0x00) or garbled, then longjmp(em_jb) returns 
+             to the test.
+  ------------------------------------------------------------------
+  This file is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This software is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this software.  If not, see <http://www.gnu.org/licenses/>.
+  ================================================================== */
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#define EM_SIZE (1536) /* bytes of data EEPROM of the STM8S207R8 */
+#define EM_PROG (6000) /* usec. of a program cycle, every mode */
+#define EM_POLL (1)    /* usec. of one FLASH_IAPSR read */
+
+#define EEP_BASE_ADDR   (em_mem)
+#define FLASH_DUKR      (*em_dukr())
+#define FLASH_IAPSR_DUL (*em_dul())
+#define FLASH_CR2       (*em_cr2())
+#define FLASH_IAPSR     (*em_iapsr())
+
+uint8_t  em_mem[EM_SIZE];      // the EEPROM
+uint8_t  em_old[EM_SIZE];      // the EEPROM before the running cycle
+volatile uint8_t em_dukrv = 0, em_dulv = 0, em_cr2v = 0, em_iapsrv = 0;
+uint8_t  em_key   = 0;         // previous value of FLASH_DUKR
+bool     em_armed = false;     // FLASH_CR2 written, bytes not checked yet
+bool     em_busy  = false;     // program cycle running
+uint32_t em_now   = 0;         // time in usec.
+uint32_t em_end   = 0;         // em_now at which the cycle ends
+uint32_t em_cycles[3] = {0};   // program cycles: byte, word and block
+uint32_t em_bytes = 0;         // bytes covered by the program cycles
+uint32_t em_err   = 0;         // program cycles that broke a rule
+uint32_t em_wear[EM_SIZE / 4]; // program cycles per word
+uint32_t em_cut   = 0;         // the power fails in this cycle, 0 = never
+uint16_t em_cut_n = 0;         // bytes programmed before the power fails
+bool     em_garble = false;    // true = the other bytes are garbled
+jmp_buf  em_jb;                // where a power failure returns to
+extern volatile unsigned char FLASH_NCR2;
+
+/*------------------------------------------------------------------
+  Purpose  : This function returns the sum of the program cycles.
+  ------------------------------------------------------------------*/
+static uint32_t em_ncycles(void)
+{
+    return em_cycles[0] + em_cycles[1] + em_cycles[2];
+} // em_ncycles()
+
+/*------------------------------------------------------------------
+  Purpose  : FLASH_DUKR: the write after this call is the new key.
+  ------------------------------------------------------------------*/
+static volatile uint8_t *em_dukr(void)
+{
+    em_key = em_dukrv;
+    return &em_dukrv;
+} // em_dukr()
+
+/*------------------------------------------------------------------
+  Purpose  : FLASH_IAPSR_DUL: set after the keys 0xAE and 0x56.
+  ------------------------------------------------------------------*/
+static volatile uint8_t *em_dul(void)
+{
+    if ((em_key == 0xAE) && (em_dukrv == 0x56)) em_dulv = 1;
+    em_key = em_dukrv = 0;
+    return &em_dulv;
+} // em_dul()
+
+/*------------------------------------------------------------------
+  Purpose  : FLASH_CR2: a program cycle starts after this write. No
+             byte of the EEPROM may have changed since the last cycle.
+  ------------------------------------------------------------------*/
+static volatile uint8_t *em_cr2(void)
+{
+    if (em_busy || em_armed || !em_dulv || memcmp(em_mem, em_old, EM_SIZE))
+    {
+        em_err++;
+        printf("em: FLASH_CR2 written during a cycle, while locked or bytes changed\n");
+    } // if
+    memcpy(em_old, em_mem, EM_SIZE);
+    em_armed = true;
+    return &em_cr2v;
+} // em_cr2()
+
+/*------------------------------------------------------------------
+  Purpose  : This function checks the bytes of a program cycle that
+             was started with FLASH_CR2 and counts it.
+  ------------------------------------------------------------------*/
+static void em_start(void)
+{
+    uint16_t i, lo = EM_SIZE, hi = 0, size;
+    uint8_t  m;
+
+    switch (em_cr2v)
+    {
+        case 0x00: m = 0; size = 1;   break; // EEP_PRG_BYTE
+        case 0x40: m = 1; size = 4;   break; // EEP_PRG_WORD
+        case 0x01: m = 2; size = 128; break; // EEP_PRG_BLOCK
+        default  : m = 0; size = 0;   break;
+    } // switch
+    for (i = 0; i < EM_SIZE; i++)
+    {
+        if (em_mem[i] != em_old[i])
+        {
+            if (lo == EM_SIZE) lo = i;
+            hi = i;
+        } // if
+    } // for i
+    if (!size || (FLASH_NCR2 != (uint8_t)~em_cr2v) || (lo == EM_SIZE) || (lo / size != hi / size))
+    {
+        em_err++;
+        printf("em: mode 0x%02x, bytes %u..%u changed\n", em_cr2v, lo, hi);
+    } // if
+    em_cycles[m]++;
+    em_bytes += size;
+    if (size && (lo < EM_SIZE))
+    {
+        lo -= lo % size; // start of the byte, word or block
+        for (i = lo; i < lo + size; i += 4) em_wear[i / 4]++;
+        if (em_cut && (em_ncycles() == em_cut))
+        {   // power failure
+            for (i = lo + em_cut_n; i < lo + size; i++) em_mem[i] = em_garble ? em_old[i] ^ 0x5A : 0x00;
+            memcpy(em_old, em_mem, EM_SIZE);
+            em_armed = em_busy = false;
+            em_dulv  = 0;
+            em_cut   = 0;
+            longjmp(em_jb, 1);
+        } // if
+    } // if
+    memcpy(em_old, em_mem, EM_SIZE);
+    em_armed = false;
+    em_busy  = true;
+    em_end   = em_now + EM_PROG;
+} // em_start()
+
+/*------------------------------------------------------------------
+  Purpose  : FLASH_IAPSR: EOP is set when the program cycle has ended.
+  ------------------------------------------------------------------*/
+static volatile uint8_t *em_iapsr(void)
+{
+    em_now += EM_POLL;
+    if (em_armed) em_start();
+    em_iapsrv = 0;
+    if (em_busy && ((int32_t)(em_now - em_end) >= 0))
+    {   // reading FLASH_IAPSR clears EOP
+        em_iapsrv = 0x04;
+        em_busy   = false;
+    } // if
+    return &em_iapsrv;
+} // em_iapsr()
+
+#endif
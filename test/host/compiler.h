@@ -0,0 +1,37 @@
+#ifndef _COMPILER_H
+#define _COMPILER_H
+/*==================================================================
+  File Name: compiler.h (host build)
+  Author   : Emile
+  ------------------------------------------------------------------
+  Purpose  : IAR STM8 keywords for gcc, this file is included before
+             every source file with -include (see test/Makefile).
+             __monitor functions run with interrupts disabled on the
+             target, the host tests are single-threaded and call the
+             ISRs themselves, so all keywords are empty here.
+             PROF_CLOCK() is host_cycles(), a counter set by the tests.
+  ------------------------------------------------------------------
+  This file is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+ 
+  This software is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+ 
+  You should have received a copy of the GNU General Public License
+  along with this software.  If not, see <http://www.gnu.org/licenses/>.
+  ================================================================== */ 
+#define __interrupt
+#define __monitor
+#define __near
+#define __far
+#define __eeprom
+
+#include <stdint.h>
+extern uint32_t host_cycle_cnt;  // PROF_CLOCK() = host_cycles()
+extern uint32_t host_cycle_step; // cycles of one PROF_CLOCK() call
+uint32_t host_cycles(void);
+#endif
@@ -0,0 +1,53 @@
+/*==================================================================
+  File Name: host.c (host build)
+  Author   : Emile
+  ------------------------------------------------------------------
+  Purpose  : Defines all the registers of iostm8s207r8.h, the 
+             interrupt enable bit and WFI of intrinsics.h and the cycle
+             counter that replaces TIM3 in profiler.h for the host tests.
+  ------------------------------------------------------------------
+  This file is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+ 
+  This software is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+ 
+  You should have received a copy of the GNU General Public License
+  along with this software.  If not, see <http://www.gnu.org/licenses/>.
+  ================================================================== */ 
+#define HOST_REG
+#include <iostm8s207r8.h>
+#include <intrinsics.h>
+#include <stddef.h>
+
+volatile uint8_t host_irq_en = 1; // interrupts enabled
+void (*host_wfi_hook)(void) = NULL; // called by WFI
+uint32_t host_cycle_cnt  = 0;      // advanced by the tests
+uint32_t host_cycle_step = 0;      // added by every host_cycles() call
+
+/*------------------------------------------------------------------
+  Purpose  : PROF_CLOCK() of the host build, see test/Makefile.
+  Variables: -
+  Returns  : host_cycle_cnt, after adding the cost of the call itself
+  ------------------------------------------------------------------*/
+uint32_t host_cycles(void)
+{
+    host_cycle_cnt += host_cycle_step;
+    return host_cycle_cnt;
+} // host_cycles()
+
+/*------------------------------------------------------------------
+  Purpose  : __wait_for_interrupt() of the host build: WFI enables the
+             interrupts, host_wfi_hook may run the ISR that wakes up.
+  Variables: -
+  Returns  : -
+  ------------------------------------------------------------------*/
+void host_wfi(void)
+{
+    host_irq_en = 1;
+    if (host_wfi_hook) host_wfi_hook();
+} // host_wfi()
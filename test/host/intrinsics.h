@@ -0,0 +1,36 @@
+#ifndef _INTRINSICS_H
+#define _INTRINSICS_H
+/*==================================================================
+  File Name: intrinsics.h (host build)
+  Author   : Emile
+  ------------------------------------------------------------------
+  Purpose  : Stand-in for the IAR intrinsics. The interrupt enable
+             bit is kept in host_irq_en, so a test can check that a
+             function leaves the interrupt state as it found it. WFI
+             enables the interrupts and calls host_wfi_hook, where a
+             test can run the board until the next interrupt.
+  ------------------------------------------------------------------
+  This file is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+ 
+  This software is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+ 
+  You should have received a copy of the GNU General Public License
+  along with this software.  If not, see <http://www.gnu.org/licenses/>.
+  ================================================================== */ 
+#include <stdint.h>
+
+extern volatile uint8_t host_irq_en; // 1 = interrupts enabled (I1/I0 bits)
+extern void (*host_wfi_hook)(void);  // called by WFI, NULL = none
+void host_wfi(void);
+
+#define __enable_interrupt()   (host_irq_en = 1)
+#define __disable_interrupt()  (host_irq_en = 0)
+#define __wait_for_interrupt() host_wfi()
+#define __no_operation()       ((void)0)
+#endif
@@ -0,0 +1,371 @@
+#ifndef _IOSTM8S207R8_H
+#define _IOSTM8S207R8_H
+/*==================================================================
+  File Name: iostm8s207r8.h (host build)
+  Author   : Emile
+  ------------------------------------------------------------------
+  Purpose  : Stand-in for the IAR register header, so that the sources
+             can be compiled with gcc for the host tests in test/.
+             Every register is a plain byte. A test that needs the side
+             effects of a register (e.g. reading I2C_DR clears RXNE)
+             defines the register as a macro before including any
+             source header; the declaration below is then skipped.
+             host.c defines all registers by setting HOST_REG to empty.
+  ------------------------------------------------------------------
+  This file is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+ 
+  This software is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+ 
+  You should have received a copy of the GNU General Public License
+  along with this software.  If not, see <http://www.gnu.org/licenses/>.
+  ================================================================== */ 
+#ifndef HOST_REG
+#define HOST_REG extern
+#endif
+
+#ifndef ADC_CR1_SPSEL
+HOST_REG volatile unsigned char ADC_CR1_SPSEL;
+#endif
+#ifndef BEEP_CSR_BEEPDIV
+HOST_REG volatile unsigned char BEEP_CSR_BEEPDIV;
+#endif
+#ifndef BEEP_CSR_BEEPEN
+HOST_REG volatile unsigned char BEEP_CSR_BEEPEN;
+#endif
+#ifndef BEEP_CSR_BEEPSEL
+HOST_REG volatile unsigned char BEEP_CSR_BEEPSEL;
+#endif
+#ifndef CLK_CKDIVR
+HOST_REG volatile unsigned char CLK_CKDIVR;
+#endif
+#ifndef CLK_CMSR
+HOST_REG volatile unsigned char CLK_CMSR;
+#endif
+#ifndef CLK_ECKR
+HOST_REG volatile unsigned char CLK_ECKR;
+#endif
+#ifndef CLK_ECKR_HSEEN
+HOST_REG volatile unsigned char CLK_ECKR_HSEEN;
+#endif
+#ifndef CLK_ECKR_HSERDY
+HOST_REG volatile unsigned char CLK_ECKR_HSERDY;
+#endif
+#ifndef CLK_SWCR
+HOST_REG volatile unsigned char CLK_SWCR;
+#endif
+#ifndef CLK_SWCR_SWBSY
+HOST_REG volatile unsigned char CLK_SWCR_SWBSY;
+#endif
+#ifndef CLK_SWCR_SWEN
+HOST_REG volatile unsigned char CLK_SWCR_SWEN;
+#endif
+#ifndef CLK_SWCR_SWIF
+HOST_REG volatile unsigned char CLK_SWCR_SWIF;
+#endif
+#ifndef CLK_SWIMCCR
+HOST_REG volatile unsigned char CLK_SWIMCCR;
+#endif
+#ifndef CLK_SWR
+HOST_REG volatile unsigned char CLK_SWR;
+#endif
+#ifndef FLASH_CR2
+HOST_REG volatile unsigned char FLASH_CR2;
+#endif
+#ifndef FLASH_DUKR
+HOST_REG volatile unsigned char FLASH_DUKR;
+#endif
+#ifndef FLASH_IAPSR
+HOST_REG volatile unsigned char FLASH_IAPSR;
+#endif
+#ifndef FLASH_IAPSR_DUL
+HOST_REG volatile unsigned char FLASH_IAPSR_DUL;
+#endif
+#ifndef FLASH_NCR2
+HOST_REG volatile unsigned char FLASH_NCR2;
+#endif
+#ifndef I2C_CCRH
+HOST_REG volatile unsigned char I2C_CCRH;
+#endif
+#ifndef I2C_CCRL
+HOST_REG volatile unsigned char I2C_CCRL;
+#endif
+#ifndef I2C_CR1
+HOST_REG volatile unsigned char I2C_CR1;
+#endif
+#ifndef I2C_CR2
+HOST_REG volatile unsigned char I2C_CR2;
+#endif
+#ifndef I2C_DR
+HOST_REG volatile unsigned char I2C_DR;
+#endif
+#ifndef I2C_FREQR
+HOST_REG volatile unsigned char I2C_FREQR;
+#endif
+#ifndef I2C_ITR
+HOST_REG volatile unsigned char I2C_ITR;
+#endif
+#ifndef I2C_OARH
+HOST_REG volatile unsigned char I2C_OARH;
+#endif
+#ifndef I2C_SR1
+HOST_REG volatile unsigned char I2C_SR1;
+#endif
+#ifndef I2C_SR2
+HOST_REG volatile unsigned char I2C_SR2;
+#endif
+#ifndef I2C_SR3
+HOST_REG volatile unsigned char I2C_SR3;
+#endif
+#ifndef I2C_TRISER
+HOST_REG volatile unsigned char I2C_TRISER;
+#endif
+#ifndef PB_CR1
+HOST_REG volatile unsigned char PB_CR1;
+#endif
+#ifndef PB_DDR
+HOST_REG volatile unsigned char PB_DDR;
+#endif
+#ifndef PB_ODR
+HOST_REG volatile unsigned char PB_ODR;
+#endif
+#ifndef PB_ODR_ODR7
+HOST_REG volatile unsigned char PB_ODR_ODR7;
+#endif
+#ifndef PC_CR1
+HOST_REG volatile unsigned char PC_CR1;
+#endif
+#ifndef PC_DDR
+HOST_REG volatile unsigned char PC_DDR;
+#endif
+#ifndef PC_ODR
+HOST_REG volatile unsigned char PC_ODR;
+#endif
+#ifndef PC_ODR_ODR1
+HOST_REG volatile unsigned char PC_ODR_ODR1;
+#endif
+#ifndef PC_ODR_ODR2
+HOST_REG volatile unsigned char PC_ODR_ODR2;
+#endif
+#ifndef PC_ODR_ODR3
+HOST_REG volatile unsigned char PC_ODR_ODR3;
+#endif
+#ifndef PC_ODR_ODR4
+HOST_REG volatile unsigned char PC_ODR_ODR4;
+#endif
+#ifndef PC_ODR_ODR5
+HOST_REG volatile unsigned char PC_ODR_ODR5;
+#endif
+#ifndef PE_CR1
+HOST_REG volatile unsigned char PE_CR1;
+#endif
+#ifndef PE_DDR
+HOST_REG volatile unsigned char PE_DDR;
+#endif
+#ifndef PE_IDR
+HOST_REG volatile unsigned char PE_IDR;
+#endif
+#ifndef PE_ODR
+HOST_REG volatile unsigned char PE_ODR;
+#endif
+#ifndef PF_CR1
+HOST_REG volatile unsigned char PF_CR1;
+#endif
+#ifndef PF_DDR
+HOST_REG volatile unsigned char PF_DDR;
+#endif
+#ifndef PF_IDR
+HOST_REG volatile unsigned char PF_IDR;
+#endif
+#ifndef PG_CR1
+HOST_REG volatile unsigned char PG_CR1;
+#endif
+#ifndef PG_DDR
+HOST_REG volatile unsigned char PG_DDR;
+#endif
+#ifndef PG_IDR
+HOST_REG volatile unsigned char PG_IDR;
+#endif
+#ifndef PG_ODR
+HOST_REG volatile unsigned char PG_ODR;
+#endif
+#ifndef PG_ODR_ODR5
+HOST_REG volatile unsigned char PG_ODR_ODR5;
+#endif
+#ifndef PG_ODR_ODR6
+HOST_REG volatile unsigned char PG_ODR_ODR6;
+#endif
+#ifndef TIM2_ARRH
+HOST_REG volatile unsigned char TIM2_ARRH;
+#endif
+#ifndef TIM2_ARRL
+HOST_REG volatile unsigned char TIM2_ARRL;
+#endif
+#ifndef TIM2_CNTRH
+HOST_REG volatile unsigned char TIM2_CNTRH;
+#endif
+#ifndef TIM2_CNTRL
+HOST_REG volatile unsigned char TIM2_CNTRL;
+#endif
+#ifndef TIM2_CR1_CEN
+HOST_REG volatile unsigned char TIM2_CR1_CEN;
+#endif
+#ifndef TIM2_IER_UIE
+HOST_REG volatile unsigned char TIM2_IER_UIE;
+#endif
+#ifndef TIM2_PSCR
+HOST_REG volatile unsigned char TIM2_PSCR;
+#endif
+#ifndef TIM2_SR1_UIF
+HOST_REG volatile unsigned char TIM2_SR1_UIF;
+#endif
+#ifndef TIM3_ARRH
+HOST_REG volatile unsigned char TIM3_ARRH;
+#endif
+#ifndef TIM3_ARRL
+HOST_REG volatile unsigned char TIM3_ARRL;
+#endif
+#ifndef TIM3_CNTRH
+HOST_REG volatile unsigned char TIM3_CNTRH;
+#endif
+#ifndef TIM3_CNTRL
+HOST_REG volatile unsigned char TIM3_CNTRL;
+#endif
+#ifndef TIM3_CR1_CEN
+HOST_REG volatile unsigned char TIM3_CR1_CEN;
+#endif
+#ifndef TIM3_IER_UIE
+HOST_REG volatile unsigned char TIM3_IER_UIE;
+#endif
+#ifndef TIM3_PSCR
+HOST_REG volatile unsigned char TIM3_PSCR;
+#endif
+#ifndef TIM3_SR1_UIF
+HOST_REG volatile unsigned char TIM3_SR1_UIF;
+#endif
+#ifndef UART1_BRR1
+HOST_REG volatile unsigned char UART1_BRR1;
+#endif
+#ifndef UART1_BRR2
+HOST_REG volatile unsigned char UART1_BRR2;
+#endif
+#ifndef UART1_CR1
+HOST_REG volatile unsigned char UART1_CR1;
+#endif
+#ifndef UART1_CR1_M
+HOST_REG volatile unsigned char UART1_CR1_M;
+#endif
+#ifndef UART1_CR1_PCEN
+HOST_REG volatile unsigned char UART1_CR1_PCEN;
+#endif
+#ifndef UART1_CR2
+HOST_REG volatile unsigned char UART1_CR2;
+#endif
+#ifndef UART1_CR2_ILIEN
+HOST_REG volatile unsigned char UART1_CR2_ILIEN;
+#endif
+#ifndef UART1_CR2_REN
+HOST_REG volatile unsigned char UART1_CR2_REN;
+#endif
+#ifndef UART1_CR2_RIEN
+HOST_REG volatile unsigned char UART1_CR2_RIEN;
+#endif
+#ifndef UART1_CR2_TEN
+HOST_REG volatile unsigned char UART1_CR2_TEN;
+#endif
+#ifndef UART1_CR2_TIEN
+HOST_REG volatile unsigned char UART1_CR2_TIEN;
+#endif
+#ifndef UART1_CR3
+HOST_REG volatile unsigned char UART1_CR3;
+#endif
+#ifndef UART1_CR3_CKEN
+HOST_REG volatile unsigned char UART1_CR3_CKEN;
+#endif
+#ifndef UART1_CR3_CPHA
+HOST_REG volatile unsigned char UART1_CR3_CPHA;
+#endif
+#ifndef UART1_CR3_CPOL
+HOST_REG volatile unsigned char UART1_CR3_CPOL;
+#endif
+#ifndef UART1_CR3_LBCL
+HOST_REG volatile unsigned char UART1_CR3_LBCL;
+#endif
+#ifndef UART1_CR3_STOP
+HOST_REG volatile unsigned char UART1_CR3_STOP;
+#endif
+#ifndef UART1_CR4
+HOST_REG volatile unsigned char UART1_CR4;
+#endif
+#ifndef UART1_CR5
+HOST_REG volatile unsigned char UART1_CR5;
+#endif
+#ifndef UART1_DR
+HOST_REG volatile unsigned char UART1_DR;
+#endif
+#ifndef UART1_GTR
+HOST_REG volatile unsigned char UART1_GTR;
+#endif
+#ifndef UART1_PSCR
+HOST_REG volatile unsigned char UART1_PSCR;
+#endif
+#ifndef UART1_SR
+HOST_REG volatile unsigned char UART1_SR;
+#endif
+#ifndef UART1_SR_TC
+HOST_REG volatile unsigned char UART1_SR_TC;
+#endif
+#ifndef UART3_BRR1
+HOST_REG volatile unsigned char UART3_BRR1;
+#endif
+#ifndef UART3_BRR2
+HOST_REG volatile unsigned char UART3_BRR2;
+#endif
+#ifndef UART3_CR1
+HOST_REG volatile unsigned char UART3_CR1;
+#endif
+#ifndef UART3_CR1_M
+HOST_REG volatile unsigned char UART3_CR1_M;
+#endif
+#ifndef UART3_CR1_PCEN
+HOST_REG volatile unsigned char UART3_CR1_PCEN;
+#endif
+#ifndef UART3_CR2
+HOST_REG volatile unsigned char UART3_CR2;
+#endif
+#ifndef UART3_CR2_REN
+HOST_REG volatile unsigned char UART3_CR2_REN;
+#endif
+#ifndef UART3_CR2_RIEN
+HOST_REG volatile unsigned char UART3_CR2_RIEN;
+#endif
+#ifndef UART3_CR2_TEN
+HOST_REG volatile unsigned char UART3_CR2_TEN;
+#endif
+#ifndef UART3_CR2_TIEN
+HOST_REG volatile unsigned char UART3_CR2_TIEN;
+#endif
+#ifndef UART3_CR3
+HOST_REG volatile unsigned char UART3_CR3;
+#endif
+#ifndef UART3_CR3_STOP
+HOST_REG volatile unsigned char UART3_CR3_STOP;
+#endif
+#ifndef UART3_CR4
+HOST_REG volatile unsigned char UART3_CR4;
+#endif
+#ifndef UART3_DR
+HOST_REG volatile unsigned char UART3_DR;
+#endif
+#ifndef UART3_SR
+HOST_REG volatile unsigned char UART3_SR;
+#endif
+#ifndef UART3_SR_TC
+HOST_REG volatile unsigned char UART3_SR_TC;
+#endif
+#endif
@@ -0,0 +1,213 @@
+#ifndef _I2C_BUS_H
+#define _I2C_BUS_H
+/*==================================================================
+  File Name: i2c_bus.h
+  Author   : Emile
+  ------------------------------------------------------------------
+  Purpose  : Model of I2C bus 0 (PE1 = SCL, PE2 = SDA) with a DS3231
+             (19 registers) as slave, for the tests of i2c_bb.c. Include
+             it before i2c_bb.c: the PE registers are functions of the
+             model, the levels of SCL and SDA follow from the pins of
+             the master (open drain with pull-ups: input = 1) and the
+             SDA output of the slave. The slave acts on the edges:
+             start, stop, SCL rising (sample) and SCL falling (shift).
+             Time: every PE register access takes 0.25 usec. (about 6
+             cycles at 24 MHz), i2c_delay_5usec() is replaced by one
+             that adds 5 usec. to bus_us. The same time in cycles is
+             added to host_cycle_cnt, so the profiler (PROF_CLOCK())
+             sees the time a task spends on the bus.
+  ------------------------------------------------------------------
+  This file is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This software is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this software.  If not, see <http://www.gnu.org/licenses/>.
+  ================================================================== */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+volatile uint8_t *bus_pe(uint8_t r);
+void bus_delay(uint16_t x);
+#define PE_ODR (*bus_pe(0))
+#define PE_DDR (*bus_pe(1))
+#define PE_IDR (*bus_pe(2))
+#define PE_CR1 (*bus_pe(3))
+#define i2c_delay_5usec(x) bus_delay(x)
+
+#define BUS_REGS (19)   /* registers of the DS3231 */
+#define BUS_ADDR (0xD0) /* I2C address of the DS3231 */
+
+// States of the slave
+enum {BS_IDLE, BS_RX, BS_ACKOUT, BS_TX, BS_ACKIN};
+
+uint8_t  bus_reg[BUS_REGS];      // registers of the DS3231
+double   bus_us    = 0.0;        // time in usec.
+uint32_t bus_fails = 0;          // protocol errors
+uint32_t bus_starts = 0, bus_stops = 0, bus_naddr = 0; // start, stop, addressed
+
+static uint8_t pe[4];            // ODR, DDR, IDR and CR1 of port E
+static bool    scl = true, sda = true; // levels of the bus
+static bool    s_sda = true;     // SDA output of the slave
+static int     sst = BS_IDLE;    // state of the slave
+static int     cnt;              // bits of the byte
+static bool    adr;              // true = the address byte
+static bool    rw;               // 1 = read
+static bool    first;            // write: the register pointer, read: NACK
+static uint8_t sh;               // shift register
+static uint8_t bptr;             // register pointer
+
+/*------------------------------------------------------------------
+  Purpose  : This function counts a protocol error.
+  ------------------------------------------------------------------*/
+static void bus_fail(const char *msg)
+{
+    if (bus_fails++ < 5) printf("i2c bus: %s\n", msg);
+} // bus_fail()
+
+/*------------------------------------------------------------------
+  Purpose  : This function sets the bus levels after a write to the PE
+             registers and lets the slave act on the edges.
+  ------------------------------------------------------------------*/
+static void bus_update(void)
+{
+    bool nscl = !(pe[1] & 0x02) || (pe[0] & 0x02);
+    bool msda = !(pe[1] & 0x04) || (pe[0] & 0x04);
+    bool nsda = msda && s_sda;
+
+    if (scl && nscl && (nsda != sda))
+    {
+        if (!nsda)
+        {   // start condition
+            sst   = BS_RX;
+            cnt   = 0;
+            adr   = true;
+            s_sda = true;
+            bus_starts++;
+        } // if
+        else
+        {   // stop condition
+            if (sst == BS_TX) bus_fail("stop while the slave sends");
+            sst   = BS_IDLE;
+            s_sda = true;
+            bus_stops++;
+        } // else
+    } // if
+    else if (!scl && nscl)
+    {   // SCL rising: sample SDA
+        if (sst == BS_RX)
+        {
+            sh = (sh << 1) | nsda;
+            cnt++;
+        } // if
+        else if (sst == BS_TX)    cnt++;
+        else if (sst == BS_ACKIN) first = nsda; // 1 = NACK
+    } // else if
+    else if (scl && !nscl)
+    {   // SCL falling: shift out the next bit
+        switch (sst)
+        {
+            case BS_RX:
+                if (cnt < 8) break;
+                if (adr)
+                {
+                    if ((sh & 0xFE) != BUS_ADDR)
+                    {   // not for this slave
+                        sst = BS_IDLE;
+                        break;
+                    } // if
+                    rw    = sh & 1;
+                    adr   = false;
+                    first = true;
+                    bus_naddr++;
+                } // if
+                else if (first)
+                {
+                    bptr  = sh % BUS_REGS;
+                    first = false;
+                } // else if
+                else
+                {
+                    bus_reg[bptr] = sh;
+                    bptr = (bptr + 1) % BUS_REGS;
+                } // else
+                s_sda = false; // ACK
+                sst   = BS_ACKOUT;
+                break;
+            case BS_ACKOUT:
+                s_sda = true;
+                cnt   = 0;
+                if (rw)
+                {
+                    sh    = bus_reg[bptr];
+                    bptr  = (bptr + 1) % BUS_REGS;
+                    sst   = BS_TX;
+                    s_sda = (sh >> 7) & 1;
+                } // if
+                else sst = BS_RX;
+                break;
+            case BS_TX:
+                if (cnt == 8)
+                {
+                    s_sda = true;
+                    sst   = BS_ACKIN;
+                } // if
+                else s_sda = (sh >> (7 - cnt)) & 1;
+                break;
+            case BS_ACKIN:
+                if (first)
+                {   // NACK: the master sends a stop
+                    sst   = BS_IDLE;
+                    s_sda = true;
+                } // if
+                else
+                {
+                    sh    = bus_reg[bptr];
+                    bptr  = (bptr + 1) % BUS_REGS;
+                    cnt   = 0;
+                    sst   = BS_TX;
+                    s_sda = (sh >> 7) & 1;
+                } // else
+                break;
+        } // switch
+    } // else if
+    scl = nscl;
+    sda = msda && s_sda;
+} // bus_update()
+
+/*------------------------------------------------------------------
+  Purpose  : PE_ODR, PE_DDR, PE_IDR and PE_CR1: the previous write is
+             applied first, PE_IDR returns the bus levels.
+  ------------------------------------------------------------------*/
+volatile uint8_t *bus_pe(uint8_t r)
+{
+    bus_update();
+    bus_us         += 0.25;
+    host_cycle_cnt += 6;
+    if (r == 2) pe[2] = (scl ? 0x02 : 0) | (sda ? 0x04 : 0);
+    return &pe[r];
+} // bus_pe()
+
+void bus_delay(uint16_t x)
+{
+    bus_update();
+    bus_us         += 5.0 * x;
+    host_cycle_cnt += 120UL * x;
+} // bus_delay()
+
+/*------------------------------------------------------------------
+  Purpose  : This function returns true when the bus is free.
+  ------------------------------------------------------------------*/
+static bool bus_idle(void)
+{
+    bus_update();
+    return scl && sda && (sst == BS_IDLE);
+} // bus_idle()
+#endif
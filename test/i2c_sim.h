@@ -0,0 +1,396 @@
+#ifndef _I2C_SIM_H
+#define _I2C_SIM_H
+/*==================================================================
+  File Name: i2c_sim.h
+  Author   : Emile
+  ------------------------------------------------------------------
+  Purpose  : Model of the I2C peripheral of the STM8S207 as master,
+             with a DS3231 (19 registers) as slave, for the tests of
+             i2c_hw.c. Include it before i2c_hw.c: I2C_DR and I2C_SR3
+             are functions of the model, because reading or writing
+             them has side effects (RM0016). The other registers are
+             plain bytes. sim_step() moves the bus on by one step and
+             first runs the I2C ISR when it is pending (0..2 extra
+             times, and only 1 in sim_lat times: a late ISR), but only
+             when interrupts are enabled (host_irq_en).
+             The slave checks the protocol: no byte may be clocked out
+             after a NACK, a read must end with a NACK before the stop.
+             Every error is counted in sim_fails, with a trace of the
+             bus: S start, A address, W written, R read, a/N (n)ack,
+             P stop, [i] ISR with SR1, CR2 and the state of the model.
+  ------------------------------------------------------------------
+  This file is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This software is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this software.  If not, see <http://www.gnu.org/licenses/>.
+  ================================================================== */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <intrinsics.h>
+
+volatile uint16_t *sim_dr(void);
+volatile uint8_t  *sim_sr3(void);
+#define I2C_DR  (*sim_dr())
+#define I2C_SR3 (*sim_sr3())
+#include <iostm8s207r8.h>
+
+__interrupt void I2C_IRQHandler(void);
+
+#define SIM_REGS  (19)   /* registers of the DS3231 */
+#define SIM_ADDR  (0xD0) /* I2C address of the DS3231 */
+#define SR1_SB    (0x01)
+#define SR1_ADDR  (0x02)
+#define SR1_BTF   (0x04)
+#define SR1_RXNE  (0x40)
+#define SR1_TXE   (0x80)
+
+// States of the master
+enum {SIM_IDLE, SIM_SB, SIM_ADDRW, SIM_TX, SIM_RX, SIM_HOLD};
+// States of the slave
+enum {SL_IDLE, SL_PTR, SL_WR, SL_RD};
+
+uint8_t  sim_reg[SIM_REGS];      // registers of the DS3231
+uint32_t sim_fails = 0;          // protocol errors
+uint8_t  sim_lat   = 1;          // the ISR runs 1 in sim_lat steps
+bool     sim_stuck = false;      // true = the bus does not move (lock-up)
+uint32_t sim_naddr = 0;          // times the slave was addressed
+char     sim_trace[4096];        // the bus since sim_clear()
+int      sim_tl    = 0;
+
+static int      st = SIM_IDLE;   // state of the master
+static int      dir;             // R/W bit of the address
+static bool     sh_full;         // shift register holds a byte
+static int      sh_ticks;        // steps until the byte is shifted
+static bool     dr_full;         // DR holds a byte to send
+static int      last_ack;        // 1 = last byte read was NACKed
+static int      latched;         // ACK/NACK for the next byte with POS
+static uint8_t  sh_v, dr_v;      // shift register and DR
+static int      sl_state = SL_IDLE, sl_ptr, sl_rx; // the slave
+static bool     sl_nack;         // slave saw the NACK
+static uint16_t dr_slot;         // I2C_DR access: 0x100 | DR = read, else write
+static bool     dr_pending = false;
+static uint8_t  sr3;
+
+#define TRACE(...) do { if (sim_tl < (int)sizeof(sim_trace)) \
+           sim_tl += snprintf(sim_trace + sim_tl, sizeof(sim_trace) - sim_tl, __VA_ARGS__); } while (0)
+
+/*------------------------------------------------------------------
+  Purpose  : This function counts a protocol error.
+  ------------------------------------------------------------------*/
+static void sim_fail(const char *msg)
+{
+    if (sim_fails++ < 5) printf("i2c sim: %s\nbus: %s\n", msg, sim_trace);
+} // sim_fail()
+
+/*------------------------------------------------------------------
+  Purpose  : This function clears the trace, before a transaction.
+  ------------------------------------------------------------------*/
+static void sim_clear(void)
+{
+    sim_tl       = 0;
+    sim_trace[0] = '\0';
+} // sim_clear()
+
+//------------------------------------------------------------------
+// The slave
+//------------------------------------------------------------------
+static void sl_start(void)
+{
+    if ((sl_state == SL_RD) && !sl_nack && sl_rx) sim_fail("restart while the slave sends");
+    sl_state = SL_IDLE;
+    sl_rx    = 0;
+    sl_nack  = false;
+} // sl_start()
+
+static void sl_stop(void)
+{
+    if ((sl_state == SL_RD) && !sl_nack) sim_fail("stop after an ACKed byte");
+    sl_state = SL_IDLE;
+    TRACE("P ");
+} // sl_stop()
+
+static int sl_addr(uint8_t a)
+{   // returns 1 for a NACK
+    TRACE("A%02x ", a);
+    if ((a & 0xFE) != SIM_ADDR) return 1;
+    sl_state = (a & 1) ? SL_RD : SL_PTR;
+    sim_naddr++;
+    return 0;
+} // sl_addr()
+
+static void sl_write(uint8_t b)
+{
+    TRACE("W%02x ", b);
+    if (sl_state == SL_PTR)
+    {   // register pointer
+        sl_ptr   = b % SIM_REGS;
+        sl_state = SL_WR;
+    } // if
+    else if (sl_state == SL_WR)
+    {
+        sim_reg[sl_ptr] = b;
+        sl_ptr = (sl_ptr + 1) % SIM_REGS;
+    } // else if
+    else sim_fail("write in the wrong state");
+} // sl_write()
+
+static uint8_t sl_read(void)
+{
+    uint8_t b = sim_reg[sl_ptr];
+
+    if ((sl_state != SL_RD) || sl_nack) sim_fail("byte clocked out after a NACK");
+    sl_ptr = (sl_ptr + 1) % SIM_REGS;
+    sl_rx++;
+    TRACE("R%02x ", b);
+    return b;
+} // sl_read()
+
+static void sl_ack(int nack)
+{
+    TRACE("%s ", nack ? "N" : "a");
+    if (nack) sl_nack = true;
+} // sl_ack()
+
+//------------------------------------------------------------------
+// The master: side effects of I2C_DR and I2C_SR3
+//------------------------------------------------------------------
+static void dr_write(uint8_t v)
+{
+    if ((st == SIM_SB) && (I2C_SR1 & SR1_SB))
+    {   // the address
+        I2C_SR1 &= ~SR1_SB;
+        dir = v & 1;
+        if (!sl_addr(v))
+        {
+            I2C_SR1 |= SR1_ADDR;
+            st = SIM_ADDRW;
+        } // if
+        else
+        {   // AF
+            I2C_SR2 |= 0x04;
+            st = SIM_HOLD;
+        } // else
+    } // if
+    else if (st == SIM_TX)
+    {
+        if (I2C_SR1 & SR1_BTF)
+        {
+            I2C_SR1 &= ~SR1_BTF;
+            sh_v     = v;
+            sh_full  = true;
+            sh_ticks = 2;
+        } // if
+        else if (!sh_full)
+        {
+            sh_v     = v;
+            sh_full  = true;
+            sh_ticks = 2;
+        } // else if
+        else if (!dr_full)
+        {
+            dr_v     = v;
+            dr_full  = true;
+            I2C_SR1 &= ~SR1_TXE;
+        } // else if
+        else sim_fail("DR written while full");
+    } // else if
+    else sim_fail("DR written in the wrong state");
+} // dr_write()
+
+static void rx_begin(void)
+{   // the next byte is shifted in
+    sh_full  = true;
+    sh_ticks = 2;
+    latched  = (I2C_CR2 & 0x04) ? 0 : 1; // ACKEN now, used with POS
+} // rx_begin()
+
+static void dr_read(void)
+{
+    if ((st != SIM_RX) && (st != SIM_HOLD) && (st != SIM_IDLE))
+    {
+        sim_fail("DR read in the wrong state");
+        return;
+    } // if
+    if (!(I2C_SR1 & SR1_RXNE))
+    {
+        sim_fail("DR read while empty");
+        return;
+    } // if
+    if (I2C_SR1 & SR1_BTF)
+    {   // shift register to DR
+        dr_v     = sh_v;
+        sh_full  = false;
+        I2C_SR1 &= ~SR1_BTF;
+        if (!last_ack && (st == SIM_RX)) rx_begin();
+    } // if
+    else I2C_SR1 &= ~SR1_RXNE;
+} // dr_read()
+
+static void dr_finish(void)
+{   // the access to I2C_DR is known after the statement
+    if (!dr_pending) return;
+    dr_pending = false;
+    if (dr_slot < 0x100) dr_write(dr_slot);
+    else                 dr_read();
+} // dr_finish()
+
+volatile uint16_t *sim_dr(void)
+{
+    dr_finish();
+    dr_pending = true;
+    dr_slot    = 0x100 | dr_v;
+    return &dr_slot;
+} // sim_dr()
+
+volatile uint8_t *sim_sr3(void)
+{   // reading SR3 after SR1 clears ADDR
+    dr_finish();
+    if (I2C_SR1 & SR1_ADDR)
+    {
+        I2C_SR1 &= ~SR1_ADDR;
+        if (dir == 0)
+        {
+            st = SIM_TX;
+            I2C_SR1 |= SR1_TXE;
+        } // if
+        else
+        {
+            st       = SIM_RX;
+            last_ack = 0;
+            rx_begin();
+        } // else
+    } // if
+    return &sr3;
+} // sim_sr3()
+
+static void do_stop(void)
+{
+    I2C_CR2 &= ~0x02;
+    I2C_SR1 &= SR1_RXNE;
+    sh_full  = dr_full = false;
+    st       = SIM_IDLE;
+    sl_stop();
+} // do_stop()
+
+static void do_start(void)
+{
+    I2C_CR2 &= ~0x01;
+    I2C_SR1  = SR1_SB;
+    sh_full  = dr_full = false;
+    st       = SIM_SB;
+    sl_start();
+    TRACE("S ");
+} // do_start()
+
+/*------------------------------------------------------------------
+  Purpose  : This function moves the bus on by one step.
+  ------------------------------------------------------------------*/
+static void sim_tick(void)
+{
+    uint8_t b;
+    int     nack;
+
+    dr_finish();
+    if (I2C_CR2 & 0x80)
+    {   // SWRST
+        st      = SIM_IDLE;
+        I2C_SR1 = I2C_SR2 = 0;
+        return;
+    } // if
+    if (!(I2C_CR1 & 1) || sim_stuck) return;
+    switch (st)
+    {
+        case SIM_IDLE:
+        case SIM_HOLD:
+            if      (I2C_CR2 & 0x02) do_stop();
+            else if (I2C_CR2 & 0x01) do_start();
+            break;
+        case SIM_TX:
+            if (sh_full)
+            {
+                if (--sh_ticks == 0)
+                {
+                    sh_full = false;
+                    sl_write(sh_v);
+                    if (dr_full)
+                    {
+                        sh_v     = dr_v;
+                        sh_full  = true;
+                        sh_ticks = 2;
+                        dr_full  = false;
+                        I2C_SR1 |= SR1_TXE;
+                    } // if
+                    else I2C_SR1 |= SR1_BTF;
+                } // if
+            } // if
+            else if ((I2C_SR1 & SR1_BTF) || !dr_full)
+            {
+                if      (I2C_CR2 & 0x02) do_stop();
+                else if (I2C_CR2 & 0x01) do_start();
+            } // else if
+            break;
+        case SIM_RX:
+            if (sh_full && sh_ticks && (--sh_ticks == 0))
+            {
+                b    = sl_read();
+                nack = (I2C_CR2 & 0x08) ? latched : ((I2C_CR2 & 0x04) ? 0 : 1);
+                sl_ack(nack);
+                last_ack = nack;
+                sh_v     = b;
+                if (!(I2C_SR1 & SR1_RXNE))
+                {
+                    dr_v     = b;
+                    sh_full  = false;
+                    I2C_SR1 |= SR1_RXNE;
+                    if (!nack) rx_begin();
+                } // if
+                else I2C_SR1 |= SR1_BTF; // SCL stretched
+                if (nack) st = SIM_HOLD;
+            } // if
+            break;
+    } // switch
+} // sim_tick()
+
+/*------------------------------------------------------------------
+  Purpose  : This function returns true when the I2C ISR is pending.
+  ------------------------------------------------------------------*/
+static bool sim_irq(void)
+{
+    uint8_t itr = I2C_ITR, sr1 = I2C_SR1;
+
+    if ((itr & 0x01) && (I2C_SR2 & 0x0F)) return true; // ITERREN
+    if (!(itr & 0x02)) return false;                    // ITEVTEN
+    if (sr1 & (SR1_SB | SR1_ADDR | SR1_BTF)) return true;
+    return (itr & 0x04) && (sr1 & (SR1_TXE | SR1_RXNE)); // ITBUFEN
+} // sim_irq()
+
+/*------------------------------------------------------------------
+  Purpose  : This function runs the ISR when it is pending and moves
+             the bus on by one step.
+  ------------------------------------------------------------------*/
+static void sim_step(void)
+{
+    int k = rand() % 3;
+
+    if (host_irq_en && sim_irq() && ((rand() % sim_lat) == 0))
+    {
+        do
+        {   // the ISR may run more than once before the bus moves on
+            TRACE("[i%02x,%02x,%d]", I2C_SR1, I2C_CR2, st);
+            I2C_IRQHandler();
+            dr_finish();
+        } while (k-- && sim_irq());
+    } // if
+    sim_tick();
+} // sim_step()
+#endif
@@ -0,0 +1,118 @@
+#ifndef _PANEL_H
+#define _PANEL_H
+/*==================================================================
+  File Name: panel.h
+  Author   : Emile
+  ------------------------------------------------------------------
+  Purpose  : Model of PORTC and the HC595 shift-registers for the 
+             display tests. Include it before stm8_hw_init.c and
+             pixel.c: every PORTC access of the TIM2 ISR then goes 
+             through pc_reg(). The buffers and the functions that the
+             ISR and pixel.c need from other files are defined here.
+  ------------------------------------------------------------------
+  This file is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+ 
+  This software is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+ 
+  You should have received a copy of the GNU General Public License
+  along with this software.  If not, see <http://www.gnu.org/licenses/>.
+  ================================================================== */ 
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+// Every PORTC access goes through pc_reg(), n = bit number, 8 = PC_ODR
+static volatile unsigned char *pc_reg(uint8_t n);
+#define PC_ODR      (*pc_reg(8))
+#define PC_ODR_ODR1 (*pc_reg(1))
+#define PC_ODR_ODR2 (*pc_reg(2))
+#define PC_ODR_ODR3 (*pc_reg(3))
+#define PC_ODR_ODR4 (*pc_reg(4))
+#define PC_ODR_ODR5 (*pc_reg(5))
+
+#include "stm8_hw_init.h"
+#include "tetris.h"
+
+uint16_t rgb_bufr[MAX_Y], rgb_bufg[MAX_Y], rgb_bufb[MAX_Y];
+uint16_t fieldr[TETRIS_SIZE_Y], fieldg[TETRIS_SIZE_Y], fieldb[TETRIS_SIZE_Y];
+#if ROW_STREAM
+uint8_t  row_stream[2][MAX_Y][SIZE_X];
+uint8_t  rows_dirty[MAX_Y];
+#else
+uint16_t frame_bufr[2][BCM_PLANES][MAX_Y];
+uint16_t frame_bufg[2][BCM_PLANES][MAX_Y];
+uint16_t frame_bufb[2][BCM_PLANES][MAX_Y];
+#endif
+#if BCM_PLANES > 1
+uint16_t bcm_bufr[BCM_PLANES][MAX_Y];
+uint16_t bcm_bufg[BCM_PLANES][MAX_Y];
+uint16_t bcm_bufb[BCM_PLANES][MAX_Y];
+#endif
+uint32_t t2_millis;
+volatile bool     idle_sleep;
+volatile uint32_t idle_wake;
+
+void scheduler_isr(void)       { }
+void scheduler_frame_isr(void) { }
+void post_event(uint8_t ev)    { (void)ev; }
+void prof_add(uint8_t id, uint32_t cycles) { (void)id; (void)cycles; }
+
+static uint8_t  pc_odr;         // PORTC output pins
+static uint8_t  pc_ext;         // PC0, PC6 and PC7 as set by their owner
+static uint8_t  pc_slot;        // byte handed out by the last pc_reg()
+static int8_t   pc_last = -1;   // register of the last pc_reg(), -1 = none
+static uint32_t pc_acc;         // number of PORTC accesses
+static uint32_t pc_err;         // number of changes to PC0, PC6 or PC7
+static uint16_t sr[3], latch[3];// HC595 shift and output registers R,G,B
+
+/*------------------------------------------------------------------
+  Purpose  : Applies the last PORTC access to the pins and clocks the
+             shift-registers on a rising SHCP or STCP edge.
+  Variables: -
+  Returns  : -
+  ------------------------------------------------------------------*/
+static void pc_commit(void)
+{
+    uint8_t old = pc_odr;
+    
+    if (pc_last == 8) pc_odr = pc_slot;
+    else if (pc_last >= 0)
+    {
+        pc_odr &= ~(1 << pc_last);
+        pc_odr |= (pc_slot & 0x01) << pc_last;
+    } // else if
+    pc_last = -1;
+    if ((pc_odr ^ pc_ext) & ~PC_MATRIX) pc_err++;
+    if ((pc_odr & SHCP) && !(old & SHCP))
+    {   // a LED is on when its bit is 0
+        sr[0] = (sr[0] << 1) | ((pc_odr & SDIN_R) ? 0 : 1);
+        sr[1] = (sr[1] << 1) | ((pc_odr & SDIN_G) ? 0 : 1);
+        sr[2] = (sr[2] << 1) | ((pc_odr & SDIN_B) ? 0 : 1);
+    } // if
+    if ((pc_odr & STCP) && !(old & STCP)) memcpy(latch, sr, sizeof(sr));
+} // pc_commit()
+
+static volatile unsigned char *pc_reg(uint8_t n)
+{
+    pc_commit();
+    pc_acc++;
+    pc_last = n;
+    pc_slot = (n == 8) ? pc_odr : ((pc_odr >> n) & 0x01);
+    return &pc_slot;
+} // pc_reg()
+
+// The first column sent ends up in the last output of the chain
+static uint16_t mirror(uint16_t x)
+{
+    uint16_t y = 0;
+    for (uint8_t i = 0; i < SIZE_X; i++, x >>= 1) y = (y << 1) | (x & 0x01);
+    return y;
+} // mirror()
+#endif
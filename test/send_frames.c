@@ -0,0 +1,167 @@
+/*==================================================================
+  File Name: send_frames.c
+  Author   : Emile
+  ------------------------------------------------------------------
+  Purpose  : Host-side sender for the binary frames on UART1. Sends
+             full frames (BIN_FRAME) back to back to the serial port 
+             and prints the frames per second that the line takes.
+             Set the baud-rate of the panel first with the B0 command.
+             
+             Usage: send_frames [-d] <port> <baud> [file]
+             
+             -d  : send only the changes, as the smallest of BIN_FRAME,
+                   BIN_ROWS and BIN_XRLE. A lost frame is not repaired,
+                   so use it on a reliable line only.
+             file: raw images of BIN_FRAME_LEN bytes each (red, green
+                   and blue plane, 2 bytes per row, MSB first), sent in
+                   a loop. Without a file, a moving test pattern is sent.
+  ------------------------------------------------------------------
+  This file is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+ 
+  This software is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+ 
+  You should have received a copy of the GNU General Public License
+  along with this software.  If not, see <http://www.gnu.org/licenses/>.
+  ================================================================== */ 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <time.h>
+#include "bin_frame.h"
+
+/*------------------------------------------------------------------
+  Purpose  : This function opens a serial port at baud,N,8,1.
+  Variables: port: the serial port, e.g. /dev/ttyUSB0
+             baud: BAUD_MIN..BAUD_MAX
+  Returns  : the file descriptor, -1 if an error occurred
+  ------------------------------------------------------------------*/
+static int open_port(const char *port, uint32_t baud)
+{
+    const struct { uint32_t baud; speed_t speed; } bauds[] = {
+        {9600, B9600}, {19200, B19200}, {38400, B38400}, {57600, B57600},
+        {115200, B115200}, {230400, B230400}, {460800, B460800}, {921600, B921600}};
+    struct termios tio;
+    int fd;
+    uint8_t i;
+    
+    for (i = 0; (i < sizeof(bauds) / sizeof(bauds[0])) && (bauds[i].baud != baud); i++) ;
+    if (i == sizeof(bauds) / sizeof(bauds[0])) return -1;
+    if ((fd = open(port, O_RDWR | O_NOCTTY)) < 0) return -1;
+    if (tcgetattr(fd, &tio) < 0) 
+    {
+        close(fd);
+        return -1;
+    } // if
+    cfmakeraw(&tio);
+    tio.c_cflag &= ~(CSTOPB | CRTSCTS);
+    tio.c_cflag |= CLOCAL | CREAD;
+    cfsetispeed(&tio, bauds[i].speed);
+    cfsetospeed(&tio, bauds[i].speed);
+    if (tcsetattr(fd, TCSANOW, &tio) < 0)
+    {
+        close(fd);
+        return -1;
+    } // if
+    return fd;
+} // open_port()
+
+/*------------------------------------------------------------------
+  Purpose  : This function makes the next image of the test pattern:
+             a diagonal in red, a moving column in green and a 
+             moving row in blue.
+  Variables: img: the image, BIN_FRAME_LEN bytes
+             n  : the frame number
+  Returns  : -
+  ------------------------------------------------------------------*/
+static void test_pattern(uint8_t *img, uint32_t n)
+{
+    uint16_t row;
+    
+    for (uint8_t y = 0; y < MAX_Y; y++)
+    {
+        row = (uint16_t)0x8000 >> ((y + n) & 0x0F);  // red
+        img[2*y]   = row >> 8;
+        img[2*y+1] = row & 0xFF;
+        row = (uint16_t)0x8000 >> (n & 0x0F);        // green
+        img[2*(MAX_Y+y)]   = row >> 8;
+        img[2*(MAX_Y+y)+1] = row & 0xFF;
+        row = (y == (n % MAX_Y)) ? 0xFFFF : 0x0000;  // blue
+        img[2*(2*MAX_Y+y)]   = row >> 8;
+        img[2*(2*MAX_Y+y)+1] = row & 0xFF;
+    } // for y
+} // test_pattern()
+
+int main(int argc, char *argv[])
+{
+    uint8_t  img[BIN_FRAME_LEN], prev[BIN_FRAME_LEN] = {0}; // image, image on the panel
+    uint8_t  p[2 * BIN_FRAME_LEN], tx[BIN_ROWS_LEN + 6], type = BIN_FRAME, len = BIN_FRAME_LEN;
+    uint16_t n;
+    uint32_t frames = 0, cnt = 0, bytes = 0;
+    FILE    *f = NULL;
+    bool     delta = (argc > 1) && !strcmp(argv[1], "-d");
+    int      fd;
+    time_t   t0;
+    
+    if (delta)
+    {   // skip the option
+        argc--;
+        argv++;
+    } // if
+    if ((argc < 3) || (argc > 4))
+    {
+        fprintf(stderr, "Usage: send_frames [-d] <port> <baud> [file]\n");
+        return 1;
+    } // if
+    if ((fd = open_port(argv[1], strtoul(argv[2], NULL, 10))) < 0)
+    {
+        fprintf(stderr, "Can not open %s at %s Baud\n", argv[1], argv[2]);
+        return 1;
+    } // if
+    if ((argc == 4) && !(f = fopen(argv[3], "rb")))
+    {
+        fprintf(stderr, "Can not open %s\n", argv[3]);
+        return 1;
+    } // if
+    t0 = time(NULL);
+    for (;;)
+    {
+        if (!f) test_pattern(img, frames);
+        else if (fread(img, 1, BIN_FRAME_LEN, f) != BIN_FRAME_LEN)
+        {   // end of file, start again
+            rewind(f);
+            if (fread(img, 1, BIN_FRAME_LEN, f) != BIN_FRAME_LEN)
+            {
+                fprintf(stderr, "%s has no complete image\n", argv[3]);
+                return 1;
+            } // if
+        } // else if
+        if (!delta || !frames) memcpy(p, img, BIN_FRAME_LEN); // first frame is always full
+        else len = bin_enc_best(p, &type, img, prev);
+        memcpy(prev, img, BIN_FRAME_LEN);
+        n = bin_frame(tx, type, p, len);
+        if (write(fd, tx, n) != n)
+        {
+            fprintf(stderr, "Write error on %s\n", argv[1]);
+            return 1;
+        } // if
+        tcdrain(fd); // frames per second as the line sends them
+        frames++;
+        cnt++;
+        bytes += n;
+        if (time(NULL) != t0)
+        {   // once a second
+            printf("%u frames/sec., %u bytes/frame\n", (unsigned)cnt, (unsigned)(bytes / cnt));
+            cnt = bytes = 0;
+            t0  = time(NULL);
+        } // if
+    } // for
+} // main()
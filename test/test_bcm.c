@@ -0,0 +1,95 @@
+/*==================================================================
+  File Name: test_bcm.c
+  Author   : Emile
+  ------------------------------------------------------------------
+  Purpose  : Host model of Binary Code Modulation (BCM_PLANES > 1). 
+             The TIM2 ISR is run with the PORTC model of panel.h and 
+             the time of every interrupt is taken from the TIM2 reload
+             value. For every LED, the time that its latched bit is on
+             divided by the row period must be level / (2^BCM_PLANES-1),
+             with level the upper BCM_PLANES bits of its 12-bit colour.
+  ------------------------------------------------------------------
+  This file is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+ 
+  This software is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+ 
+  You should have received a copy of the GNU General Public License
+  along with this software.  If not, see <http://www.gnu.org/licenses/>.
+  ================================================================== */ 
+#include "panel.h"
+#include "../stm8_hw_init.c"
+#include "../pixel.c"
+
+#define LEVELS ((1 << BCM_PLANES) - 1)
+
+static uint32_t on[MAX_Y][SIZE_X][3]; // on-time of every LED in TIM2 counts
+static uint32_t period[MAX_Y];        // time of every row in TIM2 counts
+
+int main(void)
+{
+    uint16_t col[MAX_Y][SIZE_X];
+    uint32_t fails = 0, unit;
+    uint8_t  lvl;
+    
+    setup_timers(HSE, FREQ_4KHZ);
+    unit = bcm_arr[0] + 1;
+    srand(3);
+    for (uint8_t y = 0; y < MAX_Y; y++)
+    {
+        for (uint8_t x = 0; x < SIZE_X; x++)
+        {   // random 12-bit colours and some full-intensity 3-bit colours
+            col[y][x] = rand() & 0x0FFF;
+            if (rand() % 8)
+            {   // getPixel12() returns the colour without the unused lower bits
+                setPixel12(SCREEN, x, y, col[y][x]);
+                if (getPixel12(SCREEN, x, y) != (col[y][x] & 
+                    (RGB12(BCM_MASK,BCM_MASK,BCM_MASK) << (4 - BCM_PLANES)))) fails++;
+            } // if
+            else
+            {   // a 3-bit colour is on in every plane
+                setPixel(SCREEN, x, y, rand() & WHITE);
+                col[y][x] = getPixel12(SCREEN, x, y);
+            } // else
+        } // for x
+    } // for y
+    init_frame_buffers();
+    for (uint16_t i = 0; i < MAX_Y * BCM_PLANES; i++)
+    {   // one complete frame: every plane of every row
+        uint8_t  y  = current_row;
+        uint32_t dt;
+        
+        TIM2_UPD_OVF_IRQHandler();
+        pc_commit();
+        dt = ((uint16_t)TIM2_ARRH << 8 | TIM2_ARRL) + 1; // time until the next interrupt
+        period[y] += dt;
+        for (uint8_t x = 0; x < SIZE_X; x++)
+        {
+            for (uint8_t c = 0; c < 3; c++)
+            {
+                if (latch[c] & mirror(1 << x)) on[y][x][c] += dt;
+            } // for c
+        } // for x
+    } // for i
+    for (uint8_t y = 0; y < MAX_Y; y++)
+    {
+        if (period[y] != LEVELS * unit) fails++;
+        for (uint8_t x = 0; x < SIZE_X; x++)
+        {
+            for (uint8_t c = 0; c < 3; c++)
+            {   // c = 0: red (bits 11-8), 1: green, 2: blue
+                lvl = (col[y][x] >> (12 - 4 * c - BCM_PLANES)) & BCM_MASK;
+                if (on[y][x][c] != lvl * unit) fails++;
+            } // for c
+        } // for x
+    } // for y
+    printf("BCM_PLANES=%d: %d levels, unit %u counts, row %u counts (%.1f kHz), %u errors\n",
+           BCM_PLANES, LEVELS + 1, (unsigned)unit, (unsigned)period[0], 
+           24000.0 / period[0], (unsigned)fails);
+    return fails ? 1 : 0;
+} // main()
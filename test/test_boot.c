@@ -0,0 +1,187 @@
+/*==================================================================
+  File Name: test_boot.c
+  Author   : Emile
+  ------------------------------------------------------------------
+  Purpose  : Test of the boot of the firmware: fw_main() (main() of
+             rgb_platform_stm8s207.c) runs with the models of the I2C
+             peripheral (i2c_sim.h), of I2C bus 0 (i2c_bus.h), both with
+             a DS3231, and of the EEPROM (eep_model.h). It is built with
+             I2C_HW = 1 (boot1) and I2C_HW = 0 (boot0).
+             The board runs in millis() and in WFI: the I2C ISR runs when
+             interrupts are enabled, a TIM2 tick every 4 millis() calls
+             and at every WFI. After BOOT_TICKS the test leaves fw_main().
+             Checks:
+             - main() reaches the main loop, it does not wait for an I2C
+               transfer with interrupts disabled (that is a hang)
+             - clock_task() reads the date and time from the DS3231 in
+               the first dispatch passes, and lk2[] shows it
+             - KV_DST is not set, so clock_task() advances the DS3231
+               by one hour and then sets KV_DST
+             - I2C_HW = 0: the longest clock_task() pass, in bus time,
+               against the blocking ds3231_settime() and ds3231_gettemp()
+               that clock_task() called before
+  ------------------------------------------------------------------
+  This file is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This software is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this software.  If not, see <http://www.gnu.org/licenses/>.
+  ================================================================== */
+#include <setjmp.h>
+#include <signal.h>
+#include "eep_model.h"
+#include "i2c_sim.h"
+
+// PE_IDR of fw_main(), i2c_bus.h replaces PE_IDR for i2c_bb.c
+static void set_pe_idr(uint8_t v)
+{
+    PE_IDR = v;
+} // set_pe_idr()
+
+#include "i2c_bus.h"
+#include "../eep.c"
+#include "../i2c_bb.c"
+#include "../i2c_hw.c"
+#include "board.h"
+#include "../profiler.h"
+#include "../kv.h"
+#include "../i2c_ds3231_bb.h"
+
+#define BOOT_TICKS (4000)   /* 1 sec. after the first tick */
+#define MAX_POLLS  (100000) /* millis() calls without a tick: a hang */
+
+static uint32_t fails = 0;
+#define CHECK(c) if (!(c)) { fails++; printf("line %d: %s\n", __LINE__, #c); }
+
+int fw_main(void);
+extern char lk2[];
+extern prof_struct prof[];
+
+static jmp_buf  boot_jb;       // leaves fw_main()
+static uint32_t polls = 0;     // millis() calls since the last tick
+static uint32_t calls = 0;     // millis() calls
+static uint32_t t_irq = 0;     // tick at which interrupts were first enabled
+static uint32_t t_lk2 = 0;     // tick at which lk2[] was filled in
+static uint32_t naddr_off = 0; // DS3231 addressed while interrupts were disabled
+static uint32_t naddr = 0;     // DS3231 addressed
+
+/*------------------------------------------------------------------
+  Purpose  : This function runs the board for one TIM2 tick.
+  ------------------------------------------------------------------*/
+static void tick(void)
+{
+    polls   = 0;
+    em_now += 1000000 / TICKS_PER_SEC;
+    board_tick();
+    if (!t_lk2 && lk2[0]) t_lk2 = t2_millis;
+    if (t2_millis >= BOOT_TICKS) longjmp(boot_jb, 1);
+} // tick()
+
+/*------------------------------------------------------------------
+  Purpose  : This function runs the I2C models and counts the times
+             the DS3231 was addressed, with interrupts disabled.
+  ------------------------------------------------------------------*/
+static void run_i2c(void)
+{
+    int i;
+
+    for (i = 0; i < 20; i++) sim_step();
+    if (sim_naddr + bus_naddr != naddr)
+    {
+        if (!host_irq_en) naddr_off += sim_naddr + bus_naddr - naddr;
+        naddr = sim_naddr + bus_naddr;
+    } // if
+    sim_clear();
+} // run_i2c()
+
+// millis(): the firmware runs, a tick every 4 calls with interrupts enabled
+static void boot_millis(void)
+{
+    run_i2c();
+    if (host_irq_en && !t_irq) t_irq = t2_millis + 1;
+    if (++polls > MAX_POLLS) longjmp(boot_jb, 2);
+    if (host_irq_en && !(++calls & 3)) tick();
+} // boot_millis()
+
+// WFI: the CPU sleeps until the next tick
+static void boot_wfi(void)
+{
+    run_i2c();
+    if (!t_irq) t_irq = t2_millis + 1;
+    tick();
+} // boot_wfi()
+
+static void hang(int sig)
+{
+    printf("fw_main() hangs, %u ticks, interrupts %s\n", t2_millis, host_irq_en ? "on" : "off");
+    exit(1);
+} // hang()
+
+int main(void)
+{
+    const uint8_t now[7] = {0x45, 0x59, 0x23, 5, 0x17, 0x10, 0x26}; // Fri 17-10-2026 23:59:45
+    uint8_t *rtc = I2C_HW ? sim_reg : bus_reg;
+    int r;
+#if !I2C_HW
+    double  t0, t_set, t_temp, t_task, t_i2c;
+#endif
+
+    memcpy(sim_reg, now, sizeof(now));
+    memcpy(bus_reg, now, sizeof(now));
+    sim_reg[0x11] = bus_reg[0x11] = 21; // 21.25 C
+    sim_reg[0x12] = bus_reg[0x12] = 0x40;
+    set_pe_idr(0xF0 | 0x06);       // dip-switches off (lichtkrant), SCL and SDA high
+    CLK_ECKR_HSERDY = 1;           // HSE ready
+    CLK_SWCR_SWIF   = 1;           // clock switch done
+    board_hook    = boot_millis;
+    host_wfi_hook = boot_wfi;
+    signal(SIGALRM, hang);
+    alarm(5); // a hang without millis() calls
+    host_irq_en = 1; // reset, main() disables them
+    if (!(r = setjmp(boot_jb))) fw_main();
+    alarm(0);
+    board_hook    = NULL;
+    host_wfi_hook = NULL;
+    printf("I2C_HW = %d: %s after %u ticks, interrupts enabled at tick %d\n", I2C_HW,
+           (r == 1) ? "main loop" : "hang", t2_millis, (int)t_irq - 1); // -1 = never
+    CHECK(r == 1);
+    printf("lk2 at tick %u: \"%s\"\n", t_lk2, lk2);
+    printf("DS3231 addressed %u times, %u times with interrupts disabled\n", naddr, naddr_off);
+    CHECK(strstr(lk2, "17") && strstr(lk2, "2026 23:59:45") && strstr(lk2, " 21.25"));
+    CHECK(t_lk2 && (t_lk2 < t_irq + 100)); // within 25 msec.
+    CHECK((naddr >= 2) && !naddr_off);
+#if I2C_HW
+    CHECK(!i2c_n[I2C_NACK] && !i2c_n[I2C_ERROR] && !i2c_n[3] && !bus_naddr);
+#else
+    CHECK(!sim_naddr && !bus_fails);
+#endif
+    CHECK(!sim_fails && !em_err && strstr(u1_out, "CLK: 0x"));
+    printf("DS3231 %02x:%02x:%02x, KV_DST %u\n", rtc[2], rtc[1], rtc[0], kv_read8(KV_DST));
+    CHECK((rtc[2] == 0x00) && (rtc[1] == 0x59) && (kv_read8(KV_DST) == 1)); // summer-time
+
+#if !I2C_HW
+    // The longest clock_task() pass, the profiler counts the bus time
+    t_task = prof[PROF_TASK0 + find_task("rtc")].max / 24.0;
+    t_i2c  = prof[PROF_TASK0 + find_task("i2c")].max / 24.0;
+    t0     = bus_us;
+    ds3231_settime(0, 59, 45);
+    t_set  = bus_us - t0;
+    t0     = bus_us;
+    ds3231_gettemp();
+    t_temp = bus_us - t0;
+    printf("max. per pass: clock_task() %.0f usec., i2c_bb_task() %.0f usec.\n", t_task, t_i2c);
+    printf("before, in one clock_task() pass: ds3231_settime() %.0f usec., "
+           "ds3231_gettemp() %.0f usec.\n", t_set, t_temp);
+    CHECK((t_i2c > 0) && (t_i2c < t_temp / 10) && (t_i2c < t_set / 10));
+    CHECK(t_task < t_i2c);
+#endif
+    printf("%u errors\n", (unsigned)fails);
+    return fails ? 1 : 0;
+} // main()
@@ -0,0 +1,176 @@
+/*==================================================================
+  File Name: test_cmd.c
+  Author   : Emile
+  ------------------------------------------------------------------
+  Purpose  : Test of the command decoder: cmd_table[], text commands,
+             several commands in one line (CMD_SEP) and BIN_CMD 
+             opcodes. The firmware is linked as a whole with the board 
+             model (board.h), the replies are collected with 
+             uart1_redirect(). A text command and its binary form must
+             give the same reply and return value. Then the number of
+             commands per second through the decoder is measured.
+  ------------------------------------------------------------------
+  This file is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+ 
+  This software is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+ 
+  You should have received a copy of the GNU General Public License
+  along with this software.  If not, see <http://www.gnu.org/licenses/>.
+  ================================================================== */ 
+#include <time.h>
+#include "board.h"
+#include "../command_interpreter.h"
+
+#define NBENCH (200000UL) /* commands per benchmark */
+#define NTABLE (21)       /* entries in cmd_table[] */
+
+extern const cmd_entry cmd_table[];
+extern char  esp_rawbuf[];
+extern bool  esp_raw_busy;
+
+static uint32_t fails = 0;
+#define CHECK(c) if (!(c)) { fails++; printf("line %d: %s\n", __LINE__, #c); }
+
+static char     out[4096]; // replies of the last command
+static uint16_t outn = 0;
+static char     line[UART_BUFLEN];
+
+/*------------------------------------------------------------------
+  Purpose  : Reply sink, see uart1_redirect().
+  ------------------------------------------------------------------*/
+static uint8_t out_putc(uint8_t ch)
+{
+    if (outn < sizeof(out) - 1) out[outn++] = ch;
+    out[outn] = '\0';
+    return 1;
+} // out_putc()
+
+/*------------------------------------------------------------------
+  Purpose  : This function executes a text command line.
+  Variables: s     : the line
+             failed: the failed command is returned here (may be NULL)
+  Returns  : the return value of execute_command_line()
+  ------------------------------------------------------------------*/
+static uint8_t text(const char *s, char **failed)
+{
+    char *f = NULL;
+    
+    outn = out[0] = 0;
+    strcpy(line, s);
+    return execute_command_line(line, failed ? failed : &f);
+} // text()
+
+/*------------------------------------------------------------------
+  Purpose  : This function executes a BIN_CMD payload.
+  ------------------------------------------------------------------*/
+static uint8_t binary(const uint8_t *b, uint8_t len)
+{
+    outn = out[0] = 0;
+    return execute_binary_command(b, len, line);
+} // binary()
+
+int main(void)
+{
+    static const uint8_t b_baud[]  = {0x10, 0x00, 0x00, 0x03, 0xE8};  // B0 1000
+    static const uint8_t b_show[]  = {0x12};                          // B2
+    static const uint8_t b_bad[]   = {0x12, 0x00};                    // B2 with an argument
+    static const uint8_t b_short[] = {0x10, 0x00, 0x03, 0xE8};        // B0 with 3 bytes
+    static const uint8_t b_long[]  = {0x10, 0x00, 0x00, 0x03, 0xE8, 0x00}; // B0 with 5 bytes
+    static const uint8_t b_date[]  = {0x20, 0x00, 0x11, 0x00};        // D0 with 3 bytes
+    static const uint8_t b_none[]  = {0x99};                          // unknown opcode
+    static const uint8_t b_esp[]   = {0x30, 'A', 'T', ';', 'X'};      // E0 AT;X
+    char     ref[sizeof(out)], *failed;
+    uint8_t  i, j, r;
+    uint32_t n;
+    struct timespec t0, t1;
+    double   sec[3];
+    
+    UART1_SR_TC = UART3_SR_TC = 1; // transmitters idle
+    uart1_init(HSE);
+    uart3_init(HSE);
+    uart1_redirect(out_putc);
+    
+    // cmd_table[]: letters, numbers and opcodes are unique
+    for (i = 0; i < NTABLE; i++)
+    {
+        for (j = 0; j < i; j++)
+        {
+            CHECK(cmd_table[i].opcode != cmd_table[j].opcode);
+            CHECK((cmd_table[i].letter != cmd_table[j].letter) || 
+                  (cmd_table[i].num    != cmd_table[j].num));
+        } // for j
+    } // for i
+    
+    // A text command and its binary form
+    CHECK(text("B0 1000", NULL) == ERR_NUM);
+    CHECK(strstr(out, "UART1: 1000 Baud, not possible") != NULL);
+    strcpy(ref, out);
+    CHECK(binary(b_baud, sizeof(b_baud)) == ERR_NUM);
+    CHECK(!strcmp(out, ref));
+    CHECK(text("b2", NULL) == CMD_ACK + 2); // lower-case is allowed
+    CHECK(strstr(out, "UART1: 38400 Baud, err") && strstr(out, "UART3: "));
+    strcpy(ref, out);
+    CHECK(binary(b_show, sizeof(b_show)) == CMD_ACK + 2);
+    CHECK(!strcmp(out, ref));
+    
+    // Errors: unknown letter, number, missing or wrong argument
+    CHECK((text("X1", NULL) == ERR_CMD) && !strcmp(out, "ERR.CMD[X1]\r\n"));
+    CHECK((text("B7", NULL) == ERR_NUM) && !outn);
+    CHECK((text("B0", NULL) == ERR_NUM) && !outn);
+    CHECK((text("B0 x", NULL) == ERR_NUM) && !outn);
+    CHECK((text("D0 17-10", NULL) == ERR_NUM) && !outn);
+    CHECK((text("D1 12:30-", NULL) == ERR_NUM) && !outn);
+    CHECK((binary(b_bad, sizeof(b_bad)) == ERR_NUM) && !outn);
+    CHECK((binary(b_short, sizeof(b_short)) == ERR_NUM) && !outn);
+    CHECK((binary(b_long, sizeof(b_long)) == ERR_NUM) && !outn);
+    CHECK((binary(b_date, sizeof(b_date)) == ERR_NUM) && !outn);
+    CHECK(binary(b_none, sizeof(b_none)) == ERR_CMD);
+    
+    // Several commands in one line: in order, until the first error
+    CHECK(text("B2;B0 1000", &failed) == ERR_NUM);
+    CHECK(strstr(out, "UART1: 38400 Baud, err") && strstr(out, "UART1: 1000 Baud"));
+    CHECK(!strcmp(failed, "B0 1000"));
+    CHECK(text("B0 1000; B0 2000;B2", &failed) == ERR_NUM);
+    CHECK(strstr(out, "UART1: 1000 Baud") && !strstr(out, "2000") && !strstr(out, "38400"));
+    CHECK(!strcmp(failed, "B0 1000"));
+    CHECK(text("B2;X1;B0 1000", &failed) == ERR_CMD);
+    CHECK(!strcmp(failed, "X1") && !strstr(out, "1000"));
+    CHECK(text(";;B2;", NULL) == CMD_ACK + 2);
+    CHECK(text("", NULL) == NO_ERR);
+    
+    // An ARG_TEXT argument takes the rest of the line, also CMD_SEP
+    esp_raw_busy = false;
+    CHECK(text("B2;E0 AT+CWJAP_DEF=\"a;b\",\"c\"", NULL) == CMD_ACK + 0);
+    CHECK(!strcmp(esp_rawbuf, "AT+CWJAP_DEF=\"a;b\",\"c\""));
+    esp_raw_busy = false;
+    CHECK(binary(b_esp, sizeof(b_esp)) == CMD_ACK + 0);
+    CHECK(!strcmp(esp_rawbuf, "AT;X"));
+    CHECK(binary(b_esp, sizeof(b_esp)) == ERR_NUM); // previous E0 not finished
+    esp_raw_busy = false;
+    
+    // Throughput: B0 1000 as one text line, 8 per line and binary
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (n = 0; n < NBENCH; n++) r = text("B0 1000", NULL);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    sec[0] = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (n = 0; n < NBENCH / 8; n++) r = text("B2;B2;B2;B2;B2;B2;B2;B2", NULL);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    sec[1] = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (n = 0; n < NBENCH; n++) r = binary(b_baud, sizeof(b_baud));
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    sec[2] = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+    CHECK(r == ERR_NUM);
+    printf("text B0 1000     : %.0f commands/sec.\n", NBENCH / sec[0]);
+    printf("text B2, 8 a line: %.0f commands/sec.\n", NBENCH / sec[1]);
+    printf("binary B0 1000   : %.0f commands/sec.\n", NBENCH / sec[2]);
+    printf("%u errors\n", (unsigned)fails);
+    return fails ? 1 : 0;
+} // main()
@@ -0,0 +1,175 @@
+/*==================================================================
+  File Name: test_delta.c
+  Author   : Emile
+  ------------------------------------------------------------------
+  Purpose  : Test and benchmark of the BIN_ROWS and BIN_XRLE frames.
+             The firmware is linked as a whole (main() renamed to
+             fw_main()) and the lichtkrant and Tetris tasks record a
+             frame sequence, with the TIM2 ISR running in between as
+             on the panel. Every frame is then sent as BIN_FRAME, 
+             BIN_ROWS, BIN_XRLE and the smallest of these (bin_frame.h)
+             and decoded with decode_frame(): the image must be equal 
+             and every changed row must be marked dirty. Prints the
+             bytes on the line per frame and frames per second.
+  ------------------------------------------------------------------
+  This file is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+ 
+  This software is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+ 
+  You should have received a copy of the GNU General Public License
+  along with this software.  If not, see <http://www.gnu.org/licenses/>.
+  ================================================================== */ 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../rgb_platform_stm8s207.h"
+#include "../pixel.h"
+#include "../tetris.h"
+#include "bin_frame.h"
+
+#define NFRAMES (1000) /* frames per sequence, 48 seconds at 6 frames per call */
+
+extern uint16_t rgb_bufr[], rgb_bufg[], rgb_bufb[];
+extern char     lk1[], lk2[];
+extern uint8_t  lk1c[], lk2c[];
+extern uint8_t  screen;   // Tetris screen: 0 = menu, 1 = game, 2 = pause, 3 = game-over
+__interrupt void TIM2_UPD_OVF_IRQHandler(void);
+
+static uint8_t  seq[NFRAMES][BIN_FRAME_LEN]; // recorded images
+static uint32_t fails = 0;
+
+/*------------------------------------------------------------------
+  Purpose  : This function runs a display task as the scheduler does,
+             every 6 frames, and records the image after every call.
+  Variables: task : the display task
+             tetris: true = press the joystick to play Tetris
+  Returns  : -
+  ------------------------------------------------------------------*/
+static void record(void (*task)(void), bool tetris)
+{
+    const uint8_t keys[] = {0, 0, STICK_LEFT, STICK_RIGHT, STICK_UP, STICK_DOWN};
+    uint8_t stick = 0;
+    
+    srand(16);
+    for (uint16_t f = 0; f < NFRAMES; f++)
+    {
+        if (!tetris) stick = 0;
+        else if ((f == 10) || (screen == 3)) stick = STICK_RIGHT | STICK_DOWN; // (re)start the game
+        else if (stick) stick = 0; // release
+        else if (screen == 1) stick = keys[rand() % sizeof(keys)];
+        PF_IDR = stick;
+        for (uint16_t t = 0; t < 6 * MAX_Y; t++) TIM2_UPD_OVF_IRQHandler();
+        task();
+        bin_image(seq[f], rgb_bufr, rgb_bufg, rgb_bufb);
+    } // for f
+} // record()
+
+/*------------------------------------------------------------------
+  Purpose  : This function decodes one payload and checks the result.
+  Variables: type: the frame type
+             p   : the payload
+             len : the payload length
+             img : the image that must result
+             prev: the previous image, now in rgb_bufr/g/b
+  Returns  : -
+  ------------------------------------------------------------------*/
+static void check_decode(uint8_t type, const uint8_t *p, uint8_t len, 
+                         const uint8_t *img, const uint8_t *prev)
+{
+    uint8_t out[BIN_FRAME_LEN];
+    
+    memset(rows_dirty, 0, MAX_Y);
+    if (!decode_frame(type, p, len)) fails++;
+    bin_image(out, rgb_bufr, rgb_bufg, rgb_bufb);
+    if (memcmp(out, img, BIN_FRAME_LEN)) fails++;
+    for (uint8_t y = 0; y < MAX_Y; y++)
+    {   // a changed row must be encoded again
+        for (uint8_t k = 0; k < 3; k++)
+        {
+            if (((img[k*2*MAX_Y + 2*y] != prev[k*2*MAX_Y + 2*y]) || 
+                 (img[k*2*MAX_Y + 2*y+1] != prev[k*2*MAX_Y + 2*y+1])) && !rows_dirty[y]) fails++;
+        } // for k
+    } // for y
+} // check_decode()
+
+/*------------------------------------------------------------------
+  Purpose  : This function sends a sequence in every format, checks 
+             the decoded images and prints the bytes per frame.
+  Variables: name: the name of the sequence
+  Returns  : -
+  ------------------------------------------------------------------*/
+static void bench(const char *name)
+{
+    static const uint8_t black[BIN_FRAME_LEN] = {0};
+    uint8_t  out[2 * BIN_FRAME_LEN], type, len;
+    uint16_t nx;
+    uint32_t bytes[4] = {0}, cnt[3] = {0}; // full, rows, xrle, best
+    const uint8_t *prev = black;
+    
+    for (uint8_t f = 0; f < 4; f++)
+    {   // every format over the whole sequence, from a black screen
+        memset(rgb_bufr, 0, 2 * MAX_Y);
+        memset(rgb_bufg, 0, 2 * MAX_Y);
+        memset(rgb_bufb, 0, 2 * MAX_Y);
+        prev = black;
+        for (uint16_t i = 0; i < NFRAMES; i++)
+        {
+            switch (f)
+            {
+                case 0 : type = BIN_FRAME;
+                         len  = BIN_FRAME_LEN;
+                         memcpy(out, seq[i], len);
+                         break;
+                case 1 : type = BIN_ROWS;
+                         len  = bin_enc_rows(out, seq[i], prev);
+                         break;
+                case 2 : nx = bin_enc_xrle(out, seq[i], prev);
+                         if ((nx > 0) && (nx <= BIN_FRAME_LEN))
+                         {
+                             type = BIN_XRLE;
+                             len  = nx;
+                         } // if
+                         else
+                         {   // no change or too large, send the rows
+                             type = BIN_ROWS;
+                             len  = bin_enc_rows(out, seq[i], prev);
+                         } // else
+                         break;
+                default: len = bin_enc_best(out, &type, seq[i], prev);
+                         cnt[type - BIN_FRAME]++;
+                         break;
+            } // switch
+            check_decode(type, out, len, seq[i], prev);
+            bytes[f] += len + 6; // + sync, type, len and crc
+            prev      = seq[i];
+        } // for i
+    } // for f
+    printf("%-10s: full %5.1f, rows %5.1f, xrle %5.1f, best %5.1f bytes/frame (%4.1f %% of full)\n",
+           name, bytes[0] / (double)NFRAMES, bytes[1] / (double)NFRAMES, bytes[2] / (double)NFRAMES,
+           bytes[3] / (double)NFRAMES, 100.0 * bytes[3] / bytes[0]);
+    printf("            best: %u full, %u rows, %u xrle; frames/sec. at 38400 Baud: full %.1f, best %.1f\n",
+           (unsigned)cnt[0], (unsigned)cnt[1], (unsigned)cnt[2], 3840.0 * NFRAMES / bytes[0], 
+           3840.0 * NFRAMES / bytes[3]);
+} // bench()
+
+int main(void)
+{
+    init_frame_buffers();
+    strcpy(lk1, "Binary frames with BIN_ROWS and BIN_XRLE    ");
+    strcpy(lk2, "De lichtkrant draait op het RGB platform    ");
+    color_text_input(lk1, lk1c);
+    color_text_input(lk2, lk2c);
+    record(lichtkrant, false);
+    bench("lichtkrant");
+    clearScreen(SCREEN);
+    record(tetrisMain, true);
+    bench("tetris");
+    printf("%u errors\n", (unsigned)fails);
+    return fails ? 1 : 0;
+} // main()
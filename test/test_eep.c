@@ -0,0 +1,189 @@
+/*==================================================================
+  File Name: test_eep.c
+  Author   : Emile
+  ------------------------------------------------------------------
+  Purpose  : Test of the EEPROM write queue of eep.c with the model of
+             eep_model.h: the choice between byte, word and block
+             programming, unchanged blocks that are skipped, reads of
+             queued bytes, and random writes against a reference copy.
+             Then the stall time of a T0 command (text and colours of
+             the top row) is compared with byte-by-byte writing.
+  ------------------------------------------------------------------
+  This file is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This software is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this software.  If not, see <http://www.gnu.org/licenses/>.
+  ================================================================== */
+#include <stdlib.h>
+#include "eep_model.h"
+#include "../eep.c"
+
+#define NRANDOM (20000UL) /* random writes */
+
+static uint32_t fails = 0;
+#define CHECK(c) if (!(c)) { fails++; printf("line %d: %s\n", __LINE__, #c); }
+
+static uint8_t ref[EM_SIZE]; // what the EEPROM must hold
+
+// eep_stats() prints to UART1, which is not linked
+uint8_t uart1_printf(const char *s) { return 0; }
+uint8_t uart1_putu(uint32_t v, uint8_t w, char pad) { return 0; }
+
+/*------------------------------------------------------------------
+  Purpose  : This function runs eep_task() once every msec. until the
+             write queue is empty.
+  Variables: -
+  Returns  : the program cycles that were needed
+  ------------------------------------------------------------------*/
+static uint32_t run(void)
+{
+    uint32_t n = em_ncycles();
+
+    while (eep_pending() || eep_busy)
+    {
+        em_now += 1000;
+        eep_task();
+    } // while
+    return em_ncycles() - n;
+} // run()
+
+/*------------------------------------------------------------------
+  Purpose  : This function writes bytes and programs them.
+  Variables: addr : address in the EEPROM
+             p    : the bytes
+             len  : the number of bytes
+             words: true = eep_write_words(), false = eep_write_block()
+             b, w, blk: the expected byte, word and block program cycles
+  Returns  : -
+  ------------------------------------------------------------------*/
+static void write(uint16_t addr, const uint8_t *p, uint16_t len, bool words,
+                  uint8_t b, uint8_t w, uint8_t blk)
+{
+    uint32_t c[3];
+
+    memcpy(c, em_cycles, sizeof(c));
+    if (words) eep_write_words(addr, p, len);
+    else       eep_write_block(addr, p, len);
+    memcpy(&ref[addr], p, len);
+    run();
+    CHECK((em_cycles[0] - c[0] == b) && (em_cycles[1] - c[1] == w) && (em_cycles[2] - c[2] == blk));
+    CHECK(!memcmp(em_mem, ref, EM_SIZE));
+} // write()
+
+int main(void)
+{
+    uint8_t  d[EEP_STRLEN], col[EEP_STRLEN];
+    uint16_t a, len, skip;
+    uint32_t i, j, t, stall, stall_max = 0, n, bytes;
+    char     *txt = "Lichtkrant: the new text of the top row, with colours";
+
+    srand(1);
+    // One block: 1 byte, 1 word and 2 words changed, nothing changed
+    memset(d, 0, sizeof(d));
+    d[5] = 1;
+    write(0x100, d, EEP_BLOCK, false, 1, 0, 0);
+    d[8] = d[9] = d[11] = 2;
+    write(0x100, d, EEP_BLOCK, false, 0, 1, 0);
+    d[12] = 3;
+    d[100] = 4;
+    write(0x100, d, EEP_BLOCK, false, 0, 0, 1);
+    skip = eep_skip;
+    write(0x100, d, EEP_BLOCK, false, 0, 0, 0);
+    CHECK(eep_skip == skip + 1);
+
+    // Two blocks, a span that is not aligned. Word mode: one per word
+    for (i = 0; i < 20; i++) d[i] = i + 10;
+    write(0x17A, d, 20, false, 0, 0, 2);
+    for (i = 0; i < 12; i++) d[i] = i + 30;
+    write(0x202, d, 12, true, 0, 4, 0); // 0x200..0x20F: 4 words
+    d[0] = 0;
+    write(0x202, d, 12, true, 1, 0, 0);
+
+    // Reads return queued bytes before they are programmed
+    n = em_ncycles();
+    eep_write32(0x300, 0x12345678UL);
+    eep_write8(0x301, 0xAA);
+    CHECK((eep_read32(0x300) == 0x12AA5678UL) && (em_ncycles() == n));
+    CHECK((em_mem[0x300] == 0) && eep_pending());
+    ref[0x300] = 0x12; ref[0x301] = 0xAA; ref[0x302] = 0x56; ref[0x303] = 0x78;
+    run();
+    CHECK(!memcmp(em_mem, ref, EM_SIZE) && (eep_read32(0x300) == 0x12AA5678UL));
+
+    // Random writes, eep_task() every msec., reads in between
+    for (i = 0; i < NRANDOM; i++)
+    {
+        len = 1 + rand() % ((rand() & 1) ? 8 : 200);
+        a   = rand() % (EM_SIZE - len);
+        for (j = 0; j < len; j++) d[j] = (rand() & 3) ? ref[a + j] : rand();
+        t = em_now;
+        if (rand() & 1) eep_write_block(a, d, len);
+        else            eep_write_words(a, d, len);
+        stall = em_now - t; // only when the queue is full
+        if (stall > stall_max) stall_max = stall;
+        memcpy(&ref[a], d, len);
+        for (j = rand() % 8; j; j--)
+        {
+            em_now += 1000;
+            eep_task();
+        } // for j
+        a = rand() % EM_SIZE;
+        CHECK(eep_read8(a) == ref[a]);
+        if (fails > 10) break;
+    } // for i
+    run();
+    CHECK(!memcmp(em_mem, ref, EM_SIZE));
+    CHECK(!em_err && (em_ncycles() == eep_prog[0] + eep_prog[1] + eep_prog[2]));
+    printf("%lu random writes: %u byte, %u word, %u block prog., %u blocks unchanged, "
+           "max. %.1f msec. in a write\n", NRANDOM, eep_prog[0], eep_prog[1], eep_prog[2],
+           eep_skip, stall_max / 1000.0);
+
+    // T0: text and colours, byte-by-byte all bytes wait for a program cycle
+    len = strlen(txt) + 1;
+    for (i = 0; i < len; i++) col[i] = i % 7;
+    memcpy(d, txt, len);
+    eep_write_string(EEP_TEXT1, (char *)d);
+    eep_write_block(EEP_COL1, col, len);
+    run();
+    d[12] = 'N';  // a changed word of the text
+    col[3] = 6;   // and of the colours
+    n = em_ncycles();
+    t = em_now;
+    eep_write_string(EEP_TEXT1, (char *)d);
+    eep_write_block(EEP_COL1, col, len);
+    stall = em_now - t;
+    bytes = em_bytes;
+    t = em_now;
+    run();
+    printf("T0, 2 x %u bytes: byte-by-byte %u cycles, %.0f msec. stall\n", len, 2 * len,
+           2 * len * EM_PROG / 1000.0);
+    printf("T0, 2 x %u bytes: %u cycles (%u bytes), %.1f msec. stall, programmed in %.0f msec.\n",
+           len, em_ncycles() - n, em_bytes - bytes, stall / 1000.0, (em_now - t) / 1000.0);
+    CHECK((em_ncycles() - n == 2) && (stall == 0));
+    for (i = 0; i < len - 1; i++) 
+    {   // a new text: all bytes change
+        d[i]++;
+        col[i]++;
+    } // for i
+    n = em_ncycles();
+    t = em_now;
+    eep_write_string(EEP_TEXT1, (char *)d);
+    eep_write_block(EEP_COL1, col, len);
+    stall = em_now - t;
+    bytes = em_bytes;
+    t = em_now;
+    run();
+    printf("T0, 2 x %u bytes, all new: %u cycles (%u bytes), %.1f msec. stall, programmed in %.0f msec.\n",
+           len, em_ncycles() - n, em_bytes - bytes, stall / 1000.0, (em_now - t) / 1000.0);
+    CHECK((em_ncycles() - n == 2) && (stall == 0));
+    CHECK(!em_err && !memcmp(&em_mem[EEP_TEXT1], d, len) && !memcmp(&em_mem[EEP_COL1], col, len));
+    printf("%u errors\n", (unsigned)fails);
+    return fails ? 1 : 0;
+} // main()
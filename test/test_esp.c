@@ -0,0 +1,267 @@
+/*==================================================================
+  File Name: test_esp.c
+  Author   : Emile
+  ------------------------------------------------------------------
+  Purpose  : Test of the ESP8266 driver against a scripted stand-in 
+             modem on a pseudo-terminal. The firmware is linked as a
+             whole, UART3 of the board model (board.h) is the slave 
+             side of the pty, the modem reads and writes the master 
+             side. esp_task() and command_task() run as the scheduler
+             runs them: on their events and esp_task() every 100 msec.
+             The script:
+             - the first AT+RST gets no "ready": timeout, retry later
+             - the second init. gets an ERROR on AT+CIPMUX: retry later
+             - E0 AT+CWJAP_DEF: the response lines are printed to UART1
+             - a client connects and sends S0 and E1 in one +IPD, and
+               a BIN_FRAME split over two +IPD messages
+             - the replies come back with AT+CIPSEND, then the client
+               closes the connection and a reply after that is dropped
+             - the module resets itself ("ready") and is initialised 
+               again, then a burst of lines while esp_task() is late
+  ------------------------------------------------------------------
+  This file is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+ 
+  This software is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+ 
+  You should have received a copy of the GNU General Public License
+  along with this software.  If not, see <http://www.gnu.org/licenses/>.
+  ================================================================== */ 
+#include <fcntl.h>
+#include <pty.h>
+#include <termios.h>
+#include "board.h"
+#include "../esp8266.h"
+#include "../rgb_platform_stm8s207.h"
+#include "bin_frame.h"
+
+#define SIM_TICKS (90UL * TICKS_PER_SEC) /* 90 seconds */
+#define MS(x)     ((uint32_t)(x) * TICKS_PER_SEC / 1000)
+
+extern uint8_t  esp_state, esp_conn, esp_txn;
+extern uint16_t esp_lost, esp_ipd, esp_tmo_cnt, esp_err_cnt;
+extern volatile uint8_t sched_events;
+
+static uint32_t fails = 0;
+#define CHECK(c) if (!(c)) { fails++; printf("line %d: %s\n", __LINE__, #c); }
+
+//------------------------------------------------------------------
+// The stand-in modem on the master side of the pty
+//------------------------------------------------------------------
+typedef struct
+{
+    uint32_t at;        // tick at which data is written
+    uint16_t n;         // number of bytes
+    uint8_t  data[256];
+} say_t;
+
+int      m_fd;                  // master side of the pty
+say_t    m_q[32];               // what the modem will write
+uint8_t  m_nq = 0;
+char     m_line[256];           // command line being received
+uint16_t m_pos = 0;
+uint16_t m_data = 0;            // bytes of AT+CIPSEND data still to come
+char     m_sent[1024];          // all AT+CIPSEND data
+uint16_t m_sentn = 0;
+uint8_t  m_rst = 0, m_sends = 0, m_joined = 0;
+uint8_t  frame[BIN_FRAME_LEN];  // image sent over WiFi
+
+/*------------------------------------------------------------------
+  Purpose  : The modem writes n bytes after ms msec., in order.
+  ------------------------------------------------------------------*/
+static void say(uint32_t ms, const void *d, uint16_t n)
+{
+    say_t *s = &m_q[m_nq++];
+    
+    s->at = millis() + MS(ms);
+    s->n  = n;
+    memcpy(s->data, d, n);
+} // say()
+
+#define SAY(ms, s) say(ms, s, sizeof(s) - 1)
+
+/*------------------------------------------------------------------
+  Purpose  : The modem handles one command line.
+  ------------------------------------------------------------------*/
+static void modem_line(const char *s)
+{
+    uint8_t  ipd[BIN_FRAME_LEN + 32], tx[BIN_FRAME_LEN + 6];
+    uint16_t n, k;
+    
+    if (!strcmp(s, "AT+RST"))
+    {
+        SAY(1, "\r\nOK\r\n garbage\x00\xff\r\n");
+        if (++m_rst > 1) SAY(200, "\r\nready\r\nWIFI GOT IP\r\n"); // no "ready" the 1st time
+    } // if
+    else if (!strcmp(s, "AT+CIPMUX=1") && (m_rst == 2)) SAY(1, "ERROR\r\n");
+    else if (!strncmp(s, "AT+CWJAP_DEF=", 13))
+    {   // join, then a client connects and sends commands and a frame
+        m_joined++;
+        SAY(1, "WIFI CONNECTED\r\n");
+        SAY(300, "OK\r\n");
+        SAY(400, "0,CONNECT\r\n");
+        SAY(401, "\r\n+IPD,0,6:S0\nE1\n\r\n");
+        n = bin_frame(tx, BIN_FRAME, frame, BIN_FRAME_LEN);
+        k = sprintf((char *)ipd, "+IPD,0,100:");
+        memcpy(ipd + k, tx, 100);
+        say(402, ipd, k + 100);
+        k = sprintf((char *)ipd, "\r\n+IPD,0,%u:", n - 100);
+        memcpy(ipd + k, tx + 100, n - 100);
+        say(403, ipd, k + n - 100);
+    } // else if
+    else if (!strncmp(s, "AT+CIPSEND=0,", 13))
+    {   // data follows after the prompt
+        m_data = atoi(s + 13);
+        SAY(1, "\r\nOK\r\n> ");
+    } // else if
+    else SAY(1, "\r\nOK\r\n");
+} // modem_line()
+
+/*------------------------------------------------------------------
+  Purpose  : The modem runs for one tick.
+  ------------------------------------------------------------------*/
+static void modem(void)
+{
+    uint8_t b;
+    char    s[40];
+    
+    while (m_nq && ((int32_t)(millis() - m_q[0].at) >= 0))
+    {   // write what is due
+        if (write(m_fd, m_q[0].data, m_q[0].n) != m_q[0].n) fails++;
+        memmove(&m_q[0], &m_q[1], --m_nq * sizeof(say_t));
+    } // while
+    while (read(m_fd, &b, 1) == 1)
+    {
+        if (m_data)
+        {   // AT+CIPSEND data
+            if (m_sentn < sizeof(m_sent) - 1) m_sent[m_sentn++] = b;
+            if (--m_data == 0)
+            {
+                sprintf(s, "\r\nRecv %u bytes\r\n\r\nSEND OK\r\n", m_sentn);
+                say(1, s, strlen(s));
+                m_sends++;
+            } // if
+        } // if
+        else if (b == '\n')
+        {
+            if (m_pos && (m_line[m_pos-1] == '\r')) m_line[m_pos-1] = '\0';
+            else                                    m_line[m_pos]   = '\0';
+            modem_line(m_line);
+            m_pos = 0;
+        } // else if
+        else if (m_pos < sizeof(m_line) - 1) m_line[m_pos++] = b;
+    } // while
+} // modem()
+
+int main(void)
+{
+    struct termios tio;
+    int      s_fd;
+    uint8_t  ev, *p, type, len, src, phase = 0, sends = 0, frames = 0, rst = 0;
+    uint32_t t, t0, dt, dt_max = 0, next = 0, hold = 0, wait = 0;
+    
+    if (openpty(&m_fd, &s_fd, NULL, NULL, NULL) < 0) return 1;
+    tcgetattr(s_fd, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(s_fd, TCSANOW, &tio);
+    fcntl(m_fd, F_SETFL, O_NONBLOCK);
+    fcntl(s_fd, F_SETFL, O_NONBLOCK);
+    u3_fd = s_fd;
+    for (t = 0; t < BIN_FRAME_LEN; t++) frame[t] = t * 7;
+    
+    UART1_SR_TC = UART3_SR_TC = 1; // transmitters idle
+    uart1_init(HSE);
+    uart3_init(HSE);
+    esp_init();
+    for (t = 0; t < SIM_TICKS; t++)
+    {
+        board_tick();
+        modem();
+        ev = sched_events;
+        sched_events = 0;
+        if (ev & (EV_UART1_LINE | EV_WIFI_LINE)) command_task();
+        if ((ev & EV_ESP) || ((int32_t)(millis() - next) >= 0))
+        {   // esp_task() on EV_ESP and every 100 msec.
+            if (hold && ((int32_t)(millis() - hold) < 0)) 
+            {   // esp_task() is late
+                sched_events |= ev & EV_ESP;
+            } // if
+            else
+            {
+                next = millis() + MS(100);
+                t0   = millis();
+                esp_task();
+                dt = millis() - t0; // delay_msec() runs the board
+                if (dt > dt_max) dt_max = dt;
+            } // else
+        } // if
+        while ((p = uart1_getframe(&type, &len, &src)) != NULL)
+        {   // as stream_task() does
+            CHECK((type == BIN_FRAME) && (src == SRC_WIFI) && !memcmp(p, frame, BIN_FRAME_LEN));
+            frames++;
+            uart1_frame_free();
+        } // while
+        switch (phase)
+        {   // the test side of the script
+            case 0: if (esp_state == ESP_READY)
+                    {   // join an access-point with the E0 command
+                        CHECK((m_rst == 3) && (esp_tmo_cnt == 1) && (esp_err_cnt == 1));
+                        CHECK(esp_raw("AT+CWJAP_DEF=\"ssid\",\"pw\""));
+                        phase++;
+                    } // if
+                    break;
+            case 1: if (strstr(m_sent, "RGB Platform") && strstr(m_sent, "ESP: ready"))
+                    {   // replies of S0 and E1 received, client goes away
+                        SAY(10, "0,CLOSED\r\n");
+                        wait = millis() + MS(500);
+                        phase++;
+                    } // if
+                    break;
+            case 2: if ((int32_t)(millis() - wait) >= 0)
+                    {   // a reply to a closed connection is dropped
+                        CHECK(!esp_conn);
+                        sends = m_sends;
+                        esp_putc('x');
+                        esp_flush();
+                        SAY(1000, "\r\nready\r\nWIFI GOT IP\r\n"); // module resets itself
+                        rst = m_rst;
+                        phase++;
+                    } // if
+                    break;
+            case 3: if ((m_rst == rst + 1) && (esp_state == ESP_READY))
+                    {   // initialised again, now a burst of lines
+                        CHECK(m_sends == sends && !esp_txn);
+                        hold = millis() + MS(50);
+                        SAY(10, "1,CONNECT\r\n1,CLOSED\r\n1,CONNECT\r\n1,CLOSED\r\n"
+                                "2,CONNECT\r\n2,CLOSED\r\n2,CONNECT\r\n2,CLOSED\r\n");
+                        phase++;
+                    } // if
+                    break;
+            case 4: if (!hold || ((int32_t)(millis() - hold - MS(100)) >= 0))
+                    {   // the driver still works
+                        CHECK(esp_lost > 0);
+                        hold = 0;
+                        CHECK(esp_raw("AT"));
+                        phase++;
+                    } // if
+                    break;
+            default: break;
+        } // switch
+    } // for t
+    esp_stats();
+    for (t = 0; t < MS(100); t++) board_tick(); // print it
+    printf("%s", strstr(u1_out, "ESP: "));
+    CHECK(phase == 5);
+    CHECK(strstr(u1_out, "WIFI CONNECTED\r\nOK\r\n") != NULL); // E0 response lines
+    CHECK(frames == 1);
+    CHECK((esp_state == ESP_READY) && (esp_ipd == 3));
+    CHECK(dt_max == 0); // esp_task() never waits for UART3
+    printf("%u bytes sent, %u received on UART3, max. %u ticks in esp_task(), %u errors\n", 
+           (unsigned)u3_tx, (unsigned)u3_rx, (unsigned)dt_max, (unsigned)fails);
+    return fails ? 1 : 0;
+} // main()
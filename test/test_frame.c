@@ -0,0 +1,143 @@
+/*==================================================================
+  File Name: test_frame.c
+  Author   : Emile
+  ------------------------------------------------------------------
+  Purpose  : Loopback test of the binary frames on UART1. A host-side
+             sender (bin_frame.h) sends full frames back to back, 1 in
+             20 with a corrupted byte. The bytes go through the UART1 
+             receive path (uart1_rx_byte()) at the time they arrive at
+             the baud-rate. Every tick the TIM2 ISR runs (frame swap)
+             and the frames are handled as stream_task() does. Every
+             frame shown must be the frame sent, no bad frame may be
+             shown. Prints the sustained frames per second for every
+             baud-rate that UART1 can make.
+  ------------------------------------------------------------------
+  This file is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+ 
+  This software is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+ 
+  You should have received a copy of the GNU General Public License
+  along with this software.  If not, see <http://www.gnu.org/licenses/>.
+  ================================================================== */ 
+#include "panel.h"
+#include "../stm8_hw_init.c"
+#include "../pixel.c"
+#include "../uart.c"
+#include "bin_frame.h"
+
+#define SIM_TICKS (2 * TICKS_PER_SEC) /* 2 seconds per baud-rate */
+#define MAX_SENT  (1024)                /* > 2 seconds of frames at 921600 Baud */
+
+void delay_msec(uint16_t ms) { (void)ms; }
+void esp_rx(uint8_t ch)      { (void)ch; }
+
+static uint32_t fails = 0;
+static uint32_t sent_hash[MAX_SENT]; // FNV-1a hash of every payload sent
+static bool     sent_bad[MAX_SENT];  // true = the frame was corrupted
+
+/*------------------------------------------------------------------
+  Purpose  : FNV-1a hash of a payload.
+  ------------------------------------------------------------------*/
+static uint32_t fnv(const uint8_t *p, uint8_t len)
+{
+    uint32_t h = 2166136261u;
+    
+    while (len--) h = (h ^ *p++) * 16777619u;
+    return h;
+} // fnv()
+
+/*------------------------------------------------------------------
+  Purpose  : Send frames at a baud-rate for SIM_TICKS ticks.
+  Variables: baud: the baud-rate
+             bad : returns the number of corrupted frames sent
+  Returns  : the number of frames shown
+  ------------------------------------------------------------------*/
+static uint32_t loopback(uint32_t baud, uint32_t *bad)
+{
+    uint8_t  img[BIN_FRAME_LEN], tx[BIN_FRAME_LEN + 6], *p, type, len, src;
+    uint16_t n = 0, pos = 0;
+    uint32_t shown = 0, sent = 0, last = 0, h, i;
+    double   bytes = 0.0;     // bytes that have arrived, not yet received
+    bool     decoded = false;
+    
+    *bad = 0;
+    for (uint32_t t = 0; t < SIM_TICKS; t++)
+    {
+        for (bytes += baud / 10.0 / TICKS_PER_SEC; bytes >= 1.0; bytes -= 1.0)
+        {   // bytes received during this tick
+            if (pos == n)
+            {   // send the next frame
+                for (i = 0; i < BIN_FRAME_LEN; i++) img[i] = rand();
+                n   = bin_frame(tx, BIN_FRAME, img, BIN_FRAME_LEN);
+                pos = 0;
+                sent_hash[sent] = fnv(img, BIN_FRAME_LEN);
+                sent_bad[sent]  = !((sent + 1) % 20);
+                if (sent_bad[sent++])
+                {   // a byte is corrupted on the line
+                    tx[4 + rand() % BIN_FRAME_LEN] ^= 0x10;
+                    (*bad)++;
+                } // if
+            } // if
+            uart1_rx_byte(tx[pos++]);
+        } // for
+        TIM2_UPD_OVF_IRQHandler(); // swaps the buffers at the end of a frame
+        pc_commit();
+        while ((p = uart1_getframe(&type, &len, &src)) != NULL)
+        {   // as stream_task() does
+            if (!decoded)
+            {
+                if (!decode_frame(type, p, len)) fails++;
+                decoded = true;
+                // the image must be a frame that was sent without error, 
+                // later than the previous frame shown
+                h = fnv(p, len);
+                for (i = last; (i < sent) && (sent_hash[i] != h); i++) ;
+                if ((i == sent) || sent_bad[i]) fails++;
+                last = i + 1;
+                for (i = 0; i < MAX_Y; i++)
+                {   // the rows are sent MSB first
+                    if ((rgb_bufr[i] != ((p[2*i] << 8) | p[2*i+1])) ||
+                        (rgb_bufg[i] != ((p[2*(MAX_Y+i)] << 8) | p[2*(MAX_Y+i)+1])) ||
+                        (rgb_bufb[i] != ((p[2*(2*MAX_Y+i)] << 8) | p[2*(2*MAX_Y+i)+1]))) fails++;
+                } // for i
+            } // if
+            if (!present()) break;
+            uart1_frame_free();
+            decoded = false;
+            shown++;
+        } // while
+    } // for t
+    while (pos < n) uart1_rx_byte(tx[pos++]); // the frame on the line is completed
+    while (uart1_getframe(&type, &len, &src)) uart1_frame_free();
+    return shown;
+} // loopback()
+
+int main(void)
+{
+    const uint32_t baud[] = {9600, 19200, 38400, 57600, 115200, 230400, 460800, 921600};
+    uint32_t shown, bad, crc = 0;
+    
+    srand(15);
+    UART1_SR_TC = 1; // transmitter idle
+    uart1_init(HSE); 
+    init_frame_buffers();
+    printf("baud-rate  frames/sec.  (wire limit)\n");
+    for (uint8_t i = 0; i < sizeof(baud) / sizeof(baud[0]); i++)
+    {
+        if (!uart1_set_baud(baud[i])) fails++; // BRR can not be set
+        shown = loopback(baud[i], &bad);
+        printf("%7u    %6.1f       (%6.1f)\n", (unsigned)baud[i], shown / 2.0, 
+               baud[i] / 10.0 / (BIN_FRAME_LEN + 6));
+        crc += bad;
+    } // for i
+    if (rx1_crc != crc) fails++; // every corrupted frame is seen
+    printf("%u frames, %u crc errors (%u corrupted), %u lost, %u errors\n", rx1_frames, 
+           rx1_crc, (unsigned)crc, rx1_flost, (unsigned)fails);
+    return fails ? 1 : 0;
+} // main()
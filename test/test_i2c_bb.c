@@ -0,0 +1,181 @@
+/*==================================================================
+  File Name: test_i2c_bb.c
+  Author   : Emile
+  ------------------------------------------------------------------
+  Purpose  : Test of the I2C transaction engine of i2c_bb.c (bus 0,
+             bit-banging) with the model of the bus and a DS3231 of
+             i2c_bus.h, built with I2C_HW = 0:
+             - clock_task(): ds3231_gettime_nb() in PT_WAIT_UNTIL(),
+               with one i2c_bb_task() per dispatch pass in between
+             - random writes, write-reads, reads and probes with the
+               blocking i2c_transfer(), against a copy of the registers
+             - a full queue with callbacks, and i2c_transfer() while
+               the queue is running
+             The time of every i2c_bb_task() call is compared with the
+             time of a blocking ds3231_gettime().
+  ------------------------------------------------------------------
+  This file is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This software is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this software.  If not, see <http://www.gnu.org/licenses/>.
+  ================================================================== */
+#include <stdlib.h>
+#include "i2c_bus.h"
+#include "../i2c_bb.c"
+#include "../i2c_ds3231_bb.c"
+
+#define NGROUPS (20000UL) /* random transactions or groups */
+
+static uint32_t fails = 0;
+#define CHECK(c) if (!(c)) { fails++; if (fails < 10) printf("line %d: %s\n", __LINE__, #c); }
+
+static uint8_t  reg[BUS_REGS]; // what the DS3231 must hold
+static uint8_t  ptr;           // its register pointer
+static uint8_t  events = 0;    // posted events
+static double   task_max = 0;  // usec., the longest i2c_bb_task()
+static int      ncb;           // callbacks
+
+void post_event(uint8_t ev)
+{
+    events |= ev;
+} // post_event()
+
+static void cb(i2c_xfer *x)
+{
+    ncb++;
+} // cb()
+
+/*------------------------------------------------------------------
+  Purpose  : One dispatch_tasks() pass: i2c_bb_task() runs when EV_I2C
+             is posted.
+  ------------------------------------------------------------------*/
+static void pass(void)
+{
+    double t = bus_us;
+
+    if (!(events & EV_I2C)) return;
+    events &= ~EV_I2C;
+    i2c_bb_task();
+    if (bus_us - t > task_max) task_max = bus_us - t;
+} // pass()
+
+/*------------------------------------------------------------------
+  Purpose  : This function checks bytes read from the DS3231.
+  Variables: r: the bytes read
+             n: the number of bytes
+             p: the register they are read from
+  Returns  : -
+  ------------------------------------------------------------------*/
+static void check_read(const uint8_t *r, uint8_t n, uint8_t p)
+{
+    uint8_t i;
+
+    for (i = 0; i < n; i++) CHECK(r[i] == reg[(p + i) % BUS_REGS]);
+    ptr = (p + n) % BUS_REGS;
+} // check_read()
+
+int main(void)
+{
+    static i2c_xfer x[I2C_BB_QLEN];
+    static uint8_t  rb[I2C_BB_QLEN][16], wr[I2C_BB_QLEN];
+    i2c_xfer y = {BUS_ADDR, wr, 1, rb[0], 1, NULL, 0};
+    const uint8_t now[7] = {0x45, 0x59, 0x23, 5, 0x17, 0x10, 0x26}; // Fri 17-10-2026 23:59:45
+    Time     t;
+    double   t0, nb_max = 0, blk;
+    uint32_t g, passes;
+    uint8_t  w[8], r[16], typ, n, rg, i, k;
+    bool     done, blocking;
+
+    srand(2);
+    for (i = 0; i < BUS_REGS; i++) reg[i] = bus_reg[i] = (i < 7) ? now[i] : rand();
+    i2c_init_bb(I2C_CH0);
+
+    // clock_task(): PT_WAIT_UNTIL(ds3231_gettime_nb(&dt))
+    for (passes = 0, done = false; !done; passes++)
+    {
+        t0   = bus_us;
+        done = ds3231_gettime_nb(&t);
+        if (bus_us - t0 > nb_max) nb_max = bus_us - t0;
+        if (!done) pass();
+    } // for
+    printf("ds3231_gettime_nb(): %u passes, max. %.0f usec. per call, %02d:%02d:%02d %d-%d-%d\n",
+           passes, nb_max, t.hour, t.min, t.sec, t.day, t.mon, t.year);
+    CHECK((t.sec == 45) && (t.min == 59) && (t.hour == 23) && (t.day == 17) && (t.year == 2026));
+    ptr = 7;
+    t0  = bus_us;
+    CHECK(!ds3231_gettime(&t) && (t.sec == 45));
+    blk = bus_us - t0;
+
+    // Random transactions
+    for (g = 0; g < NGROUPS; g++)
+    {
+        typ = rand() % 4;
+        n   = 1 + rand() % 8;
+        rg  = rand() % BUS_REGS;
+        switch (typ)
+        {
+            case 0: // write n-1 registers from rg
+                w[0] = rg;
+                for (i = 1; i < n; i++) w[i] = rand();
+                CHECK(i2c_transfer(BUS_ADDR, w, n, NULL, 0) == I2C_ACK);
+                for (i = 1; i < n; i++) reg[(rg + i - 1) % BUS_REGS] = w[i];
+                ptr = (rg + n - 1) % BUS_REGS;
+                break;
+            case 1: // write rg, read n registers
+                w[0] = rg;
+                CHECK(i2c_transfer(BUS_ADDR, w, 1, r, n) == I2C_ACK);
+                check_read(r, n, rg);
+                break;
+            case 2: // read n registers from the register pointer, probes
+                CHECK(i2c_transfer(BUS_ADDR | 1, NULL, 0, r, n) == I2C_ACK);
+                check_read(r, n, ptr);
+                CHECK(i2c_transfer(BUS_ADDR, NULL, 0, NULL, 0) == I2C_ACK);
+                CHECK(i2c_transfer(0x50, NULL, 0, NULL, 0) == I2C_NACK);
+                CHECK(i2c_transfer(0x50, w, 1, r, 2) == I2C_NACK);
+                break;
+            default: // a full queue, i2c_transfer() while it runs
+                ncb = 0;
+                for (k = 0; k < I2C_BB_QLEN; k++)
+                {
+                    wr[k] = rand() % BUS_REGS;
+                    x[k]  = (i2c_xfer){BUS_ADDR, &wr[k], 1, rb[k], 1 + rand() % 12, cb, 0};
+                    CHECK(i2c_submit(&x[k]));
+                } // for k
+                CHECK(!i2c_submit(&y));
+                blocking = rand() & 1;
+                if (blocking)
+                {   // it waits for the queue, the register pointer is then 5
+                    for (k = rand() % 40; k; k--) pass();
+                    w[0] = 3;
+                    CHECK(i2c_transfer(BUS_ADDR, w, 1, r, 2) == I2C_ACK);
+                } // if
+                while (x[I2C_BB_QLEN - 1].status == I2C_BUSY) pass();
+                CHECK(ncb == I2C_BB_QLEN);
+                for (k = 0; k < I2C_BB_QLEN; k++)
+                {
+                    CHECK(x[k].status == I2C_ACK);
+                    check_read(rb[k], x[k].rlen, wr[k]);
+                } // for k
+                if (blocking) check_read(r, 2, 3);
+                break;
+        } // switch
+        CHECK(bus_idle());
+        if (fails > 10) break;
+    } // for g
+    printf("%lu transactions or groups: %u starts, %u stops, %u protocol errors\n",
+           NGROUPS, bus_starts, bus_stops, bus_fails);
+    printf("blocking ds3231_gettime(): %.0f usec., i2c_bb_task() max. %.0f usec. (%d bits)\n",
+           blk, task_max, I2C_BB_BITS);
+    CHECK(task_max < blk / 10);
+    CHECK(!bus_fails);
+    printf("%u errors\n", (unsigned)(fails + bus_fails));
+    return (fails || bus_fails) ? 1 : 0;
+} // main()
@@ -0,0 +1,202 @@
+/*==================================================================
+  File Name: test_i2c_hw.c
+  Author   : Emile
+  ------------------------------------------------------------------
+  Purpose  : Test of the interrupt-driven I2C master i2c_hw.c with the
+             model of the I2C peripheral and a DS3231 of i2c_sim.h:
+             - random writes, write-reads and reads of 1..8 bytes
+               against a copy of the registers, with a late ISR
+             - probes of a device that is there and one that is not
+             - a full queue of transactions with callbacks
+             - a bus lock-up: the transaction is aborted after I2C_TMO
+               msec., with interrupts enabled and disabled. The bus
+               reset runs with the interrupt state of the caller, a
+               transaction submitted meanwhile waits for it, and the
+               interrupt state must be the same afterwards
+             - the clock settings for 400 kHz and 100 kHz
+  ------------------------------------------------------------------
+  This file is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This software is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this software.  If not, see <http://www.gnu.org/licenses/>.
+  ================================================================== */
+#include "i2c_sim.h"
+#include "../i2c_hw.c"
+
+#define NGROUPS (20000UL) /* random transactions or groups */
+
+static uint32_t fails = 0;
+#define CHECK(c) if (!(c)) { fails++; if (fails < 10) printf("line %d: %s\nbus: %s\n", __LINE__, #c, sim_trace); }
+
+static uint8_t  reg[SIM_REGS]; // what the DS3231 must hold
+static uint8_t  ptr;           // its register pointer
+static uint32_t ms = 0;        // calls of millis()
+static int      ncb;           // callbacks
+
+// millis(): 20 steps of the bus, a tick every 4 calls
+__monitor uint32_t millis(void)
+{
+    int i;
+
+    for (i = 0; i < 20; i++) sim_step();
+    return ms++ / 4;
+} // millis()
+
+static i2c_xfer q;            // queued during the bus reset
+static uint8_t  q_w, q_r[2];
+static bool     rst_irq;      // interrupt state during the bus reset
+static bool     rst_ok;       // the ISR was stopped, the queued one did not start
+
+// The bus reset of i2c_hw_abort(), it takes 2 msec. or more on the target
+uint8_t i2c_reset_bus(enum I2C_CH ch)
+{
+    i2c_xfer *x = i2c_cur;
+
+    rst_irq = host_irq_en;
+    q       = (i2c_xfer){SIM_ADDR, &q_w, 1, q_r, 2, NULL, 0};
+    rst_ok  = !I2C_ITR && x && i2c_hw_submit(&q) && (i2c_cur == x) && (q.status == I2C_BUSY);
+    return 0;
+} // i2c_reset_bus()
+
+// i2c_hw_stats() prints to UART1, which is not linked
+uint8_t uart1_printf(const char *s) { return 0; }
+uint8_t uart1_putu(uint32_t v, uint8_t w, char pad) { return 0; }
+
+static void cb(i2c_xfer *x)
+{
+    ncb++;
+} // cb()
+
+/*------------------------------------------------------------------
+  Purpose  : This function checks bytes read from the DS3231.
+  Variables: r: the bytes read
+             n: the number of bytes
+             p: the register they are read from
+  Returns  : -
+  ------------------------------------------------------------------*/
+static void check_read(const uint8_t *r, uint8_t n, uint8_t p)
+{
+    uint8_t i;
+
+    for (i = 0; i < n; i++) CHECK(r[i] == reg[(p + i) % SIM_REGS]);
+    ptr = (p + n) % SIM_REGS;
+} // check_read()
+
+/*------------------------------------------------------------------
+  Purpose  : This function locks up the bus during a write-read.
+  Variables: irq: the interrupt state during the transaction
+  Returns  : -
+  ------------------------------------------------------------------*/
+static void stuck(uint8_t irq)
+{
+    uint8_t  w = 0, r[7], s;
+    uint32_t t;
+
+    sim_clear();
+    sim_stuck   = true;
+    host_irq_en = irq;
+    t = ms;
+    s = i2c_hw_xfer(SIM_ADDR, &w, 1, r, 7);
+    printf("stuck bus, interrupts %s: status %u after %u msec.\n", irq ? "on" : "off", s,
+           (unsigned)((ms - t) / 4 * 1000 / TICKS_PER_SEC));
+    CHECK((s == I2C_ERROR) && (host_irq_en == irq) && (rst_irq == irq) && rst_ok);
+    sim_stuck   = false;
+    host_irq_en = 1;
+    sim_clear();
+    while (q.status == I2C_BUSY) i2c_hw_poll(); // started by the abort
+    CHECK((q.status == I2C_ACK) && !i2c_cur);
+    check_read(q_r, 2, q_w);
+    CHECK(i2c_hw_xfer(SIM_ADDR, &w, 1, r, 7) == I2C_ACK); // the bus works again
+    check_read(r, 7, 0);
+} // stuck()
+
+int main(void)
+{
+    static i2c_xfer x[I2C_QLEN + 1];
+    static uint8_t  rb[I2C_QLEN + 1][16], wr[I2C_QLEN + 1];
+    i2c_xfer y = {SIM_ADDR, wr, 1, rb[0], 1, NULL, 0};
+    uint8_t  w[8], r[16], t, n, rg, i, k;
+    uint32_t g;
+
+    srand(1);
+    for (i = 0; i < SIM_REGS; i++) reg[i] = sim_reg[i] = rand();
+    host_irq_en = 1;
+    i2c_hw_init(0xB4, I2C_400KHZ);
+    printf("400 kHz at 24 MHz: CCRH 0x%02x, CCRL %u, TRISER %u, FREQR %u\n",
+           I2C_CCRH, I2C_CCRL, I2C_TRISER, I2C_FREQR);
+    CHECK((I2C_CCRH == 0x80) && (I2C_CCRL == 20) && (I2C_TRISER == 8) && (I2C_FREQR == 24));
+    for (g = 0; g < NGROUPS; g++)
+    {
+        sim_lat = 1 + rand() % 8;
+        sim_clear();
+        t  = rand() % 5;
+        n  = 1 + rand() % 8;
+        rg = rand() % SIM_REGS;
+        switch (t)
+        {
+            case 0: // write n-1 registers from rg
+                w[0] = rg;
+                for (i = 1; i < n; i++) w[i] = rand();
+                CHECK(i2c_hw_xfer(SIM_ADDR, w, n, NULL, 0) == I2C_ACK);
+                for (i = 1; i < n; i++) reg[(rg + i - 1) % SIM_REGS] = w[i];
+                ptr = (rg + n - 1) % SIM_REGS;
+                break;
+            case 1: // write rg, read n registers
+                w[0] = rg;
+                CHECK(i2c_hw_xfer(SIM_ADDR, w, 1, r, n) == I2C_ACK);
+                check_read(r, n, rg);
+                break;
+            case 2: // read n registers from the register pointer
+                CHECK(i2c_hw_xfer(SIM_ADDR, NULL, 0, r, n) == I2C_ACK);
+                check_read(r, n, ptr);
+                break;
+            case 3: // probes
+                CHECK(i2c_hw_xfer(SIM_ADDR, NULL, 0, NULL, 0) == I2C_ACK);
+                CHECK(i2c_hw_xfer(0x50, NULL, 0, NULL, 0) == I2C_NACK);
+                CHECK(i2c_hw_xfer(0x50, w, 2, r, 2) == I2C_NACK);
+                break;
+            default: // one running and a full queue, the ISR runs them
+                ncb = 0;
+                for (k = 0; k <= I2C_QLEN; k++)
+                {
+                    wr[k] = rand() % SIM_REGS;
+                    x[k]  = (i2c_xfer){SIM_ADDR, &wr[k], 1, rb[k], 1 + rand() % 12, cb, 0};
+                    CHECK(i2c_hw_submit(&x[k]));
+                } // for k
+                CHECK(!i2c_hw_submit(&y));
+                while (x[I2C_QLEN].status == I2C_BUSY) i2c_hw_poll();
+                CHECK(ncb == I2C_QLEN + 1);
+                for (k = 0; k <= I2C_QLEN; k++)
+                {
+                    CHECK(x[k].status == I2C_ACK);
+                    check_read(rb[k], x[k].rlen, wr[k]);
+                } // for k
+                break;
+        } // switch
+        if (fails > 10) break;
+    } // for g
+    printf("%lu transactions or groups: %u ok, %u nack, %u error, %u protocol errors\n",
+           NGROUPS, i2c_n[I2C_ACK], i2c_n[I2C_NACK], i2c_n[I2C_ERROR], (unsigned)sim_fails);
+
+    // Bus lock-up, with interrupts enabled and disabled (during init.)
+    sim_lat = 1;
+    stuck(1);
+    stuck(0);
+    CHECK((i2c_n[3] == 2) && !i2c_n[I2C_ERROR]);
+
+    i2c_hw_init(0xE1, I2C_100KHZ);
+    printf("100 kHz at 16 MHz: CCRH 0x%02x, CCRL %u, TRISER %u, FREQR %u\n",
+           I2C_CCRH, I2C_CCRL, I2C_TRISER, I2C_FREQR);
+    CHECK((I2C_CCRH == 0x00) && (I2C_CCRL == 80) && (I2C_TRISER == 17) && (I2C_FREQR == 16));
+    CHECK(!sim_fails);
+    printf("%u errors\n", (unsigned)(fails + sim_fails));
+    return (fails || sim_fails) ? 1 : 0;
+} // main()
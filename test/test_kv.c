@@ -0,0 +1,267 @@
+/*==================================================================
+  File Name: test_kv.c
+  Author   : Emile
+  ------------------------------------------------------------------
+  Purpose  : Test of the configuration store kv.c, with eep.c and the
+             EEPROM model of eep_model.h:
+             - migration of the fixed layout of older versions
+             - power failures: a list of writes is run once, then again
+               with a power failure in every program cycle, after every
+               byte of the cycle, with the rest erased or garbled. After
+               the reboot every key must have its old or its new value,
+               and the store must keep working.
+             - wear: program cycles per word of every sector.
+  ------------------------------------------------------------------
+  This file is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This software is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this software.  If not, see <http://www.gnu.org/licenses/>.
+  ================================================================== */
+#include <stdlib.h>
+#include "eep_model.h"
+#include "../eep.c"
+#include "../kv.c"
+
+#define NOPS  (120) /* writes in the list */
+#define NWEAR (20)  /* times the list is written for the wear figures */
+
+static uint32_t fails = 0;
+#define CHECK(c) if (!(c)) { fails++; if (fails < 10) printf("line %d: %s\n", __LINE__, #c); }
+
+// eep_stats() and kv_stats() print to UART1, which is not linked
+uint8_t uart1_printf(const char *s) { return 0; }
+uint8_t uart1_putu(uint32_t v, uint8_t w, char pad) { return 0; }
+
+typedef struct
+{
+    uint8_t key;
+    uint8_t len;
+    uint8_t v[KV_MAXLEN];
+} kv_op; // a write, or the value of a key
+
+typedef struct
+{
+    kv_op k[KV_KEYS]; // the value of every key
+} kv_state;
+
+static kv_op    ops[NOPS];         // the list of writes
+static uint8_t  image[NOPS + 1][EM_SIZE]; // the EEPROM before every write
+static kv_state st[NOPS + 1];      // the values before every write
+static uint32_t ncyc[NOPS + 1];    // program cycles of every write
+
+/*------------------------------------------------------------------
+  Purpose  : Power-up: the RAM of eep.c and kv.c is lost.
+  ------------------------------------------------------------------*/
+static void reboot(void)
+{
+    eep_qwr  = eep_qrd = 0;
+    eep_qin  = eep_qused = 0;
+    eep_busy = false;
+    em_busy  = em_armed = false;
+    em_dulv  = 0;
+    kv_init();
+} // reboot()
+
+/*------------------------------------------------------------------
+  Purpose  : This function reads the values of all keys.
+  ------------------------------------------------------------------*/
+static void get_state(kv_state *s)
+{
+    uint8_t k;
+
+    for (k = KV_FREE + 1; k < KV_KEYS; k++) s->k[k].len = kv_read(k, s->k[k].v, KV_MAXLEN);
+} // get_state()
+
+/*------------------------------------------------------------------
+  Purpose  : This function compares the value of a key.
+  ------------------------------------------------------------------*/
+static bool same(const kv_op *a, const kv_op *b)
+{
+    return (a->len == b->len) && !memcmp(a->v, b->v, a->len);
+} // same()
+
+/*------------------------------------------------------------------
+  Purpose  : This function makes the list of writes: texts, colours,
+             DST and baud-rates, as the commands would write them.
+  ------------------------------------------------------------------*/
+static void make_ops(void)
+{
+    kv_op    *o;
+    uint32_t b;
+    uint8_t  i, j;
+
+    srand(7);
+    for (i = 0; i < NOPS; i++)
+    {
+        o = &ops[i];
+        switch (rand() % 10)
+        {
+            case 0: case 1: case 2:
+                o->key = KV_TEXT1 + rand() % 2;
+                o->len = 20 + rand() % 80;
+                for (j = 0; j < o->len; j++) o->v[j] = 'A' + rand() % 26;
+                break;
+            case 3: case 4: case 5:
+                o->key = KV_COL1 + rand() % 2;
+                o->len = 20 + rand() % 80;
+                for (j = 0; j < o->len; j++) o->v[j] = 1 + rand() % 7;
+                break;
+            case 6: case 7:
+                o->key  = KV_DST;
+                o->len  = 1;
+                o->v[0] = i & 1;
+                break;
+            default:
+                o->key  = KV_BAUD1 + rand() % 2;
+                o->len  = 4;
+                b       = (rand() & 1) ? 115200 : 38400 + i;
+                o->v[0] = b >> 24;
+                o->v[1] = b >> 16;
+                o->v[2] = b >> 8;
+                o->v[3] = b;
+                break;
+        } // switch
+    } // for i
+} // make_ops()
+
+/*------------------------------------------------------------------
+  Purpose  : This function runs one write of the list, -1 = the first
+             kv_init() with the fixed layout of older versions.
+  ------------------------------------------------------------------*/
+static void run_op(int i)
+{
+    if (i < 0) reboot();
+    else       kv_write(ops[i].key, ops[i].v, ops[i].len);
+    eep_flush();
+} // run_op()
+
+int main(void)
+{
+    kv_state s, s2;
+    kv_op    probe = {KV_TEXT2, 5, "probe"};
+    char     txt[KV_MAXLEN + 1];
+    uint8_t  col[KV_MAXLEN];
+    uint32_t c, cuts = 0, bad = 0, mx, sum, wear[KV_SECTORS];
+    uint16_t n, size, seq0, a;
+    int      i, k, g;
+
+    // The fixed layout of older versions
+    make_ops();
+    strcpy((char *)&em_mem[EEP_TEXT1], "Oude tekst van de lichtkrant");
+    for (i = 0; i < 28; i++) em_mem[EEP_COL1 + i] = 1 + i % 7;
+    em_mem[EEP_DST_ACTIVE] = 1;
+    em_mem[EEP_BAUD1 + 1]  = 0x01; // 115200
+    em_mem[EEP_BAUD1 + 2]  = 0xC2;
+    memcpy(em_old, em_mem, EM_SIZE);
+    memcpy(image[0], em_mem, EM_SIZE);
+
+    // Run the list once: the EEPROM and the values before every write
+    c = em_ncycles();
+    run_op(-1);
+    kv_read_string(KV_TEXT1, txt);
+    printf("migrated: TEXT1 \"%s\", COL1 %u bytes, DST %u, BAUD1 %u, BAUD3 %u\n", txt,
+           kv_read(KV_COL1, col, KV_MAXLEN), kv_read8(KV_DST),
+           (unsigned)kv_read32(KV_BAUD1), (unsigned)kv_read32(KV_BAUD3));
+    CHECK(!strcmp(txt, "Oude tekst van de lichtkrant") && (kv_read8(KV_DST) == 1));
+    CHECK((kv_read32(KV_BAUD1) == 115200) && (kv_read32(KV_BAUD3) == 0));
+    ncyc[0] = em_ncycles() - c;
+    get_state(&st[0]);
+    seq0 = kv_seq;
+    for (i = 0; i < NOPS; i++)
+    {
+        memcpy(image[i + 1], em_mem, EM_SIZE); // before write i
+        c = em_ncycles();
+        run_op(i);
+        ncyc[i + 1] = em_ncycles() - c;
+        get_state(&st[i + 1]);
+    } // for i
+    printf("%d writes: %u sector moves\n", NOPS, kv_seq - seq0);
+    reboot();
+    get_state(&s);
+    for (k = KV_FREE + 1; k < KV_KEYS; k++) CHECK(same(&s.k[k], &st[NOPS].k[k]));
+    CHECK(kv_seq - seq0 >= 2); // every sector is used
+
+    // A power failure in every program cycle, after every byte
+    for (g = 0; g < 2; g++)
+    {
+        em_garble = g;
+        for (i = -1; i < NOPS; i++)
+        {
+            for (c = 1; c <= ncyc[i + 1]; c++)
+            {
+                for (n = 0, size = 1; n < size; n++)
+                {   // size: the bytes of cycle c, known after the first cut
+                    memcpy(em_mem, image[i + 1], EM_SIZE); // the EEPROM before write i
+                    memcpy(em_old, em_mem, EM_SIZE);
+                    if (i >= 0) reboot();
+                    em_cut   = em_ncycles() + c;
+                    em_cut_n = n;
+                    if (!setjmp(em_jb))
+                    {
+                        run_op(i);
+                        printf("write %d: no program cycle %u\n", i, c);
+                        fails++;
+                    } // if
+                    if (!n)
+                    {   // the mode of cycle c
+                        size = (em_cr2v == EEP_PRG_BLOCK) ? EEP_BLOCK : (em_cr2v == EEP_PRG_WORD) ? EEP_WORD : 1;
+                    } // if
+                    cuts++;
+                    reboot();
+                    bad += kv_bad;
+                    get_state(&s);
+                    for (k = KV_FREE + 1; k < KV_KEYS; k++)
+                    {   // old or new value
+                        CHECK(same(&s.k[k], &st[i < 0 ? 0 : i].k[k]) || same(&s.k[k], &st[i + 1].k[k]));
+                    } // for k
+                    kv_write(probe.key, probe.v, probe.len); // the store still works
+                    eep_flush();
+                    reboot();
+                    get_state(&s2);
+                    s.k[KV_TEXT2] = probe;
+                    for (k = KV_FREE + 1; k < KV_KEYS; k++) CHECK(same(&s2.k[k], &s.k[k]));
+                } // for n
+            } // for c
+        } // for i
+    } // for g
+    printf("%u power failures (erased and garbled), %u torn records skipped\n", cuts, bad);
+
+    // Wear: the list NWEAR times, program cycles per word
+    memcpy(em_mem, image[NOPS], EM_SIZE);
+    memcpy(em_old, em_mem, EM_SIZE);
+    reboot();
+    memset(em_wear, 0, sizeof(em_wear));
+    for (k = 0; k < NWEAR; k++)
+    {
+        for (i = 0; i < NOPS; i++) run_op(i);
+    } // for k
+    for (k = 0; k < KV_SECTORS; k++)
+    {
+        mx = sum = 0;
+        for (a = k * KV_SECSIZE / 4; a < (k + 1) * KV_SECSIZE / 4; a++)
+        {
+            sum += em_wear[a];
+            if (em_wear[a] > mx) mx = em_wear[a];
+        } // for a
+        printf("sector %d: max. %u, mean %.1f program cycles per word\n", k, mx, sum * 4.0 / KV_SECSIZE);
+        wear[k] = mx;
+    } // for k
+    for (k = 1; k < KV_SECTORS; k++) CHECK(abs((int)wear[k] - (int)wear[0]) < wear[0] / 10); // round-robin
+    for (k = KV_FREE + 1, mx = 0; k < KV_KEYS; k++)
+    {   // the fixed layout: every write of a key programs the same word or block
+        for (i = n = 0; i < NOPS; i++) n += (ops[i].key == k);
+        if (n > mx) mx = n;
+    } // for k
+    printf("%u writes: fixed layout max. %u program cycles per word\n", NWEAR * NOPS, NWEAR * mx);
+    CHECK(!em_err);
+    printf("%u errors\n", (unsigned)fails);
+    return fails ? 1 : 0;
+} // main()
@@ -0,0 +1,169 @@
+/*==================================================================
+  File Name: test_ports.c
+  Author   : Emile
+  ------------------------------------------------------------------
+  Purpose  : Test of the command ports. The firmware is linked as a 
+             whole with the board model (board.h). Three ports get 
+             their command lines at the same time, byte by byte:
+             - UART1, through the UART1 RX ISR at 115200 Baud
+             - WiFi, as +IPD messages through esp_rx()
+             - a test port, a cmd_port of this file
+             Every port sends "B0 <n>" with a baud-rate that is not
+             possible, n is unique for every command, and sends the next
+             command when the previous one is done. The reply of such
+             a command holds n, so the reply of every command must be 
+             found in the output of its own port, in order, and nowhere
+             else. Then the command throughput is measured.
+  ------------------------------------------------------------------
+  This file is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+ 
+  This software is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+ 
+  You should have received a copy of the GNU General Public License
+  along with this software.  If not, see <http://www.gnu.org/licenses/>.
+  ================================================================== */ 
+#include <time.h>
+#include "board.h"
+#include "../command_interpreter.h"
+#include "../esp8266.h"
+
+#define NCMD   (300)  /* commands per port */
+#define NBENCH (200000UL) /* commands for the throughput of the test port */
+
+extern cmd_port cmd_ports[];
+extern uint8_t  esp_state, esp_conn, esp_tx[], esp_txn;
+extern volatile uint8_t sched_events;
+extern line_buf rx1_line, esp_cmdline;
+void command_task(void);
+
+static uint32_t fails = 0;
+#define CHECK(c) if (!(c)) { fails++; printf("line %d: %s\n", __LINE__, #c); }
+
+static char     wifi_out[1 << 16], test_out[1 << 16]; // replies
+static uint32_t wifi_outn = 0, test_outn = 0, test_bytes = 0;
+static line_buf test_line;
+
+/*------------------------------------------------------------------
+  Purpose  : Reply sink of the test port.
+  ------------------------------------------------------------------*/
+static uint8_t test_putc(uint8_t ch)
+{
+    test_bytes++;
+    if (test_outn < sizeof(test_out) - 1) test_out[test_outn++] = ch;
+    return 1;
+} // test_putc()
+
+static cmd_port test_port = {"test", &test_line, test_putc, NULL};
+
+/*------------------------------------------------------------------
+  Purpose  : This function checks the replies of one port: the numbers
+             in "UART1: <n> Baud" must be first .. first + NCMD - 1, in order.
+             The "Number Error" reply is not used: on UART1 it is cut off
+             when the transmit ring is full (see command_task()).
+  Variables: name : name of the port
+             s    : the output of the port
+             first: the first number sent by the port
+  Returns  : -
+  ------------------------------------------------------------------*/
+static void check_replies(const char *name, const char *s, uint32_t first)
+{
+    uint32_t n = first, found = 0;
+    
+    while ((s = strstr(s, "UART1: ")) != NULL)
+    {
+        s += 7;
+        if ((uint32_t)atol(s) != n++) fails++; // reply of another port or out of order
+        else found++;
+    } // while
+    printf("%-5s: %u of %u replies\n", name, (unsigned)found, NCMD);
+    CHECK(found == NCMD);
+} // check_replies()
+
+int main(void)
+{
+    static char cmds[3][NCMD][12]; // "B0 <n>\n" for UART1, WiFi and the test port
+    char     ipd[40], *w = "", *tp = "";
+    uint32_t i, t, n, k[3] = {0};
+    struct timespec t0, t1;
+    double   sec;
+    
+    UART1_SR_TC = UART3_SR_TC = 1; // transmitters idle
+    uart1_init(HSE);
+    uart1_set_baud(115200UL); // UART1_BAUD is 38400
+    uart3_init(HSE);
+    esp_init();
+    esp_state = ESP_READY; // as if the ESP8266 is initialised, no AT+CIPSEND
+    esp_conn  = 0x01;
+    line_init(&test_line, 0);
+    for (i = 0; i < NCMD; i++)
+    {   // "B0 <n>": n < 9600 is not a possible baud-rate
+        for (n = 0; n < 3; n++) sprintf(cmds[n][i], "B0 %u\n", (unsigned)(1000 + 2000 * n + i));
+    } // for i
+    u1_in = "";
+    for (t = 0; t < 60 * TICKS_PER_SEC; t++)
+    {   // every port sends the next command when the previous one is done
+        if (!*u1_in && (k[0] < NCMD) && (cmd_ports[0].n_cmd == k[0])) u1_in = cmds[0][k[0]++];
+        if (!*w && (k[1] < NCMD) && (cmd_ports[1].n_cmd == k[1]))
+        {   // one +IPD message per command
+            sprintf(ipd, "+IPD,0,%u:%.11s\r\n", (unsigned)strlen(cmds[1][k[1]]), cmds[1][k[1]]);
+            w = ipd;
+            k[1]++;
+        } // if
+        if (!*tp && (k[2] < NCMD) && (test_port.n_cmd == k[2])) tp = cmds[2][k[2]++];
+        board_tick();         // UART1 receives about 3 bytes per tick
+        if (*w)  esp_rx(*w++); // WiFi and the test port 1 byte per tick
+        if (*tp) line_rx(&test_line, *tp++);
+        sched_events = 0;
+        command_task();
+        while (line_ready(&test_line)) cmd_port_handler(&test_port);
+        memcpy(&wifi_out[wifi_outn], esp_tx, esp_txn); // as AT+CIPSEND does
+        wifi_outn += esp_txn;
+        esp_txn    = 0;
+        if ((cmd_ports[0].n_cmd == NCMD) && (cmd_ports[1].n_cmd == NCMD) && 
+            (test_port.n_cmd == NCMD)) break;
+    } // for t
+    for (i = 0; i < 100 * TICKS_PER_SEC / 1000; i++) board_tick(); // UART1 sends the rest
+    printf("all commands done after %.2f sec.\n", t / (double)TICKS_PER_SEC);
+    check_replies("uart1", u1_out, 1000);
+    check_replies("wifi", wifi_out, 3000);
+    check_replies("test", test_out, 5000);
+    CHECK((cmd_ports[0].n_cmd == NCMD) && (cmd_ports[0].n_err == NCMD));
+    CHECK((cmd_ports[1].n_cmd == NCMD) && (cmd_ports[1].n_err == NCMD));
+    CHECK((test_port.n_cmd == NCMD) && (test_port.n_err == NCMD));
+    CHECK(!rx1_line.lost && !esp_cmdline.lost && !test_line.lost);
+    
+    // Throughput of the test port: S5 (CPU load), nothing else runs
+    test_bytes = 0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < NBENCH; i++)
+    {
+        for (tp = "S5\n"; *tp; tp++) line_rx(&test_line, *tp);
+        cmd_port_handler(&test_port);
+    } // for i
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    sec = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+    printf("test : %.0f commands/sec. on the host (%u bytes per reply)\n", 
+           NBENCH / sec, (unsigned)(test_bytes / NBENCH));
+    
+    // Throughput of UART1 at 115200 Baud: a terminal that waits for every reply
+    u1_outn = 0;
+    n       = cmd_ports[0].n_cmd;
+    for (t = i = 0; (i < NCMD) || *u1_in || !ring_buffer_is_empty(&ring_buffer_out1); t++)
+    {
+        if (!*u1_in && (i < NCMD) && ring_buffer_is_empty(&ring_buffer_out1) && 
+            (cmd_ports[0].n_cmd == n + i)) u1_in = cmds[0][i++];
+        board_tick();
+        sched_events = 0;
+        command_task();
+    } // for t
+    printf("uart1: %.0f commands/sec. at 115200 Baud (%u bytes per reply)\n", 
+           NCMD * (double)TICKS_PER_SEC / t, (unsigned)(u1_outn / NCMD));
+    printf("%u errors\n", (unsigned)fails);
+    return fails ? 1 : 0;
+} // main()
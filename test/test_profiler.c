@@ -0,0 +1,122 @@
+/*==================================================================
+  File Name: test_profiler.c
+  Author   : Emile
+  ------------------------------------------------------------------
+  Purpose  : Host test of profiler.c. Built twice by test/Makefile:
+             - prof      : PROF_CLOCK() is host_cycles(). Checks the
+                           overhead correction, min/max/mean, the log2
+                           histogram, halving of sum and cnt and the 
+                           CPU load windows against a reference.
+             - prof_tim3 : PROF_CLOCK() is prof_clock() on TIM3. Checks
+                           that an overflow that is pending but not yet
+                           handled by the TIM3 ISR is added.
+  ------------------------------------------------------------------
+  This file is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+ 
+  This software is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+ 
+  You should have received a copy of the GNU General Public License
+  along with this software.  If not, see <http://www.gnu.org/licenses/>.
+  ================================================================== */ 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "profiler.h"
+#include "stm8_hw_init.h"
+
+extern prof_struct prof[];
+extern uint32_t    prof_ovh;
+#ifdef PROF_TIM3
+extern uint16_t    prof_ovf;
+#endif
+
+static uint32_t fails = 0;
+
+#define CHECK(c) if (!(c)) { fails++; printf("line %d: %s\n", __LINE__, #c); }
+
+#ifdef PROF_TIM3
+/*------------------------------------------------------------------
+  Purpose  : Sets TIM3 and the overflow flag and checks prof_clock().
+  Variables: ovf: prof_ovf, cnt: TIM3 counter, uif: TIM3_SR1_UIF
+             exp: expected prof_clock()
+  Returns  : -
+  ------------------------------------------------------------------*/
+static void tim3_case(uint16_t ovf, uint16_t cnt, uint8_t uif, uint32_t exp)
+{
+    prof_ovf     = ovf;
+    TIM3_CNTRH   = cnt >> 8;
+    TIM3_CNTRL   = cnt & 0xFF;
+    TIM3_SR1_UIF = uif;
+    CHECK(prof_clock() == exp);
+} // tim3_case()
+
+int main(void)
+{
+    tim3_case(0x0012, 0x3456, 0, 0x00123456);
+    tim3_case(0x0012, 0x0003, 1, 0x00130003); // wrapped, ISR still pending
+    tim3_case(0x0012, 0xFFFE, 1, 0x0012FFFE); // flag set after reading CNTR
+    tim3_case(0xFFFF, 0x0001, 1, 0x00000001); // 32-bit wrap
+    printf("prof_clock(): %u errors\n", (unsigned)fails);
+    return fails ? 1 : 0;
+} // main()
+#else
+int main(void)
+{
+    prof_struct p;
+    uint32_t    min = UINT32_MAX, max = 0, sum = 0, c;
+    uint16_t    hist[PROF_BINS] = {0};
+    uint8_t     bin;
+    
+    host_cycle_step = 7; // every PROF_CLOCK() call costs 7 cycles
+    prof_init();
+    CHECK(prof_ovh == 7);
+    CHECK(!prof_get(PROF_TIM2, &p));
+
+    srand(4);
+    for (uint16_t i = 0; i < 1000; i++)
+    {   // measure blocks of known length, with a spread of 1..2^20 cycles
+        c = (uint32_t)rand() % (1UL << (rand() % 21));
+        {
+            PROF_START(t0);
+            host_cycle_cnt += c;
+            PROF_STOP(PROF_TASK0 + 1, t0);
+        }
+        if (c < min) min = c;
+        if (c > max) max = c;
+        sum += c;
+        for (bin = 0; (c >> (bin + 1)) && (bin < PROF_BINS-1); bin++) ;
+        hist[bin]++;
+    } // for i
+    CHECK(prof_get(PROF_TASK0 + 1, &p));
+    CHECK(p.cnt == 1000);
+    CHECK(p.min == min);
+    CHECK(p.max == max);
+    CHECK(p.sum == sum);
+    CHECK(!memcmp(p.hist, hist, sizeof(hist)));
+    printf("1000 samples: min %u, mean %u, max %u cycles\n", 
+           (unsigned)p.min, (unsigned)(p.sum / p.cnt), (unsigned)p.max);
+    
+    for (uint32_t i = 0; i < 70000; i++) prof_add(PROF_TIM2, 1500 + prof_ovh);
+    CHECK(prof_get(PROF_TIM2, &p));
+    CHECK(p.sum / p.cnt == 1500); // cnt is halved at 65535, the mean stays
+    CHECK(p.hist[10] == UINT16_MAX); // 1024 <= 1500 < 2048, saturated
+    prof_add(PROF_SLOTS, 1); // out of range, ignored
+
+    host_cycle_step = 0;
+    for (uint16_t i = 0; i < 2 * LOAD_WINDOWS * 100; i++)
+    {   // 100 dispatches per window, 30 % of the time asleep
+        host_cycle_cnt += LOAD_WIN_CYCLES / 100;
+        load_add_idle(LOAD_WIN_CYCLES * 3 / 1000);
+    } // for i
+    CHECK(cpu_load() == 700);
+    printf("CPU load %u.%u %%, %u errors\n", cpu_load() / 10, cpu_load() % 10, 
+           (unsigned)fails);
+    return fails ? 1 : 0;
+} // main()
+#endif
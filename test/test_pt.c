@@ -0,0 +1,95 @@
+/*==================================================================
+  File Name: test_pt.c
+  Author   : Emile
+  ------------------------------------------------------------------
+  Purpose  : Host test of the coroutine tasks and run_now_task_h().
+             run_now_task_h() must only make a task ready: main() calls
+             it before interrupts are enabled, for a coroutine that 
+             waits for an I2C transfer that only an ISR can finish.
+             A coroutine called outside the scheduler must not write
+             outside task_list[].
+  ------------------------------------------------------------------
+  This file is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+ 
+  This software is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+ 
+  You should have received a copy of the GNU General Public License
+  along with this software.  If not, see <http://www.gnu.org/licenses/>.
+  ================================================================== */ 
+#include <stdio.h>
+#include "scheduler.h"
+
+extern task_struct task_list[];
+
+static uint32_t tick = 0;
+static uint16_t steps, done; // coroutine steps, complete runs
+static bool     xfer_done;   // set by the "ISR"
+
+uint32_t millis(void)
+{
+    return tick;
+} // millis()
+
+// Like clock_task(): waits for a transfer, sleeps and yields
+static void co_task(void)
+{
+    PT_BEGIN();
+    steps++;
+    PT_WAIT_UNTIL(xfer_done);
+    steps++;
+    PT_SLEEP_MS(100);
+    steps++;
+    PT_YIELD();
+    steps++;
+    done++;
+    PT_END();
+} // co_task()
+
+static uint32_t fails = 0;
+
+#define CHECK(c) if (!(c)) { fails++; printf("line %d: %s\n", __LINE__, #c); }
+
+int main(void)
+{
+    task_handle h;
+    
+    scheduler_init();
+    h = add_task(co_task, "co", 75, 20000);
+    CHECK(run_now_task_h(h) == NO_ERR);   // returns, interrupts are still off
+    CHECK(run_now_task_h(TASK_NONE) == ERR_NAME);
+    CHECK(steps == 0);
+    dispatch_tasks();                     // first pass: waits for the transfer
+    CHECK((steps == 1) && task_list[h].Pt_Line);
+    for (uint8_t i = 0; i < 10; i++) dispatch_tasks();
+    CHECK(steps == 1);
+    xfer_done = true;                     // the ISR finishes the transfer
+    dispatch_tasks();
+    CHECK((steps == 2) && (task_list[h].Status & TASK_SLEEP));
+    for (uint8_t i = 0; i < 10; i++) 
+    {   // sleeping, 10 ticks is not 100 msec.
+        scheduler_isr();
+        tick++;
+        dispatch_tasks();
+    } // for i
+    CHECK(steps == 2);
+    run_now_task_h(h);                    // wakes the coroutine up
+    CHECK(steps == 2);
+    dispatch_tasks();                     // runs till PT_YIELD()
+    CHECK(steps == 3);
+    dispatch_tasks();                     // runs to the end
+    CHECK((steps == 4) && (done == 1) && !task_list[h].Pt_Line);
+    CHECK(!(task_list[h].Status & TASK_READY));
+    dispatch_tasks();
+    CHECK(steps == 4);                    // not ready until the next period
+    task_list[h].Pt_Line = 0;
+    co_task();                            // called outside the scheduler: runs till PT_SLEEP_MS()
+    CHECK((steps == 6) && !task_list[h].Pt_Line && !(task_list[h].Status & TASK_SLEEP));
+    printf("coroutine and run_now_task_h(): %u errors\n", (unsigned)fails);
+    return fails ? 1 : 0;
+} // main()
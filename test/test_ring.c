@@ -0,0 +1,165 @@
+/*==================================================================
+  File Name: test_ring.c
+  Author   : Emile
+  ------------------------------------------------------------------
+  Purpose  : Host test of ring_buffer.h. Random single-byte and block
+             puts and gets are checked against a simple queue, also 
+             used/free/full/empty and the high-water mark. Then the
+             time per byte is compared with the ring buffer used before
+             (runtime size and buffer pointer, compare-and-branch wrap).
+  ------------------------------------------------------------------
+  This file is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+ 
+  This software is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+ 
+  You should have received a copy of the GNU General Public License
+  along with this software.  If not, see <http://www.gnu.org/licenses/>.
+  ================================================================== */ 
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "ring_buffer.h"
+
+//---------------------------------------------------------------
+// The previous ring buffer, only the functions used by the UARTs
+//---------------------------------------------------------------
+struct old_ring
+{
+    volatile uint8_t write_offset;
+    volatile uint8_t read_offset;
+    uint8_t          size;
+    uint8_t          *buffer;
+};
+
+static inline uint8_t old_next(uint8_t cur_offset, uint8_t max_offset)
+{
+   return ((cur_offset == max_offset-1) ? 0 : cur_offset + 1);
+} // old_next()
+
+static inline bool old_is_full(const struct old_ring *ring)
+{
+    return (ring->read_offset == old_next(ring->write_offset, ring->size));
+} // old_is_full()
+
+static inline bool old_is_empty(const struct old_ring *ring)
+{
+    uint8_t r = ring->read_offset;
+    return (r == ring->write_offset);
+} // old_is_empty()
+
+static inline uint8_t old_get(struct old_ring *ring)
+{
+    uint8_t data = ring->buffer[ring->read_offset];
+    ring->read_offset = old_next(ring->read_offset, ring->size);
+    return data;
+} // old_get()
+
+static inline void old_put(struct old_ring *ring, uint8_t data)
+{
+    ring->buffer[ring->write_offset] = data;
+    ring->write_offset = old_next(ring->write_offset, ring->size);
+} // old_put()
+
+static uint32_t fails = 0;
+
+#define CHECK(c) if (!(c)) { fails++; if (fails < 10) printf("line %d: %s\n", __LINE__, #c); }
+#define QN       ((uint16_t)(qt - qh)) /* bytes in q[] */
+#define BENCH_N  (20000000UL) /* bytes per benchmark */
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+} // now_sec()
+
+int main(void)
+{
+    static struct ring_buffer ring;
+    uint8_t  q[4096];         // reference queue
+    uint16_t qh = 0, qt = 0;  // head and tail in q[]
+    uint8_t  hw = 0, buf[64], n, k, x = 0;
+    uint32_t sum = 0;
+    double   t;
+    
+    srand(14);
+    ring_buffer_init(&ring);
+    CHECK(ring_buffer_is_empty(&ring) && (ring_buffer_free(&ring) == RING_SIZE));
+    for (uint32_t i = 0; i < 1000000; i++)
+    {
+        switch (rand() % 4)
+        {
+            case 0: if (!ring_buffer_is_full(&ring))
+                    {
+                        ring_buffer_put(&ring, x);
+                        q[qt++ & 0xFFF] = x++;
+                    } // if
+                    break;
+            case 1: if (!ring_buffer_is_empty(&ring))
+                    {
+                        CHECK(ring_buffer_get(&ring) == q[qh++ & 0xFFF]);
+                    } // if
+                    break;
+            case 2: n = rand() % (RING_SIZE + 8);
+                    for (k = 0; k < n; k++) buf[k] = x + k;
+                    k = ring_buffer_put_block(&ring, buf, n);
+                    CHECK(k == ((n < RING_SIZE - QN) ? n : RING_SIZE - QN));
+                    for (n = 0; n < k; n++) q[qt++ & 0xFFF] = x++;
+                    break;
+            default:n = rand() % (RING_SIZE + 8);
+                    k = ring_buffer_get_block(&ring, buf, n);
+                    CHECK(k == ((n < QN) ? n : QN));
+                    for (n = 0; n < k; n++) CHECK(buf[n] == q[qh++ & 0xFFF]);
+                    break;
+        } // switch
+        if (QN > hw) hw = QN;
+        CHECK(ring_buffer_used(&ring) == QN);
+        CHECK(ring_buffer_free(&ring) == RING_SIZE - QN);
+        CHECK(ring_buffer_is_full(&ring)  == (QN == RING_SIZE));
+        CHECK(ring_buffer_is_empty(&ring) == (qt == qh));
+        CHECK(ring_buffer_high_water(&ring) == hw);
+    } // for i
+    printf("1000000 random operations, high-water %u of %u: %u errors\n", 
+           ring_buffer_high_water(&ring), RING_SIZE, (unsigned)fails);
+
+    //-----------------------------------------------------------
+    // Benchmark: an ISR puts one byte, the main program gets it
+    //-----------------------------------------------------------
+    static uint8_t    old_buf[RING_SIZE];
+    struct old_ring   old = {0, 0, RING_SIZE, old_buf};
+    
+    t = now_sec();
+    for (uint32_t i = 0; i < BENCH_N; i++)
+    {
+        if (!old_is_full(&old)) old_put(&old, (uint8_t)i);
+        if (!old_is_empty(&old)) sum += old_get(&old);
+    } // for i
+    t = now_sec() - t;
+    printf("old ring   : %5.2f nsec. per byte\n", t * 1e9 / BENCH_N);
+    t = now_sec();
+    for (uint32_t i = 0; i < BENCH_N; i++)
+    {
+        if (!ring_buffer_is_full(&ring)) ring_buffer_put(&ring, (uint8_t)i);
+        if (!ring_buffer_is_empty(&ring)) sum -= ring_buffer_get(&ring);
+    } // for i
+    t = now_sec() - t;
+    printf("mask ring  : %5.2f nsec. per byte\n", t * 1e9 / BENCH_N);
+    t = now_sec();
+    for (uint32_t i = 0; i < BENCH_N; i += 16)
+    {   // 16-byte blocks, as the UART TX functions put them
+        for (k = 0; k < 16; k++) buf[k] = (uint8_t)(i + k);
+        ring_buffer_put_block(&ring, buf, 16);
+        ring_buffer_get_block(&ring, buf, 16);
+        sum += buf[0];
+    } // for i
+    t = now_sec() - t;
+    printf("block ring : %5.2f nsec. per byte (16-byte blocks)\n", t * 1e9 / BENCH_N);
+    return (fails || !sum) ? 1 : 0;
+} // main()
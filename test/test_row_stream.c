@@ -0,0 +1,72 @@
+/*==================================================================
+  File Name: test_row_stream.c
+  Author   : Emile
+  ------------------------------------------------------------------
+  Purpose  : Host test of the TIM2 row scan. The TIM2 ISR and the
+             pixel routines are compiled together with a model of
+             PORTC and the HC595 shift-registers. For every row, the
+             latched outputs must match rgb_bufr/g/b, and the PC0, PC6
+             and PC7 pins may never change. test/Makefile builds it
+             with ROW_STREAM=1 and ROW_STREAM=0, both print the number
+             of PORTC accesses per row.
+  ------------------------------------------------------------------
+  This file is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+ 
+  This software is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+ 
+  You should have received a copy of the GNU General Public License
+  along with this software.  If not, see <http://www.gnu.org/licenses/>.
+  ================================================================== */ 
+#include "panel.h"
+#include "../stm8_hw_init.c"
+#include "../pixel.c"
+
+int main(void)
+{
+    uint16_t er[MAX_Y], eg[MAX_Y], eb[MAX_Y];
+    uint32_t fails = 0, rows = 0, acc = 0;
+    
+    srand(1);
+    pc_odr = pc_ext = 0xC1; // PC7, PC6 and PC0 high
+    for (int frame = 0; frame < 200; frame++)
+    {
+        for (int n = rand() % MAX_Y; n >= 0; n--)
+        {   // change some pixels of the drawing buffer
+            setPixel(SCREEN, rand() % SIZE_X, rand() % MAX_Y, rand() & WHITE);
+        } // for n
+        if (frame == 0) init_frame_buffers();
+        else if (!present()) fails++;
+        memcpy(er, rgb_bufr, sizeof(er));
+        memcpy(eg, rgb_bufg, sizeof(eg));
+        memcpy(eb, rgb_bufb, sizeof(eb));
+        for (int i = 0; i < 2 * MAX_Y; i++)
+        {   // the swap is done after the frame shown now
+            uint8_t y = current_row;
+            uint32_t a = pc_acc;
+            
+            TIM2_UPD_OVF_IRQHandler();
+            pc_commit();
+            if (i >= MAX_Y)
+            {
+                acc += pc_acc - a;
+                rows++;
+                if ((latch[0] != mirror(er[y])) || (latch[1] != mirror(eg[y])) || 
+                    (latch[2] != mirror(eb[y]))) fails++;
+            } // if
+            if (y == MAX_Y / 2)
+            {   // the owner of PC6 changes it between two interrupts
+                pc_odr ^= 0x40;
+                pc_ext ^= 0x40;
+            } // if
+        } // for i
+    } // for frame
+    printf("ROW_STREAM=%d: %u rows, %.1f PORTC accesses per row, %u wrong rows, %u changes of PC0/6/7\n",
+           ROW_STREAM, (unsigned)rows, (double)acc / rows, (unsigned)fails, (unsigned)pc_err);
+    return (fails || pc_err) ? 1 : 0;
+} // main()
@@ -0,0 +1,124 @@
+/*==================================================================
+  File Name: test_sched_prio.c
+  Author   : Emile
+  ------------------------------------------------------------------
+  Purpose  : Host simulation of the dispatch order. The lichtkrant
+             task (every 6 frames) shares the CPU with a slow rtc task
+             that was added first, and with the esp, eep and cmd tasks.
+             Every task spends its run-time in scheduler ticks, so the
+             scheduler sees the time pass. The worst-case lateness of
+             the lichtkrant task is measured with the priorities in 
+             table order (as before priorities were added) and with 
+             PRIO_AUTO (deadline-monotonic), for every phase of the rtc
+             task within the 48 msec. lichtkrant period.
+             Run-times are estimates for the blocking tasks of that time:
+             rtc 15 msec. (DS3231 read, EEPROM write, sprintf), esp 2,
+             eep 1, cmd 1 and lichtkrant 3 msec.
+  ------------------------------------------------------------------
+  This file is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+ 
+  This software is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+ 
+  You should have received a copy of the GNU General Public License
+  along with this software.  If not, see <http://www.gnu.org/licenses/>.
+  ================================================================== */ 
+#include <stdio.h>
+#include <stdlib.h>
+#include "scheduler.h"
+#include "stm8_hw_init.h"
+
+#define MS(x)  ((x) * TICKS_PER_SEC / 1000)
+#define SIM_S  (8) /* simulated time per phase in seconds, 2 rtc runs */
+
+extern task_struct task_list[];
+extern uint8_t     max_tasks;
+
+static uint32_t tick = 0;
+
+uint32_t millis(void)
+{
+    return tick;
+} // millis()
+
+/*------------------------------------------------------------------
+  Purpose  : Let time pass: call the scheduler ISRs as the TIM2 ISR
+             does, scheduler_frame_isr() once every MAX_Y ticks.
+  Variables: n: the number of ticks
+  Returns  : -
+  ------------------------------------------------------------------*/
+static void spend(uint32_t n)
+{
+    while (n--)
+    {
+        scheduler_isr();
+        if (!(++tick % MAX_Y)) scheduler_frame_isr();
+        if (!(rand() % MS(500))) post_event(EV_UART1_LINE); // a command now and then
+    } // while
+} // spend()
+
+static void rtc(void)    { spend(MS(15)); }
+static void esp(void)    { spend(MS(2));  }
+static void eep(void)    { spend(MS(1));  }
+static void cmd(void)    { spend(MS(1));  }
+static void lkrant(void) { spend(MS(3));  }
+
+/*------------------------------------------------------------------
+  Purpose  : Simulate SIM_S seconds.
+  Variables: table_order: true = priorities in table order, 
+                          false = PRIO_AUTO for all tasks
+             delay      : initial delay of the rtc task in msec.
+  Returns  : the worst-case lateness of the lichtkrant task in ticks
+  ------------------------------------------------------------------*/
+static uint16_t simulate(bool table_order, uint16_t delay)
+{
+    task_handle h, lk;
+    
+    srand(9);
+    tick      = 0;
+    max_tasks = 0;
+    scheduler_init();
+    add_task(rtc, "rtc", delay, 20000);
+    add_task(esp, "esp", 100, 100);
+    add_task(eep, "eep", 0, 20);
+    h  = add_task(cmd, "cmd", 0, 1000);
+    set_task_events_h(h, EV_UART1_LINE);
+    lk = add_frame_task(lkrant, "lkrant", 12, 6);
+    if (table_order)
+    {
+        for (h = 0; h < max_tasks; h++) set_task_priority_h(h, h);
+    } // if
+    while (tick < SIM_S * TICKS_PER_SEC)
+    {
+        spend(1);
+        dispatch_tasks();
+    } // while
+    return task_list[lk].Late_Max;
+} // simulate()
+
+int main(void)
+{
+    uint16_t table = 0, prio = 0, t, p;
+    uint32_t tsum = 0, psum = 0;
+    
+    for (uint16_t d = 0; d < 48; d++)
+    {   // every phase of the rtc task, 1 msec. apart
+        t = simulate(true, d);
+        p = simulate(false, d);
+        if (t > table) table = t;
+        if (p > prio)  prio  = p;
+        tsum += t;
+        psum += p;
+    } // for d
+    printf("lichtkrant lateness (worst-case, mean of 48 phases):\n");
+    printf("  table order: %5.2f, %5.2f msec.\n", table * 1000.0 / TICKS_PER_SEC, 
+           tsum * 1000.0 / TICKS_PER_SEC / 48);
+    printf("  PRIO_AUTO  : %5.2f, %5.2f msec.\n", prio * 1000.0 / TICKS_PER_SEC, 
+           psum * 1000.0 / TICKS_PER_SEC / 48);
+    return ((prio < table) && (psum < tsum)) ? 0 : 1;
+} // main()
@@ -0,0 +1,83 @@
+/*==================================================================
+  File Name: test_sched_tick.c
+  Author   : Emile
+  ------------------------------------------------------------------
+  Purpose  : Host test of the scheduler tick with 32 tasks (MAX_TASKS
+             is set by test/Makefile). Built with SCHED_DEADLINE=1 and
+             SCHED_DEADLINE=0. Every task must run exactly once per
+             period during 10 sec. of ticks, both builds print the mean
+             time of scheduler_isr() per tick.
+  ------------------------------------------------------------------
+  This file is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+ 
+  This software is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+ 
+  You should have received a copy of the GNU General Public License
+  along with this software.  If not, see <http://www.gnu.org/licenses/>.
+  ================================================================== */ 
+#include <stdio.h>
+#include <time.h>
+#include "scheduler.h"
+
+#define NTASKS (32)
+#define TICKS  (10 * TICKS_PER_SEC)
+
+extern task_struct task_list[];
+extern uint8_t     sched_current;
+
+static uint32_t runs[NTASKS]; // number of runs of every task
+static uint32_t tick = 0;     // millis()
+
+uint32_t millis(void)
+{
+    return tick;
+} // millis()
+
+static void task(void)
+{
+    runs[sched_current]++;
+} // task()
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+} // now_ns()
+
+int main(void)
+{
+    uint32_t fails = 0, period;
+    uint64_t t, isr = 0, ovh = 0;
+    
+    scheduler_init();
+    for (uint8_t i = 0; i < NTASKS; i++)
+    {   // periods of 1..32 msec., task i has handle i
+        if (add_task(task, "t", 0, i + 1) != i) fails++;
+    } // for i
+    if (add_task(task, "full", 0, 1) != TASK_NONE) fails++;
+    for (tick = 1; tick <= TICKS; tick++)
+    {
+        t = now_ns();
+        scheduler_isr();
+        isr += now_ns() - t;
+        t = now_ns();
+        ovh += now_ns() - t;
+        dispatch_tasks();
+    } // for tick
+    for (uint8_t i = 0; i < NTASKS; i++)
+    {   // a task with a period of p ticks runs at p, 2p, ...
+        period = (i + 1) * TICKS_PER_SEC / 1000;
+        if ((runs[i] != TICKS / period) || task_list[i].Missed) fails++;
+    } // for i
+    printf("SCHED_DEADLINE=%d, %d tasks: %.1f nsec. per tick, %u errors\n", SCHED_DEADLINE, 
+           NTASKS, (double)(isr - ovh) / TICKS, (unsigned)fails);
+    return fails ? 1 : 0;
+} // main()
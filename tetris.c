@@ -59,7 +59,7 @@ uint16_t fieldb[TETRIS_SIZE_Y]; // Tetris playfield blue-colors
   -------------------------------------------------------------------------*/
 void tetrisInputs(void)
 {
-    joystick = (PF_IDR & STICK_ALL); // Joystick is connected to PORTF: PF7..PF3
+    joystick = get_stick(); // Joystick is connected to PORTF: PF7..PF3, debounced
     if (((old_joystick ^ joystick) & (STICK_LEFT | STICK_DOWN)) == (STICK_LEFT | STICK_DOWN))
     {	// LEFT & DOWN button pressed at the same time?
         if ((joystick & (STICK_LEFT | STICK_DOWN)) == (STICK_LEFT | STICK_DOWN))
@@ -606,7 +606,7 @@ bool shouldPlace(int8_t x, int8_t y, uint8_t shape, uint8_t rotation)
   -------------------------------------------------------------------------*/
 void drawShape(bool screen, int8_t x, int8_t y, uint8_t shape, uint8_t rotation)
 {
-    uint8_t col; // fixed colour per Tetris block type
+    uint8_t col = 0; // fixed colour per Tetris block type, 0 = unknown shape
 
     switch (shape)
     {
@@ -773,6 +773,7 @@ void copyFieldToScreen(void)
         rgb_bufg[y] |= (fieldg[y] & TETRIS_MASK_X); // add green playfield bits
         rgb_bufb[y] &= ~TETRIS_MASK_X; // Clear Tetris blue playfield bits
         rgb_bufb[y] |= (fieldb[y] & TETRIS_MASK_X); // add blue playfield bits
+        mark_row_dirty(y);
     } // for y
 } // copyFieldToScreen()
 
@@ -867,7 +868,7 @@ void tetrisGameScreen(void)
     if (level > MAX_LEVEL) level = MAX_LEVEL;
     if (level >= 8) 
          mpy = 5;
-    else mpy = 1 + level>>1;
+    else mpy = (1 + level) >> 1;
 
     if (gameFlags & (1<<PLACE_SHAPE)) // Check whether we need to save shape this frame
     {
@@ -1089,4 +1090,5 @@ void tetrisMain(void)
         default: screen = 0; // Menu Screen
                  break;
     } // switch
+    present(); // show new frame, clearScreen() above is never visible
 } // tetris_main(()
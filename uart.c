@@ -19,28 +19,71 @@
   along with this software.  If not, see <http://www.gnu.org/licenses/>.
   ================================================================== */ 
 #include <stdio.h>
+#include <string.h>
 #include "delay.h"
 #include "uart.h"
 #include "ring_buffer.h"
+#include "profiler.h"
+#include "scheduler.h"
+#include "esp8266.h"
 
 // buffers for use with the ring buffer (belong to the USART)
-bool     ovf_buf_in1; // true = input buffer overflow
-bool     ovf_buf_in3; // true = input buffer overflow
 uint16_t isr1_cnt = 0;
 uint16_t isr3_cnt = 0;
 
 struct ring_buffer ring_buffer_out1;
-struct ring_buffer ring_buffer_in1;
-uint8_t            out1_buffer[TX_BUF_SIZE];
-uint8_t            in1_buffer[RX_BUF_SIZE];
 struct ring_buffer ring_buffer_out3;
-struct ring_buffer ring_buffer_in3;
-uint8_t            out3_buffer[TX_BUF_SIZE];
-uint8_t            in3_buffer[RX_BUF_SIZE];
 
 uint8_t ch;       // debug
 uint8_t uart1_sr; // debug
 
+// UART1 receive: the ISR assembles complete lines
+line_buf rx1_line;              // command lines received by UART1
+uint16_t rx1_overrun = 0;       // bytes lost by the UART (OR flag)
+
+// UART1 receive: binary frames, double-buffered like rx1_line
+#define BIN_IDLE (0) /* receiving text */
+#define BIN_SYNC (1) /* BIN_SYNC1 received, expect BIN_SYNC2 */
+#define BIN_TYPE (2) /* expect type byte */
+#define BIN_LEN  (3) /* expect len byte */
+#define BIN_DATA (4) /* receiving payload */
+#define BIN_CRCH (5) /* expect MSB of crc */
+#define BIN_CRCL (6) /* expect LSB of crc */
+
+uint8_t  bin1[2][BIN_BUFLEN];   // double-buffered frame store
+uint8_t  bin1_state = BIN_IDLE; // receive state, see BIN_IDLE..BIN_CRCL
+uint8_t  bin1_wr    = 0;        // index of bin1[] filled by the ISR
+uint8_t  bin1_rd    = 0;        // index of bin1[] to read next
+uint8_t  bin1_pos   = 0;        // write index in bin1[bin1_wr]
+uint8_t  bin1_type  = 0;        // type of the current frame
+uint8_t  bin1_len   = 0;        // payload length of the current frame
+bool     bin1_lost  = false;    // true = bin1[bin1_wr] was full at the start of the frame
+uint8_t  bin1_t[2];             // type of the frame in bin1[i]
+uint8_t  bin1_n[2];             // payload length of the frame in bin1[i]
+uint8_t  bin1_s[2];             // source of the frame in bin1[i] [SRC_UART1, SRC_WIFI]
+uint8_t  bin1_src   = SRC_UART1; // source of the current frame
+uint8_t  bin1_rdy   = 0;        // bit i set: bin1[i] holds a complete frame
+uint16_t bin1_crc;              // crc calculated over the current frame
+uint16_t bin1_crc_rx;           // crc received
+uint16_t rx1_frames = 0;        // frames received correctly
+uint16_t rx1_crc    = 0;        // frames with a crc error
+uint16_t rx1_hdr    = 0;        // frames with an unknown type or length
+uint16_t rx1_flost  = 0;        // frames lost, both frame buffers were full
+
+// Baud-rates, the BRR registers are calculated from the master clock
+uint32_t fmaster = FMASTER(HSE); // master clock in Hz, set by uart1_init()
+uint32_t baud1   = UART1_BAUD;   // actual baud-rate setting of UART1
+uint32_t baud3   = UART3_BAUD;   // actual baud-rate setting of UART3
+
+// UART1 transmit: blocking or non-blocking writes into ring_buffer_out1
+bool     tx1_nonblock = false;  // true = drop bytes instead of waiting
+putc_fn  tx1_sink     = NULL;   // != NULL: UART1 output goes here, see uart1_redirect()
+uint16_t tx1_drop     = 0;      // bytes dropped in non-blocking mode
+
+// Powers of 10 for uart1_putu(): digits by subtraction, no 32-bit division
+static const uint32_t dec_pow[10] = {1000000000UL, 100000000UL, 10000000UL, 
+                            1000000UL, 100000UL, 10000UL, 1000UL, 100UL, 10UL, 1UL};
+
 //-----------------------------------------------------------------------------
 // UART Transmit complete Interrupt.
 //
@@ -53,6 +96,8 @@ uint8_t uart1_sr; // debug
 #pragma vector=UART1_T_TXE_vector
 __interrupt void UART1_TX_IRQHandler()
 {
+    IDLE_WAKEUP();  // end of idle time
+    PROF_START(t0); // cycles of this ISR
 	if (!ring_buffer_is_empty(&ring_buffer_out1))
 	{   // if there is data in the ring buffer, fetch it and send it
 		UART1_DR = ring_buffer_get(&ring_buffer_out1);
@@ -61,8 +106,154 @@ __interrupt void UART1_TX_IRQHandler()
     {   // no more data to send, turn off interrupt
         UART1_CR2_TIEN = 0;
     } // else
+    PROF_STOP(PROF_UART1_TX,t0);
 } /* UART1_TX_IRQHandler() */
 
+/*------------------------------------------------------------------
+  Purpose  : This function checks the payload length of a binary frame.
+  Variables: type: [BIN_FRAME, BIN_ROWS, BIN_XRLE, BIN_CMD]
+             len : the payload length
+  Returns  : true if len is valid for this type
+  ------------------------------------------------------------------*/
+static inline bool bin1_len_ok(uint8_t type, uint8_t len)
+{
+    switch (type)
+    {
+        case BIN_FRAME: return (len == BIN_FRAME_LEN);
+        case BIN_ROWS : return (len <= BIN_ROWS_LEN) && !(len % BIN_ROW_SIZE);
+        case BIN_CMD  : return (len > 0) && (len <= UART_BUFLEN); // opcode + args
+        default       : return (len > 0) && (len <= BIN_FRAME_LEN); // BIN_XRLE
+    } // switch
+} // bin1_len_ok()
+
+/*------------------------------------------------------------------
+  Purpose  : This function receives one byte of a binary frame, the
+             payload goes straight into bin1[bin1_wr]. A correct frame
+             is handed over with EV_UART1_FRAME. Called from the 
+             UART1 RX ISR after BIN_SYNC1 was received.
+  Variables: ch: the byte received
+  Returns  : -
+  ------------------------------------------------------------------*/
+static inline void bin1_rx(uint8_t ch)
+{
+    switch (bin1_state)
+    {
+        case BIN_SYNC: bin1_state = (ch == BIN_SYNC2) ? BIN_TYPE : BIN_IDLE;
+                       break;
+        case BIN_TYPE: bin1_crc   = crc16_ccitt(0xFFFF, ch);
+                       bin1_type  = ch;
+                       bin1_state = ((ch >= BIN_FRAME) && (ch <= BIN_CMD)) ? BIN_LEN : BIN_IDLE;
+                       if (bin1_state == BIN_IDLE) rx1_hdr++;
+                       break;
+        case BIN_LEN : bin1_crc   = crc16_ccitt(bin1_crc, ch);
+                       bin1_len   = ch;
+                       bin1_pos   = 0;
+                       // a buffer freed halfway the frame is not used, it
+                       // would hold the start of the old frame
+                       bin1_lost  = (bin1_rdy & (1 << bin1_wr)) != 0;
+                       if (!bin1_len_ok(bin1_type, ch))
+                       {
+                           bin1_state = BIN_IDLE;
+                           rx1_hdr++;
+                       } // if
+                       else bin1_state = ch ? BIN_DATA : BIN_CRCH; // no payload
+                       break;
+        case BIN_DATA: bin1_crc = crc16_ccitt(bin1_crc, ch);
+                       if (!bin1_lost)
+                       {   // the buffer is free, else the frame is lost
+                           bin1[bin1_wr][bin1_pos] = ch;
+                       } // if
+                       if (++bin1_pos == bin1_len) bin1_state = BIN_CRCH;
+                       break;
+        case BIN_CRCH: bin1_crc_rx = (uint16_t)ch << 8;
+                       bin1_state  = BIN_CRCL;
+                       break;
+        default      : bin1_state = BIN_IDLE; // BIN_CRCL
+                       if ((bin1_crc_rx | ch) != bin1_crc) rx1_crc++;
+                       else if (bin1_lost) rx1_flost++;
+                       else
+                       {   // frame is complete and correct
+                           bin1_t[bin1_wr] = bin1_type;
+                           bin1_n[bin1_wr] = bin1_len;
+                           bin1_s[bin1_wr] = bin1_src;
+                           bin1_rdy |= (1 << bin1_wr);
+                           bin1_wr  ^= 0x01; // continue in the other buffer
+                           rx1_frames++;
+                           post_event(EV_UART1_FRAME);
+                       } // else
+                       break;
+    } // switch
+} // bin1_rx()
+
+/*------------------------------------------------------------------
+  Purpose  : This function feeds one byte to the binary frame receiver.
+             A frame starts with BIN_SYNC1 at the start of a line. Frames 
+             received over WiFi (see esp8266.c) also end up in bin1[],
+             so only one source should send frames at a time.
+  Variables: ch : the byte received
+             sol: true = ch is at the start of a line
+             src: where ch comes from [SRC_UART1, SRC_WIFI]
+  Returns  : true if ch is part of a binary frame, false if it is text
+  ------------------------------------------------------------------*/
+bool uart1_frame_rx(uint8_t ch, bool sol, uint8_t src)
+{
+	if (bin1_state != BIN_IDLE)
+	{   // binary frame in progress
+	    bin1_rx(ch);
+	} // if
+	else if ((ch == BIN_SYNC1) && sol)
+	{   // start of a binary frame
+	    bin1_state = BIN_SYNC;
+	    bin1_src   = src;
+	} // else if
+	else return false;
+	return true;
+} // uart1_frame_rx()
+
+/*------------------------------------------------------------------
+  Purpose  : This function adds one received byte to a line store, so
+             the main program never has to poll for single characters.
+             '\r' is ignored, '\n' ends a line and posts lb->ev. When
+             both line buffers are full, the line is lost. Called from
+             an ISR only.
+  Variables: lb: the line store
+             ch: the byte received
+  Returns  : -
+  ------------------------------------------------------------------*/
+void line_rx(line_buf *lb, uint8_t ch)
+{
+	if (lb->rdy & (1 << lb->wr))
+	{   // both line buffers are full, drop input until one is read
+	    if (ch == '\n') lb->lost++;
+	} // if
+	else if (ch == '\n')
+	{   // line is complete
+	    lb->line[lb->wr][lb->pos] = '\0';
+	    lb->rdy  |= (1 << lb->wr);
+	    lb->wr   ^= 0x01; // continue in the other buffer
+	    lb->pos   = 0;
+	    if (lb->trunc) lb->ntrunc++;
+	    lb->trunc = false;
+	    post_event(lb->ev);
+	} // else if
+	else if (ch != '\r')
+	{
+	    if (lb->pos < UART_BUFLEN-1) lb->line[lb->wr][lb->pos++] = ch;
+	    else                         lb->trunc = true;
+	} // else if
+} // line_rx()
+
+/*------------------------------------------------------------------
+  Purpose  : This function handles one byte received by UART1: binary
+             frames go to bin1_rx(), text to the line store rx1_line.
+  Variables: ch: the byte received
+  Returns  : -
+  ------------------------------------------------------------------*/
+void uart1_rx_byte(uint8_t ch)
+{
+	if (!uart1_frame_rx(ch, rx1_line.pos == 0, SRC_UART1)) line_rx(&rx1_line, ch);
+} // uart1_rx_byte()
+
 //-----------------------------------------------------------------------------
 // UART Receive Complete Interrupt.
 
@@ -75,18 +266,14 @@ __interrupt void UART1_TX_IRQHandler()
 #pragma vector=UART1_R_RXNE_vector
 __interrupt void UART1_RX_IRQHandler(void)
 {
-	if (!ring_buffer_is_full(&ring_buffer_in1))
-	{
-	    ring_buffer_put(&ring_buffer_in1, UART1_DR);
-	    ovf_buf_in1 = false;
-	} // if
-	else
-	{
-            uart1_sr    = UART1_SR; // Clear IDLE and Overrun errors
-            ch          = UART1_DR;
-	    ovf_buf_in1 = true;
-	} // else
+    IDLE_WAKEUP();  // end of idle time
+    PROF_START(t0); // cycles of this ISR
+	uart1_sr = UART1_SR; // read SR before DR, this clears the Overrun flag
+	ch       = UART1_DR;
+	if (uart1_sr & UART_SR_OR) rx1_overrun++;
+	uart1_rx_byte(ch);
 	isr1_cnt++;
+    PROF_STOP(PROF_UART1_RX,t0);
 } /* UART1_RX_IRQHandler() */
 
 //-----------------------------------------------------------------------------
@@ -101,6 +288,8 @@ __interrupt void UART1_RX_IRQHandler(void)
 #pragma vector=UART3_T_TXE_vector
 __interrupt void UART3_TX_IRQHandler()
 {
+    IDLE_WAKEUP();  // end of idle time
+    PROF_START(t0); // cycles of this ISR
 	if (!ring_buffer_is_empty(&ring_buffer_out3))
 	{   // if there is data in the ring buffer, fetch it and send it
 		UART3_DR = ring_buffer_get(&ring_buffer_out3);
@@ -109,6 +298,7 @@ __interrupt void UART3_TX_IRQHandler()
     {   // no more data to send, turn off interrupt
         UART3_CR2_TIEN = 0;
     } // else
+    PROF_STOP(PROF_UART3_TX,t0);
 } /* UART3_TX_IRQHandler() */
 
 //-----------------------------------------------------------------------------
@@ -119,28 +309,117 @@ __interrupt void UART3_TX_IRQHandler()
 // RDR shift register has been transferred to the UART3_DR register. An interrupt 
 // is generated if RIEN=1 in the UART3_CR2 register. It is cleared by a read to 
 // the UART3_DR register. It can also be cleared by writing 0.
+//
+// UART3 is connected to the ESP8266, every byte goes to esp_rx().
 //-----------------------------------------------------------------------------
 #pragma vector=UART3_R_RXNE_vector
 __interrupt void UART3_RX_IRQHandler(void)
 {
-	volatile uint8_t ch;
-	
-	if (!ring_buffer_is_full(&ring_buffer_in3))
-	{
-		ring_buffer_put(&ring_buffer_in3, UART1_DR);
-		ovf_buf_in3 = false;
-	} // if
-	else
-	{
-		ch = UART3_DR; // clear RXNE flag
-		ovf_buf_in3 = true;
-	} // else
+    IDLE_WAKEUP();  // end of idle time
+    PROF_START(t0); // cycles of this ISR
+	esp_rx(UART3_DR);
 	isr3_cnt++;
+    PROF_STOP(PROF_UART3_RX,t0);
 } /* UART3_RX_IRQHandler() */
 
 /*------------------------------------------------------------------
-  Purpose  : This function initializes UART 1 to 38400,N,8,1
-             Master clock is 24 MHz, baud-rate is 38400 Baud.
+  Purpose  : This function calculates the baud-rate divider for the
+             current master clock: UART_DIV = fmaster / baud, rounded.
+  Variables: baud: the baud-rate, BAUD_MIN..BAUD_MAX
+  Returns  : UART_DIV, 0 if the baud-rate can not be made
+  ------------------------------------------------------------------*/
+static uint16_t baud_div(uint32_t baud)
+{
+    uint32_t div;
+    
+    if ((baud < BAUD_MIN) || (baud > BAUD_MAX)) return 0;
+    div = (fmaster + (baud >> 1)) / baud;
+    if ((div < 16) || (div > 0xFFFF)) return 0; // limits of UART_DIV
+    return (uint16_t)div;
+} // baud_div()
+
+/*------------------------------------------------------------------
+  Purpose  : This function returns the error of the actual baud-rate
+             (fmaster / UART_DIV) compared to the requested one.
+  Variables: baud: the requested baud-rate
+  Returns  : error in 0.01 %, BAUD_INVALID if the baud-rate can not
+             be made with the current master clock
+  ------------------------------------------------------------------*/
+int16_t uart_baud_err(uint32_t baud)
+{
+    uint16_t div = baud_div(baud);
+    int32_t  err;
+    
+    if (!div) return BAUD_INVALID;
+    err = (int32_t)(fmaster / div) - (int32_t)baud;
+    return (int16_t)(err * 10000 / (int32_t)baud);
+} // uart_baud_err()
+
+/*------------------------------------------------------------------
+  Purpose  : This function checks if a baud-rate can be used: it can
+             be made with the current master clock and the error is 
+             less than UART_MAX_ERR.
+  Variables: baud: the requested baud-rate
+  Returns  : UART_DIV, 0 if the baud-rate can not be used
+  ------------------------------------------------------------------*/
+static uint16_t baud_ok(uint32_t baud)
+{
+    int16_t err = uart_baud_err(baud);
+    
+    if ((err == BAUD_INVALID) || (err > UART_MAX_ERR) || (err < -UART_MAX_ERR)) return 0;
+    return baud_div(baud);
+} // baud_ok()
+
+/*------------------------------------------------------------------
+  Purpose  : This function sets the baud-rate of UART 1. Bytes still
+             in the transmit ring are sent first with the old rate.
+  Variables: baud: the baud-rate, BAUD_MIN..BAUD_MAX
+  Returns  : true if the baud-rate was set
+  ------------------------------------------------------------------*/
+bool uart1_set_baud(uint32_t baud)
+{
+    uint16_t div = baud_ok(baud);
+    
+    if (!div) return false;
+    while (!ring_buffer_is_empty(&ring_buffer_out1) || !UART1_SR_TC) ; // wait until all is sent
+    UART1_BRR2 = ((div >> 8) & 0xF0) | (div & 0x0F); // BRR2 must be written first
+    UART1_BRR1 = (uint8_t)(div >> 4);
+    baud1      = baud;
+    return true;
+} // uart1_set_baud()
+
+/*------------------------------------------------------------------
+  Purpose  : This function sets the baud-rate of UART 3. Bytes still
+             in the transmit ring are sent first with the old rate.
+  Variables: baud: the baud-rate, BAUD_MIN..BAUD_MAX
+  Returns  : true if the baud-rate was set
+  ------------------------------------------------------------------*/
+bool uart3_set_baud(uint32_t baud)
+{
+    uint16_t div = baud_ok(baud);
+    
+    if (!div) return false;
+    while (!ring_buffer_is_empty(&ring_buffer_out3) || !UART3_SR_TC) ; // wait until all is sent
+    UART3_BRR2 = ((div >> 8) & 0xF0) | (div & 0x0F); // BRR2 must be written first
+    UART3_BRR1 = (uint8_t)(div >> 4);
+    baud3      = baud;
+    return true;
+} // uart3_set_baud()
+
+/*------------------------------------------------------------------
+  Purpose  : This function returns the baud-rate of UART 1 or UART 3.
+  Variables: uart: [1,3]
+  Returns  : the baud-rate
+  ------------------------------------------------------------------*/
+uint32_t uart_get_baud(uint8_t uart)
+{
+    return (uart == 3) ? baud3 : baud1;
+} // uart_get_baud()
+
+/*------------------------------------------------------------------
+  Purpose  : This function initializes UART 1 to UART1_BAUD,N,8,1.
+             The baud-rate registers are calculated from the master 
+             clock, use uart1_set_baud() for another baud-rate.
   Variables: clk: which clock is active: HSI (0xE1), HSE (0xB4) or LSI (0xD2)
   Returns  : -
   ------------------------------------------------------------------*/
@@ -163,30 +442,19 @@ void uart1_init(uint8_t clk)
     UART1_PSCR = 0;
 
     // initialize the in and out buffer for the UART
-    ring_buffer_out1 = ring_buffer_init(out1_buffer, TX_BUF_SIZE);
-    ring_buffer_in1  = ring_buffer_init(in1_buffer , RX_BUF_SIZE);
-
-    //  Now setup the port to 115200,N,8,1.
-    //   8 MHz:  69 = 0x0045, BRR1=0x04, BRR2=0x05, err=+0.64%
-    //  16 MHz: 139 = 0x008B, BRR1=0x08, BRR2=0x0B, err=-0.08%
-    //  24 MHz: 208 = 0x00D0, BRR1=0x0D, BRR2=0x00, err=+0.16%
-    // 24 MHz: 1250 = 0x04E2, BRR1=0x4E, BRR2=0x02 for 19200 Baud
-    // 24 MHz:  625 = 0x0271, BRR1=0x27, BRR2=0x01 for 38400 Baud
+    ring_buffer_init(&ring_buffer_out1);
+    line_init(&rx1_line, EV_UART1_LINE);
+    bin1_wr  = bin1_rd  = bin1_rdy  = 0;
+    bin1_state = BIN_IDLE;
+
+    //  Now setup the port to UART1_BAUD,N,8,1.
+    //  UART_DIV = fmaster / baud, e.g. 24 MHz: 625 = 0x0271 for 38400 Baud,
+    //  208 = 0x00D0 for 115200 Baud (err=+0.16%)
     UART1_CR1_M    = 0;     //  8 Data bits.
     UART1_CR1_PCEN = 0;     //  Disable parity.
     UART1_CR3_STOP = 0;     //  1 stop bit.
-    if (clk == HSE)
-    {   // external HSE oscillator
-        //UART1_BRR2     = 0x00;  //  Set the baud rate registers to 115200 baud
-        //UART1_BRR1     = 0x0D;  //  based upon a 24 MHz system clock.
-        UART1_BRR2     = 0x01;  //  Set the baud rate registers to 38400 baud
-        UART1_BRR1     = 0x27;  //  based upon a 24 MHz system clock.
-    } // if
-    else
-    {   // internal HSI oscillator
-        UART1_BRR2     = 0x0B;  //  Set the baud rate registers to 115200 baud
-        UART1_BRR1     = 0x08;  //  based upon a 16 MHz system clock.
-    } // else
+    fmaster        = FMASTER(clk);
+    uart1_set_baud(UART1_BAUD);
 
     //  Disable the transmitter and receiver.
     UART1_CR2_TEN = 0;      //  Disable transmit.
@@ -207,8 +475,8 @@ void uart1_init(uint8_t clk)
 } // uart1_init()
 
 /*------------------------------------------------------------------
-  Purpose  : This function initializes UART 3 to 115200,N,8,1
-             Master clock is 24 MHz, baud-rate is 115200 Baud.
+  Purpose  : This function initializes UART 3 to UART3_BAUD,N,8,1.
+             Call uart1_init() first, it sets the master clock.
   Variables: clk: which clock is active: HSI (0xE1), HSE (0xB4) or LSI (0xD2)
   Returns  : -
   ------------------------------------------------------------------*/
@@ -228,26 +496,14 @@ void uart3_init(uint8_t clk)
     UART3_CR4 = 0;
 
     // initialize the in and out buffer for the UART
-    ring_buffer_out3 = ring_buffer_init(out3_buffer, TX_BUF_SIZE);
-    ring_buffer_in3  = ring_buffer_init(in3_buffer , RX_BUF_SIZE);
+    ring_buffer_init(&ring_buffer_out3);
 
-    //  Now setup the port to 115200,N,8,1.
-    //   8 MHz:  69 = 0x0045, BRR1=0x04, BRR2=0x05, err=+0.64%
-    //  16 MHz: 139 = 0x008B, BRR1=0x08, BRR2=0x0B, err=-0.08%
-    //  24 MHz: 208 = 0x00D0, BRR1=0x0D, BRR2=0x00, err=+0.16%
+    //  Now setup the port to UART3_BAUD,N,8,1.
     UART3_CR1_M    = 0;     //  8 Data bits.
     UART3_CR1_PCEN = 0;     //  Disable parity.
     UART3_CR3_STOP = 0;     //  1 stop bit.
-    if (clk == HSE)
-    {   // external HSE oscillator
-        UART3_BRR2     = 0x00;  //  Set the baud rate registers to 115200 baud
-        UART3_BRR1     = 0x0D;  //  based upon a 24 MHz system clock.
-    } // if
-    else
-    {   // internal HSI oscillator
-        UART3_BRR2     = 0x0B;  //  Set the baud rate registers to 115200 baud
-        UART3_BRR1     = 0x08;  //  based upon a 16 MHz system clock.
-    } // else
+    fmaster        = FMASTER(clk);
+    uart3_set_baud(UART3_BAUD);
 
     //  Disable the transmitter and receiver.
     UART3_CR2_TEN = 0;      //  Disable transmit.
@@ -261,14 +517,25 @@ void uart3_init(uint8_t clk)
 } // uart3_init()
 
 /*------------------------------------------------------------------
-  Purpose  : This function writes one data-byte to UART 1.	
+  Purpose  : This function writes one data-byte to UART 1. In blocking
+             mode it waits until there is room in the transmit ring,
+             in non-blocking mode the byte is dropped (and counted).
   Variables: ch: the byte to send to the uart.
-  Returns  : -
+  Returns  : 1 if the byte was written, 0 if it was dropped
   ------------------------------------------------------------------*/
-void uart1_putc(uint8_t ch)
+uint8_t uart1_putc(uint8_t ch)
 {    
+    if (tx1_sink) return tx1_sink(ch); // redirected, see uart1_redirect()
     // At 115200 Baud, sending 1 byte takes a max. of 90 usec.
-    while (ring_buffer_is_full(&ring_buffer_out1)) delay_msec(1);
+    while (ring_buffer_is_full(&ring_buffer_out1))
+    {
+        if (tx1_nonblock)
+        {
+            tx1_drop++;
+            return 0;
+        } // if
+        delay_msec(1);
+    } // while
     __disable_interrupt(); // Disable interrupts to get exclusive access to ring_buffer_out
     if (ring_buffer_is_empty(&ring_buffer_out1))
     {
@@ -276,8 +543,60 @@ void uart1_putc(uint8_t ch)
     } // if
     ring_buffer_put(&ring_buffer_out1, ch); // Put data in buffer
     __enable_interrupt(); // Re-enable interrupts
+    return 1;
 } // uart1_putc()
 
+/*------------------------------------------------------------------
+  Purpose  : This function writes a block of bytes to UART 1, without
+             any conversion (no CR is added). The bytes are copied into
+             the transmit ring in at most two spans. In non-blocking
+             mode, only the bytes that fit are written.
+  Variables: p  : the bytes to send
+             len: the number of bytes in p
+  Returns  : the number of bytes written
+  ------------------------------------------------------------------*/
+uint8_t uart1_write(const uint8_t *p, uint8_t len)
+{
+    uint8_t n = 0;
+    
+    if (tx1_sink)
+    {   // redirected, see uart1_redirect()
+        while ((n < len) && tx1_sink(p[n])) n++;
+        return n;
+    } // if
+    while (n < len)
+    {
+        while (ring_buffer_is_full(&ring_buffer_out1))
+        {
+            if (tx1_nonblock)
+            {
+                tx1_drop += len - n;
+                return n;
+            } // if
+            delay_msec(1);
+        } // while
+        __disable_interrupt(); // Disable interrupts to get exclusive access to ring_buffer_out
+        if (ring_buffer_is_empty(&ring_buffer_out1))
+        {
+            UART1_CR2_TIEN = 1; // First data in buffer, enable data ready interrupt
+        } // if
+        n += ring_buffer_put_block(&ring_buffer_out1, p + n, len - n);
+        __enable_interrupt(); // Re-enable interrupts
+    } // while
+    return n;
+} // uart1_write()
+
+/*------------------------------------------------------------------
+  Purpose  : This function tells if uart3_putc() can write a byte
+             without waiting.
+  Variables: -
+  Returns  : true if the transmit ring of UART 3 is not full
+  ------------------------------------------------------------------*/
+bool uart3_tx_room(void)
+{
+    return !ring_buffer_is_full(&ring_buffer_out3);
+} // uart3_tx_room()
+
 /*------------------------------------------------------------------
   Purpose  : This function writes one data-byte to UART 3.	
   Variables: ch: the byte to send to the uart.
@@ -301,22 +620,180 @@ void uart3_putc(uint8_t ch)
              the uart1_putc() routine.
   Variables:
          s : The string to write to UART 3
-  Returns  : the number of characters written
+  Returns  : the number of characters written, this is less than
+             strlen(s) (plus CRs) if the transmit ring was full
+             in non-blocking mode.
   ------------------------------------------------------------------*/
-void uart1_printf(char *s)
+uint8_t uart1_printf(const char *s)
 {
-    char *ch = s;
+    const char *ch = s;
+    uint8_t    n   = 0;
+    
     while (*ch)
     {
         if (*ch == '\n')
         {
-            uart1_putc('\r'); // add CR
+            if (!uart1_putc('\r')) break; // add CR
+            n++;
         } // if
-        uart1_putc(*ch);
+        if (!uart1_putc(*ch)) break;
+        n++;
         ch++;                //  Grab the next character.
     } // while
+    return n;
 } // uart1_printf()
 
+/*------------------------------------------------------------------
+  Purpose  : This function selects blocking or non-blocking output
+             for UART 1. In non-blocking mode, uart1_putc() and the
+             formatting functions never wait for the transmit ring,
+             they return the number of characters actually written.
+  Variables: nb: true = non-blocking, false = blocking (default)
+  Returns  : the previous mode
+  ------------------------------------------------------------------*/
+bool uart1_nonblock(bool nb)
+{
+    bool prev = tx1_nonblock;
+    
+    tx1_nonblock = nb;
+    return prev;
+} // uart1_nonblock()
+
+/*------------------------------------------------------------------
+  Purpose  : This function redirects all UART 1 output (uart1_putc(),
+             uart1_write() and the formatting functions) to another
+             sink, e.g. to send a command reply over WiFi. Tasks do
+             not preempt each other, so the task that redirects the
+             output must restore it before it returns.
+  Variables: sink: the new output function, NULL = UART 1 itself
+  Returns  : the previous sink
+  ------------------------------------------------------------------*/
+putc_fn uart1_redirect(putc_fn sink)
+{
+    putc_fn prev = tx1_sink;
+    
+    tx1_sink = sink;
+    return prev;
+} // uart1_redirect()
+
+/*------------------------------------------------------------------
+  Purpose  : This function writes a number of pad characters to UART 1.
+  Variables: pad: the pad character, n: the number of characters
+  Returns  : the number of characters written
+  ------------------------------------------------------------------*/
+static uint8_t uart1_pad(char pad, uint8_t n)
+{
+    uint8_t i;
+    
+    for (i = 0; i < n; i++)
+    {
+        if (!uart1_putc(pad)) break;
+    } // for i
+    return i;
+} // uart1_pad()
+
+/*------------------------------------------------------------------
+  Purpose  : This function returns the number of decimal digits of v.
+  Variables: v: the number
+  Returns  : 1..10
+  ------------------------------------------------------------------*/
+static uint8_t ndigits(uint32_t v)
+{
+    uint8_t i = 0;
+    
+    while ((i < 9) && (v < dec_pow[i])) i++;
+    return 10 - i;
+} // ndigits()
+
+/*------------------------------------------------------------------
+  Purpose  : This function writes an unsigned number in decimal to the
+             transmit ring of UART 1, like printf("%*lu") or "%0*lu".
+             Digits are made by subtracting powers of 10.
+  Variables: v  : the number to write
+             w  : minimum width, 0 = no padding
+             pad: pad character, normally ' ' or '0'
+  Returns  : the number of characters written
+  ------------------------------------------------------------------*/
+uint8_t uart1_putu(uint32_t v, uint8_t w, char pad)
+{
+    uint8_t i, d;
+    uint8_t len = ndigits(v);
+    uint8_t n   = 0;
+    
+    if (w > len)
+    {
+        n = uart1_pad(pad, w - len);
+        if (n < w - len) return n;
+    } // if
+    for (i = 10 - len; i < 10; i++)
+    {
+        d = '0';
+        while (v >= dec_pow[i])
+        {
+            v -= dec_pow[i];
+            d++;
+        } // while
+        if (!uart1_putc(d)) break;
+        n++;
+    } // for i
+    return n;
+} // uart1_putu()
+
+/*------------------------------------------------------------------
+  Purpose  : This function writes a signed number in decimal to the
+             transmit ring of UART 1, like printf("%*ld") or "%0*ld".
+  Variables: v  : the number to write
+             w  : minimum width (including the sign), 0 = no padding
+             pad: pad character, ' ' pads before, '0' after the sign
+  Returns  : the number of characters written
+  ------------------------------------------------------------------*/
+uint8_t uart1_puti(int32_t v, uint8_t w, char pad)
+{
+    uint32_t u;
+    uint8_t  len, n = 0;
+    
+    if (v >= 0) return uart1_putu((uint32_t)v, w, pad);
+    u   = -(uint32_t)v;
+    len = ndigits(u) + 1;
+    if ((pad != '0') && (w > len))
+    {
+        n = uart1_pad(pad, w - len);
+        if (n < w - len) return n;
+        w = 0;
+    } // if
+    if (!uart1_putc('-')) return n;
+    n++;
+    return n + uart1_putu(u, (w > 0) ? w - 1 : 0, pad);
+} // uart1_puti()
+
+/*------------------------------------------------------------------
+  Purpose  : This function writes a number in hexadecimal (lower-case,
+             no 0x prefix) to the transmit ring of UART 1.
+  Variables: v: the number to write
+             w: minimum number of digits (zero-padded), 0 = no padding
+  Returns  : the number of characters written
+  ------------------------------------------------------------------*/
+uint8_t uart1_puthex(uint16_t v, uint8_t w)
+{
+    uint8_t i, d;
+    uint8_t len = 4;
+    uint8_t n   = 0;
+    
+    while ((len > 1) && !(v >> ((len - 1) << 2))) len--; // skip leading zeros
+    if (w > len)
+    {
+        n = uart1_pad('0', w - len);
+        if (n < w - len) return n;
+    } // if
+    for (i = len; i > 0; i--)
+    {
+        d = (v >> ((i - 1) << 2)) & 0x0F;
+        if (!uart1_putc((d < 10) ? '0' + d : 'a' - 10 + d)) break;
+        n++;
+    } // for i
+    return n;
+} // uart1_puthex()
+
 /*------------------------------------------------------------------
   Purpose  : This function writes a string to UART 3, using
              the uart3_putc() routine.
@@ -324,9 +801,9 @@ void uart1_printf(char *s)
          s : The string to write to UART 3
   Returns  : the number of characters written
   ------------------------------------------------------------------*/
-void uart3_printf(char *s)
+void uart3_printf(const char *s)
 {
-    char *ch = s;
+    const char *ch = s;
     while (*ch)
     {
         if (*ch == '\n')
@@ -339,44 +816,120 @@ void uart3_printf(char *s)
 } // uart3_printf()
 
 /*------------------------------------------------------------------
-  Purpose  : This function checks if a character is present in the
-             receive buffer of UART 1.
-  Variables: -
-  Returns  : 1 if a character is received, 0 otherwise
+  Purpose  : This function empties a line store. Call it before the
+             ISR that fills it is enabled.
+  Variables: lb: the line store
+             ev: the event posted for every complete line
+  Returns  : -
   ------------------------------------------------------------------*/
-bool uart1_kbhit(void)
+void line_init(line_buf *lb, uint8_t ev)
 {
-    return !ring_buffer_is_empty(&ring_buffer_in1);
-} // uart1_kbhit()
+    memset(lb, 0, sizeof(line_buf));
+    lb->ev = ev;
+} // line_init()
 
 /*------------------------------------------------------------------
-  Purpose  : This function checks if a character is present in the
-             receive buffer of UART 3.
-  Variables: -
-  Returns  : 1 if a character is received, 0 otherwise
+  Purpose  : This function checks if a complete line is in a line store.
+  Variables: lb: the line store
+  Returns  : true if a line can be read with line_get()
   ------------------------------------------------------------------*/
-bool uart3_kbhit(void)
+bool line_ready(line_buf *lb)
 {
-    return !ring_buffer_is_empty(&ring_buffer_in3);
-} // uart3_kbhit()
+    return (lb->rdy & (1 << lb->rd)) != 0;
+} // line_ready()
 
 /*------------------------------------------------------------------
-  Purpose  : This function reads one data-byte from uart 1.	
+  Purpose  : This function prints the UART 1 receive statistics: the
+             number of lost lines (both line buffers full), truncated
+             lines (longer than UART_BUFLEN-1) and overrun errors, plus
+             the transmit bytes dropped in non-blocking mode, the
+             high-water mark of the transmit ring and the number of
+             binary frames: correct, crc error, bad header and lost.
   Variables: -
-  Returns  : the data-byte read from the uart
+  Returns  : -
+  ------------------------------------------------------------------*/
+void uart1_stats(void)
+{
+    uart1_printf("RX1: ");
+    uart1_putu(isr1_cnt, 0, ' ');
+    uart1_printf(" isr, ");
+    uart1_putu(rx1_line.lost, 0, ' ');
+    uart1_printf(" lost, ");
+    uart1_putu(rx1_line.ntrunc, 0, ' ');
+    uart1_printf(" trunc, ");
+    uart1_putu(rx1_overrun, 0, ' ');
+    uart1_printf(" ovr\nTX1: ");
+    uart1_putu(tx1_drop, 0, ' ');
+    uart1_printf(" dropped, ");
+    uart1_putu(ring_buffer_high_water(&ring_buffer_out1), 0, ' ');
+    uart1_putc('/');
+    uart1_putu(RING_SIZE, 0, ' ');
+    uart1_printf(" max. used\nBIN: ");
+    uart1_putu(rx1_frames, 0, ' ');
+    uart1_printf(" ok, ");
+    uart1_putu(rx1_crc, 0, ' ');
+    uart1_printf(" crc, ");
+    uart1_putu(rx1_hdr, 0, ' ');
+    uart1_printf(" hdr, ");
+    uart1_putu(rx1_flost, 0, ' ');
+    uart1_printf(" lost\n");
+} // uart1_stats()
+
+/*------------------------------------------------------------------
+  Purpose  : This function gives a line buffer back to the ISR.
+  Variables: lb: the line store
+             i : index in lb->line[]
+  Returns  : -
   ------------------------------------------------------------------*/
-uint8_t uart1_getc(void)
+static __monitor void line_free(line_buf *lb, uint8_t i)
 {
-    return ring_buffer_get(&ring_buffer_in1);
-} // uart1_getch()
+    lb->rdy &= ~(1 << i);
+} // line_free()
 
 /*------------------------------------------------------------------
-  Purpose  : This function reads one data-byte from uart 3.	
+  Purpose  : This function copies the oldest complete line of a line
+             store and frees its line buffer for the ISR. 
+  Variables: lb: the line store
+             s : buffer of at least UART_BUFLEN bytes
+  Returns  : true if a line was copied into s
+  ------------------------------------------------------------------*/
+bool line_get(line_buf *lb, char *s)
+{
+    if (!line_ready(lb)) return false;
+    // the ISR does not write into a full buffer, no need to lock
+    strcpy(s, lb->line[lb->rd]);
+    line_free(lb, lb->rd);
+    lb->rd ^= 0x01;
+    return true;
+} // line_get()
+
+/*------------------------------------------------------------------
+  Purpose  : This function returns the oldest binary frame received
+             by UART 1. The frame stays in the receive buffer (no copy)
+             until uart1_frame_free() is called.
+  Variables: type: the frame type is returned here [BIN_FRAME..BIN_CMD]
+             len : the payload length is returned here
+             src : the source is returned here [SRC_UART1, SRC_WIFI]
+  Returns  : pointer to the payload bytes, NULL if there is no frame
+  ------------------------------------------------------------------*/
+uint8_t *uart1_getframe(uint8_t *type, uint8_t *len, uint8_t *src)
+{
+    if (!(bin1_rdy & (1 << bin1_rd))) return NULL;
+    *type = bin1_t[bin1_rd];
+    *len  = bin1_n[bin1_rd];
+    *src  = bin1_s[bin1_rd];
+    return bin1[bin1_rd];
+} // uart1_getframe()
+
+/*------------------------------------------------------------------
+  Purpose  : This function gives the frame returned by uart1_getframe()
+             back to the UART 1 ISR.
   Variables: -
-  Returns  : the data-byte read from the uart
+  Returns  : -
   ------------------------------------------------------------------*/
-uint8_t uart3_getc(void)
+__monitor void uart1_frame_free(void)
 {
-    return ring_buffer_get(&ring_buffer_in3);
-} // uart3_getch()
+    bin1_rdy &= ~(1 << bin1_rd);
+    bin1_rd  ^= 0x01;
+} // uart1_frame_free()
 
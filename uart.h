@@ -21,21 +21,122 @@
   ================================================================== */ 
 #include "stm8_hw_init.h"
 
-#define UART_BUFLEN (80) /* Size for rs232_inbuf[] */
-#define TX_BUF_SIZE (30) /* Transmit ring-buffer size */
-#define RX_BUF_SIZE (30) /* Receive ring-buffer size */
+#define UART_BUFLEN (100) /* Max. command line incl. '\0', see line_buf */
+#if UART_BUFLEN > 100
+#error "UART_BUFLEN > 100: lines would not fit in lk1[] and lk2[]"
+#endif
+#define UART_SR_OR  (0x08) /* Overrun error flag in UARTx_SR */
+
+// Baud-rates, see uart1_set_baud() and uart3_set_baud()
+#define UART1_BAUD   (38400UL)  /* default baud-rate UART1 */
+#define UART3_BAUD   (115200UL) /* default baud-rate UART3 (ESP8266) */
+#define BAUD_MIN     (9600UL)
+#define BAUD_MAX     (921600UL)
+#define UART_MAX_ERR (250)      /* max. baud-rate error in 0.01 % */
+#define BAUD_INVALID (0x7FFF)   /* uart_baud_err(): baud-rate can not be made */
+
+//----------------------------------------------------------------------
+// Binary frames on UART1. A frame is recognised by BIN_SYNC1 at the start
+// of a line (it is not a valid text character) and is:
+//   BIN_SYNC1 BIN_SYNC2 type len payload[len] crc_hi crc_lo
+// crc is CRC-16/CCITT (poly 0x1021, init 0xFFFF) over type, len and
+// payload. The image is rgb_bufr[], rgb_bufg[] and rgb_bufb[] (MAX_Y rows 
+// each), every row MSB first with bit 0 the leftmost column. Types:
+// BIN_FRAME: the full image, BIN_FRAME_LEN bytes.
+// BIN_ROWS : changed rows only, BIN_ROW_SIZE bytes per row: row-index,
+//            red, green, blue. len 0 is allowed (no change).
+// BIN_XRLE : the full image XOR the previous image, run-length encoded.
+//            A control byte c < 0x80 is followed by c+1 bytes to XOR,
+//            c >= 0x80 skips (c & 0x7F)+1 unchanged bytes. 
+//            The sender uses BIN_FRAME if this would be longer.
+// BIN_XRLE depends on the previous image: send a BIN_FRAME or BIN_ROWS
+// with all rows now and then, a lost frame is not detected.
+// BIN_CMD  : a command for machine clients: opcode and arguments, see
+//            execute_binary_command(). The reply goes to the port (UART1 
+//            or WiFi) that sent the frame.
+//----------------------------------------------------------------------
+#define BIN_SYNC1     (0xA5)
+#define BIN_SYNC2     (0x5A)
+#define BIN_FRAME     (0x01)            /* type: full frame, 3 planes */
+#define BIN_ROWS      (0x02)            /* type: changed rows */
+#define BIN_XRLE      (0x03)            /* type: XOR-delta, run-length encoded */
+#define BIN_CMD       (0x04)            /* type: binary command */
+#define BIN_FRAME_LEN (3 * 2 * MAX_Y)   /* payload size of BIN_FRAME */
+#define BIN_ROW_SIZE  (1 + 3 * 2)       /* row-index + 3 planes */
+#define BIN_ROWS_LEN  (BIN_ROW_SIZE * MAX_Y) /* max. payload of BIN_ROWS */
+#define BIN_BUFLEN    (BIN_ROWS_LEN)    /* max. payload size */
+#if BIN_BUFLEN > 255
+#error "BIN_BUFLEN > 255: does not fit in the len byte"
+#endif
+#if BIN_BUFLEN < UART_BUFLEN
+#error "BIN_BUFLEN < UART_BUFLEN: BIN_CMD can not hold a full text argument"
+#endif
+
+// Source of a binary frame, the same as the index in cmd_ports[]
+#define SRC_UART1     (0)
+#define SRC_WIFI      (1)
+
+// Line store of a command port, filled one byte at a time by an ISR
+// with line_rx() and read by a task with line_get().
+typedef struct _line_buf
+{
+    char     line[2][UART_BUFLEN]; // double-buffered line store
+    uint8_t  wr;     // index of line[] filled by the ISR
+    uint8_t  rd;     // index of line[] to read next
+    uint8_t  pos;    // write index in line[wr]
+    uint8_t  rdy;    // bit i set: line[i] holds a complete line
+    bool     trunc;  // true = current line is too long
+    uint8_t  ev;     // event posted for every complete line
+    uint16_t lost;   // lines lost, both line buffers were full
+    uint16_t ntrunc; // lines truncated to UART_BUFLEN-1 chars
+} line_buf;
+
+typedef uint8_t (*putc_fn)(uint8_t ch); // 1 = written, 0 = dropped
+
+/*------------------------------------------------------------------
+  Purpose  : This function adds one byte to a CRC-16/CCITT
+             (poly 0x1021), without a table. Used for the
+             binary frames and by the kv store (kv.c).
+  Variables: crc: the crc so far (0xFFFF at the start)
+             b  : the byte to add
+  Returns  : the new crc
+  ------------------------------------------------------------------*/
+static inline uint16_t crc16_ccitt(uint16_t crc, uint8_t b)
+{
+    uint8_t x = (uint8_t)(crc >> 8) ^ b;
+    
+    x ^= x >> 4;
+    return (crc << 8) ^ ((uint16_t)x << 12) ^ ((uint16_t)x << 5) ^ x;
+} // crc16_ccitt()
+
+int16_t  uart_baud_err(uint32_t baud);
+uint32_t uart_get_baud(uint8_t uart);
+void     line_init(line_buf *lb, uint8_t ev);
+void     line_rx(line_buf *lb, uint8_t ch);
+bool     line_ready(line_buf *lb);
+bool     line_get(line_buf *lb, char *s);
 
 // UART1: Used for general communication
 void    uart1_init(uint8_t clk);
-void    uart1_printf(char *s);
-bool    uart1_kbhit(void);
-uint8_t uart1_getc(void);
-void    uart1_putc(uint8_t ch);
+bool    uart1_set_baud(uint32_t baud);
+uint8_t uart1_printf(const char *s);
+bool    uart1_nonblock(bool nb);
+uint8_t uart1_putu(uint32_t v, uint8_t w, char pad);
+uint8_t uart1_puti(int32_t v, uint8_t w, char pad);
+uint8_t uart1_puthex(uint16_t v, uint8_t w);
+void    uart1_stats(void);
+void    uart1_rx_byte(uint8_t ch);
+bool    uart1_frame_rx(uint8_t ch, bool sol, uint8_t src);
+putc_fn uart1_redirect(putc_fn sink);
+uint8_t *uart1_getframe(uint8_t *type, uint8_t *len, uint8_t *src);
+__monitor void uart1_frame_free(void);
+uint8_t uart1_putc(uint8_t ch);
+uint8_t uart1_write(const uint8_t *p, uint8_t len);
 
 // UART3: Used for ESP8266 communication
 void    uart3_init(uint8_t clk);
+bool    uart3_set_baud(uint32_t baud);
 void    uart3_putc(uint8_t ch);
-bool    uart3_kbhit(void);
-uint8_t uart3_getc(void);
-void    uart3_putc(uint8_t ch);
+bool    uart3_tx_room(void);
+void    uart3_printf(const char *s);
 #endif
\ No newline at end of file